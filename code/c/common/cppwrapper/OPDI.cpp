@@ -40,13 +40,20 @@ namespace opdi {
 //////////////////////////////////////////////////////////////////////////////////////////
 
 uint8_t OPDI::shutdownInternal(void) {
-	// shutdown and free all ports
+	// shutdown all ports before freeing them; ports may access other ports during shutdown
 	auto it = this->ports.begin();
 	auto ite = this->ports.end();
 	while (it != ite) {
 		// ignore any errors during this process
 		try {
 			(*it)->shutdown();
+		}
+		catch (...) {}
+		++it;
+	}
+	it = this->ports.begin();
+	while (it != ite) {
+		try {
 			delete *it;
 		}
 		catch (...) {}
@@ -57,6 +64,15 @@ uint8_t OPDI::shutdownInternal(void) {
 	return OPDI_SHUTDOWN;
 }
 
+void OPDI::clearPendingRefreshes(void) {
+	auto it = this->ports.begin();
+	auto ite = this->ports.end();
+	while (it != ite) {
+		(*it)->refreshRequired = false;
+		++it;
+	}
+}
+
 uint8_t OPDI::setup(const char* slaveName, int idleTimeout) {
 	this->shutdownRequested = false;
 
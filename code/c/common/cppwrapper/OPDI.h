@@ -70,6 +70,9 @@ protected:
 	// May return OPDI_STATUS_OK to cancel the shutdown. Any other value stops message processing.
 	uint8_t shutdownInternal(void);
 
+	// clears the pending refreshes of all ports; to be called when all ports have been refreshed
+	void clearPendingRefreshes(void);
+
 	LogVerbosity logVerbosity;
 
 	virtual void log(const std::string& message) = 0;
@@ -3,6 +3,7 @@
 #include <string>
 #include <sstream>
 #include <cassert>
+#include <algorithm>
 
 #include "Poco/Exception.h"
 
@@ -102,6 +103,8 @@ void Port::setID(const char* newID) {
 }
 
 void Port::handleStateChange(ChangeSource changeSource) {
+	this->notifyStateListeners();
+
 	// determine port list to iterate
 	DigitalPortList* pl;
 	switch (changeSource) {
@@ -118,6 +121,22 @@ void Port::handleStateChange(ChangeSource changeSource) {
 	}
 }
 
+void Port::notifyStateListeners(void) {
+	for (auto it = this->stateListeners.begin(), ite = this->stateListeners.end(); it != ite; ++it)
+		(*it)->portStateChanged(this);
+}
+
+void Port::addStateListener(StateListener* listener) {
+	if (std::find(this->stateListeners.begin(), this->stateListeners.end(), listener) == this->stateListeners.end())
+		this->stateListeners.push_back(listener);
+}
+
+void Port::removeStateListener(StateListener* listener) {
+	auto it = std::find(this->stateListeners.begin(), this->stateListeners.end(), listener);
+	if (it != this->stateListeners.end())
+		this->stateListeners.erase(it);
+}
+
 std::string Port::ID() const {
 	return std::string(this->getID());
 }
@@ -237,6 +256,10 @@ void Port::setGroup(const std::string& group) {
 	}
 }
 
+std::string Port::getGroup(void) const {
+	return this->group;
+}
+
 void Port::setHistory(uint64_t intervalSeconds, int maxCount, const std::vector<int64_t>& values) {
 	this->history = "interval=" + this->to_string(intervalSeconds);
 	this->history.append(";maxCount=" + this->to_string(maxCount));
@@ -343,9 +366,11 @@ void Port::checkError() const {
 }
 
 void Port::setError(Error error) {
-	if (this->error != error)
-		this->refreshRequired = (this->refreshMode == RefreshMode::REFRESH_AUTO);
+	if (this->error == error)
+		return;
+	this->refreshRequired = (this->refreshMode == RefreshMode::REFRESH_AUTO);
 	this->error = error;
+	this->notifyStateListeners();
 }
 
 Port::Error Port::getError() const {
@@ -650,7 +675,8 @@ void DigitalPort::setMode(uint8_t mode, ChangeSource changeSource) {
 void DigitalPort::setLine(uint8_t line, ChangeSource changeSource) {
 	if (line > 1)
 		throw PortError(this->ID() + ": Digital port line not supported: " + this->to_string((int)line));
-	if (this->error != Error::VALUE_OK)
+	bool errorCleared = (this->error != Error::VALUE_OK);
+	if (errorCleared)
 		this->refreshRequired = (this->refreshMode == RefreshMode::REFRESH_AUTO);
 	bool changed = (line != this->line);
 	if (changed) {
@@ -663,6 +689,9 @@ void DigitalPort::setLine(uint8_t line, ChangeSource changeSource) {
 		this->opdi->persist(this);
 	if (changed)
 		this->handleStateChange(changeSource);
+	else
+	if (errorCleared)
+		this->notifyStateListeners();
 }
 
 void DigitalPort::getState(uint8_t* mode, uint8_t* line) const {
@@ -773,7 +802,8 @@ void AnalogPort::setReference(uint8_t reference, ChangeSource changeSource) {
 void AnalogPort::setValue(int32_t value, ChangeSource changeSource) {
 	// restrict value to possible range
 	int32_t newValue = this->validateValue(value);
-	if (this->error != Error::VALUE_OK)
+	bool errorCleared = (this->error != Error::VALUE_OK);
+	if (errorCleared)
 		this->refreshRequired = (this->refreshMode == RefreshMode::REFRESH_AUTO);
 	bool changed = (newValue != this->value);
 	if (changed) {
@@ -786,6 +816,9 @@ void AnalogPort::setValue(int32_t value, ChangeSource changeSource) {
 		this->opdi->persist(this);
 	if (changed)
 		this->handleStateChange(changeSource);
+	else
+	if (errorCleared)
+		this->notifyStateListeners();
 }
 
 void AnalogPort::getState(uint8_t* mode, uint8_t* resolution, uint8_t* reference, int32_t* value) const {
@@ -900,7 +933,8 @@ void SelectPort::setItems(const char** items) {
 void SelectPort::setPosition(uint16_t position, ChangeSource changeSource) {
 	if (position > count)
 		throw PortError(this->ID() + ": Position must not exceed the number of items: " + to_string((int)this->count));
-	if (this->error != Error::VALUE_OK)
+	bool errorCleared = (this->error != Error::VALUE_OK);
+	if (errorCleared)
 		this->refreshRequired = (this->refreshMode == RefreshMode::REFRESH_AUTO);
 	bool changed = (position != this->position);
 	if (changed) {
@@ -913,6 +947,9 @@ void SelectPort::setPosition(uint16_t position, ChangeSource changeSource) {
 		this->opdi->persist(this);
 	if (changed)
 		this->handleStateChange(changeSource);
+	else
+	if (errorCleared)
+		this->notifyStateListeners();
 }
 
 void SelectPort::getState(uint16_t* position) const {
@@ -1001,7 +1038,8 @@ void DialPort::setPosition(int64_t position, ChangeSource changeSource) {
 		throw PortError(this->ID() + ": Position must not be greater than the maximum: " + to_string(this->maxValue));
 	// correct position to next possible step
 	int64_t newPosition = ((position - this->minValue) / this->step) * this->step + this->minValue;
-	if (this->error != Error::VALUE_OK)
+	bool errorCleared = (this->error != Error::VALUE_OK);
+	if (errorCleared)
 		this->refreshRequired = (this->refreshMode == RefreshMode::REFRESH_AUTO);
 	bool changed = (newPosition != this->position);
 	if (changed) {
@@ -1014,6 +1052,9 @@ void DialPort::setPosition(int64_t position, ChangeSource changeSource) {
 		this->opdi->persist(this);
 	if (changed)
 		this->handleStateChange(changeSource);
+	else
+	if (errorCleared)
+		this->notifyStateListeners();
 }
 
 void DialPort::getState(int64_t* position) const {
@@ -64,6 +64,16 @@ public:
 		VALUE_NOT_AVAILABLE
 	};
 
+	/** Implement this interface to be notified when the state of a port changes. */
+	class StateListener {
+	public:
+		virtual ~StateListener() {};
+
+		/** Called when the state or the error state of the port has changed. Listeners must not
+		* change the port state in this method. */
+		virtual void portStateChanged(Port* port) = 0;
+	};
+
 	// disable copy constructor
 	Port(const Port& that) = delete;
 
@@ -124,6 +134,9 @@ protected:
 	// indicates whether port state should be written to a persistent storage
 	bool persistent;
 
+	// listeners that are notified about state changes
+	std::vector<StateListener*> stateListeners;
+
 	// utility function for string conversion 
 	template <class T> std::string to_string(const T& t) const;
 
@@ -168,9 +181,12 @@ protected:
 	virtual void setID(const char* newID);
 
 	/** This method must be called when the state changes in order to
-	* handle the onChange* functionality. */
+	* handle the onChange* functionality. Also notifies the state listeners. */
 	virtual void handleStateChange(ChangeSource changeSource);
 
+	/** Notifies the state listeners about a change of the state or the error state. */
+	virtual void notifyStateListeners(void);
+
 	virtual Port* findPort(const std::string& configPort, const std::string& setting, const std::string& portID, bool required);
 
 	virtual void findPorts(const std::string& configPort, const std::string& setting, const std::string& portIDs, PortList& portList);
@@ -283,6 +299,9 @@ public:
 
 	virtual void setGroup(const std::string& group);
 
+	/** Returns the ID of the group the port belongs to, or an empty string. */
+	virtual std::string getGroup(void) const;
+
 	virtual void setHistory(uint64_t intervalSeconds, int maxCount, const std::vector<int64_t>& values);
 
 	virtual void clearHistory(void);
@@ -315,6 +334,13 @@ public:
 	/** Gets the error state of this port. */
 	virtual Port::Error getError(void) const;
 
+	/** Registers a listener that is notified when the state of this port changes.
+	* Ports that determine their state in getState() (e.g. by reading hardware) do not
+	* notify their listeners. */
+	virtual void addStateListener(StateListener* listener);
+
+	virtual void removeStateListener(StateListener* listener);
+
 	/** This method returns true if the port is in an error state. This will likely be the case
 	*   when the getState() method of the port throws an exception.
 	*/
@@ -37,8 +37,10 @@ void MessageProcessor::run()
 
 	while (!stop || hasMessagesToSend) {
         try {
+			bool received = false;
 			if ((device->getEncryption() == 0 ? device->hasBytes() > 0 : device->has_block())) {
         		int bytes = (device->getEncryption() == 0 ? device->read(buffer, BUFFER_SIZE) : device->read_block(buffer));
+				received = (bytes > 0);
 				// append received bytes to message until terminator character
 				int terminatorPos = -1;
 				int bufferEnd = 0;
@@ -96,7 +98,9 @@ void MessageProcessor::run()
 			}
 			// are there messages to send?
 			hasMessagesToSend = device->processOutQueue();
-			Poco::Thread::sleep(1);
+			// sleep until there is something to do
+			if (!received && !hasMessagesToSend && !stop)
+				device->waitForBytes();
         } catch (Poco::IOException e) {
             if (!stop) {
 	            device->setDeviceError("IO error: " + e.displayText());
@@ -230,6 +234,7 @@ void MessageProcessor::run()
 void MessageProcessor::stopProcessing()
 {
 	stop = true;
+	device->wakeUp();
 }
 
 MessageQueueDevice::MessageQueueDevice(std::string id): IDevice(id)
@@ -244,6 +249,7 @@ void MessageQueueDevice::sendMessage(OPDIMessage* message)
 
 	outQueue.enqueueNotification(new MessageNotification(message));
 	msgProcessor->hasMessagesToSend = true;
+	wakeUp();
 }
 
 void MessageQueueDevice::clearQueues() {
@@ -623,9 +629,10 @@ OPDIMessage* MessageQueueDevice::receiveHandshakeMessage(int timeout /* , IAbort
 	char buffer[BUFFER_SIZE];
 
     int bytesReceived = 0;
-	int counter = 0;
 
-	while (counter++ < timeout /* && (abortable == null || !abortable.isAborted()) */) {
+	uint64_t startTime = opdi_get_time_ms();
+
+	while (opdi_get_time_ms() - startTime < (uint64_t)timeout /* && (abortable == null || !abortable.isAborted()) */) {
         if ((encryption == 0 ? hasBytes() > 0 : has_block())) {
         	int bytes = (encryption == 0 ? read(buffer, BUFFER_SIZE) : read_block(buffer));
         	// append received bytes to buffer
@@ -672,7 +679,7 @@ OPDIMessage* MessageQueueDevice::receiveHandshakeMessage(int timeout /* , IAbort
                 }
         	}
         }                		
-        Poco::Thread::sleep(1);
+        waitForBytes();
     }
 	/*
 	if (abortable != null && abortable.isAborted())
@@ -681,6 +688,15 @@ OPDIMessage* MessageQueueDevice::receiveHandshakeMessage(int timeout /* , IAbort
 	throw Poco::TimeoutException("Timeout waiting for handshake message");
 }
 	
+void MessageQueueDevice::waitForBytes()
+{
+	Poco::Thread::sleep(1);
+}
+
+void MessageQueueDevice::wakeUp()
+{
+}
+
 bool MessageQueueDevice::hasCredentials()
 {
 	return false;
@@ -186,6 +186,17 @@ virtual int read_bytes(char buffer[], int maxlength) = 0;
 */
 virtual int hasBytes() = 0;
 
+/** Blocks the message processor until bytes may be available, a message has been queued for sending,
+* or the device is being stopped. Returns after a short time in any case.
+* The default implementation sleeps for a millisecond.
+*/
+virtual void waitForBytes();
+
+/** Interrupts a thread that is blocked in waitForBytes().
+* The default implementation does nothing.
+*/
+virtual void wakeUp();
+
 /** Reads the received bytes into the buffer.
 * 
 * @param buffer
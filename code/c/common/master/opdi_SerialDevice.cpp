@@ -13,6 +13,9 @@
 
 using Poco::RegularExpression;
 
+// the message processor checks its state after this many milliseconds if no data arrives
+#define SERIAL_WAIT_MS		100
+
 SerialDevice::SerialDevice(std::string id, Poco::URI uri, bool *debug) : IODevice(id)
 {
 	this->uri = uri;
@@ -175,27 +178,57 @@ void SerialDevice::write(char buffer[], int length)
 
 int SerialDevice::read_bytes(char buffer[], int maxlength)
 {
-	int count = 0;
-	char c = -1;
-	while ((count < maxlength) && ((c = read()) > 0))
-		buffer[count++] = c;
-	return count;
+	int code = this->device->Read(buffer, maxlength);
+	// error?
+	if (code < 0)
+		throw Poco::IOException(std::string(this->getID()) + ": Unable to read from serial port: " + this->comport);
+	// disconnected?
+	if ((code == 0) && this->serialPort->HungUp())
+		throw Poco::IOException(std::string(this->getID()) + ": The serial port has hung up: " + this->comport);
+	return code;
 }
 
-int SerialDevice::hasBytes()
+void SerialDevice::checkHangup()
 {
+	if (!this->serialPort->HungUp())
+		return;
+	// the device remains readable after a hangup; it is disconnected if no bytes are left
 	char buf;
 	int code = this->device->Read(&buf, 1);
-	// error?
-	if (code < 0)
-		return code;
-	// byte read?
 	if (code > 0) {
 		this->device->PutBack(buf);
-		return 1;
+		return;
 	}
-	// nothing available
-	return 0;
+	throw Poco::IOException(std::string(this->getID()) + ": The serial port has hung up: " + this->comport);
+}
+
+int SerialDevice::hasBytes()
+{
+	// the result is only used as a flag; the actual number of bytes is not known
+	int code = this->serialPort->WaitReadable(0);
+	// error?
+	if (code < 0)
+		return code;
+	if (code == 0)
+		return 0;
+	this->checkHangup();
+	return 1;
+}
+
+void SerialDevice::waitForBytes()
+{
+	// sleep until data arrives or wakeUp() is called
+	int code = this->serialPort->WaitReadable(SERIAL_WAIT_MS);
+	if (code < 0)
+		throw Poco::IOException(std::string(this->getID()) + ": Unable to wait for data on serial port: " + this->comport);
+	// a hangup makes the device readable without data
+	if (code > 0)
+		this->checkHangup();
+}
+
+void SerialDevice::wakeUp()
+{
+	this->serialPort->CancelWait();
 }
 
 int SerialDevice::read(char buffer[], int length)
@@ -36,6 +36,9 @@ protected:
 	// pointer to debug flag (logDebug)
 	bool *debug;
 
+	/** Throws an IOException if the device has hung up and the remaining bytes have been read. */
+	virtual void checkHangup();
+
 public :
 	/** Deserializing constructor */
 	SerialDevice(std::string id, Poco::URI uri, bool *debug);
@@ -75,6 +78,8 @@ public :
 	char read() override;
 	int read_bytes(char buffer[], int maxlength) override;
 	int hasBytes() override;
+	void waitForBytes() override;
+	void wakeUp() override;
 	int read(char buffer[], int length) override;
 	void write(char buffer[], int length) override;
 };
@@ -96,6 +96,10 @@ typedef enum {
 	, OPDI_FUNCTION_SET_USERNAME					/** During authentication, first the username is set. */
 	, OPDI_FUNCTION_SET_PASSWORD					/** Next, the password is set. If the implementation returns any code other than OPDI_STATUS_OK it is interpreted as "authentication failed". */
 #endif
+
+#ifdef OPDI_HAS_TIME_SERIES
+	, OPDI_FUNCTION_GET_TIME_SERIES					/** Returns a key=value;-string containing time series data. The buffer contains the port ID, start time, end time and maximum number of points, separated by colons. */
+#endif
 } OPDIFunctionCode;
 
 /** The slave callback function that is used by the OPDI system to send data to or request data from
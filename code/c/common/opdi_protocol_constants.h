@@ -96,3 +96,6 @@
 
 #define OPDI_getAllSelectPortLabels		"gASL"
 
+#define OPDI_getTimeSeries				"gTS"
+#define OPDI_timeSeries					"TS"
+
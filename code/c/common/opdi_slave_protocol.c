@@ -844,6 +844,42 @@ static uint8_t send_all_select_port_labels(channel_t channel, opdi_Port *port) {
 	return OPDI_STATUS_OK;
 }
 
+#ifdef OPDI_HAS_TIME_SERIES
+
+static uint8_t send_time_series(channel_t channel, const char *portID) {
+	// buffer for the request parameters and the result (static to conserve stack space)
+	static char buffer[OPDI_MESSAGE_PAYLOAD_LENGTH];
+	const char *request[5];
+	uint16_t length;
+	uint8_t result;
+
+	// pass the request parameters (port ID, start time, end time, maximum number of points) to the callback
+	request[0] = portID;
+	request[1] = opdi_msg_parts[2];
+	request[2] = opdi_msg_parts[3];
+	request[3] = opdi_msg_parts[4];
+	request[4] = NULL;
+	result = strings_join(request, OPDI_PARTS_SEPARATOR, buffer, OPDI_MESSAGE_PAYLOAD_LENGTH);
+	if (result != OPDI_STATUS_OK)
+		return result;
+
+	// the result must fit into the payload together with the message name and the port ID
+	length = OPDI_MESSAGE_PAYLOAD_LENGTH - strlen(OPDI_timeSeries) - strlen(portID) - 3;
+	result = opdi_slave_callback(OPDI_FUNCTION_GET_TIME_SERIES, buffer, length);
+	if (result != OPDI_STATUS_OK)
+		return result;
+
+	// join payload
+	opdi_msg_parts[0] = OPDI_timeSeries;
+	opdi_msg_parts[1] = portID;
+	opdi_msg_parts[2] = buffer;
+	opdi_msg_parts[3] = NULL;
+
+	return send_parts(channel);
+}
+
+#endif		// OPDI_HAS_TIME_SERIES
+
 #endif		// OPDI_EXTENDED_PROTOCOL
 
 /** Implements the basic protocol message handler.
@@ -1138,6 +1174,19 @@ static uint8_t extended_protocol_message(channel_t channel) {
 		return send_all_select_port_labels(channel, port);
 	} 
 	else 
+#ifdef OPDI_HAS_TIME_SERIES
+	if (0 == strcmp(opdi_msg_parts[0], OPDI_getTimeSeries)) {
+		// expected parameters: port ID, start time, end time, maximum number of points
+		if ((opdi_msg_parts[1] == NULL) || (opdi_msg_parts[2] == NULL) || (opdi_msg_parts[3] == NULL) || (opdi_msg_parts[4] == NULL))
+			return OPDI_PROTOCOL_ERROR;
+		// find port
+		port = opdi_find_port_by_id(opdi_msg_parts[1]);
+		if (port == NULL)
+			return OPDI_PORT_UNKNOWN;
+		return send_time_series(channel, port->id);
+	} 
+	else 
+#endif
 		// for all other messages, fall back to the basic protocol
 		return basic_protocol_message(channel);
 }
@@ -0,0 +1,223 @@
+// Checks how the master's SerialDevice waits for data on a pseudo terminal.
+// A device loop calls hasBytes, read and waitForBytes like the MessageProcessor of the device.
+// The checks cover the idle wait, the interruption of the wait by wakeUp, the latency of single
+// bytes, and hangups: when the other side of a pseudo terminal is closed, and when a device
+// stays readable but has no more data, which is simulated by replacing the descriptor of the
+// serial port with a socket whose peer has been closed. In both cases the loop must end with
+// an IOException after the remaining bytes have been delivered, instead of spinning.
+// The idle CPU load and the median and 99th percentile of the latency are reported.
+//
+// Usage: serial_device_check
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <algorithm>
+#include <vector>
+
+#include "Poco/Exception.h"
+#include "Poco/Mutex.h"
+#include "Poco/Runnable.h"
+#include "Poco/Thread.h"
+#include "Poco/URI.h"
+
+#include "opdi_main_io.h"
+#include "opdi_SerialDevice.h"
+
+#include "check.h"
+
+// the output stream of the master's console functions
+OUTPUT_TYPE output;
+
+/** Provides access to the serial port of the device. */
+class CheckDevice : public SerialDevice {
+public:
+	static bool debug;
+
+	CheckDevice(const std::string& slaveName) : SerialDevice("check", Poco::URI("opdi_com://" + slaveName), &debug) {}
+
+	int handle(void) {
+		return this->serialPort->GetHandle();
+	}
+
+	void closePort(void) {
+		this->serialPort->Close();
+	}
+};
+
+bool CheckDevice::debug = false;
+
+/** Receives data like the MessageProcessor until it is stopped or an IOException occurs. */
+class DeviceLoop : public Poco::Runnable {
+public:
+	CheckDevice* device;
+	std::atomic<bool> stopping;
+	std::atomic<bool> done;
+	std::atomic<int> waits;
+	std::atomic<int> bytes;
+	std::atomic<uint64_t> arrivalUs;
+
+	Poco::Mutex mutex;		// protects the members below
+	std::string data;
+	std::string error;
+
+	DeviceLoop(CheckDevice* device) : device(device), stopping(false), done(false), waits(0), bytes(0), arrivalUs(0) {}
+
+	virtual void run(void) override {
+		char buffer[256];
+		try {
+			while (!this->stopping) {
+				bool received = false;
+				if (this->device->hasBytes() > 0) {
+					int count = this->device->read(buffer, sizeof(buffer));
+					received = (count > 0);
+					if (received) {
+						this->arrivalUs = monotonicUs();
+						Poco::Mutex::ScopedLock lock(this->mutex);
+						this->data.append(buffer, count);
+						this->bytes += count;
+					}
+				}
+				if (!received && !this->stopping) {
+					this->waits++;
+					this->device->waitForBytes();
+				}
+			}
+		} catch (Poco::IOException& e) {
+			Poco::Mutex::ScopedLock lock(this->mutex);
+			this->error = e.displayText();
+		}
+		this->done = true;
+	}
+
+	/** Waits until the loop has ended; returns false if the time is up. */
+	bool waitForEnd(int timeoutMs) {
+		uint64_t start = monotonicUs();
+		while (!this->done) {
+			if (monotonicUs() - start > (uint64_t)timeoutMs * 1000)
+				return false;
+			Poco::Thread::sleep(1);
+		}
+		return true;
+	}
+};
+
+static double percentile(std::vector<uint64_t>& values, double p) {
+	std::sort(values.begin(), values.end());
+	return (double)values[(size_t)(p * (values.size() - 1))];
+}
+
+static void checkWaiting(void) {
+	std::string slaveName;
+	int master = openTerminal(slaveName);
+	CheckDevice device(slaveName);
+	device.tryConnect();
+	DeviceLoop loop(&device);
+	Poco::Thread thread;
+	thread.start(loop);
+
+	// idle
+	Poco::Thread::sleep(100);
+	int waits = loop.waits;
+	uint64_t cpu = cpuUs();
+	uint64_t start = monotonicUs();
+	Poco::Thread::sleep(1000);
+	double idleCpu = (double)(cpuUs() - cpu) * 100 / (monotonicUs() - start);
+	waits = loop.waits - waits;
+	check(waits <= 15, "the idle loop waits instead of polling (" + std::to_string(waits) + " waits in one second)");
+	printf("        idle CPU load: %.2f%%\n", idleCpu);
+
+	// single bytes with pauses of 3 to 8 milliseconds
+	std::vector<uint64_t> latencies;
+	bool arrived = true;
+	for (int i = 0; (i < 200) && arrived; i++) {
+		Poco::Thread::sleep(3 + (i * 7919) % 6);
+		int expected = loop.bytes + 1;
+		uint64_t sent = monotonicUs();
+		if (::write(master, "x", 1) != 1)
+			throw Poco::IOException("Unable to write to the pseudo terminal");
+		while ((loop.bytes < expected) && (monotonicUs() - sent < 1000000))
+			usleep(10);
+		arrived = (loop.bytes >= expected);
+		if (arrived)
+			latencies.push_back(loop.arrivalUs - sent);
+	}
+	check(arrived, "200 single bytes arrive");
+	if (arrived)
+		printf("        latency: median %.0f us, 99th percentile %.0f us\n", percentile(latencies, 0.5), percentile(latencies, 0.99));
+
+	// stopping wakes up the loop
+	start = monotonicUs();
+	loop.stopping = true;
+	device.wakeUp();
+	bool stopped = loop.waitForEnd(1000);
+	uint64_t elapsed = (monotonicUs() - start) / 1000;
+	check(stopped && (elapsed < 50), "wakeUp interrupts the wait (" + std::to_string(elapsed) + " ms)");
+	thread.join();
+	device.closePort();
+	close(master);
+}
+
+static void checkHangup(bool socketPeer) {
+	std::string slaveName;
+	int master = openTerminal(slaveName);
+	CheckDevice device(slaveName);
+	device.tryConnect();
+	std::string kind;
+	if (socketPeer) {
+		// the socket stays readable after its peer has been closed and reads zero bytes
+		int sockets[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+			throw Poco::IOException("Unable to create a socket pair");
+		dup2(sockets[0], device.handle());
+		close(sockets[0]);
+		fcntl(device.handle(), F_SETFL, fcntl(device.handle(), F_GETFL) | O_NONBLOCK);
+		close(master);
+		master = sockets[1];
+		kind = "a device that reads zero bytes after a hangup";
+	} else {
+		kind = "a closed pseudo terminal";
+	}
+
+	DeviceLoop loop(&device);
+	Poco::Thread thread;
+	thread.start(loop);
+	// the bytes are delivered before the hangup is reported
+	if (socketPeer) {
+		if (::write(master, "abc", 3) != 3)
+			throw Poco::IOException("Unable to write to the socket");
+		Poco::Thread::sleep(50);
+	}
+	close(master);
+	bool ended = loop.waitForEnd(1000);
+	if (!ended) {
+		loop.stopping = true;
+		device.wakeUp();
+	}
+	thread.join();
+	std::string error;
+	std::string data;
+	{
+		Poco::Mutex::ScopedLock lock(loop.mutex);
+		error = loop.error;
+		data = loop.data;
+	}
+	check(ended && !error.empty(), "the loop ends with an IOException after " + kind + " (" + std::to_string(loop.waits) + " waits)");
+	if (!error.empty())
+		printf("        %s\n", error.c_str());
+	if (socketPeer)
+		check(data == "abc", "the remaining bytes are delivered before the hangup");
+	device.closePort();
+}
+
+int main(int, char**) {
+	try {
+		checkWaiting();
+		checkHangup(false);
+		checkHangup(true);
+	} catch (Poco::Exception& e) {
+		check(false, "unexpected exception: " + e.displayText());
+	}
+
+	return checkResult();
+}
@@ -1,6 +1,7 @@
 #include "AbstractOPDID.h"
 
 #include <vector>
+#include <iterator>
 #include <time.h>
 
 #include "Poco/Exception.h"
@@ -18,6 +19,7 @@
 #include "Poco/Process.h"
 #include "Poco/Util/LayeredConfiguration.h"
 #include "Poco/NumberParser.h"
+#include "Poco/StringTokenizer.h"
 #include "Poco/RegularExpression.h"
 
 #include "opdi_constants.h"
@@ -63,6 +65,13 @@ AbstractOPDID::AbstractOPDID(void) {
 
 	this->logVerbosity = opdi::LogVerbosity::UNKNOWN;
 	this->persistentConfig = nullptr;
+	this->persistentJournal = nullptr;
+	this->timeSeriesStore = nullptr;
+	this->fileWatcher = nullptr;
+	this->processManager = nullptr;
+	this->httpClient = nullptr;
+	this->eventLoop = nullptr;
+	this->startedPlugins = 0;
 
 	this->logger = nullptr;
 	this->timestampFormat = "%Y-%m-%d %H:%M:%S.%i";
@@ -73,6 +82,7 @@ AbstractOPDID::AbstractOPDID(void) {
 	this->targetFramesPerSecond = 200;
 	this->waitingCallsPerSecond = 0;
 	this->framesPerSecond = 0;
+	this->currentFrame = 0;
 	this->allowHiddenPorts = true;
 
 	// map result codes
@@ -114,6 +124,26 @@ AbstractOPDID::AbstractOPDID(void) {
 }
 
 AbstractOPDID::~AbstractOPDID(void) {
+	if (this->persistentJournal != nullptr)
+		delete this->persistentJournal;
+	if (this->timeSeriesStore != nullptr)
+		delete this->timeSeriesStore;
+	if (this->fileWatcher != nullptr) {
+		delete this->fileWatcher;
+		this->fileWatcher = nullptr;
+	}
+	if (this->processManager != nullptr) {
+		delete this->processManager;
+		this->processManager = nullptr;
+	}
+	if (this->httpClient != nullptr) {
+		delete this->httpClient;
+		this->httpClient = nullptr;
+	}
+	if (this->eventLoop != nullptr) {
+		delete this->eventLoop;
+		this->eventLoop = nullptr;
+	}
 }
 
 uint8_t AbstractOPDID::idleTimeoutReached(void) {
@@ -382,6 +412,7 @@ int AbstractOPDID::startup(const std::vector<std::string>& args, const std::map<
 
 	this->sortPorts();
 	this->preparePorts();
+	this->preparePlugins();
 
 	// startup has been done using the process owner
 	// if specified, change process privileges to a different user
@@ -392,7 +423,19 @@ int AbstractOPDID::startup(const std::vector<std::string>& args, const std::map<
 	// create view to "Connection" section
 	Poco::AutoPtr<Poco::Util::AbstractConfiguration> connection = configuration->createView("Connection");
 
-	int result = this->setupConnection(connection, testMode);
+	if (!testMode)
+		this->startPlugins();
+
+	int result;
+	try {
+		result = this->setupConnection(connection, testMode);
+	} catch (...) {
+		this->stopPlugins();
+		throw;
+	}
+
+	// plugins are usually stopped when the shutdown is processed; this covers other exits
+	this->stopPlugins();
 
 	// save persistent configuration when exiting
 	this->savePersistentConfig();
@@ -489,8 +532,46 @@ void AbstractOPDID::setGeneralConfiguration(Poco::Util::AbstractConfiguration* g
 			// file does not yet exist; will be created when persisting state
 			this->persistentConfig = new Poco::Util::PropertyFileConfiguration();
 		this->persistentConfigFile = persistentFile;
+
+		// apply changes from an existing journal (possibly left over after a crash)
+		PersistentJournal* journal = new PersistentJournal(this, persistentFile);
+		if (journal->exists()) {
+			this->logVerbose("Replaying persistent journal: " + journal->getJournalFile());
+			try {
+				journal->replay(this->persistentConfig);
+				journal->compactNow(this->persistentConfig);
+			} catch (Poco::Exception &e) {
+				// do not abort the startup; the state of the configuration file is used
+				this->logWarning("Unable to apply persistent journal, changes since the last compaction are lost: " + e.displayText());
+			}
+		}
+		// use the journal to record changes?
+		if (general->getBool("PersistentJournal", false)) {
+			journal->configure(general);
+			this->persistentJournal = journal;
+			this->logVerbose("Recording persistent state changes in journal: " + journal->getJournalFile());
+		} else
+			delete journal;
 	}
 
+	// time series of ports are configured per port; the store is always available
+	this->timeSeriesStore = new TimeSeriesStore(this);
+	this->timeSeriesStore->configure(general);
+
+	// ports that monitor files share one file watcher
+	this->fileWatcher = new FileWatcher(this);
+	this->fileWatcher->configure(general);
+
+	// processes started by ports are reaped from the main loop
+	this->processManager = new ProcessManager(this);
+
+	// HTTP requests of plugins are executed by a shared client
+	this->httpClient = new HttpClient(this);
+	this->httpClient->configure(general);
+
+	// plugins and ports schedule their work using the event loop
+	this->eventLoop = new EventLoop(this);
+
 	this->heartbeatFile = this->getConfigString(general, "General", "HeartbeatFile", "", false);
 	this->targetFramesPerSecond = general->getInt("TargetFPS", this->targetFramesPerSecond);
 
@@ -763,6 +844,108 @@ void AbstractOPDID::configurePort(Poco::Util::AbstractConfiguration* portConfig,
 	port->onChangeUserPortsStr = this->getConfigString(portConfig, port->ID(), "OnChangeUser", "", false);
 
 	port->setLogVerbosity(this->getConfigLogVerbosity(portConfig, this->logVerbosity));
+
+	if (this->timeSeriesStore != nullptr)
+		this->timeSeriesStore->configurePort(portConfig, port);
+}
+
+bool AbstractOPDID::parsePortState(Poco::Util::AbstractConfiguration* stateConfig, opdi::Port* port, PortState& state) {
+	state.port = port;
+	state.mode = -1;
+	state.line = -1;
+	state.resolution = -1;
+	state.hasValue = false;
+	state.value = 0;
+	state.invalid = false;
+
+	if (port->getType()[0] == OPDI_PORTTYPE_DIGITAL[0]) {
+		std::string portMode = this->getConfigString(stateConfig, port->ID(), "Mode", "", false);
+		if (portMode == "Input")
+			state.mode = OPDI_DIGITAL_MODE_INPUT_FLOATING;
+		else if (portMode == "Input with pullup")
+			state.mode = OPDI_DIGITAL_MODE_INPUT_PULLUP;
+		else if (portMode == "Input with pulldown")
+			state.mode = OPDI_DIGITAL_MODE_INPUT_PULLDOWN;
+		else if (portMode == "Output")
+			state.mode = OPDI_DIGITAL_MODE_OUTPUT;
+		else if (portMode != "")
+			throw Poco::DataException("Unknown Mode specified; expected 'Input', 'Input with pullup', 'Input with pulldown', or 'Output'", portMode);
+
+		std::string portLine = this->getConfigString(stateConfig, port->ID(), "Line", "", false);
+		if (portLine == "High")
+			state.line = 1;
+		else if (portLine == "Low")
+			state.line = 0;
+		else if (portLine != "")
+			throw Poco::DataException("Unknown Line specified; expected 'Low' or 'High'", portLine);
+	} else
+	if (port->getType()[0] == OPDI_PORTTYPE_ANALOG[0]) {
+		std::string mode = this->getConfigString(stateConfig, port->ID(), "Mode", "", false);
+		if (mode == "Input")
+			state.mode = 0;
+		else if (mode == "Output")
+			state.mode = 1;
+		else if (mode != "")
+			throw Poco::DataException("Unknown mode specified; expected 'Input' or 'Output'", mode);
+
+		// TODO reference?
+
+		if (stateConfig->hasProperty("Resolution"))
+			state.resolution = stateConfig->getInt("Resolution", OPDI_ANALOG_PORT_RESOLUTION_12);
+		if (stateConfig->hasProperty("Value")) {
+			state.hasValue = true;
+			state.value = stateConfig->getInt("Value", 0);
+		}
+	} else
+	if (port->getType()[0] == OPDI_PORTTYPE_SELECT[0]) {
+		if (stateConfig->getString("Position", "") != "") {
+			int16_t position = stateConfig->getInt("Position", 0);
+			if ((position < 0) || (position > ((opdi::SelectPort*)port)->getMaxPosition()))
+				throw Poco::DataException("Wrong select port setting: Position is out of range: " + to_string(position));
+			state.hasValue = true;
+			state.value = position;
+		}
+	} else
+	if (port->getType()[0] == OPDI_PORTTYPE_DIAL[0]) {
+		opdi::DialPort* dialPort = (opdi::DialPort*)port;
+		state.hasValue = true;
+		state.value = stateConfig->getInt64("Position", dialPort->getMin());
+		// the port value will be invalid if the position is out of range
+		state.invalid = (state.value < dialPort->getMin()) || (state.value > dialPort->getMax());
+	} else
+		return false;
+
+	return true;
+}
+
+void AbstractOPDID::applyPortState(const PortState& state) {
+	if (state.port->getType()[0] == OPDI_PORTTYPE_DIGITAL[0]) {
+		opdi::DigitalPort* port = (opdi::DigitalPort*)state.port;
+		if (state.mode >= 0)
+			port->setMode(state.mode);
+		if (state.line >= 0)
+			port->setLine(state.line);
+	} else
+	if (state.port->getType()[0] == OPDI_PORTTYPE_ANALOG[0]) {
+		opdi::AnalogPort* port = (opdi::AnalogPort*)state.port;
+		if (state.mode >= 0)
+			port->setMode(state.mode);
+		if (state.resolution >= 0)
+			port->setResolution(state.resolution);
+		if (state.hasValue)
+			port->setValue((int32_t)state.value);
+	} else
+	if (state.port->getType()[0] == OPDI_PORTTYPE_SELECT[0]) {
+		if (state.hasValue)
+			((opdi::SelectPort*)state.port)->setPosition((uint16_t)state.value);
+	} else
+	if (state.port->getType()[0] == OPDI_PORTTYPE_DIAL[0]) {
+		// set port error to invalid if the value is out of range
+		if (state.invalid)
+			state.port->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
+		else
+			((opdi::DialPort*)state.port)->setPosition(state.value);
+	}
 }
 
 void AbstractOPDID::configureDigitalPort(Poco::Util::AbstractConfiguration* portConfig, opdi::DigitalPort* port, bool stateOnly) {
@@ -771,25 +954,9 @@ void AbstractOPDID::configureDigitalPort(Poco::Util::AbstractConfiguration* port
 
 	Poco::AutoPtr<Poco::Util::AbstractConfiguration> stateConfig = this->getConfigForState(portConfig, port->ID());
 
-	std::string portMode = this->getConfigString(stateConfig, port->ID(), "Mode", "", false);
-	if (portMode == "Input") {
-		port->setMode(OPDI_DIGITAL_MODE_INPUT_FLOATING);
-	} else if (portMode == "Input with pullup") {
-		port->setMode(OPDI_DIGITAL_MODE_INPUT_PULLUP);
-	} else if (portMode == "Input with pulldown") {
-		port->setMode(OPDI_DIGITAL_MODE_INPUT_PULLDOWN);
-	} else if (portMode == "Output") {
-		port->setMode(OPDI_DIGITAL_MODE_OUTPUT);
-	} else if (portMode != "")
-		throw Poco::DataException("Unknown Mode specified; expected 'Input', 'Input with pullup', 'Input with pulldown', or 'Output'", portMode);
-
-	std::string portLine = this->getConfigString(stateConfig, port->ID(), "Line", "", false);
-	if (portLine == "High") {
-		port->setLine(1);
-	} else if (portLine == "Low") {
-		port->setLine(0);
-	} else if (portLine != "")
-		throw Poco::DataException("Unknown Line specified; expected 'Low' or 'High'", portLine);
+	PortState state;
+	this->parsePortState(stateConfig, port, state);
+	this->applyPortState(state);
 }
 
 void AbstractOPDID::setupEmulatedDigitalPort(Poco::Util::AbstractConfiguration* portConfig, const std::string& port) {
@@ -817,24 +984,9 @@ void AbstractOPDID::configureAnalogPort(Poco::Util::AbstractConfiguration* portC
 
 	Poco::AutoPtr<Poco::Util::AbstractConfiguration> stateConfig = this->getConfigForState(portConfig, port->ID());
 
-	std::string mode = this->getConfigString(stateConfig, port->ID(), "Mode", "", false);
-	if (mode == "Input")
-		port->setMode(0);
-	else if (mode == "Output")
-		port->setMode(1);
-	else if (mode != "")
-		throw Poco::ApplicationException("Unknown mode specified; expected 'Input' or 'Output'", mode);
-
-	// TODO reference?
-
-	if (stateConfig->hasProperty("Resolution")) {
-		uint8_t resolution = stateConfig->getInt("Resolution", OPDI_ANALOG_PORT_RESOLUTION_12);
-		port->setResolution(resolution);
-	}
-	if (stateConfig->hasProperty("Value")) {
-		uint32_t value = stateConfig->getInt("Value", 0);
-		port->setValue(value);
-	}
+	PortState state;
+	this->parsePortState(stateConfig, port, state);
+	this->applyPortState(state);
 }
 
 void AbstractOPDID::setupEmulatedAnalogPort(Poco::Util::AbstractConfiguration* portConfig, const std::string& port) {
@@ -899,12 +1051,9 @@ void AbstractOPDID::configureSelectPort(Poco::Util::AbstractConfiguration* portC
 
 	Poco::AutoPtr<Poco::Util::AbstractConfiguration> stateConfig = this->getConfigForState(portConfig, port->ID());
 
-	if (stateConfig->getString("Position", "") != "") {
-		int16_t position = stateConfig->getInt("Position", 0);
-		if ((position < 0) || (position > port->getMaxPosition()))
-			throw Poco::DataException("Wrong select port setting: Position is out of range: " + to_string(position));
-		port->setPosition(position);
-	}
+	PortState state;
+	this->parsePortState(stateConfig, port, state);
+	this->applyPortState(state);
 }
 
 void AbstractOPDID::setupEmulatedSelectPort(Poco::Util::AbstractConfiguration* portConfig, Poco::Util::AbstractConfiguration* parentConfig, const std::string& port) {
@@ -967,13 +1116,9 @@ void AbstractOPDID::configureDialPort(Poco::Util::AbstractConfiguration* portCon
 
 	Poco::AutoPtr<Poco::Util::AbstractConfiguration> stateConfig = this->getConfigForState(portConfig, port->ID());
 
-	int64_t position = stateConfig->getInt64("Position", port->getMin());
-	// set port error to invalid if the value is out of range
-	if ((position < port->getMin()) || (position > port->getMax()))
-		port->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
-		//throw Poco::DataException("Wrong dial port setting: Position is out of range: " + to_string(position));
-	else
-		port->setPosition(position);
+	PortState state;
+	this->parsePortState(stateConfig, port, state);
+	this->applyPortState(state);
 }
 
 void AbstractOPDID::setupEmulatedDialPort(Poco::Util::AbstractConfiguration* portConfig, const std::string& port) {
@@ -1286,6 +1431,43 @@ void AbstractOPDID::setupRoot(Poco::Util::AbstractConfiguration* config) {
 	// TODO check group hierarchy
 }
 
+void AbstractOPDID::preparePlugins(void) {
+	for (auto it = this->pluginList.begin(), ite = this->pluginList.end(); it != ite; ++it)
+		(*it)->preparePlugin();
+}
+
+void AbstractOPDID::startPlugins(void) {
+	try {
+		for (auto it = this->pluginList.begin(), ite = this->pluginList.end(); it != ite; ++it) {
+			(*it)->startPlugin();
+			this->startedPlugins++;
+		}
+	} catch (...) {
+		this->stopPlugins();
+		throw;
+	}
+}
+
+void AbstractOPDID::stopPlugins(void) {
+	if (this->startedPlugins == 0)
+		return;
+
+	// stop in reverse order of starting
+	auto it = this->pluginList.begin();
+	std::advance(it, this->startedPlugins);
+	this->startedPlugins = 0;
+	while (it != this->pluginList.begin()) {
+		--it;
+		try {
+			(*it)->stopPlugin();
+		} catch (Poco::Exception &pe) {
+			this->logWarning(std::string("Error stopping plugin: ") + pe.message());
+		} catch (std::exception &e) {
+			this->logWarning(std::string("Error stopping plugin: ") + e.what());
+		}
+	}
+}
+
 int AbstractOPDID::setupConnection(Poco::Util::AbstractConfiguration* config, bool testMode) {
 	this->logVerbose(std::string("Setting up connection for slave: ") + this->slaveName);
 	std::string connectionType = this->getConfigString(config, "Connection", "Type", "", true);
@@ -1328,17 +1510,26 @@ void AbstractOPDID::warnIfPluginMoreRecent(const std::string& driver) {
 	}
 }
 
+uint64_t AbstractOPDID::getCurrentFrame(void) {
+	return this->currentFrame;
+}
+
 uint8_t AbstractOPDID::waiting(uint8_t canSend) {
 	uint8_t result;
 
 	// add up microseconds of idle time
 	this->totalMicroseconds += this->idleStopwatch.elapsed();
 	this->waitingCallsPerSecond++;
+	this->currentFrame++;
 
 	// start local stopwatch
 	Poco::Stopwatch stopwatch;
 	stopwatch.start();
 
+	// plugins are stopped before the ports are deleted
+	if (this->shutdownRequested)
+		this->stopPlugins();
+
 	// exception-safe processing
 	try {
 		result = OPDI::waiting(canSend);
@@ -1357,6 +1548,40 @@ uint8_t AbstractOPDID::waiting(uint8_t canSend) {
 	if (result != OPDI_STATUS_OK)
 		return result;
 
+	// notify ports about changed files
+	if (this->fileWatcher != nullptr) {
+		try {
+			this->fileWatcher->doWork();
+		} catch (Poco::Exception &pe) {
+			this->logWarning(std::string("Error processing file changes: ") + pe.message());
+		}
+	}
+
+	// reap terminated processes
+	if (this->processManager != nullptr)
+		this->processManager->doWork();
+
+	// deliver completed HTTP requests
+	if (this->httpClient != nullptr)
+		this->httpClient->doWork();
+
+	// notify the listeners of expired timers and ready file descriptors
+	if (this->eventLoop != nullptr)
+		this->eventLoop->doWork();
+
+	// sample ports with time series
+	if (this->timeSeriesStore != nullptr)
+		this->timeSeriesStore->doWork();
+
+	// write pending persistent state changes
+	if (this->persistentJournal != nullptr) {
+		try {
+			this->persistentJournal->doWork(this->persistentConfig);
+		} catch (Poco::Exception &pe) {
+			this->logWarning(std::string("Error writing persistent journal: ") + pe.message());
+		}
+	}
+
 	// add runtime statistics to monitor buffer
 	this->monSecondStats[this->monSecondPos] = stopwatch.elapsed();		// microseconds
 	// add up microseconds of processing time
@@ -1448,6 +1673,8 @@ uint8_t AbstractOPDID::refresh(opdi::Port** ports) {
 	}
 
 	if (ports == nullptr) {
+		// individual refreshes of changed ports are no longer necessary
+		this->clearPendingRefreshes();
 		this->allPortsRefreshed(this);
 		this->logDebug("Processed refresh for all ports");
 		return OPDI_STATUS_OK;
@@ -1468,10 +1695,29 @@ void AbstractOPDID::savePersistentConfig() {
 	if (this->persistentConfig == nullptr)
 		return;
 
+	if (this->persistentJournal != nullptr) {
+		this->persistentJournal->compactNow(this->persistentConfig);
+		return;
+	}
+
 	this->persistentConfig->setString("LastChange", this->getTimestampStr());
 	this->persistentConfig->save(this->persistentConfigFile);
 }
 
+void AbstractOPDID::setPersistentValue(const std::string& key, const std::string& value) {
+	this->persistentConfig->setString(key, value);
+	if (this->persistentJournal != nullptr)
+		this->persistentJournal->set(key, value);
+}
+
+void AbstractOPDID::removePersistentValue(const std::string& key) {
+	if (!this->persistentConfig->hasProperty(key))
+		return;
+	this->persistentConfig->remove(key);
+	if (this->persistentJournal != nullptr)
+		this->persistentJournal->remove(key);
+}
+
 void AbstractOPDID::persist(opdi::Port* port) {
 	if (this->persistentConfig == nullptr) {
 		this->logWarning(std::string("Unable to persist state for port ") + port->ID() + ": No configuration file specified; use 'PersistentConfig' in the General configuration section");
@@ -1503,11 +1749,11 @@ void AbstractOPDID::persist(opdi::Port* port) {
 
 			if (modeStr != "") {
 				this->logDebug("Writing port state for: " + port->ID() + "; mode = " + modeStr);
-				this->persistentConfig->setString(port->ID() + ".Mode", modeStr);
+				this->setPersistentValue(port->ID() + ".Mode", modeStr);
 			}
 			if (lineStr != "") {
 				this->logDebug("Writing port state for: " + port->ID() + "; line = " + lineStr);
-				this->persistentConfig->setString(port->ID() + ".Line", lineStr);
+				this->setPersistentValue(port->ID() + ".Line", lineStr);
 			}
 		} else
 		if (port->getType()[0] == OPDI_PORTTYPE_ANALOG[0]) {
@@ -1526,26 +1772,26 @@ void AbstractOPDID::persist(opdi::Port* port) {
 
 			if (modeStr != "") {
 				this->logDebug("Writing port state for: " + port->ID() + "; mode = " + modeStr);
-				this->persistentConfig->setString(port->ID() + ".Mode", modeStr);
+				this->setPersistentValue(port->ID() + ".Mode", modeStr);
 			}
 			this->logDebug("Writing port state for: " + port->ID() + "; resolution = " + this->to_string((int)resolution));
-			this->persistentConfig->setInt(port->ID() + ".Resolution", resolution);
+			this->setPersistentValue(port->ID() + ".Resolution", this->to_string((int)resolution));
 			this->logDebug("Writing port state for: " + port->ID() + "; value = " + this->to_string(value));
-			this->persistentConfig->setInt(port->ID() + ".Value", value);
+			this->setPersistentValue(port->ID() + ".Value", this->to_string(value));
 		} else
 		if (port->getType()[0] == OPDI_PORTTYPE_DIAL[0]) {
 			int64_t position;
 			((opdi::DialPort*)port)->getState(&position);
 
 			this->logDebug("Writing port state for: " + port->ID() + "; position = " + this->to_string(position));
-			this->persistentConfig->setInt64(port->ID() + ".Position", position);
+			this->setPersistentValue(port->ID() + ".Position", this->to_string(position));
 		} else
 		if (port->getType()[0] == OPDI_PORTTYPE_SELECT[0]) {
 			uint16_t position;
 			((opdi::SelectPort*)port)->getState(&position);
 
 			this->logDebug("Writing port state for: " + port->ID() + "; position = " + this->to_string(position));
-			this->persistentConfig->setInt(port->ID() + ".Position", position);
+			this->setPersistentValue(port->ID() + ".Position", this->to_string(position));
 		} else {
 			this->logDebug("Unable to persist port state for: " + port->ID() + "; unknown port type: " + port->getType());
 			return;
@@ -1556,7 +1802,8 @@ void AbstractOPDID::persist(opdi::Port* port) {
 	}
 	// save configuration only if not already shutting down
 	// the config will be saved on shutdown automatically
-	if (!this->shutdownRequested)
+	// if the journal is used the changes are written in the doWork loop
+	if (!this->shutdownRequested && (this->persistentJournal == nullptr))
 		this->savePersistentConfig();
 }
 
@@ -1592,6 +1839,48 @@ std::string AbstractOPDID::getPortStateStr(opdi::Port* port) const {
 	}
 }
 
+std::string AbstractOPDID::getTimeSeries(const std::string& request, size_t maxLength, uint8_t* code) {
+	*code = OPDI_STATUS_OK;
+	Poco::StringTokenizer tokenizer(request, ":");
+	if (tokenizer.count() != 4) {
+		*code = OPDI_PROTOCOL_ERROR;
+		return "";
+	}
+	TimeSeries* series = (this->timeSeriesStore != nullptr ? this->timeSeriesStore->getTimeSeries(tokenizer[0]) : nullptr);
+	if (series == nullptr) {
+		*code = OPDI_PORT_ERROR;
+		return "";
+	}
+	Poco::Int64 from;
+	Poco::Int64 to;
+	unsigned int maxPoints;
+	if (!Poco::NumberParser::tryParse64(tokenizer[1], from) || !Poco::NumberParser::tryParse64(tokenizer[2], to)
+		|| !Poco::NumberParser::tryParseUnsigned(tokenizer[3], maxPoints)) {
+		*code = OPDI_PROTOCOL_ERROR;
+		return "";
+	}
+
+	std::vector<TimeSeries::Point> points;
+	int64_t resolution = series->query(from, to, maxPoints, points);
+
+	// points are separated by commas; each point consists of time/min/max/average
+	std::string header = "resolution=" + this->to_string(resolution) + ";total=" + this->to_string(points.size()) + ";count=";
+	// reserve space for the count and the points key
+	size_t length = header.size() + 16;
+	std::string values;
+	size_t count = 0;
+	for (auto it = points.begin(), ite = points.end(); it != ite; ++it) {
+		std::string point = std::string(count > 0 ? "," : "") + this->to_string(it->time) + "/" + this->to_string(it->min) + "/"
+			+ this->to_string(it->max) + "/" + this->to_string(it->sum / it->count);
+		// stop if the result would become too long; the master can query the rest
+		if (length + values.size() + point.size() >= maxLength)
+			break;
+		values.append(point);
+		count++;
+	}
+	return header + this->to_string(count) + ";points=" + values;
+}
+
 std::string AbstractOPDID::getDeviceInfo(void) {
 	return this->deviceInfo;
 }
@@ -1643,6 +1932,17 @@ uint8_t opdi_slave_callback(OPDIFunctionCode opdiFunctionCode, char* buffer, siz
 		strncpy(buffer, exPortState.c_str(), bufLength);
 		break;
 	}
+#ifdef OPDI_HAS_TIME_SERIES
+	case OPDI_FUNCTION_GET_TIME_SERIES: {
+		uint8_t code;
+		// request parameters in buffer
+		std::string timeSeries = Opdi->getTimeSeries(buffer, bufLength, &code);
+		if (code != OPDI_STATUS_OK)
+			return code;
+		strncpy(buffer, timeSeries.c_str(), bufLength);
+		break;
+	}
+#endif
 #ifndef OPDI_NO_AUTHENTICATION
 	case OPDI_FUNCTION_SET_USERNAME: return Opdi->setUsername(buffer);
 	case OPDI_FUNCTION_SET_PASSWORD: return Opdi->setPassword(buffer);
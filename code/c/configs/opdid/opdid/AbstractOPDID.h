@@ -12,6 +12,12 @@
 #include "Poco/Delegate.h"
 
 #include "OPDIDConfigurationFile.h"
+#include "PersistentJournal.h"
+#include "TimeSeriesStore.h"
+#include "FileWatcher.h"
+#include "ProcessManager.h"
+#include "HttpClient.h"
+#include "EventLoop.h"
 
 #include "opdi_configspecs.h"
 #include "OPDI.h"
@@ -23,11 +29,29 @@ namespace opdid {
 	class AbstractOPDID;
 }
 
-/** The abstract plugin interface. */
+/** The abstract plugin interface.
+*   Plugins are loaded when their node is set up; they are not loaded on demand.
+*   After all nodes have been set up, the daemon calls the lifecycle hooks of the plugins
+*   in the order in which the plugins have been loaded. Plugins should do their periodic
+*   work using timers and file descriptor watches of the daemon's EventLoop instead of
+*   checking the time in the doWork method of a port or running threads of their own.
+*   Threads that a plugin needs anyway should be started in startPlugin and joined in stopPlugin.
+*   All hooks are called on the main thread.
+*/
 struct IOPDIDPlugin {
 	// config is the parent configuration. Implementations should use createView to get the node configuration.
 	virtual void setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std::string& nodeName, Poco::Util::AbstractConfiguration* config) = 0;
 
+	// called after all ports have been prepared; the ports of other nodes can be resolved here
+	virtual void preparePlugin(void) {}
+
+	// called before the daemon starts accepting connections; not called in test mode
+	virtual void startPlugin(void) {}
+
+	// called in reverse order when the daemon shuts down, before the ports are deleted;
+	// the plugin must cancel its timers and watches and stop its threads
+	virtual void stopPlugin(void) {}
+
 	// virtual destructor (called when the plugin is deleted)
 	virtual ~IOPDIDPlugin() {}
 };
@@ -37,7 +61,7 @@ namespace opdid {
 #define OPDID_CONFIG_FILE_SETTING	"__OPDID_CONFIG_FILE_PATH"
 
 #define OPDID_MAJOR_VERSION		0
-#define OPDID_MINOR_VERSION		1
+#define OPDID_MINOR_VERSION		2
 #define OPDID_PATCH_VERSION		0
 
 /** The listener interface for plugin registrations. */
@@ -81,6 +105,7 @@ protected:
 
 	typedef std::list<Poco::SharedPtr<IOPDIDPlugin>> PluginList;
 	PluginList pluginList;
+	size_t startedPlugins;					// number of plugins whose startPlugin hook has been called
 
 	// internal status monitoring variables
 	static const int maxSecondStats = 1100;
@@ -89,6 +114,7 @@ protected:
 	Poco::Stopwatch idleStopwatch;			// measures time until waiting() is called again
 	uint64_t totalMicroseconds;				// total time (doWork + idle)
 	int waitingCallsPerSecond;				// number of calls to waiting()
+	uint64_t currentFrame;					// total number of calls to waiting()
 	double framesPerSecond;					// average number of doWork iterations ("frames") processed per second
 	int targetFramesPerSecond;				// target number of doWork iterations per second
 
@@ -114,6 +140,18 @@ public:
 	// configuration file for port state persistence
 	std::string persistentConfigFile;
 	Poco::Util::PropertyFileConfiguration* persistentConfig;
+	// optional journal for changes of the persistent configuration
+	PersistentJournal* persistentJournal;
+	// in-memory time series of ports that have the TimeSeries setting enabled
+	TimeSeriesStore* timeSeriesStore;
+	// shared watcher for files that are monitored by ports
+	FileWatcher* fileWatcher;
+	// starts and reaps operating system processes for ports
+	ProcessManager* processManager;
+	// performs HTTP requests for plugins using shared worker threads and kept-alive connections
+	HttpClient* httpClient;
+	// timers and file descriptor watches of plugins and ports; the main loop sleeps in its wait method
+	EventLoop* eventLoop;
 
 	AbstractOPDID(void);
 
@@ -142,6 +180,10 @@ public:
 
 	virtual std::string getTimestampStr(void);
 
+	/** Returns the number of the current main loop iteration ("frame"). Ports and plugins can use this
+	* number to cache expensive values for the duration of a frame. */
+	virtual uint64_t getCurrentFrame(void);
+
 	virtual std::string getOPDIResult(uint8_t code);
 
 	/** Returns the key's value from the configuration or the default value, if it is missing. If missing and isRequired is true, throws an exception. */
@@ -192,6 +234,26 @@ public:
 	/** Reads common properties from the configuration and configures the port. */
 	virtual void configurePort(Poco::Util::AbstractConfiguration* portConfig, opdi::Port* port, int defaultFlags);
 
+	/** The state of a port as specified by the Mode, Line, Resolution, Value or Position settings
+	 *  of a configuration section. Unspecified values are -1. */
+	struct PortState {
+		opdi::Port* port;
+		int mode;			// digital and analog ports
+		int line;			// digital ports
+		int resolution;		// analog ports
+		bool hasValue;
+		int64_t value;		// analog value, select or dial position
+		bool invalid;		// dial position is out of range
+	};
+
+	/** Reads the state settings of the port from the configuration without changing the port.
+	 *  Returns false if the port type does not have state settings. Throws an exception if a
+	 *  setting is invalid. */
+	virtual bool parsePortState(Poco::Util::AbstractConfiguration* stateConfig, opdi::Port* port, PortState& state);
+
+	/** Applies the state that has been read by parsePortState to the port. */
+	virtual void applyPortState(const PortState& state);
+
 	/** Reads special properties from the configuration and configures the digital port. */
 	virtual void configureDigitalPort(Poco::Util::AbstractConfiguration* portConfig, opdi::DigitalPort* port, bool stateOnly = false);
 
@@ -253,6 +315,16 @@ public:
 	/** Starts enumerating the nodes of the Root section and configures the nodes. */
 	virtual void setupRoot(Poco::Util::AbstractConfiguration* config);
 
+	/** Calls the preparePlugin hooks of all plugins. */
+	virtual void preparePlugins(void);
+
+	/** Calls the startPlugin hooks of all plugins. If a plugin fails to start, the plugins that have
+	* already been started are stopped again and the exception is rethrown. */
+	virtual void startPlugins(void);
+
+	/** Calls the stopPlugin hooks of the started plugins in reverse order. Errors are logged. */
+	virtual void stopPlugins(void);
+
 	/** Sets up the connection from the specified configuration. */
 	virtual int setupConnection(Poco::Util::AbstractConfiguration* config, bool testMode);
 
@@ -275,14 +347,26 @@ public:
 	/** This implementation also logs the refreshed ports. */
 	virtual uint8_t refresh(opdi::Port** ports) override;
 
+	/** Saves the persistent configuration file. If the journal is used, the journal is compacted. */
 	virtual void savePersistentConfig();
 
+	/** Sets a value in the persistent configuration and records the change in the journal, if used. */
+	virtual void setPersistentValue(const std::string& key, const std::string& value);
+
+	/** Removes a value from the persistent configuration and records the change in the journal, if used. */
+	virtual void removePersistentValue(const std::string& key);
+
 	/** Implements a persistence mechanism for port states. */
 	virtual void persist(opdi::Port* port) override;
 
 	/** Returns a string representing the port state; empty in case of errors. */
 	virtual std::string getPortStateStr(opdi::Port* port) const;
 
+	/** Handles a time series request of a master. The request contains the port ID, the start and end time
+	* (milliseconds since the epoch) and the maximum number of points, separated by colons.
+	* Returns a key=value;-string of at most maxLength characters. */
+	virtual std::string getTimeSeries(const std::string& request, size_t maxLength, uint8_t* code);
+
 	virtual std::string getDeviceInfo(void);
 
 	virtual void getEnvironment(std::map<std::string, std::string>& mapToFill);
@@ -0,0 +1,325 @@
+#include "EventLoop.h"
+
+#ifdef linux
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#endif
+
+#include "Poco/Exception.h"
+
+#include "opdi_platformfuncs.h"
+
+#include "AbstractOPDID.h"
+
+namespace opdid {
+
+///////////////////////////////////////////////////////////////////////////////
+// Event Loop
+///////////////////////////////////////////////////////////////////////////////
+
+EventLoop::EventLoop(AbstractOPDID* opdid) : nextDueTime(0), waiting(false) {
+	this->opdid = opdid;
+	this->lastTimerID = 0;
+	this->lastWatchID = 0;
+#ifdef linux
+	this->wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (this->wakeupFd < 0)
+		throw Poco::SystemException("EventLoop: Unable to create the wakeup event", strerror(errno));
+	// add the wakeup event to the poll array
+	this->pollFdsChanged = true;
+#endif
+}
+
+EventLoop::~EventLoop() {
+#ifdef linux
+	close(this->wakeupFd);
+#endif
+}
+
+void EventLoop::wakeUp(void) {
+	// the main thread cannot add or cancel timers while it waits, so this is another thread
+	if (!this->waiting)
+		return;
+#ifdef linux
+	eventfd_write(this->wakeupFd, 1);
+#else
+	this->wakeupEvent.set();
+#endif
+}
+
+void EventLoop::updateNextDueTime(void) {
+	uint64_t next = 0;
+	for (auto it = this->timers.begin(), ite = this->timers.end(); it != ite; ++it)
+		if ((next == 0) || (it->second.dueTime < next))
+			next = it->second.dueTime;
+	this->nextDueTime = next;
+}
+
+EventLoop::TimerID EventLoop::addTimer(Listener* listener, int delayMs, int periodMs) {
+	if (listener == nullptr)
+		throw Poco::InvalidArgumentException("EventLoop: A timer requires a listener");
+	if ((delayMs < 0) || (periodMs < 0))
+		throw Poco::InvalidArgumentException("EventLoop: Timer delay and period must not be negative");
+
+	Timer timer;
+	timer.listener = listener;
+	timer.dueTime = opdi_get_time_ms() + delayMs;
+	timer.periodMs = periodMs;
+
+	TimerID id;
+	bool earliest = false;
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		id = ++this->lastTimerID;
+		this->timers[id] = timer;
+		uint64_t next = this->nextDueTime;
+		if ((next == 0) || (timer.dueTime < next)) {
+			this->nextDueTime = timer.dueTime;
+			earliest = true;
+		}
+	}
+	// a wait in progress may sleep past the new timer
+	if (earliest)
+		this->wakeUp();
+	return id;
+}
+
+void EventLoop::cancelTimer(TimerID id) {
+	bool cancelled;
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		cancelled = (this->timers.erase(id) > 0);
+		if (cancelled)
+			this->updateNextDueTime();
+	}
+	if (cancelled)
+		this->wakeUp();
+}
+
+EventLoop::WatchID EventLoop::addWatch(int fd, int events, Listener* listener) {
+#ifdef linux
+	if (listener == nullptr)
+		throw Poco::InvalidArgumentException("EventLoop: A watch requires a listener");
+	if ((fd < 0) || ((events & (READABLE | WRITABLE)) == 0))
+		throw Poco::InvalidArgumentException("EventLoop: Invalid file descriptor or events for watch");
+
+	Watch watch;
+	watch.listener = listener;
+	watch.fd = fd;
+	watch.events = events;
+
+	WatchID id = ++this->lastWatchID;
+	this->watches[id] = watch;
+	this->pollFdsChanged = true;
+	return id;
+#else
+	throw Poco::NotImplementedException("EventLoop: File descriptor watches are not supported on this platform");
+#endif
+}
+
+void EventLoop::removeWatch(WatchID id) {
+	if (this->watches.erase(id) > 0) {
+#ifdef linux
+		this->pollFdsChanged = true;
+#endif
+	}
+}
+
+void EventLoop::removeListener(Listener* listener) {
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		auto it = this->timers.begin();
+		while (it != this->timers.end()) {
+			if (it->second.listener == listener)
+				it = this->timers.erase(it);
+			else
+				++it;
+		}
+		this->updateNextDueTime();
+	}
+
+	auto it = this->watches.begin();
+	while (it != this->watches.end()) {
+		if (it->second.listener == listener) {
+			it = this->watches.erase(it);
+#ifdef linux
+			this->pollFdsChanged = true;
+#endif
+		} else
+			++it;
+	}
+}
+
+void EventLoop::dispatchTimers(uint64_t now) {
+	std::vector<TimerID> expired;
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		for (auto it = this->timers.begin(), ite = this->timers.end(); it != ite; ++it)
+			if (it->second.dueTime <= now)
+				expired.push_back(it->first);
+	}
+
+	// listeners may add and cancel timers when notified; a timer that has been
+	// cancelled by a previous listener is not notified
+	for (auto it = expired.begin(), ite = expired.end(); it != ite; ++it) {
+		Listener* listener;
+		{
+			Poco::Mutex::ScopedLock lock(this->mutex);
+			auto tit = this->timers.find(*it);
+			if (tit == this->timers.end())
+				continue;
+			listener = tit->second.listener;
+			if (tit->second.periodMs > 0) {
+				// skip periods that have been missed instead of catching up
+				tit->second.dueTime += tit->second.periodMs;
+				if (tit->second.dueTime <= now)
+					tit->second.dueTime = now + tit->second.periodMs;
+			} else
+				this->timers.erase(tit);
+		}
+		try {
+			listener->timerExpired(*it);
+		} catch (Poco::Exception &pe) {
+			this->opdid->logWarning(std::string("EventLoop: Error processing timer: ") + pe.message());
+		}
+	}
+
+	Poco::Mutex::ScopedLock lock(this->mutex);
+	this->updateNextDueTime();
+}
+
+#ifdef linux
+
+void EventLoop::updatePollFds(void) {
+	this->pollFds.clear();
+	this->pollWatches.clear();
+	struct pollfd wakeup;
+	wakeup.fd = this->wakeupFd;
+	wakeup.events = POLLIN;
+	wakeup.revents = 0;
+	this->pollFds.push_back(wakeup);
+	this->pollWatches.push_back(0);
+	for (auto it = this->watches.begin(), ite = this->watches.end(); it != ite; ++it) {
+		struct pollfd pfd;
+		pfd.fd = it->second.fd;
+		pfd.events = ((it->second.events & READABLE) ? POLLIN : 0) | ((it->second.events & WRITABLE) ? POLLOUT : 0);
+		pfd.revents = 0;
+		this->pollFds.push_back(pfd);
+		this->pollWatches.push_back(it->first);
+	}
+	this->pollFdsChanged = false;
+}
+
+void EventLoop::dispatchWatches(void) {
+	if (this->pollFdsChanged)
+		this->updatePollFds();
+	if (this->pollFds.size() <= 1)
+		return;
+
+	// the wakeup event in the first entry is not polled here
+	if (poll(this->pollFds.data() + 1, this->pollFds.size() - 1, 0) <= 0)
+		return;
+
+	// collect the ready watches first; listeners may add or remove watches when notified
+	std::vector<std::pair<WatchID, int> > ready;
+	for (size_t i = 1; i < this->pollFds.size(); i++) {
+		short revents = this->pollFds[i].revents;
+		if (revents == 0)
+			continue;
+		if (revents & POLLNVAL) {
+			// the file descriptor has been closed without removing the watch
+			this->opdid->logWarning("EventLoop: Removing watch of invalid file descriptor " + this->opdid->to_string(this->pollFds[i].fd));
+			this->removeWatch(this->pollWatches[i]);
+			continue;
+		}
+		int events = 0;
+		if (revents & (POLLIN | POLLHUP | POLLERR))
+			events |= READABLE;
+		if (revents & POLLOUT)
+			events |= WRITABLE;
+		ready.push_back(std::make_pair(this->pollWatches[i], events));
+	}
+
+	for (auto it = ready.begin(), ite = ready.end(); it != ite; ++it) {
+		auto wit = this->watches.find(it->first);
+		if (wit == this->watches.end())
+			continue;
+		Watch watch = wit->second;
+		int events = it->second & watch.events;
+		// hangups and errors are reported even if the watch is for WRITABLE only
+		if (events == 0)
+			events = READABLE;
+		try {
+			watch.listener->fileDescriptorReady(it->first, watch.fd, events);
+		} catch (Poco::Exception &pe) {
+			this->opdid->logWarning(std::string("EventLoop: Error processing file descriptor event: ") + pe.message());
+		}
+	}
+}
+
+#else
+
+void EventLoop::dispatchWatches(void) {
+	// watches are not supported
+}
+
+#endif
+
+void EventLoop::doWork(void) {
+	uint64_t next = this->nextDueTime;
+	if (next != 0) {
+		uint64_t now = opdi_get_time_ms();
+		if (now >= next)
+			this->dispatchTimers(now);
+	}
+
+	if (!this->watches.empty())
+		this->dispatchWatches();
+}
+
+void EventLoop::wait(int timeoutUs) {
+	if (timeoutUs <= 0)
+		return;
+
+	// set before the due time is read; a timer that is added by another thread afterwards
+	// wakes up the wait
+	this->waiting = true;
+
+	// do not sleep past the earliest timer
+	uint64_t next = this->nextDueTime;
+	if (next != 0) {
+		uint64_t now = opdi_get_time_ms();
+		if (now >= next) {
+			this->waiting = false;
+			return;
+		}
+		if ((next - now) * 1000 < (uint64_t)timeoutUs)
+			timeoutUs = (int)((next - now) * 1000);
+	}
+
+#ifdef linux
+	if (this->pollFdsChanged)
+		this->updatePollFds();
+
+	struct timespec timeout;
+	timeout.tv_sec = timeoutUs / 1000000;
+	timeout.tv_nsec = (timeoutUs % 1000000) * 1000;
+	// without watches this waits for the wakeup event only; the ready descriptors are dispatched by doWork
+	if ((ppoll(this->pollFds.data(), this->pollFds.size(), &timeout, nullptr) < 0) && (errno != EINTR))
+		this->opdid->logWarning(std::string("EventLoop: Error waiting for events: ") + strerror(errno));
+	this->waiting = false;
+	if (this->pollFds[0].revents & POLLIN) {
+		eventfd_t value;
+		eventfd_read(this->wakeupFd, &value);
+	}
+#else
+	// sleep at least one millisecond (the minimum on Windows)
+	this->wakeupEvent.tryWait(timeoutUs < 1000 ? 1 : timeoutUs / 1000);
+	this->waiting = false;
+#endif
+}
+
+}		// namespace opdid
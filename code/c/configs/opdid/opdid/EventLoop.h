@@ -0,0 +1,145 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <atomic>
+#include <stdint.h>
+
+#include "Poco/Mutex.h"
+
+#ifdef linux
+#include <poll.h>
+#else
+#include "Poco/Event.h"
+#endif
+
+namespace opdid {
+
+class AbstractOPDID;
+
+///////////////////////////////////////////////////////////////////////////////
+// Event Loop
+///////////////////////////////////////////////////////////////////////////////
+
+/** The EventLoop lets plugins and ports schedule work on the main thread instead of
+*   checking the time in every doWork call or running threads of their own.
+*   Timers expire once or periodically with millisecond resolution. File descriptor
+*   watches notify the listener when the descriptor becomes readable or writable; they
+*   are level triggered, so the listener must consume the data or remove the watch.
+*   File descriptor watches are only supported on Linux.
+*   The main loop sleeps in wait() between frames; it returns early when a watched
+*   file descriptor becomes ready, so that the events are processed in the next frame
+*   without delay.
+*   Timers can be added and cancelled from any thread; this interrupts a wait() in progress
+*   so that the new timeout is observed. Watches must be added and removed on the main
+*   thread. Listeners are always notified on the main thread.
+*/
+class EventLoop {
+public:
+	typedef uint32_t TimerID;
+	typedef uint32_t WatchID;
+
+	enum Events {
+		READABLE = 1,
+		WRITABLE = 2
+	};
+
+	/** Implement this interface to receive timer and file descriptor notifications. */
+	class Listener {
+	public:
+		virtual ~Listener() {};
+
+		/** Called on the main thread when the timer has expired. */
+		virtual void timerExpired(TimerID /*id*/) {};
+
+		/** Called on the main thread when the watched file descriptor is ready. events is a
+		* combination of READABLE and WRITABLE; hangups and errors are reported as READABLE,
+		* so that the listener detects them when reading. */
+		virtual void fileDescriptorReady(WatchID /*id*/, int /*fd*/, int /*events*/) {};
+	};
+
+protected:
+	struct Timer {
+		Listener* listener;
+		uint64_t dueTime;
+		uint64_t periodMs;		// 0 for a one-shot timer
+	};
+
+	struct Watch {
+		Listener* listener;
+		int fd;
+		int events;
+	};
+
+	AbstractOPDID* opdid;
+
+	Poco::Mutex mutex;		// protects the timers
+	TimerID lastTimerID;
+	std::map<TimerID, Timer> timers;
+	std::atomic<uint64_t> nextDueTime;		// of the earliest timer, or 0 if there are no timers
+	std::atomic<bool> waiting;				// true while the main thread sleeps in wait()
+
+	// accessed on the main thread only
+	WatchID lastWatchID;
+	std::map<WatchID, Watch> watches;
+#ifdef linux
+	int wakeupFd;		// eventfd that interrupts wait(); the first entry of pollFds
+	std::vector<struct pollfd> pollFds;
+	std::vector<WatchID> pollWatches;		// the watch of each entry in pollFds
+	bool pollFdsChanged;
+
+	/** Rebuilds the poll array after watches have been added or removed. */
+	void updatePollFds(void);
+#else
+	Poco::Event wakeupEvent;		// interrupts wait()
+#endif
+
+	/** Interrupts wait() if the main thread is sleeping in it. */
+	void wakeUp(void);
+
+	/** Recalculates the due time of the earliest timer. Requires the lock. */
+	void updateNextDueTime(void);
+
+	/** Notifies the listeners of the timers that have expired. */
+	void dispatchTimers(uint64_t now);
+
+	/** Notifies the listeners of the watches that are ready. */
+	void dispatchWatches(void);
+
+public:
+	EventLoop(AbstractOPDID* opdid);
+
+	virtual ~EventLoop();
+
+	/** Starts a timer that expires after delayMs milliseconds. If periodMs is greater than 0,
+	* the timer expires repeatedly at this interval until it is cancelled. A delay of 0 means
+	* that the listener is notified in the next frame, which is how threads can hand over work
+	* to the main thread. May be called from any thread. */
+	virtual TimerID addTimer(Listener* listener, int delayMs, int periodMs = 0);
+
+	/** Cancels the timer. Has no effect if the timer does not exist (anymore).
+	* May be called from any thread. */
+	virtual void cancelTimer(TimerID id);
+
+	/** Watches the file descriptor for the events (READABLE, WRITABLE or both).
+	* The caller remains the owner of the file descriptor and must remove the watch before
+	* closing it. Throws an exception if watches are not supported on this platform. */
+	virtual WatchID addWatch(int fd, int events, Listener* listener);
+
+	/** Stops watching the file descriptor. Has no effect if the watch does not exist (anymore). */
+	virtual void removeWatch(WatchID id);
+
+	/** Cancels all timers and watches of the listener. Must be called on the main thread
+	* before the listener is deleted. */
+	virtual void removeListener(Listener* listener);
+
+	/** Called from the main loop; notifies the listeners of expired timers and ready watches. */
+	virtual void doWork(void);
+
+	/** Sleeps for at most timeoutUs microseconds. Returns early if a watched file descriptor
+	* becomes ready, a timer expires, or another thread adds or cancels a timer.
+	* Called by the main loop between frames. */
+	virtual void wait(int timeoutUs);
+};
+
+}		// namespace opdid
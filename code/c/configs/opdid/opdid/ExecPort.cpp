@@ -1,14 +1,69 @@
 #include "ExecPort.h"
 
+#include <string.h>
+#include <algorithm>
+
+#include "Poco/String.h"
+#include "Poco/NumberParser.h"
+
 #include "opdi_constants.h"
 
+#define DEFAULT_OUTPUT_BUFFER_SIZE	4096
+
 namespace opdid {
 
 ///////////////////////////////////////////////////////////////////////////////
 // Exec Port
 ///////////////////////////////////////////////////////////////////////////////
 
-ExecPort::ExecPort(AbstractOPDID* opdid, const char* id) : opdi::DigitalPort(id, id, OPDI_PORTDIRCAP_OUTPUT, 0), waiter(*this, &ExecPort::waitForProcessEnd) {
+ExecPort::OutputBuffer::OutputBuffer() {
+	this->start = 0;
+	this->size = 0;
+}
+
+void ExecPort::OutputBuffer::setCapacity(size_t capacity) {
+	this->data.resize(capacity);
+	this->clear();
+}
+
+void ExecPort::OutputBuffer::clear(void) {
+	this->start = 0;
+	this->size = 0;
+}
+
+void ExecPort::OutputBuffer::append(const char* bytes, size_t length) {
+	size_t capacity = this->data.size();
+	if (capacity == 0)
+		return;
+	// only the last bytes fit into the buffer
+	if (length >= capacity) {
+		memcpy(&this->data[0], bytes + length - capacity, capacity);
+		this->start = 0;
+		this->size = capacity;
+		return;
+	}
+	size_t end = (this->start + this->size) % capacity;
+	size_t first = std::min(length, capacity - end);
+	memcpy(&this->data[end], bytes, first);
+	memcpy(&this->data[0], bytes + first, length - first);
+	this->size += length;
+	if (this->size > capacity) {
+		// the oldest bytes have been overwritten
+		this->start = (this->start + this->size - capacity) % capacity;
+		this->size = capacity;
+	}
+}
+
+std::string ExecPort::OutputBuffer::str(void) const {
+	std::string result;
+	result.reserve(this->size);
+	size_t first = std::min(this->size, this->data.size() - this->start);
+	result.append(&this->data[0] + this->start, first);
+	result.append(&this->data[0], this->size - first);
+	return result;
+}
+
+ExecPort::ExecPort(AbstractOPDID* opdid, const char* id) : opdi::DigitalPort(id, id, OPDI_PORTDIRCAP_OUTPUT, 0) {
 	this->opdid = opdid;
 
 	opdi::DigitalPort::setMode(OPDI_DIGITAL_MODE_OUTPUT);
@@ -17,14 +72,22 @@ ExecPort::ExecPort(AbstractOPDID* opdid, const char* id) : opdi::DigitalPort(id,
 	this->line = 0;
 	this->lastTriggerTime = 0;
 	this->processPID = 0;
-	this->processIO = nullptr;
 	this->changeType = CHANGED_TO_HIGH;	// default: execute when changed to High only
 	this->waitTimeMs = 0;		// no wait time
 	this->resetTimeMs = 1000;	// reset after one second
 	this->killTimeMs = 0;		// kill time disabled
+	this->forceKill = false;
+	this->captureOutput = false;
+	this->exitCodePort = nullptr;
+	this->valuePort = nullptr;
+	this->numerator = 1;
+	this->denominator = 1;
 }
 
 ExecPort::~ExecPort() {
+	// a running process is not notified anymore
+	if (this->opdid->processManager != nullptr)
+		this->opdid->processManager->removeListener(this);
 }
 
 void ExecPort::configure(Poco::Util::AbstractConfiguration* config) {
@@ -63,7 +126,29 @@ void ExecPort::configure(Poco::Util::AbstractConfiguration* config) {
 		throw Poco::DataException(this->ID() + ": Please specify a positive value for KillTime: ", this->to_string(this->killTimeMs));
 
 	this->forceKill = config->getBool("ForceKill", false);
-	
+
+	this->exitCodePortStr = config->getString("ExitCodePort", "");
+	this->valuePortStr = config->getString("ValuePort", "");
+	this->numerator = config->getInt64("Numerator", this->numerator);
+	this->denominator = config->getInt64("Denominator", this->denominator);
+	if (this->denominator == 0)
+		throw Poco::DataException(this->ID() + ": The Denominator may not be 0");
+
+	// a value can only be parsed from the captured output
+	this->captureOutput = config->getBool("CaptureOutput", !this->valuePortStr.empty());
+	if (!this->captureOutput && !this->valuePortStr.empty())
+		throw Poco::DataException(this->ID() + ": A ValuePort requires CaptureOutput to be enabled");
+	int outputBufferSize = config->getInt("OutputBufferSize", DEFAULT_OUTPUT_BUFFER_SIZE);
+	if (outputBufferSize <= 0)
+		throw Poco::DataException(this->ID() + ": Please specify a positive value for OutputBufferSize: ", this->to_string(outputBufferSize));
+	if (this->captureOutput) {
+#ifndef linux
+		this->logWarning("Capturing process output is not supported on this platform");
+#endif
+		this->stdoutBuffer.setCapacity(outputBufferSize);
+		this->stderrBuffer.setCapacity(outputBufferSize);
+	}
+
 	if ((this->waitTimeMs > 0) && (this->resetTimeMs > 0) && (this->waitTimeMs > this->resetTimeMs))
 		this->logWarning("The specified wait time is larger than the reset time; reset will not execute!");
 }
@@ -79,30 +164,176 @@ void ExecPort::setMode(uint8_t /*mode*/, ChangeSource /*changeSource*/) {
 void ExecPort::prepare() {
 	this->logDebug("Preparing port");
 	opdi::DigitalPort::prepare();
+
+	this->parseParameters();
+
+	if (!this->exitCodePortStr.empty())
+		this->exitCodePort = this->findDialPort("ExitCodePort", this->exitCodePortStr);
+	if (!this->valuePortStr.empty())
+		this->valuePort = this->findDialPort("ValuePort", this->valuePortStr);
+}
+
+opdi::DialPort* ExecPort::findDialPort(const std::string& setting, const std::string& portID) {
+	opdi::Port* port = this->findPort(this->getID(), setting, portID, true);
+	if (port->getType()[0] != OPDI_PORTTYPE_DIAL[0])
+		throw Poco::DataException(this->ID() + ": The " + setting + " must be a DialPort: " + portID);
+	return (opdi::DialPort*)port;
+}
+
+void ExecPort::parseParameters(void) {
+	this->parameterParts.clear();
+	opdi::PortList pl = this->opdid->getPorts();
+	static const std::string allPorts("ALL_PORTS");
+
+	ParameterPart literal;
+	literal.port = nullptr;
+	literal.allPorts = false;
+
+	size_t pos = 0;
+	while (pos < this->parameters.size()) {
+		size_t start = this->parameters.find('$', pos);
+		if (start == std::string::npos)
+			break;
+
+		// find the longest placeholder that matches at this position
+		ParameterPart placeholder;
+		placeholder.port = nullptr;
+		placeholder.allPorts = false;
+		size_t length = 0;
+		if (this->parameters.compare(start + 1, allPorts.size(), allPorts) == 0) {
+			placeholder.allPorts = true;
+			length = allPorts.size();
+		}
+		for (auto pli = pl.begin(), plie = pl.end(); pli != plie; ++pli) {
+			const std::string& id = (*pli)->ID();
+			if ((id.size() > length) && (this->parameters.compare(start + 1, id.size(), id) == 0)) {
+				placeholder.port = *pli;
+				placeholder.allPorts = false;
+				length = id.size();
+			}
+		}
+
+		if (length == 0) {
+			// no placeholder; keep the text
+			literal.text += this->parameters.substr(pos, start + 1 - pos);
+			pos = start + 1;
+			continue;
+		}
+
+		literal.text += this->parameters.substr(pos, start - pos);
+		if (!literal.text.empty()) {
+			this->parameterParts.push_back(literal);
+			literal.text.clear();
+		}
+		this->parameterParts.push_back(placeholder);
+		pos = start + 1 + length;
+	}
+	if (pos < this->parameters.size())
+		literal.text += this->parameters.substr(pos);
+	if (!literal.text.empty())
+		this->parameterParts.push_back(literal);
+}
+
+std::string ExecPort::getParameters(void) {
+	std::string params;
+	for (auto it = this->parameterParts.begin(), ite = this->parameterParts.end(); it != ite; ++it) {
+		if (it->allPorts) {
+			// go through all ports
+			opdi::PortList pl = this->opdid->getPorts();
+			for (auto pli = pl.begin(), plie = pl.end(); pli != plie; ++pli) {
+				std::string val = this->opdid->getPortStateStr(*pli);
+				if (val.empty())
+					val = "<error>";
+				params += (*pli)->ID() + "=" + val + " ";
+			}
+		} else
+		if (it->port != nullptr) {
+			std::string val = this->opdid->getPortStateStr(it->port);
+			if (val.empty())
+				val = "<error>";
+			params += val;
+		} else
+			params += it->text;
+	}
+	return params;
+}
+
+void ExecPort::processOutput(ProcessManager::PID pid, bool isStderr, const char* data, size_t length) {
+	// ignore the output of previous processes
+	if (pid != this->processPID)
+		return;
+	if (isStderr)
+		this->stderrBuffer.append(data, length);
+	else
+		this->stdoutBuffer.append(data, length);
+}
+
+void ExecPort::processTerminated(ProcessManager::PID pid, int exitCode) {
+	this->logVerbose("Process with PID " + this->to_string(pid) + " has terminated with exit code " + this->to_string(exitCode));
+	if (pid != this->processPID)
+		return;
+	this->processPID = 0;
+
+	if (this->captureOutput) {
+		std::string output = this->stdoutBuffer.str();
+		if (!output.empty())
+			this->logVerbose("stdout: " + output);
+		std::string errors = this->stderrBuffer.str();
+		if (!errors.empty())
+			this->logNormal("stderr: " + errors);
+	}
+
+	if (this->exitCodePort != nullptr) {
+		if ((exitCode < 0) || (exitCode < this->exitCodePort->getMin()) || (exitCode > this->exitCodePort->getMax()))
+			this->exitCodePort->setError(Error::VALUE_NOT_AVAILABLE);
+		else
+			this->exitCodePort->setPosition(exitCode);
+	}
+
+	if (this->valuePort != nullptr)
+		this->setValueFromOutput(exitCode);
+}
+
+void ExecPort::setValueFromOutput(int exitCode) {
+	if (exitCode != 0) {
+		this->valuePort->setError(Error::VALUE_NOT_AVAILABLE);
+		return;
+	}
+
+	// find the last non-empty line
+	std::string output = Poco::trimRight(this->stdoutBuffer.str());
+	size_t lineStart = output.find_last_of("\r\n");
+	std::string content = Poco::trim(lineStart == std::string::npos ? output : output.substr(lineStart + 1));
+
+	double value;
+	if (!Poco::NumberParser::tryParseFloat(content, value)) {
+		std::string errorContent = (content.length() > 50 ? content.substr(0, 50) + "..." : content);
+		this->logWarning("Expected a numeric value in the output of program '" + this->programName + "' but got: " + errorContent);
+		this->valuePort->setError(Error::VALUE_NOT_AVAILABLE);
+		return;
+	}
+	int64_t position = (int64_t)(value * this->numerator / this->denominator);
+	if ((position < this->valuePort->getMin()) || (position > this->valuePort->getMax())) {
+		this->logWarning("The value in the output of program '" + this->programName + "' is out of range for port " + this->valuePort->ID() + ": " + this->to_string(position));
+		this->valuePort->setError(Error::VALUE_NOT_AVAILABLE);
+		return;
+	}
+	this->logDebug("Setting position of dial port '" + this->valuePort->ID() + "' to " + this->to_string(position));
+	this->valuePort->setPosition(position);
 }
 
 uint8_t ExecPort::doWork(uint8_t canSend)  {
 	opdi::DigitalPort::doWork(canSend);
 
-	if (this->processIO)
-		this->processIO->process();
-
 	// process running?
 	if (this->processPID != 0) {
-		if (Poco::Process::isRunning(this->processPID)) {
-			Poco::Timestamp::TimeDiff timeDiff = (Poco::Timestamp() - this->lastTriggerTime);
-			// kill time up?
-			if ((this->killTimeMs > 0) && (timeDiff / 1000 > this->killTimeMs)) { // Poco TimeDiff is in microseconds
-				this->logVerbose("Trying to kill previously started process with PID " + this->to_string(this->processPID) + ": Kill time exceeded");
+		Poco::Timestamp::TimeDiff timeDiff = (Poco::Timestamp() - this->lastTriggerTime);
+		// kill time up?
+		if ((this->killTimeMs > 0) && (timeDiff / 1000 > this->killTimeMs)) { // Poco TimeDiff is in microseconds
+			this->logVerbose("Trying to kill previously started process with PID " + this->to_string(this->processPID) + ": Kill time exceeded");
 
-				// kill process
-				Poco::Process::kill(this->processPID);
-			}
-		} else {
-			this->logVerbose("Process with PID " + this->to_string(this->processPID) + " has terminated.");
-			processIO = nullptr;
-			this->processIO = nullptr;
-			this->processPID = 0;
+			// kill process
+			this->opdid->processManager->kill(this->processPID);
 		}
 	}
 
@@ -125,44 +356,15 @@ uint8_t ExecPort::doWork(uint8_t canSend)  {
 				// trigger detected
 
 				// program still running?
-				if (Poco::Process::isRunning(this->processPID) && forceKill) {
+				if ((this->processPID != 0) && forceKill) {
 					this->logVerbose("Trying to kill previously started process with PID " + this->to_string(this->processPID) + ": Kill forced on repeated start");
 
 					// kill process
-					Poco::Process::kill(this->processPID);
+					this->opdid->processManager->kill(this->processPID);
 				}
 
 				// build parameter string
-				std::string params(this->parameters);
-
-				typedef std::map<std::string, std::string> PortValues;
-				PortValues portValues;
-				std::string allPorts;
-				// go through all ports
-				opdi::PortList pl = this->opdid->getPorts();
-				auto pli = pl.begin();
-				auto plie = pl.end();
-				while (pli != plie) {
-					std::string val = this->opdid->getPortStateStr(*pli);
-					if (val.empty())
-						val = "<error>";
-					// store value
-					portValues[std::string("$") + (*pli)->ID()] = val;
-					allPorts += (*pli)->ID() + "=" + val + " ";
-					++pli;
-				}
-				portValues["$ALL_PORTS"] = allPorts;
-
-				// replace parameters in content
-				for (auto iterator = portValues.begin(), iteratorEnd = portValues.end(); iterator != iteratorEnd; ++iterator) {
-					std::string key = iterator->first;
-					std::string value = iterator->second;
-
-					size_t start = 0;
-					while ((start = params.find(key, start)) != std::string::npos) {
-						params.replace(start, key.length(), value);
-					}
-				}
+				std::string params = this->getParameters();
 
 				this->logDebug("Preparing start of program '" + this->programName + "'");
 				this->logDebug("Parameters: " + params);
@@ -183,18 +385,9 @@ uint8_t ExecPort::doWork(uint8_t canSend)  {
 
 				// execute program
 				try {
-					// create pipes for IO redirection
-					std::unique_ptr<Poco::Pipe> outPipe(new Poco::Pipe);
-					std::unique_ptr<Poco::Pipe> errPipe(new Poco::Pipe);
-					std::unique_ptr<Poco::Pipe> inPipe(new Poco::Pipe);
-					this->processHandle = new Poco::ProcessHandle(Poco::Process::launch(this->programName, argList, inPipe.get(), outPipe.get(), errPipe.get()));
-
-					this->processPID = this->processHandle->id();
-					// let the helper class handle IO
-					this->processIO = std::unique_ptr<ProcessIO>(new ProcessIO(this, std::move(outPipe), std::move(errPipe), std::move(inPipe)));
-					// create a thread that waits for the process to terminate
-					// otherwise, on Linux, child processes will remain defunct
-					this->waitThread.start(waiter);
+					this->stdoutBuffer.clear();
+					this->stderrBuffer.clear();
+					this->processPID = this->opdid->processManager->launch(this->programName, argList, this, this->captureOutput);
 
 					this->logVerbose("Started program '" + this->programName + "' with PID " + this->to_string(this->processPID));
 				} catch (Poco::Exception &e) {
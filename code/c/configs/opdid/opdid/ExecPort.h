@@ -1,13 +1,9 @@
 #pragma once
 
-#include "Poco/Process.h"
-#include "Poco/Thread.h"
-#include "Poco/RunnableAdapter.h"
-#include "Poco/Util/AbstractConfiguration.h"
-#include "Poco/PipeStream.h"
-#include "Poco/StreamCopier.h"
+#include <vector>
 
-#include <memory>
+#include "Poco/Timestamp.h"
+#include "Poco/Util/AbstractConfiguration.h"
 
 #include "AbstractOPDID.h"
 
@@ -27,13 +23,24 @@ namespace opdid {
 *   will be evaluated to 0 or 1. An AnalogPort will be evaluated as its relative value. A
 *   DialPort will be evaluated as its absolute value, as will the position of a SelectPort.
 *   If an error occurs during port evaluation the value will be represented as "<error>".
-*   A port ID that cannot be found will not be substituted.
+*   A port ID that cannot be found will not be substituted. If several port IDs match at the same
+*   position the longest one is used. The placeholders are resolved when the port is prepared;
+*   only the ports that are actually referenced are evaluated when the process is started.
 *   The special value $ALL_PORTS in the parameter string will be replaced by a space-separated
 *   list of <port_id>=<value> specifiers.
+*   Processes are started and reaped by the ProcessManager of the OPDID instance.
 *   If the parameter ForceKill is true a running process is killed if it is still running when the
 *   same process is to be started again.
+*   If CaptureOutput is true the output of the process (stdout and stderr) is captured (Linux only).
+*   The most recent output is kept in ring buffers of OutputBufferSize bytes and logged when the
+*   process terminates.
+*   If an ExitCodePort is specified (a DialPort) it is set to the exit code of the process.
+*   If a ValuePort is specified (a DialPort) the last line of the process's standard output is
+*   parsed as a number, scaled by Numerator and Denominator, and set as the position of the
+*   ValuePort; this implies CaptureOutput. If the process fails or the output cannot be parsed
+*   the ValuePort's value becomes invalid.
 */
-class ExecPort : public opdi::DigitalPort {
+class ExecPort : public opdi::DigitalPort, protected ProcessManager::Listener {
 protected:
 
 	enum ChangeType {
@@ -42,73 +49,71 @@ protected:
 		ANY_CHANGE
 	};
 
-	class ProcessIO {
-		std::unique_ptr<Poco::Pipe> outPipe;
-		std::unique_ptr<Poco::Pipe> errPipe;
-		std::unique_ptr<Poco::Pipe> inPipe;
+	/** A part of the parameter string: either literal text or a placeholder. */
+	struct ParameterPart {
+		std::string text;		// literal text
+		opdi::Port* port;		// port whose value is to be inserted, or nullptr
+		bool allPorts;			// the part is the $ALL_PORTS placeholder
+	};
 
-		Poco::PipeInputStream pis;	// stdout
-		Poco::PipeInputStream pes;	// stderr
-		Poco::PipeOutputStream pos;	// stdin
+	typedef std::vector<ParameterPart> ParameterParts;
 
-		ExecPort* execPort;
+	/** Keeps the most recent output of a process up to a fixed size. */
+	class OutputBuffer {
+		std::vector<char> data;
+		size_t start;
+		size_t size;
 
 	public:
-		ProcessIO(ExecPort* execPort, std::unique_ptr<Poco::Pipe> outPipe, std::unique_ptr<Poco::Pipe> errPipe, std::unique_ptr<Poco::Pipe> inPipe)
-			: pis(*outPipe.get()), pes(*errPipe.get()), pos(*inPipe.get()) {
-			this->execPort = execPort;
-		}
-
-		void process() {
-			// this does not work (on Windows, at least)
-			// because iostream does not support async I/O
-			// TODO check whether this can be solved with async I/O
-			/*
-			// does the stdin stream request data?
-			if (this->pos.rdbuf()->) {
-				// data cannot be served, the process must be killed
-				this->execPort->logWarning("Process " + this->execPort->to_string(this->execPort->processPID) + " requests data that cannot be provided, killing the process");
-				Poco::Process::kill(this->execPort->processPID);
-			}
-			// check whether stream data is available
-			if (this->pes.rdbuf()->in_avail() > 0) {
-				// read data from the stream
-				std::string data;
-				Poco::StreamCopier::copyToString(this->pes, data);
-				this->execPort->logNormal("stderr: " + data);
-			}
-			if (this->pis.rdbuf()->in_avail() > 0) {
-				// read data from the stream
-				std::string data;
-				Poco::StreamCopier::copyToString(this->pis, data);
-				this->execPort->logVerbose("stdout: " + data);
-			}
-			*/
-		}
+		OutputBuffer();
+
+		void setCapacity(size_t capacity);
+
+		void clear(void);
+
+		void append(const char* bytes, size_t length);
+
+		std::string str(void) const;
 	};
 
-protected:
 	opdid::AbstractOPDID* opdid;
 	std::string programName;
 	std::string parameters;
+	ParameterParts parameterParts;
 	ChangeType changeType;
 	int64_t waitTimeMs;
 	int64_t resetTimeMs;
 	int64_t killTimeMs;
 	bool forceKill;
+	bool captureOutput;
+	std::string exitCodePortStr;
+	std::string valuePortStr;
+	opdi::DialPort* exitCodePort;
+	opdi::DialPort* valuePort;
+	int64_t numerator;
+	int64_t denominator;
+
+	OutputBuffer stdoutBuffer;
+	OutputBuffer stderrBuffer;
 
 	uint8_t lastState;
 	Poco::Timestamp lastTriggerTime;
-	Poco::ProcessHandle* processHandle;
-	Poco::Process::PID processPID;
-	Poco::Thread waitThread;
-	Poco::RunnableAdapter<ExecPort> waiter;
-	std::unique_ptr<ProcessIO> processIO;
-
-	void waitForProcessEnd() {
-		Poco::Process::wait(*this->processHandle);
-		free(this->processHandle);
-	}
+	ProcessManager::PID processPID;
+
+	/** Splits the parameter string into literal text and placeholders of existing ports. */
+	void parseParameters(void);
+
+	/** Returns the parameter string with the placeholders replaced by the current port values. */
+	std::string getParameters(void);
+
+	virtual void processTerminated(ProcessManager::PID pid, int exitCode) override;
+
+	virtual void processOutput(ProcessManager::PID pid, bool isStderr, const char* data, size_t length) override;
+
+	/** Parses the last line of the captured standard output and sets the value port. */
+	void setValueFromOutput(int exitCode);
+
+	opdi::DialPort* findDialPort(const std::string& setting, const std::string& portID);
 
 	virtual uint8_t doWork(uint8_t canSend);
 
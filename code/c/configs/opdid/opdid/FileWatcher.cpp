@@ -0,0 +1,319 @@
+#include "FileWatcher.h"
+
+#include <vector>
+
+#ifdef linux
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/inotify.h>
+#else
+#include "Poco/Delegate.h"
+#endif
+
+#include "Poco/Exception.h"
+#include "Poco/File.h"
+#include "Poco/Path.h"
+
+#include "opdi_platformfuncs.h"
+
+#include "AbstractOPDID.h"
+
+#define DEFAULT_FILE_WATCH_DELAY_MS		50
+// interval for checking whether removed directories have been recreated
+#define REWATCH_INTERVAL_MS				1000
+
+namespace opdid {
+
+///////////////////////////////////////////////////////////////////////////////
+// File Watcher
+///////////////////////////////////////////////////////////////////////////////
+
+FileWatcher::FileWatcher(AbstractOPDID* opdid) {
+	this->opdid = opdid;
+	this->delayMs = DEFAULT_FILE_WATCH_DELAY_MS;
+#ifdef linux
+	this->fd = -1;
+	this->lastRewatchTime = 0;
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef linux
+	if (this->fd >= 0)
+		close(this->fd);
+#else
+	for (auto it = this->directories.begin(), ite = this->directories.end(); it != ite; ++it)
+		delete it->second.watcher;
+#endif
+}
+
+void FileWatcher::configure(Poco::Util::AbstractConfiguration* general) {
+	int delay = general->getInt("FileWatchDelay", this->delayMs);
+	if (delay < 0)
+		throw Poco::DataException("FileWatchDelay must not be negative: " + this->opdid->to_string(delay));
+	this->delayMs = delay;
+}
+
+void FileWatcher::watchDirectory(const std::string& directory) {
+	auto it = this->directories.find(directory);
+	if (it != this->directories.end()) {
+		it->second.watchCount++;
+		return;
+	}
+#ifdef linux
+	// the directory has been removed; it is watched again when it is recreated
+	auto rit = this->removedDirectories.find(directory);
+	if (rit != this->removedDirectories.end()) {
+		rit->second++;
+		return;
+	}
+#endif
+
+	Poco::File dir(directory);
+	if (!dir.exists())
+		throw Poco::FileNotFoundException("Directory to watch does not exist", directory);
+	if (!dir.isDirectory())
+		throw Poco::InvalidArgumentException("Not a directory", directory);
+
+	Directory entry;
+	entry.watchCount = 1;
+#ifdef linux
+	if (this->fd < 0) {
+		this->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (this->fd < 0)
+			throw Poco::SystemException(std::string("Unable to initialize inotify: ") + strerror(errno));
+	}
+	entry.wd = inotify_add_watch(this->fd, directory.c_str(), IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+	if (entry.wd < 0)
+		throw Poco::SystemException("Unable to watch directory " + directory + ": " + strerror(errno));
+	this->watchDescriptors[entry.wd] = directory;
+#else
+	entry.watcher = new Poco::DirectoryWatcher(directory,
+		Poco::DirectoryWatcher::DW_ITEM_MODIFIED | Poco::DirectoryWatcher::DW_ITEM_ADDED | Poco::DirectoryWatcher::DW_ITEM_MOVED_TO);
+	entry.watcher->itemModified += Poco::delegate(this, &FileWatcher::itemChanged);
+	entry.watcher->itemAdded += Poco::delegate(this, &FileWatcher::itemChanged);
+	entry.watcher->itemMovedTo += Poco::delegate(this, &FileWatcher::itemChanged);
+#endif
+	this->directories[directory] = entry;
+	this->opdid->logDebug("FileWatcher: Watching directory: " + directory);
+}
+
+void FileWatcher::unwatchDirectory(const std::string& directory) {
+#ifdef linux
+	auto rit = this->removedDirectories.find(directory);
+	if (rit != this->removedDirectories.end()) {
+		if (--rit->second <= 0)
+			this->removedDirectories.erase(rit);
+		return;
+	}
+#endif
+	auto it = this->directories.find(directory);
+	if (it == this->directories.end())
+		return;
+	if (--it->second.watchCount > 0)
+		return;
+#ifdef linux
+	inotify_rm_watch(this->fd, it->second.wd);
+	this->watchDescriptors.erase(it->second.wd);
+#else
+	delete it->second.watcher;
+#endif
+	this->directories.erase(it);
+	this->opdid->logDebug("FileWatcher: Stopped watching directory: " + directory);
+}
+
+void FileWatcher::addWatch(const std::string& path, Listener* listener) {
+	Poco::Path filePath(path);
+	filePath.makeFile();
+	std::string fileName = filePath.toString();
+	std::string directory = filePath.parent().toString();
+
+	ListenerList& list = this->listeners[fileName];
+	for (auto it = list.begin(), ite = list.end(); it != ite; ++it)
+		if (*it == listener)
+			return;
+	if (list.empty()) {
+		try {
+			this->watchDirectory(directory);
+		} catch (...) {
+			this->listeners.erase(fileName);
+			throw;
+		}
+	}
+	list.push_back(listener);
+}
+
+void FileWatcher::removeWatch(const std::string& path, Listener* listener) {
+	Poco::Path filePath(path);
+	filePath.makeFile();
+	std::string fileName = filePath.toString();
+
+	auto it = this->listeners.find(fileName);
+	if (it == this->listeners.end())
+		return;
+	it->second.remove(listener);
+	if (it->second.empty()) {
+		this->listeners.erase(it);
+		this->pending.erase(fileName);
+		this->unwatchDirectory(filePath.parent().toString());
+	}
+}
+
+void FileWatcher::addEvent(const std::string& path, bool complete, uint64_t now) {
+	// only files that are being watched are of interest
+	if (this->listeners.find(path) == this->listeners.end())
+		return;
+	auto it = this->pending.find(path);
+	if (it == this->pending.end()) {
+		PendingChange change;
+		change.lastEventTime = now;
+		change.complete = complete;
+		this->pending[path] = change;
+	} else {
+		it->second.lastEventTime = now;
+		it->second.complete = it->second.complete || complete;
+	}
+}
+
+#ifdef linux
+
+void FileWatcher::readEvents(void) {
+	uint64_t now = opdi_get_time_ms();
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	while (true) {
+		ssize_t len = read(this->fd, buffer, sizeof(buffer));
+		if (len <= 0) {
+			if ((len < 0) && (errno != EAGAIN) && (errno != EINTR))
+				this->opdid->logWarning(std::string("FileWatcher: Error reading inotify events: ") + strerror(errno));
+			return;
+		}
+
+		for (char* ptr = buffer; ptr < buffer + len; ) {
+			const struct inotify_event* event = (const struct inotify_event*)ptr;
+			ptr += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				// events have been lost; treat all watched files as changed
+				this->opdid->logDebug("FileWatcher: inotify event queue overflow");
+				for (auto it = this->listeners.begin(), ite = this->listeners.end(); it != ite; ++it)
+					this->addEvent(it->first, false, now);
+				continue;
+			}
+			if (event->mask & IN_IGNORED) {
+				// the directory has been removed; keep its watch count so that it can be watched again
+				auto wdit = this->watchDescriptors.find(event->wd);
+				if (wdit != this->watchDescriptors.end()) {
+					this->opdid->logWarning("FileWatcher: Watched directory has been removed: " + wdit->second);
+					auto dit = this->directories.find(wdit->second);
+					if (dit != this->directories.end()) {
+						this->removedDirectories[wdit->second] = dit->second.watchCount;
+						this->directories.erase(dit);
+					}
+					this->watchDescriptors.erase(wdit);
+				}
+				continue;
+			}
+			if (event->len == 0)
+				continue;
+			auto wdit = this->watchDescriptors.find(event->wd);
+			if (wdit == this->watchDescriptors.end())
+				continue;
+
+			Poco::Path path(wdit->second);
+			path.setFileName(event->name);
+			this->addEvent(path.toString(), (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0, now);
+		}
+	}
+}
+
+void FileWatcher::rewatchDirectories(uint64_t now) {
+	if (now - this->lastRewatchTime < REWATCH_INTERVAL_MS)
+		return;
+	this->lastRewatchTime = now;
+
+	for (auto it = this->removedDirectories.begin(); it != this->removedDirectories.end(); ) {
+		Poco::File dir(it->first);
+		if (!dir.exists() || !dir.isDirectory()) {
+			++it;
+			continue;
+		}
+		Directory entry;
+		entry.watchCount = it->second;
+		entry.wd = inotify_add_watch(this->fd, it->first.c_str(), IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+		if (entry.wd < 0) {
+			// try again later
+			++it;
+			continue;
+		}
+		this->watchDescriptors[entry.wd] = it->first;
+		this->directories[it->first] = entry;
+		this->opdid->logVerbose("FileWatcher: Watching recreated directory: " + it->first);
+
+		// the watched files may have been created before the watch was added
+		for (auto lit = this->listeners.begin(), lite = this->listeners.end(); lit != lite; ++lit) {
+			Poco::Path filePath(lit->first);
+			if ((filePath.parent().toString() == it->first) && Poco::File(lit->first).exists())
+				this->addEvent(lit->first, false, now);
+		}
+		it = this->removedDirectories.erase(it);
+	}
+}
+
+#else
+
+void FileWatcher::itemChanged(const void*, const Poco::DirectoryWatcher::DirectoryEvent& evt) {
+	// this method runs on a DirectoryWatcher thread; events are delivered on the main thread
+	Poco::Path path(evt.item.path());
+	path.makeAbsolute();
+	Poco::Mutex::ScopedLock lock(this->mutex);
+	this->events.insert(path.toString());
+}
+
+#endif
+
+void FileWatcher::doWork(void) {
+#ifdef linux
+	if (this->fd >= 0)
+		this->readEvents();
+	if (!this->removedDirectories.empty())
+		this->rewatchDirectories(opdi_get_time_ms());
+#else
+	std::set<std::string> received;
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		received.swap(this->events);
+	}
+	uint64_t eventTime = opdi_get_time_ms();
+	for (auto it = received.begin(), ite = received.end(); it != ite; ++it)
+		this->addEvent(*it, false, eventTime);
+#endif
+
+	if (this->pending.empty())
+		return;
+
+	// collect the changes whose burst of events is over
+	uint64_t now = opdi_get_time_ms();
+	std::vector<std::string> changed;
+	for (auto it = this->pending.begin(); it != this->pending.end(); ) {
+		if (it->second.complete || (now - it->second.lastEventTime >= this->delayMs)) {
+			changed.push_back(it->first);
+			it = this->pending.erase(it);
+		} else
+			++it;
+	}
+
+	for (auto it = changed.begin(), ite = changed.end(); it != ite; ++it) {
+		// listeners may remove their watch during notification; work on a copy
+		auto lit = this->listeners.find(*it);
+		if (lit == this->listeners.end())
+			continue;
+		this->opdid->logExtreme("FileWatcher: File changed: " + *it);
+		ListenerList list = lit->second;
+		for (auto li = list.begin(), lie = list.end(); li != lie; ++li)
+			(*li)->fileChanged(*it);
+	}
+}
+
+}		// namespace opdid
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <list>
+#include <set>
+
+#include "Poco/Util/AbstractConfiguration.h"
+
+#ifndef linux
+#include "Poco/DirectoryWatcher.h"
+#include "Poco/Mutex.h"
+#endif
+
+namespace opdid {
+
+class AbstractOPDID;
+
+///////////////////////////////////////////////////////////////////////////////
+// File Watcher
+///////////////////////////////////////////////////////////////////////////////
+
+/** The FileWatcher is a service that monitors files for changes on behalf of ports.
+*   The directories of the watched files are monitored (so that files may be created,
+*   replaced or deleted). On Linux, all directories are monitored using a single inotify
+*   file descriptor that is polled from the main loop; no additional threads are required.
+*   On other platforms, one Poco::DirectoryWatcher is used per directory; as these do not
+*   report when a file has been closed, changes are always delivered after the delay.
+*   Bursts of change events for the same file are coalesced: a listener is notified once
+*   the file has been closed after writing or moved into place, or when no further events
+*   have been received for the specified delay.
+*   On Linux, a watched directory that is removed is watched again once it has been recreated.
+*   Listeners are always notified on the main thread.
+*/
+class FileWatcher {
+public:
+	/** Implement this interface to receive file change notifications. */
+	class Listener {
+	public:
+		virtual ~Listener() {};
+
+		/** Called on the main thread when the watched file has changed. */
+		virtual void fileChanged(const std::string& path) = 0;
+	};
+
+protected:
+	typedef std::list<Listener*> ListenerList;
+
+	/** A change of a watched file that has not yet been delivered. */
+	struct PendingChange {
+		uint64_t lastEventTime;
+		bool complete;		// the file has been closed or moved into place
+	};
+
+	/** A monitored directory. */
+	struct Directory {
+		int watchCount;		// number of watched files in this directory
+#ifdef linux
+		int wd;				// inotify watch descriptor
+#else
+		Poco::DirectoryWatcher* watcher;
+#endif
+	};
+
+	AbstractOPDID* opdid;
+	uint32_t delayMs;
+
+	std::map<std::string, ListenerList> listeners;		// by absolute file path
+	std::map<std::string, Directory> directories;		// by absolute directory path
+	std::map<std::string, PendingChange> pending;		// by absolute file path
+
+#ifdef linux
+	int fd;
+	std::map<int, std::string> watchDescriptors;
+	std::map<std::string, int> removedDirectories;		// watch count by path of watched directories that have been removed
+	uint64_t lastRewatchTime;
+
+	void readEvents(void);
+
+	/** Watches the removed directories again that have been recreated. */
+	void rewatchDirectories(uint64_t now);
+#else
+	Poco::Mutex mutex;
+	std::set<std::string> events;		// received by the DirectoryWatcher threads
+
+	void itemChanged(const void*, const Poco::DirectoryWatcher::DirectoryEvent& evt);
+#endif
+
+	void addEvent(const std::string& path, bool complete, uint64_t now);
+
+	void watchDirectory(const std::string& directory);
+
+	void unwatchDirectory(const std::string& directory);
+
+public:
+	FileWatcher(AbstractOPDID* opdid);
+
+	virtual ~FileWatcher();
+
+	/** Reads the file watcher settings from the General section. */
+	virtual void configure(Poco::Util::AbstractConfiguration* general);
+
+	/** Starts watching the file with the specified absolute path. The directory must exist. */
+	virtual void addWatch(const std::string& path, Listener* listener);
+
+	/** Stops watching the file for the specified listener. */
+	virtual void removeWatch(const std::string& path, Listener* listener);
+
+	/** Called from the main loop; collects events and notifies the listeners. */
+	virtual void doWork(void);
+};
+
+}		// namespace opdid
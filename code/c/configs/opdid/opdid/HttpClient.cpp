@@ -0,0 +1,284 @@
+#include "HttpClient.h"
+
+#include "Poco/Exception.h"
+#include "Poco/URI.h"
+#include "Poco/StreamCopier.h"
+#include "Poco/Net/HTTPClientSession.h"
+#include "Poco/Net/HTTPRequest.h"
+#include "Poco/Net/HTTPResponse.h"
+
+#include "opdi_platformfuncs.h"
+
+#include "AbstractOPDID.h"
+
+#define DEFAULT_HTTP_CLIENT_THREADS		2
+#define MAX_HTTP_CLIENT_THREADS			16
+#define DEFAULT_HTTP_KEEPALIVE_SECONDS	30
+#define DEFAULT_HTTP_TIMEOUT_SECONDS	10
+#define MAX_IDLE_SESSIONS_PER_HOST		2
+
+// idle sessions are checked at most this often
+#define IDLE_PURGE_INTERVAL_MS			1000
+
+namespace opdid {
+
+///////////////////////////////////////////////////////////////////////////////
+// HTTP Client
+///////////////////////////////////////////////////////////////////////////////
+
+HttpClient::HttpClient(AbstractOPDID* opdid) : stopping(false) {
+	this->opdid = opdid;
+	this->threadCount = DEFAULT_HTTP_CLIENT_THREADS;
+	this->keepAliveSeconds = DEFAULT_HTTP_KEEPALIVE_SECONDS;
+	this->defaultTimeoutSeconds = DEFAULT_HTTP_TIMEOUT_SECONDS;
+	this->lastRequestID = 0;
+	this->lastPurgeTime = 0;
+}
+
+HttpClient::~HttpClient() {
+	this->stopping = true;
+	this->queue.wakeUpAll();
+	for (auto it = this->threads.begin(), ite = this->threads.end(); it != ite; ++it) {
+		(*it)->join();
+		delete *it;
+	}
+	for (auto it = this->idleSessions.begin(), ite = this->idleSessions.end(); it != ite; ++it)
+		for (auto si = it->second.begin(), sie = it->second.end(); si != sie; ++si)
+			delete si->session;
+}
+
+void HttpClient::configure(Poco::Util::AbstractConfiguration* general) {
+	int threads = general->getInt("HttpClientThreads", this->threadCount);
+	if ((threads < 1) || (threads > MAX_HTTP_CLIENT_THREADS))
+		throw Poco::DataException("HttpClientThreads must be between 1 and " + this->opdid->to_string(MAX_HTTP_CLIENT_THREADS) + ": " + this->opdid->to_string(threads));
+	this->threadCount = threads;
+
+	int keepAlive = general->getInt("HttpKeepAlive", this->keepAliveSeconds);
+	if (keepAlive < 0)
+		throw Poco::DataException("HttpKeepAlive must not be negative: " + this->opdid->to_string(keepAlive));
+	this->keepAliveSeconds = keepAlive;
+
+	int timeout = general->getInt("HttpTimeout", this->defaultTimeoutSeconds);
+	if (timeout <= 0)
+		throw Poco::DataException("HttpTimeout must be greater than 0: " + this->opdid->to_string(timeout));
+	this->defaultTimeoutSeconds = timeout;
+}
+
+HttpClient::RequestID HttpClient::submit(const Request& request, Listener* listener) {
+	Poco::URI uri(request.url);
+	if (uri.getScheme() != "http")
+		throw Poco::UnknownURISchemeException("The HTTP client supports only http URLs", request.url);
+	if (uri.getHost().empty())
+		throw Poco::SyntaxException("The URL does not specify a host", request.url);
+
+	// the worker threads are started when they are needed for the first time
+	if (this->threads.empty()) {
+		for (int i = 0; i < this->threadCount; i++) {
+			Poco::Thread* thread = new Poco::Thread("HTTP client thread " + this->opdid->to_string(i + 1));
+			thread->start(*this);
+			this->threads.push_back(thread);
+		}
+	}
+
+	RequestID id = ++this->lastRequestID;
+	this->listeners[id] = listener;
+	this->queue.enqueueNotification(new RequestNotification(id, request));
+	return id;
+}
+
+HttpClient::RequestID HttpClient::get(const std::string& url, Listener* listener, int timeoutSeconds) {
+	Request request;
+	request.url = url;
+	request.timeoutSeconds = timeoutSeconds;
+	return this->submit(request, listener);
+}
+
+void HttpClient::cancel(RequestID id) {
+	auto it = this->listeners.find(id);
+	if (it != this->listeners.end())
+		it->second = nullptr;
+}
+
+void HttpClient::removeListener(Listener* listener) {
+	for (auto it = this->listeners.begin(), ite = this->listeners.end(); it != ite; ++it)
+		if (it->second == listener)
+			it->second = nullptr;
+}
+
+Poco::Net::HTTPClientSession* HttpClient::acquireSession(const std::string& key, const std::string& host, uint16_t port, bool& reused) {
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		auto it = this->idleSessions.find(key);
+		if ((it != this->idleSessions.end()) && !it->second.empty()) {
+			// the most recently used session is the least likely to have been closed by the server
+			Poco::Net::HTTPClientSession* session = it->second.back().session;
+			it->second.pop_back();
+			reused = true;
+			return session;
+		}
+	}
+	reused = false;
+	Poco::Net::HTTPClientSession* session = new Poco::Net::HTTPClientSession(host, port);
+	session->setKeepAlive(this->keepAliveSeconds > 0);
+	session->setKeepAliveTimeout(Poco::Timespan(this->keepAliveSeconds, 0));
+	return session;
+}
+
+void HttpClient::releaseSession(const std::string& key, Poco::Net::HTTPClientSession* session) {
+	if (this->keepAliveSeconds > 0) {
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		IdleSessionList& list = this->idleSessions[key];
+		if (list.size() < MAX_IDLE_SESSIONS_PER_HOST) {
+			IdleSession idle;
+			idle.session = session;
+			idle.lastUsed = opdi_get_time_ms();
+			list.push_back(idle);
+			return;
+		}
+	}
+	delete session;
+}
+
+void HttpClient::purgeIdleSessions(uint64_t now) {
+	std::vector<Poco::Net::HTTPClientSession*> expired;
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		for (auto it = this->idleSessions.begin(); it != this->idleSessions.end(); ) {
+			IdleSessionList& list = it->second;
+			for (auto si = list.begin(); si != list.end(); ) {
+				if (now - si->lastUsed >= (uint64_t)this->keepAliveSeconds * 1000) {
+					expired.push_back(si->session);
+					si = list.erase(si);
+				} else
+					++si;
+			}
+			if (list.empty())
+				it = this->idleSessions.erase(it);
+			else
+				++it;
+		}
+	}
+	// closing the sockets does not require the lock
+	for (auto it = expired.begin(), ite = expired.end(); it != ite; ++it)
+		delete *it;
+}
+
+void HttpClient::execute(const Request& request, Response& response) {
+	Poco::URI uri(request.url);
+	std::string key = uri.getHost() + ":" + this->opdid->to_string(uri.getPort());
+	std::string path(uri.getPathAndQuery());
+	if (path.empty())
+		path = "/";
+	std::string method = (request.method.empty() ? Poco::Net::HTTPRequest::HTTP_GET : request.method);
+	bool idempotent = (method == Poco::Net::HTTPRequest::HTTP_GET) || (method == Poco::Net::HTTPRequest::HTTP_HEAD);
+	int timeout = (request.timeoutSeconds > 0 ? request.timeoutSeconds : this->defaultTimeoutSeconds);
+
+	while (true) {
+		bool reused = false;
+		Poco::Net::HTTPClientSession* session = nullptr;
+		try {
+			session = this->acquireSession(key, uri.getHost(), uri.getPort(), reused);
+			session->setTimeout(Poco::Timespan(timeout, 0));
+
+			Poco::Net::HTTPRequest req(method, path, Poco::Net::HTTPMessage::HTTP_1_1);
+			req.setKeepAlive(this->keepAliveSeconds > 0);
+			if (!request.body.empty() || (method == Poco::Net::HTTPRequest::HTTP_POST) || (method == Poco::Net::HTTPRequest::HTTP_PUT)) {
+				if (!request.contentType.empty())
+					req.setContentType(request.contentType);
+				req.setContentLength(request.body.size());
+			}
+			std::ostream& os = session->sendRequest(req);
+			os << request.body;
+
+			Poco::Net::HTTPResponse res;
+			std::istream& is = session->receiveResponse(res);
+			response.body.clear();
+			// the body must be read completely for the connection to be reusable
+			Poco::StreamCopier::copyToString(is, response.body);
+			response.status = res.getStatus();
+			response.reason = res.getReason();
+
+			if (res.getKeepAlive())
+				this->releaseSession(key, session);
+			else
+				delete session;
+			return;
+		} catch (Poco::Exception& e) {
+			delete session;
+			// the server may have closed a kept-alive connection in the meantime
+			if (reused && idempotent && (dynamic_cast<Poco::TimeoutException*>(&e) == nullptr)) {
+				this->opdid->logExtreme("HttpClient: Retrying request on a new connection: " + request.url);
+				continue;
+			}
+			response.status = 0;
+			response.reason = e.displayText();
+			response.body.clear();
+			return;
+		} catch (std::exception& e) {
+			// e.g. out of memory or a stream failure; the worker thread must not terminate
+			delete session;
+			response.status = 0;
+			response.reason = e.what();
+			response.body.clear();
+			return;
+		}
+	}
+}
+
+void HttpClient::run(void) {
+	while (!this->stopping && !this->opdid->shutdownRequested) {
+		Poco::Notification::Ptr notification = this->queue.waitDequeueNotification(100);
+		if (!notification)
+			continue;
+		RequestNotification::Ptr requestNf = notification.cast<RequestNotification>();
+		if (!requestNf)
+			continue;
+
+		Completion completion;
+		completion.id = requestNf->id;
+		this->execute(requestNf->request, completion.response);
+
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		this->completions.push_back(completion);
+	}
+}
+
+void HttpClient::doWork(void) {
+	uint64_t now = opdi_get_time_ms();
+	if (now - this->lastPurgeTime >= IDLE_PURGE_INTERVAL_MS) {
+		this->purgeIdleSessions(now);
+		this->lastPurgeTime = now;
+	}
+
+	if (this->listeners.empty())
+		return;
+
+	std::vector<Completion> completed;
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		completed.swap(this->completions);
+	}
+
+	// listeners may submit new requests when notified
+	for (auto it = completed.begin(), ite = completed.end(); it != ite; ++it) {
+		auto lit = this->listeners.find(it->id);
+		if (lit == this->listeners.end())
+			continue;
+		Listener* listener = lit->second;
+		this->listeners.erase(lit);
+		if (listener == nullptr)
+			continue;
+		if (it->response.status == 0)
+			this->opdid->logDebug("HttpClient: Request " + this->opdid->to_string(it->id) + " failed: " + it->response.reason);
+		// an error in one listener must not prevent the notification of the others
+		try {
+			listener->httpCompleted(it->id, it->response);
+		} catch (Poco::Exception& pe) {
+			this->opdid->logWarning("HttpClient: Error processing response of request " + this->opdid->to_string(it->id) + ": " + pe.message());
+		} catch (std::exception& e) {
+			this->opdid->logWarning("HttpClient: Error processing response of request " + this->opdid->to_string(it->id) + ": " + e.what());
+		}
+	}
+}
+
+}		// namespace opdid
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+
+#include "Poco/Mutex.h"
+#include "Poco/Thread.h"
+#include "Poco/Runnable.h"
+#include "Poco/Notification.h"
+#include "Poco/NotificationQueue.h"
+#include "Poco/Util/AbstractConfiguration.h"
+
+namespace Poco {
+namespace Net {
+	class HTTPClientSession;
+}
+}
+
+namespace opdid {
+
+class AbstractOPDID;
+
+///////////////////////////////////////////////////////////////////////////////
+// HTTP Client
+///////////////////////////////////////////////////////////////////////////////
+
+/** The HttpClient performs HTTP requests on behalf of plugins and ports.
+*   Requests are executed by a small, bounded pool of worker threads that is shared
+*   by the whole daemon. Connections are kept alive after a request and reused for
+*   subsequent requests to the same host and port until they have been idle for the
+*   keep-alive timeout. A request that fails on a reused connection is retried once
+*   on a new connection if its method is idempotent.
+*   Only the http scheme is supported.
+*   Listeners are always notified on the main thread.
+*/
+class HttpClient : protected Poco::Runnable {
+public:
+	typedef uint32_t RequestID;
+
+	/** Describes an HTTP request. */
+	struct Request {
+		std::string method;			// GET if empty
+		std::string url;
+		std::string contentType;	// of the body, if any
+		std::string body;
+		int timeoutSeconds;			// <= 0 means the configured default
+
+		Request() : timeoutSeconds(0) {};
+	};
+
+	/** The result of an HTTP request. */
+	struct Response {
+		int status;					// HTTP status code, or 0 if no response has been received
+		std::string reason;			// reason phrase, or the error message if status is 0
+		std::string body;
+
+		Response() : status(0) {};
+
+		bool ok(void) const { return (this->status >= 200) && (this->status < 300); }
+	};
+
+	/** Implement this interface to receive the responses to your requests. */
+	class Listener {
+	public:
+		virtual ~Listener() {};
+
+		/** Called on the main thread when the request has completed or failed. */
+		virtual void httpCompleted(RequestID id, const Response& response) = 0;
+	};
+
+protected:
+	class RequestNotification : public Poco::Notification {
+	public:
+		typedef Poco::AutoPtr<RequestNotification> Ptr;
+
+		RequestID id;
+		Request request;
+
+		RequestNotification(RequestID id, const Request& request) : id(id), request(request) {};
+	};
+
+	struct IdleSession {
+		Poco::Net::HTTPClientSession* session;
+		uint64_t lastUsed;
+	};
+
+	typedef std::vector<IdleSession> IdleSessionList;
+
+	struct Completion {
+		RequestID id;
+		Response response;
+	};
+
+	AbstractOPDID* opdid;
+	int threadCount;
+	int keepAliveSeconds;
+	int defaultTimeoutSeconds;
+
+	std::vector<Poco::Thread*> threads;
+	Poco::NotificationQueue queue;
+	std::atomic<bool> stopping;
+
+	// accessed on the main thread only
+	RequestID lastRequestID;
+	std::map<RequestID, Listener*> listeners;
+	uint64_t lastPurgeTime;
+
+	Poco::Mutex mutex;		// protects the members below
+	std::map<std::string, IdleSessionList> idleSessions;		// by host:port
+	std::vector<Completion> completions;
+
+	/** Worker thread method. */
+	virtual void run(void) override;
+
+	/** Performs the request on a worker thread. Does not throw. */
+	void execute(const Request& request, Response& response);
+
+	/** Returns an idle session for the host if available, or a new session. */
+	Poco::Net::HTTPClientSession* acquireSession(const std::string& key, const std::string& host, uint16_t port, bool& reused);
+
+	/** Keeps the session for reuse. */
+	void releaseSession(const std::string& key, Poco::Net::HTTPClientSession* session);
+
+	/** Closes sessions that have been idle for longer than the keep-alive timeout. */
+	void purgeIdleSessions(uint64_t now);
+
+public:
+	HttpClient(AbstractOPDID* opdid);
+
+	virtual ~HttpClient();
+
+	/** Reads the HTTP client settings from the General section. */
+	virtual void configure(Poco::Util::AbstractConfiguration* general);
+
+	/** Queues the request for execution. The listener is notified on the main thread when
+	* the request has completed. Throws an exception if the URL is not supported. */
+	virtual RequestID submit(const Request& request, Listener* listener);
+
+	/** Queues a GET request for the URL. */
+	virtual RequestID get(const std::string& url, Listener* listener, int timeoutSeconds = 0);
+
+	/** The listener will not be notified about the result of the request. */
+	virtual void cancel(RequestID id);
+
+	/** Cancels the notifications of all requests of the listener. */
+	virtual void removeListener(Listener* listener);
+
+	/** Called from the main loop; notifies the listeners of completed requests. */
+	virtual void doWork(void);
+};
+
+}		// namespace opdid
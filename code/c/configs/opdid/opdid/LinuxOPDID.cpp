@@ -242,6 +242,12 @@ void LinuxOPDID::switchToUser(std::string newUser) {
 	if (!this->persistentConfigFile.empty()) {
 		if (chown(this->persistentConfigFile.c_str(), uid, -1) == -1)
 			throw_system_error("Unable to change persistent file owner to new user", newUser.c_str());
+		// the same applies to the journal file if it has already been created
+		if (this->persistentJournal != nullptr) {
+			std::string journalFile = this->persistentJournal->getJournalFile();
+			if ((access(journalFile.c_str(), F_OK) == 0) && (chown(journalFile.c_str(), uid, -1) == -1))
+				throw_system_error("Unable to change persistent journal file owner to new user", newUser.c_str());
+		}
 	}
 
 	// change effective user ID
@@ -394,7 +400,8 @@ int LinuxOPDID::setupTCP(std::string /*interface_*/, int port) {
 
 					if (elapsed < sleepRemainderBase) {
 						this->logExtreme(std::string("Sleeping for ") + this->to_string(sleepRemainderBase - elapsed) + " microseconds");
-						usleep(sleepRemainderBase - elapsed);
+						// returns early if a file descriptor that is watched by a plugin becomes ready
+						this->eventLoop->wait(sleepRemainderBase - elapsed);
 					}
 				} else
 					this->logNormal(std::string("Error accepting connection: ") + this->to_string(errno));
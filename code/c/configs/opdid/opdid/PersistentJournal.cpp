@@ -0,0 +1,362 @@
+#include "PersistentJournal.h"
+
+#include <iterator>
+
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "Poco/Exception.h"
+#include "Poco/File.h"
+#include "Poco/FileStream.h"
+
+#include "opdi_platformfuncs.h"
+
+#include "AbstractOPDID.h"
+
+#define DEFAULT_JOURNAL_FLUSH_INTERVAL_MS		1000
+#define DEFAULT_JOURNAL_SYNC_INTERVAL_MS		10000
+#define DEFAULT_JOURNAL_COMPACT_INTERVAL_S		3600
+#define DEFAULT_JOURNAL_COMPACT_SIZE			65536
+
+namespace opdid {
+
+///////////////////////////////////////////////////////////////////////////////
+// Persistent Journal
+///////////////////////////////////////////////////////////////////////////////
+
+PersistentJournal::PersistentJournal(AbstractOPDID* opdid, const std::string& configFile) : compacter(*this, &PersistentJournal::compact) {
+	this->opdid = opdid;
+	this->configFile = configFile;
+	this->journalFile = configFile + ".journal";
+	this->compactingFile = configFile + ".journal.compacting";
+
+	this->syncPolicy = SYNC_PERIODIC;
+	this->flushIntervalMs = DEFAULT_JOURNAL_FLUSH_INTERVAL_MS;
+	this->syncIntervalMs = DEFAULT_JOURNAL_SYNC_INTERVAL_MS;
+	this->compactIntervalMs = DEFAULT_JOURNAL_COMPACT_INTERVAL_S * 1000;
+	this->compactSize = DEFAULT_JOURNAL_COMPACT_SIZE;
+
+	this->file = nullptr;
+	this->journalSize = 0;
+	this->unsynced = false;
+	this->lastFlushTime = 0;
+	this->lastSyncTime = 0;
+	this->lastCompactTime = opdi_get_time_ms();
+	this->compactFailed = false;
+}
+
+PersistentJournal::~PersistentJournal() {
+	if (this->compactThread.isRunning())
+		this->compactThread.join();
+	if (this->file != nullptr)
+		fclose(this->file);
+}
+
+void PersistentJournal::configure(Poco::Util::AbstractConfiguration* general) {
+	this->flushIntervalMs = general->getInt("PersistentFlushInterval", this->flushIntervalMs);
+	this->syncIntervalMs = general->getInt("PersistentSyncInterval", this->syncIntervalMs);
+	int compactInterval = general->getInt("PersistentCompactInterval", (int)(this->compactIntervalMs / 1000));
+	if (compactInterval <= 0)
+		throw Poco::DataException("PersistentCompactInterval must be greater than 0 (seconds): " + this->opdid->to_string(compactInterval));
+	this->compactIntervalMs = (uint64_t)compactInterval * 1000;
+	this->compactSize = general->getInt("PersistentCompactSize", this->compactSize);
+
+	std::string syncStr = general->getString("PersistentSync", "");
+	if (syncStr == "Never") {
+		this->syncPolicy = SYNC_NEVER;
+	} else
+	if (syncStr == "Flush") {
+		this->syncPolicy = SYNC_FLUSH;
+	} else
+	if ((syncStr == "Periodic") || (syncStr == "")) {
+		this->syncPolicy = SYNC_PERIODIC;
+	} else
+		throw Poco::DataException("PersistentSync: Expected 'Never', 'Flush' or 'Periodic': " + syncStr);
+}
+
+std::string PersistentJournal::getJournalFile(void) {
+	return this->journalFile;
+}
+
+std::string PersistentJournal::escape(const std::string& str) {
+	std::string result;
+	result.reserve(str.size());
+	for (auto it = str.begin(), ite = str.end(); it != ite; ++it) {
+		switch (*it) {
+		case '\\': result.append("\\\\"); break;
+		case '=': result.append("\\="); break;
+		case '\n': result.append("\\n"); break;
+		case '\r': result.append("\\r"); break;
+		default: result.push_back(*it);
+		}
+	}
+	return result;
+}
+
+std::string PersistentJournal::unescape(const std::string& str) {
+	std::string result;
+	result.reserve(str.size());
+	for (size_t i = 0; i < str.size(); i++) {
+		if ((str[i] == '\\') && (i + 1 < str.size())) {
+			++i;
+			switch (str[i]) {
+			case 'n': result.push_back('\n'); break;
+			case 'r': result.push_back('\r'); break;
+			default: result.push_back(str[i]);
+			}
+		} else
+			result.push_back(str[i]);
+	}
+	return result;
+}
+
+void PersistentJournal::set(const std::string& key, const std::string& value) {
+	this->pending.append("S " + escape(key) + "=" + escape(value) + "\n");
+}
+
+void PersistentJournal::remove(const std::string& key) {
+	this->pending.append("R " + escape(key) + "\n");
+}
+
+void PersistentJournal::openJournal(void) {
+	if (this->file != nullptr)
+		return;
+	this->file = fopen(this->journalFile.c_str(), "ab");
+	if (this->file == nullptr)
+		throw Poco::OpenFileException("Unable to open persistent journal file", this->journalFile);
+}
+
+void PersistentJournal::closeJournal(void) {
+	if (this->file == nullptr)
+		return;
+	fflush(this->file);
+	if (this->unsynced && (this->syncPolicy != SYNC_NEVER))
+		this->sync();
+	fclose(this->file);
+	this->file = nullptr;
+}
+
+void PersistentJournal::sync(void) {
+	if (this->file != nullptr) {
+#ifdef _WIN32
+		_commit(_fileno(this->file));
+#else
+		fsync(fileno(this->file));
+#endif
+	}
+	this->unsynced = false;
+	this->lastSyncTime = opdi_get_time_ms();
+}
+
+void PersistentJournal::flush(void) {
+	this->lastFlushTime = opdi_get_time_ms();
+	if (this->pending.empty())
+		return;
+	this->openJournal();
+	size_t written = fwrite(this->pending.c_str(), 1, this->pending.size(), this->file);
+	if ((written != this->pending.size()) || (fflush(this->file) != 0))
+		throw Poco::WriteFileException("Unable to write persistent journal file", this->journalFile);
+	this->opdid->logExtreme("Appended " + this->opdid->to_string(written) + " bytes to persistent journal");
+	this->journalSize += written;
+	this->pending.clear();
+	this->unsynced = true;
+	if (this->syncPolicy == SYNC_FLUSH)
+		this->sync();
+}
+
+bool PersistentJournal::exists(void) {
+	return Poco::File(this->journalFile).exists() || Poco::File(this->compactingFile).exists();
+}
+
+void PersistentJournal::replayFile(const std::string& fileName, Poco::Util::AbstractConfiguration* config) {
+	Poco::File file(fileName);
+	if (!file.exists())
+		return;
+
+	std::string data;
+	Poco::FileInputStream fis(fileName, std::ios::in | std::ios::binary);
+	data.assign(std::istreambuf_iterator<char>(fis), std::istreambuf_iterator<char>());
+	fis.close();
+
+	int entries = 0;
+	size_t pos = 0;
+	while (pos < data.size()) {
+		size_t end = data.find('\n', pos);
+		// an incomplete last line is the result of an interrupted write; ignore it
+		if (end == std::string::npos) {
+			this->opdid->logWarning("Ignoring incomplete entry at the end of persistent journal: " + fileName);
+			break;
+		}
+		std::string line = data.substr(pos, end - pos);
+		pos = end + 1;
+		if (line.size() < 3)
+			continue;
+		if (line.compare(0, 2, "S ") == 0) {
+			// the key ends at the first '=' that is not escaped
+			size_t eq = 2;
+			while ((eq < line.size()) && (line[eq] != '=')) {
+				if (line[eq] == '\\')
+					++eq;
+				++eq;
+			}
+			if (eq >= line.size())
+				continue;
+			config->setString(unescape(line.substr(2, eq - 2)), unescape(line.substr(eq + 1)));
+			++entries;
+		} else
+		if (line.compare(0, 2, "R ") == 0) {
+			std::string key = unescape(line.substr(2));
+			if (config->hasProperty(key))
+				config->remove(key);
+			++entries;
+		}
+	}
+	this->opdid->logVerbose("Replayed " + this->opdid->to_string(entries) + " entries from persistent journal: " + fileName);
+}
+
+void PersistentJournal::replay(Poco::Util::AbstractConfiguration* config) {
+	// changes in the compacting file are older than those in the journal
+	this->replayFile(this->compactingFile, config);
+	this->replayFile(this->journalFile, config);
+}
+
+void PersistentJournal::copyConfig(Poco::Util::AbstractConfiguration* source, Poco::Util::AbstractConfiguration* target, const std::string& root) {
+	Poco::Util::AbstractConfiguration::Keys keys;
+	source->keys(root, keys);
+	for (auto it = keys.begin(), ite = keys.end(); it != ite; ++it) {
+		std::string key = (root.empty() ? *it : root + "." + *it);
+		if (source->hasProperty(key))
+			target->setString(key, source->getRawString(key));
+		this->copyConfig(source, target, key);
+	}
+}
+
+void PersistentJournal::rotateJournal(void) {
+	this->closeJournal();
+	this->journalSize = 0;
+
+	Poco::File journal(this->journalFile);
+	if (!journal.exists())
+		return;
+	Poco::File compacting(this->compactingFile);
+	if (compacting.exists()) {
+		// a previous compaction has failed; keep its entries and add the current ones
+		Poco::FileInputStream fis(this->journalFile, std::ios::in | std::ios::binary);
+		Poco::FileOutputStream fos(this->compactingFile, std::ios::out | std::ios::app | std::ios::binary);
+		fos << fis.rdbuf();
+		fos.close();
+		fis.close();
+		journal.remove();
+	} else
+		journal.renameTo(this->compactingFile);
+}
+
+void PersistentJournal::saveConfig(Poco::Util::PropertyFileConfiguration* config) {
+	std::string tempFile = this->configFile + ".tmp";
+	config->save(tempFile);
+
+	// the data must be on the storage medium before the rename; otherwise a crash
+	// may leave an empty configuration file after the journal has been discarded
+#ifdef _WIN32
+	int fd = _open(tempFile.c_str(), _O_RDWR);
+	if ((fd < 0) || (_commit(fd) != 0)) {
+		if (fd >= 0)
+			_close(fd);
+		throw Poco::WriteFileException("Unable to sync persistent configuration file", tempFile);
+	}
+	_close(fd);
+#else
+	int fd = open(tempFile.c_str(), O_RDONLY);
+	if ((fd < 0) || (fsync(fd) != 0)) {
+		if (fd >= 0)
+			close(fd);
+		throw Poco::WriteFileException("Unable to sync persistent configuration file", tempFile);
+	}
+	close(fd);
+#endif
+
+	Poco::File(tempFile).renameTo(this->configFile);
+}
+
+void PersistentJournal::compact(void) {
+	// this method runs on the compaction thread; it must not log or access OPDID state
+	try {
+		this->saveConfig(this->compactConfig);
+		Poco::File compacting(this->compactingFile);
+		if (compacting.exists())
+			compacting.remove();
+		this->compactFailed = false;
+	} catch (Poco::Exception& e) {
+		this->compactFailed = true;
+		this->compactError = e.message();
+	} catch (std::exception& e) {
+		this->compactFailed = true;
+		this->compactError = e.what();
+	}
+}
+
+void PersistentJournal::waitForCompaction(void) {
+	if (this->compactConfig.isNull())
+		return;
+	this->compactThread.join();
+	this->compactConfig = nullptr;
+	if (this->compactFailed)
+		this->opdid->logWarning("Compacting the persistent journal failed: " + this->compactError);
+	else
+		this->opdid->logDebug("Persistent journal compacted into: " + this->configFile);
+}
+
+void PersistentJournal::doWork(Poco::Util::PropertyFileConfiguration* config) {
+	uint64_t now = opdi_get_time_ms();
+
+	// compaction done?
+	if (!this->compactConfig.isNull() && !this->compactThread.isRunning())
+		this->waitForCompaction();
+
+	if (!this->pending.empty() && (now - this->lastFlushTime >= this->flushIntervalMs))
+		this->flush();
+
+	if (this->unsynced && (this->syncPolicy == SYNC_PERIODIC) && (now - this->lastSyncTime >= this->syncIntervalMs))
+		this->sync();
+
+	// start compaction?
+	if (this->compactConfig.isNull() && (this->journalSize > 0)
+		&& ((this->journalSize >= this->compactSize) || (now - this->lastCompactTime >= this->compactIntervalMs))) {
+		this->opdid->logDebug("Compacting persistent journal (" + this->opdid->to_string(this->journalSize) + " bytes)");
+		this->flush();
+		this->rotateJournal();
+		// the compaction thread works on a copy of the current state
+		this->compactConfig = new Poco::Util::PropertyFileConfiguration();
+		this->copyConfig(config, this->compactConfig, "");
+		this->compactConfig->setString("LastChange", this->opdid->getTimestampStr());
+		this->lastCompactTime = now;
+		this->compactThread.start(this->compacter);
+	}
+}
+
+void PersistentJournal::compactNow(Poco::Util::PropertyFileConfiguration* config) {
+	this->waitForCompaction();
+	this->closeJournal();
+
+	config->setString("LastChange", this->opdid->getTimestampStr());
+	this->saveConfig(config);
+
+	Poco::File journal(this->journalFile);
+	if (journal.exists())
+		journal.remove();
+	Poco::File compacting(this->compactingFile);
+	if (compacting.exists())
+		compacting.remove();
+
+	this->pending.clear();
+	this->journalSize = 0;
+	this->unsynced = false;
+	this->lastCompactTime = opdi_get_time_ms();
+}
+
+}		// namespace opdid
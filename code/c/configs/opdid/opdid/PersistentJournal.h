@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "Poco/Thread.h"
+#include "Poco/RunnableAdapter.h"
+#include "Poco/AutoPtr.h"
+#include "Poco/Util/AbstractConfiguration.h"
+#include "Poco/Util/PropertyFileConfiguration.h"
+
+namespace opdid {
+
+class AbstractOPDID;
+
+///////////////////////////////////////////////////////////////////////////////
+// Persistent Journal
+///////////////////////////////////////////////////////////////////////////////
+
+/** The PersistentJournal records changes of the persistent configuration in an
+*   append-only journal file instead of rewriting the whole persistent configuration
+*   file on every change.
+*   Changes are collected in memory and appended to the journal in batches (at most
+*   once every FlushInterval milliseconds). Depending on the sync policy the journal
+*   is synced to the storage medium after every flush, periodically, or never.
+*   When the journal becomes too large or the compaction interval expires, the journal
+*   is compacted: the current state is written to the persistent configuration file on
+*   a background thread and the journal is discarded. Changes that occur during the
+*   compaction are written to a new journal.
+*   On startup, any existing journal is replayed onto the persistent configuration.
+*   Journal entries are lines of the form "S <key>=<value>" (set) or "R <key>" (remove).
+*   Backslashes, '=', line feeds and carriage returns in keys and values are escaped
+*   with a backslash.
+*/
+class PersistentJournal {
+public:
+	enum SyncPolicy {
+		SYNC_NEVER,
+		SYNC_FLUSH,
+		SYNC_PERIODIC
+	};
+
+protected:
+	AbstractOPDID* opdid;
+	std::string configFile;
+	std::string journalFile;
+	std::string compactingFile;
+
+	SyncPolicy syncPolicy;
+	uint32_t flushIntervalMs;
+	uint32_t syncIntervalMs;
+	uint64_t compactIntervalMs;
+	size_t compactSize;
+
+	FILE* file;
+	std::string pending;		// entries not yet written to the journal
+	size_t journalSize;			// bytes written to the current journal
+	bool unsynced;				// data has been written but not synced
+	uint64_t lastFlushTime;
+	uint64_t lastSyncTime;
+	uint64_t lastCompactTime;
+
+	// compaction state; the compacted configuration is owned by the compaction thread while it runs
+	Poco::Thread compactThread;
+	Poco::RunnableAdapter<PersistentJournal> compacter;
+	Poco::AutoPtr<Poco::Util::PropertyFileConfiguration> compactConfig;
+	bool compactFailed;
+	std::string compactError;
+
+	void openJournal(void);
+
+	void closeJournal(void);
+
+	void sync(void);
+
+	void flush(void);
+
+	/** Copies the state of the configuration to a new configuration object. */
+	void copyConfig(Poco::Util::AbstractConfiguration* source, Poco::Util::AbstractConfiguration* target, const std::string& root);
+
+	/** Moves the current journal out of the way so that its contents can be compacted. */
+	void rotateJournal(void);
+
+	void replayFile(const std::string& fileName, Poco::Util::AbstractConfiguration* config);
+
+	/** Writes the configuration to a temporary file, syncs it and replaces the configuration file. */
+	void saveConfig(Poco::Util::PropertyFileConfiguration* config);
+
+	/** Runs on the compaction thread. */
+	void compact(void);
+
+	void waitForCompaction(void);
+
+	static std::string escape(const std::string& str);
+
+	static std::string unescape(const std::string& str);
+
+public:
+	PersistentJournal(AbstractOPDID* opdid, const std::string& configFile);
+
+	virtual ~PersistentJournal();
+
+	/** Reads the journal settings from the General section. */
+	virtual void configure(Poco::Util::AbstractConfiguration* general);
+
+	/** Returns true if a journal file from a previous run exists. */
+	virtual bool exists(void);
+
+	/** Replays existing journal files onto the configuration. */
+	virtual void replay(Poco::Util::AbstractConfiguration* config);
+
+	/** Records setting a value. */
+	virtual void set(const std::string& key, const std::string& value);
+
+	/** Records removing a value. */
+	virtual void remove(const std::string& key);
+
+	/** Called from the main loop; flushes, syncs and starts compactions as necessary. */
+	virtual void doWork(Poco::Util::PropertyFileConfiguration* config);
+
+	/** Writes the configuration file synchronously and removes the journal files. */
+	virtual void compactNow(Poco::Util::PropertyFileConfiguration* config);
+
+	virtual std::string getJournalFile(void);
+};
+
+}		// namespace opdid
@@ -4,17 +4,21 @@
 #define _USE_MATH_DEFINES // for C++
 #include <math.h>
 #include <numeric>
+#include <algorithm>
 #include <functional>
+#include <iterator>
+#include <string.h>
 
 #include "Poco/String.h"
 #include "Poco/Timezone.h"
 #include "Poco/DateTimeFormatter.h"
 #include "Poco/NumberParser.h"
+#include "Poco/NumberFormatter.h"
+#include "Poco/LocalDateTime.h"
 #include "Poco/Format.h"
 #include "Poco/Path.h"
 #include "Poco/File.h"
 #include "Poco/BasicEvent.h"
-#include "Poco/Delegate.h"
 #include "Poco/ScopedLock.h"
 #include "Poco/FileStream.h"
 
@@ -22,6 +26,21 @@
 
 namespace opdid {
 
+// little endian helpers for the binary file formats
+static void appendLittleEndian(std::string& data, uint64_t value, int bytes) {
+	for (int i = 0; i < bytes; i++) {
+		data.push_back((char)(value & 0xff));
+		value >>= 8;
+	}
+}
+
+static uint64_t readLittleEndian(const std::string& data, size_t offset, int bytes) {
+	uint64_t result = 0;
+	for (int i = bytes - 1; i >= 0; i--)
+		result = (result << 8) | (uint8_t)data[offset + i];
+	return result;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Logic Port
 ///////////////////////////////////////////////////////////////////////////////
@@ -583,33 +602,123 @@ uint8_t ErrorDetectorPort::doWork(uint8_t canSend)  {
 // Serial Streaming Port
 ///////////////////////////////////////////////////////////////////////////////
 
-SerialStreamingPort::SerialStreamingPort(AbstractOPDID* opdid, const char* id) : opdi::StreamingPort(id) {
+// the bridge thread copies at most this many bytes at once
+#define SERIAL_BRIDGE_BLOCK_SIZE		4096
+// an idle bridge thread checks the stop flag after this many milliseconds
+#define SERIAL_BRIDGE_IDLE_WAIT_MS		100
+
+SerialStreamingPort::SerialStreamingPort(AbstractOPDID* opdid, const char* id) : opdi::StreamingPort(id), bridge(*this, &SerialStreamingPort::pumpData) {
 	this->opdid = opdid;
 	this->mode = PASS_THROUGH;
 	this->device = nullptr;
 	this->serialPort = new ctb::SerialPort();
+
+	this->bufferStart = 0;
+	this->bufferCount = 0;
+	this->chunkSize = 256;
+	this->maxLatencyMs = 10;
+	this->chunkStartTime = 0;
+
+	this->bridgePort = nullptr;
+	this->bridgeReadThreshold = 1;
+	this->stopBridge = false;
+	this->bridgeErrorPending = false;
+	this->bytesToBridge = 0;
+	this->bytesFromBridge = 0;
 }
 
 SerialStreamingPort::~SerialStreamingPort() {
+	// the bridge thread uses both ports
+	this->stopBridgeThread();
+	if (this->bridgePort != nullptr) {
+		this->bridgePort->Close();
+		delete this->bridgePort;
+	}
+	// the serial port is also the device
+	this->device = nullptr;
+	this->serialPort->Close();
+	delete this->serialPort;
+}
+
+void SerialStreamingPort::prepare() {
+	this->logDebug("Preparing port");
+	opdi::StreamingPort::prepare();
+
+	if ((this->mode == BRIDGE) && (this->device != nullptr)) {
+		this->bridgeThread.setName(this->getID() + " bridge");
+		this->bridgeThread.start(this->bridge);
+	}
+}
+
+void SerialStreamingPort::shutdown(void) {
+	this->stopBridgeThread();
+	opdi::StreamingPort::shutdown();
+}
+
+void SerialStreamingPort::stopBridgeThread(void) {
+	if (!this->bridgeThread.isRunning())
+		return;
+	this->stopBridge = true;
+	this->serialPort->CancelWait();
+	this->bridgeThread.join();
+	this->logVerbose("Bridge stopped; bytes sent to " + this->bridgePortName + ": " + this->to_string(this->bytesToBridge.load())
+		+ ", received: " + this->to_string(this->bytesFromBridge.load()));
+}
+
+int SerialStreamingPort::fillBuffer(void) {
+	int total = 0;
+	while (this->bufferCount < this->buffer.size()) {
+		// read into the contiguous free space after the buffered data
+		size_t end = (this->bufferStart + this->bufferCount) % this->buffer.size();
+		size_t space = (end >= this->bufferStart ? this->buffer.size() - end : this->bufferStart - end);
+		int code = this->device->Read(&this->buffer[end], space);
+		// error?
+		if (code < 0)
+			return code;
+		// nothing available?
+		if (code == 0)
+			break;
+		if (this->bufferCount == 0)
+			this->chunkStartTime = opdi_get_time_ms();
+		this->bufferCount += code;
+		total += code;
+		// the device has no more data if the space has not been filled
+		if ((size_t)code < space)
+			break;
+	}
+	return total;
+}
+
+bool SerialStreamingPort::chunkComplete(void) {
+	if (this->bufferCount == 0)
+		return false;
+	return (this->bufferCount >= this->chunkSize) || (opdi_get_time_ms() - this->chunkStartTime >= this->maxLatencyMs);
 }
 
 uint8_t SerialStreamingPort::doWork(uint8_t canSend)  {
 	opdi::StreamingPort::doWork(canSend);
 
-	if (this->device == nullptr)
+	// report errors of the bridge thread
+	if (this->bridgeErrorPending.exchange(false)) {
+		Poco::Mutex::ScopedLock lock(this->bridgeErrorMutex);
+		this->logWarning("Bridge error: " + this->bridgeError);
+	}
+
+	if ((this->device == nullptr) || (this->mode != LOOPBACK))
 		return OPDI_STATUS_OK;
 
-	if (this->mode == LOOPBACK) {
-		// byte available?
-		if (this->available(0) > 0) {
-			char result;
-			if (this->read(&result) > 0) {
-				this->logDebug("Looping back received serial data byte: " + this->opdid->to_string((int)result));
+	if (this->fillBuffer() < 0)
+		return OPDI_STATUS_OK;
 
-				// echo
-				this->write(&result, 1);
-			}
-		}
+	// echo complete chunks; the data in the buffer is contiguous in at most two parts
+	while (this->chunkComplete()) {
+		size_t length = std::min(this->bufferCount, this->buffer.size() - this->bufferStart);
+		this->logExtreme("Looping back received serial data: " + this->to_string(length) + " bytes");
+		int code = this->write(&this->buffer[this->bufferStart], length);
+		if (code <= 0)
+			break;
+		this->bufferStart = (this->bufferStart + code) % this->buffer.size();
+		this->bufferCount -= code;
 	}
 
 	return OPDI_STATUS_OK;
@@ -624,6 +733,19 @@ void SerialStreamingPort::configure(Poco::Util::AbstractConfiguration* config) {
 	std::string protocol = config->getString("Protocol", "8N1");
 	// int timeout = config->getInt("Timeout", 100);
 
+	int bufferSize = config->getInt("BufferSize", 4096);
+	if (bufferSize <= 0)
+		throw Poco::DataException(this->ID() + ": BufferSize must be greater than 0: " + this->to_string(bufferSize));
+	this->buffer.resize(bufferSize);
+	int chunkSize = config->getInt("ChunkSize", (int)this->chunkSize);
+	if ((chunkSize <= 0) || (chunkSize > bufferSize))
+		throw Poco::DataException(this->ID() + ": ChunkSize must be greater than 0 and must not exceed the BufferSize: " + this->to_string(chunkSize));
+	this->chunkSize = chunkSize;
+	int maxLatency = config->getInt("MaxLatency", (int)this->maxLatencyMs);
+	if (maxLatency < 0)
+		throw Poco::DataException(this->ID() + ": MaxLatency must not be negative: " + this->to_string(maxLatency));
+	this->maxLatencyMs = maxLatency;
+
 	this->logVerbose("Opening serial port " + serialPortName + " with " + this->opdid->to_string(baudRate) + " baud and protocol " + protocol);
 
 	// try to lock the port name as a resource
@@ -645,9 +767,98 @@ void SerialStreamingPort::configure(Poco::Util::AbstractConfiguration* config) {
 	} else
 	if (modeStr == "Passthrough") {
 		this->mode = PASS_THROUGH;
+	} else
+	if (modeStr == "Bridge") {
+		this->mode = BRIDGE;
 	} else
 		if (modeStr != "")
-			throw Poco::DataException(this->ID() + ": Invalid mode specifier; expected 'Passthrough' or 'Loopback': " + modeStr);
+			throw Poco::DataException(this->ID() + ": Invalid mode specifier; expected 'Passthrough', 'Loopback' or 'Bridge': " + modeStr);
+
+	if (this->mode == BRIDGE) {
+		this->bridgePortName = this->opdid->getConfigString(config, this->ID(), "BridgePort", "", true);
+		int bridgeBaudRate = config->getInt("BridgeBaudRate", baudRate);
+		std::string bridgeProtocol = config->getString("BridgeProtocol", protocol);
+		int bridgeReadThreshold = config->getInt("BridgeReadThreshold", this->bridgeReadThreshold);
+		if ((bridgeReadThreshold < 1) || (bridgeReadThreshold > 255))
+			throw Poco::DataException(this->ID() + ": BridgeReadThreshold must be between 1 and 255: " + this->to_string(bridgeReadThreshold));
+		this->bridgeReadThreshold = bridgeReadThreshold;
+
+		this->opdid->lockResource(this->bridgePortName, this->getID());
+
+		this->bridgePort = new ctb::SerialPort();
+		if (this->bridgePort->Open(this->bridgePortName.c_str(), bridgeBaudRate,
+							bridgeProtocol.c_str(),
+							ctb::SerialPort::NoFlowControl) < 0)
+			throw Poco::ApplicationException(this->ID() + ": Unable to open bridge port: " + this->bridgePortName);
+
+		this->logVerbose("Bridge port " + this->bridgePortName + " opened successfully");
+	}
+}
+
+bool SerialStreamingPort::writeFully(ctb::SerialPort* target, char* bytes, size_t length) {
+	while (length > 0) {
+		int code = target->Write(bytes, length);
+		if (code < 0)
+			return false;
+		if (code == 0) {
+			// the output buffer is full
+			if (this->stopBridge)
+				return false;
+			if (target->WaitWritable(SERIAL_BRIDGE_IDLE_WAIT_MS) < 0)
+				return false;
+			continue;
+		}
+		bytes += code;
+		length -= code;
+	}
+	return true;
+}
+
+int SerialStreamingPort::transfer(ctb::SerialPort* source, ctb::SerialPort* target, char* block, size_t size) {
+	int code = source->Read(block, size);
+	if (code <= 0)
+		return code;
+	if (!this->writeFully(target, block, code))
+		return -1;
+	return code;
+}
+
+void SerialStreamingPort::pumpData(void) {
+	// this method runs on the bridge thread; it must not log or access OPDID state
+	std::vector<char> block(SERIAL_BRIDGE_BLOCK_SIZE);
+	ctb::SerialPort* ports[2] = { this->serialPort, this->bridgePort };
+	// an idle bridge wakes up on the first byte so that a new transfer starts without delay;
+	// with a read threshold, it waits for that many bytes while data is flowing,
+	// or for MaxLatency milliseconds to collect the remainder
+	bool idle = true;
+	while (!this->stopBridge) {
+		int code = ctb::SerialPort::WaitReadable(ports, 2, idle ? SERIAL_BRIDGE_IDLE_WAIT_MS : (int)this->maxLatencyMs);
+		if (code < 0)
+			break;
+
+		int toBridge = this->transfer(this->serialPort, this->bridgePort, &block[0], block.size());
+		if (toBridge < 0)
+			break;
+		this->bytesToBridge += toBridge;
+
+		int fromBridge = this->transfer(this->bridgePort, this->serialPort, &block[0], block.size());
+		if (fromBridge < 0)
+			break;
+		this->bytesFromBridge += fromBridge;
+
+		bool nowIdle = (this->bridgeReadThreshold == 1) || ((toBridge == 0) && (fromBridge == 0));
+		if (nowIdle != idle) {
+			idle = nowIdle;
+			this->serialPort->SetReadThreshold(idle ? 1 : this->bridgeReadThreshold);
+			this->bridgePort->SetReadThreshold(idle ? 1 : this->bridgeReadThreshold);
+		}
+	}
+
+	if (!this->stopBridge) {
+		Poco::Mutex::ScopedLock lock(this->bridgeErrorMutex);
+		this->bridgeError = "Unable to transfer data between the serial port and " + this->bridgePortName + "; bridge stopped";
+		this->bridgeErrorPending = true;
+	}
 }
 
 int SerialStreamingPort::write(char* bytes, size_t length) {
@@ -657,33 +868,45 @@ int SerialStreamingPort::write(char* bytes, size_t length) {
 int SerialStreamingPort::available(size_t /*count*/) {
 	// count has no meaning in this implementation
 
-	char buf;
-	int code = this->device->Read(&buf, 1);
+	// the data is owned by the bridge thread in bridge mode
+	if (this->mode == BRIDGE)
+		return 0;
+
+	int code = this->fillBuffer();
 	// error?
 	if (code < 0)
 		return code;
-	// byte read?
-	if (code > 0) {
-		this->device->PutBack(buf);
-		return 1;
-	}
-	// nothing available
-	return 0;
+	// data is available in chunks
+	if (!this->chunkComplete())
+		return 0;
+	return (int)this->bufferCount;
 }
 
 int SerialStreamingPort::read(char* result) {
-	char buf;
-	int code = this->device->Read(&buf, 1);
-	// error?
-	if (code < 0)
-		return code;
-	// byte read?
-	if (code > 0) {
-		*result = buf;
-		return 1;
+	return this->read(result, 1);
+}
+
+int SerialStreamingPort::read(char* bytes, size_t length) {
+	if (this->mode == BRIDGE)
+		return 0;
+
+	if (this->bufferCount < length) {
+		int code = this->fillBuffer();
+		// error?
+		if (code < 0)
+			return code;
 	}
-	// nothing available
-	return 0;
+
+	// copy the buffered data in at most two parts
+	size_t result = 0;
+	while ((result < length) && (this->bufferCount > 0)) {
+		size_t part = std::min(std::min(length - result, this->bufferCount), this->buffer.size() - this->bufferStart);
+		memcpy(bytes + result, &this->buffer[this->bufferStart], part);
+		this->bufferStart = (this->bufferStart + part) % this->buffer.size();
+		this->bufferCount -= part;
+		result += part;
+	}
+	return (int)result;
 }
 
 bool SerialStreamingPort::hasError(void) const {
@@ -694,20 +917,50 @@ bool SerialStreamingPort::hasError(void) const {
 // Logger Streaming Port
 ///////////////////////////////////////////////////////////////////////////////
 
-LoggerPort::LoggerPort(AbstractOPDID* opdid, const char* id) : opdi::StreamingPort(id) {
+// binary log file format; see the LoggerPort class comment for a description
+#define LOGGER_BINARY_MAGIC				"OPDL"
+#define LOGGER_BINARY_VERSION			1
+#define LOGGER_BINARY_BLOCK_MARKER		"OPDB"
+
+#define LOGGER_COLUMN_DIGITAL			'D'
+#define LOGGER_COLUMN_ANALOG			'A'
+#define LOGGER_COLUMN_SELECT			'S'
+#define LOGGER_COLUMN_DIAL				'L'
+#define LOGGER_COLUMN_UNSUPPORTED		'?'
+
+// buffered CSV data is written when it exceeds this size
+#define LOGGER_MAX_CSV_BUFFER			65536
+
+LoggerPort::LoggerPort(AbstractOPDID* opdid, const char* id) : opdi::StreamingPort(id), writer(*this, &LoggerPort::writeRecords) {
 	this->opdid = opdid;
 	this->logPeriod = 10000;		// default: 10 seconds
-	this->writeHeader = true;
 	this->lastEntryTime = opdi_get_time_ms();		// wait until writing first record
 	this->format = CSV;
 	this->separator = ";";
-}
 
-LoggerPort::~LoggerPort() {
+	this->flushInterval = 5000;
+	this->blockSize = 256;
+	this->queueSize = 64;
+	this->maxFileSize = 0;
+	this->rotationInterval = 0;
+	this->maxRotatedFiles = 5;
+
+	this->queueHead = 0;
+	this->queueTail = 0;
+	this->droppedRecords = 0;
+	this->stopWriter = false;
+	this->writerFailed = false;
+	this->writerErrorPending = false;
+
+	this->writeHeader = true;
+	this->fileSize = 0;
+	this->fileOpenTime = 0;
+	this->lastFlushTime = 0;
+	this->blockRows = 0;
 }
 
-std::string LoggerPort::getPortStateStr(opdi::Port* port) {
-	return this->opdid->getPortStateStr(port);
+LoggerPort::~LoggerPort() {
+	this->stopWriterThread();
 }
 
 void LoggerPort::prepare() {
@@ -716,11 +969,103 @@ void LoggerPort::prepare() {
 
 	// find ports; throws errors if something required is missing
 	this->findPorts(this->getID(), "Ports", this->portsToLogStr, this->portsToLog);
+
+	// determine the column types
+	this->columnTypes.clear();
+	for (auto it = this->portsToLog.begin(), ite = this->portsToLog.end(); it != ite; ++it) {
+		char type = (*it)->getType()[0];
+		if (type == OPDI_PORTTYPE_DIGITAL[0])
+			this->columnTypes.push_back(LOGGER_COLUMN_DIGITAL);
+		else if (type == OPDI_PORTTYPE_ANALOG[0])
+			this->columnTypes.push_back(LOGGER_COLUMN_ANALOG);
+		else if (type == OPDI_PORTTYPE_SELECT[0])
+			this->columnTypes.push_back(LOGGER_COLUMN_SELECT);
+		else if (type == OPDI_PORTTYPE_DIAL[0])
+			this->columnTypes.push_back(LOGGER_COLUMN_DIAL);
+		else
+			this->columnTypes.push_back(LOGGER_COLUMN_UNSUPPORTED);
+	}
+
+	// allocate the queue slots; one slot always remains empty to distinguish a full queue from an empty one
+	this->queue.resize(this->queueSize + 1);
+	for (auto it = this->queue.begin(), ite = this->queue.end(); it != ite; ++it)
+		it->values.resize(this->portsToLog.size());
+	this->blockValues.assign(this->portsToLog.size(), std::string());
+	this->blockValidity.assign(this->portsToLog.size(), std::string());
+
+	// the writer thread must not access OPDID state
+	this->timestampFormat = this->opdid->timestampFormat;
+
+	this->logVerbose("Opening output log file " + this->outFileStr);
+	try {
+		this->openOutput();
+	} catch (Poco::Exception &e) {
+		// do not abort the startup; the port remains in the error state and does not log
+		this->logWarning("Unable to open output log file, logging is disabled: " + e.displayText());
+		this->writerFailed = true;
+		this->stopWriter = true;
+		return;
+	}
+
+	this->lastFlushTime = opdi_get_time_ms();
+	this->writerThread.start(this->writer);
+}
+
+void LoggerPort::shutdown(void) {
+	// write pending records before the port is destroyed
+	this->stopWriterThread();
+	opdi::StreamingPort::shutdown();
+}
+
+void LoggerPort::takeSnapshot(Record& record) {
+	record.timestamp.update();
+	for (size_t i = 0; i < this->portsToLog.size(); i++) {
+		opdi::Port* port = this->portsToLog[i];
+		Value& value = record.values[i];
+		value.valid = true;
+		try {
+			switch (this->columnTypes[i]) {
+			case LOGGER_COLUMN_DIGITAL: {
+				uint8_t mode;
+				uint8_t line;
+				((opdi::DigitalPort*)port)->getState(&mode, &line);
+				value.intValue = line;
+				break;
+			}
+			case LOGGER_COLUMN_ANALOG:
+				value.doubleValue = ((opdi::AnalogPort*)port)->getRelativeValue();
+				break;
+			case LOGGER_COLUMN_SELECT: {
+				uint16_t position;
+				((opdi::SelectPort*)port)->getState(&position);
+				value.intValue = position;
+				break;
+			}
+			case LOGGER_COLUMN_DIAL: {
+				int64_t position;
+				((opdi::DialPort*)port)->getState(&position);
+				value.intValue = position;
+				break;
+			}
+			default:
+				value.valid = false;
+			}
+		} catch (...) {
+			// ports with errors are logged as empty values
+			value.valid = false;
+		}
+	}
 }
 
 uint8_t LoggerPort::doWork(uint8_t canSend)  {
 	opdi::StreamingPort::doWork(canSend);
 
+	// report errors of the writer thread
+	if (this->writerErrorPending.exchange(false)) {
+		Poco::Mutex::ScopedLock lock(this->writerErrorMutex);
+		this->logWarning("Error writing output log file: " + this->writerError);
+	}
+
 	// check whether the time for a new entry has been reached
 	uint64_t timeDiff = opdi_get_time_ms() - this->lastEntryTime;
 	if (timeDiff < this->logPeriod)
@@ -728,45 +1073,235 @@ uint8_t LoggerPort::doWork(uint8_t canSend)  {
 
 	this->lastEntryTime = opdi_get_time_ms();
 
-	// build log entry
-	std::string entry;
-
-	if (format == CSV) {
-		if (this->writeHeader) {
-			entry = "Timestamp" + this->separator;
-			// go through port list, build header
-			auto it = this->portsToLog.begin();
-			auto ite = this->portsToLog.end();
-			while (it != ite) {
-				entry += (*it)->getID();
-				// separator necessary?
-				if (it != ite - 1) 
-					entry += this->separator;
-				++it;
-			}
-			this->outFile << entry << std::endl;
-			this->writeHeader = false;
+	// writer not running?
+	if (this->queue.empty() || this->stopWriter)
+		return OPDI_STATUS_OK;
+
+	size_t tail = this->queueTail.load(std::memory_order_relaxed);
+	size_t next = (tail + 1) % this->queue.size();
+	if (next == this->queueHead.load(std::memory_order_acquire)) {
+		this->droppedRecords++;
+		this->logWarning("Writer queue is full, dropping log record (" + this->to_string(this->droppedRecords) + " records dropped so far)");
+		return OPDI_STATUS_OK;
+	}
+
+	// the main loop only copies the port states; formatting and file output is done by the writer thread
+	this->takeSnapshot(this->queue[tail]);
+	this->queueTail.store(next, std::memory_order_release);
+	this->writerEvent.set();
+
+	return OPDI_STATUS_OK;
+}
+
+void LoggerPort::openOutput(void) {
+	Poco::File file(this->outFileStr);
+	this->fileSize = (file.exists() ? file.getSize() : 0);
+	// a binary file must contain exactly one schema header; move an existing file out of the way
+	if ((this->format == BINARY) && (this->fileSize > 0)) {
+		this->rotateFiles();
+		this->fileSize = 0;
+	}
+
+	// open the stream in append mode
+	std::ios_base::openmode mode = std::ios_base::app;
+	if (this->format == BINARY)
+		mode |= std::ios_base::binary;
+	this->outFile.open(this->outFileStr, mode);
+	if (!this->outFile.is_open())
+		throw Poco::OpenFileException(this->ID() + ": Unable to open output log file", this->outFileStr);
+
+	this->fileOpenTime = opdi_get_time_ms();
+	this->writeHeader = true;
+}
+
+void LoggerPort::rotateFiles(void) {
+	Poco::File current(this->outFileStr);
+	if (this->maxRotatedFiles <= 0) {
+		if (current.exists())
+			current.remove();
+		return;
+	}
+	Poco::File oldest(this->outFileStr + "." + this->to_string(this->maxRotatedFiles));
+	if (oldest.exists())
+		oldest.remove();
+	for (int i = this->maxRotatedFiles - 1; i >= 1; i--) {
+		Poco::File rotated(this->outFileStr + "." + this->to_string(i));
+		if (rotated.exists())
+			rotated.renameTo(this->outFileStr + "." + this->to_string(i + 1));
+	}
+	if (current.exists())
+		current.renameTo(this->outFileStr + ".1");
+}
+
+void LoggerPort::rotateOutput(void) {
+	this->flushOutput();
+	this->outFile.close();
+	this->rotateFiles();
+	this->openOutput();
+}
+
+void LoggerPort::appendRecord(const Record& record) {
+	if (this->format == BINARY)
+		this->appendBinary(record);
+	else
+		this->appendCSV(record);
+	this->blockRows++;
+}
+
+void LoggerPort::appendCSV(const Record& record) {
+	if (this->writeHeader) {
+		this->buffer.append("Timestamp");
+		for (auto it = this->portsToLog.begin(), ite = this->portsToLog.end(); it != ite; ++it) {
+			this->buffer.append(this->separator);
+			this->buffer.append((*it)->getID());
 		}
-		entry = this->opdid->getTimestampStr() + this->separator;
-		// go through port list
-		auto it = this->portsToLog.begin();
-		auto ite = this->portsToLog.end();
-		while (it != ite) {
-			entry += this->getPortStateStr(*it);
-			// separator necessary?
-			if (it != ite - 1) 
-				entry += this->separator;
-			++it;
+		this->buffer.push_back('\n');
+		this->writeHeader = false;
+	}
+
+	this->buffer.append(Poco::DateTimeFormatter::format(Poco::LocalDateTime(Poco::DateTime(record.timestamp)), this->timestampFormat));
+	for (size_t i = 0; i < record.values.size(); i++) {
+		this->buffer.append(this->separator);
+		const Value& value = record.values[i];
+		if (!value.valid)
+			continue;
+		if (this->columnTypes[i] == LOGGER_COLUMN_ANALOG) {
+			this->formatStream.str("");
+			this->formatStream << value.doubleValue;
+			this->buffer.append(this->formatStream.str());
+		} else
+			Poco::NumberFormatter::append(this->buffer, (Poco::Int64)value.intValue);
+	}
+	this->buffer.push_back('\n');
+}
+
+void LoggerPort::appendBinary(const Record& record) {
+	if (this->writeHeader) {
+		this->buffer.append(LOGGER_BINARY_MAGIC);
+		appendLittleEndian(this->buffer, LOGGER_BINARY_VERSION, 4);
+		appendLittleEndian(this->buffer, this->portsToLog.size(), 4);
+		for (size_t i = 0; i < this->portsToLog.size(); i++) {
+			std::string id = this->portsToLog[i]->ID();
+			this->buffer.push_back(this->columnTypes[i]);
+			appendLittleEndian(this->buffer, id.size(), 2);
+			this->buffer.append(id);
 		}
+		this->writeHeader = false;
 	}
 
-	if (!this->outFile.is_open())
-		return OPDI_STATUS_OK;
+	uint32_t row = this->blockRows;
+	appendLittleEndian(this->blockTimestamps, record.timestamp.epochMicroseconds() / 1000, 8);
+	for (size_t i = 0; i < record.values.size(); i++) {
+		const Value& value = record.values[i];
+		if (row % 8 == 0)
+			this->blockValidity[i].push_back(0);
+		if (value.valid)
+			this->blockValidity[i].back() |= (char)(1 << (row % 8));
+		int64_t intValue = (value.valid ? value.intValue : 0);
+		switch (this->columnTypes[i]) {
+		case LOGGER_COLUMN_DIGITAL: appendLittleEndian(this->blockValues[i], intValue, 1); break;
+		case LOGGER_COLUMN_SELECT: appendLittleEndian(this->blockValues[i], intValue, 2); break;
+		case LOGGER_COLUMN_DIAL: appendLittleEndian(this->blockValues[i], intValue, 8); break;
+		case LOGGER_COLUMN_ANALOG: {
+			double doubleValue = (value.valid ? value.doubleValue : 0.0);
+			uint64_t bits;
+			memcpy(&bits, &doubleValue, sizeof(bits));
+			appendLittleEndian(this->blockValues[i], bits, 8);
+			break;
+		}
+		}
+	}
+}
 
-	// write to output
-	this->outFile << entry << std::endl;
+void LoggerPort::flushOutput(void) {
+	this->lastFlushTime = opdi_get_time_ms();
+
+	// assemble the current block
+	if ((this->format == BINARY) && (this->blockRows > 0)) {
+		this->buffer.append(LOGGER_BINARY_BLOCK_MARKER);
+		appendLittleEndian(this->buffer, this->blockRows, 4);
+		this->buffer.append(this->blockTimestamps);
+		this->blockTimestamps.clear();
+		for (size_t i = 0; i < this->blockValues.size(); i++) {
+			this->buffer.append(this->blockValidity[i]);
+			this->buffer.append(this->blockValues[i]);
+			this->blockValidity[i].clear();
+			this->blockValues[i].clear();
+		}
+	}
+	this->blockRows = 0;
 
-	return OPDI_STATUS_OK;
+	if (this->buffer.empty())
+		return;
+
+	size_t size = this->buffer.size();
+	this->outFile.write(this->buffer.data(), size);
+	this->outFile.flush();
+	// on errors the data is lost; keeping it would let the buffer grow indefinitely
+	this->buffer.clear();
+	if (!this->outFile.good()) {
+		this->outFile.clear();
+		throw Poco::WriteFileException(this->ID() + ": Unable to write output log file", this->outFileStr);
+	}
+	this->fileSize += size;
+	this->writerFailed = false;
+}
+
+void LoggerPort::setWriterError(const std::string& message) {
+	Poco::Mutex::ScopedLock lock(this->writerErrorMutex);
+	this->writerError = message;
+	this->writerFailed = true;
+	this->writerErrorPending = true;
+}
+
+void LoggerPort::writeRecords(void) {
+	// this method runs on the writer thread; it must not log or access OPDID state
+	long waitTime = ((this->flushInterval > 0) && (this->flushInterval < 1000) ? this->flushInterval : 1000);
+	while (true) {
+		bool stopping = this->stopWriter;
+
+		size_t head = this->queueHead.load(std::memory_order_relaxed);
+		while (head != this->queueTail.load(std::memory_order_acquire)) {
+			try {
+				this->appendRecord(this->queue[head]);
+				if ((this->blockRows >= this->blockSize) || (this->buffer.size() >= LOGGER_MAX_CSV_BUFFER))
+					this->flushOutput();
+			} catch (Poco::Exception& e) {
+				this->setWriterError(e.displayText());
+			} catch (std::exception& e) {
+				this->setWriterError(e.what());
+			}
+			// release the slot
+			head = (head + 1) % this->queue.size();
+			this->queueHead.store(head, std::memory_order_release);
+		}
+
+		try {
+			uint64_t now = opdi_get_time_ms();
+			if (stopping || (now - this->lastFlushTime >= this->flushInterval))
+				this->flushOutput();
+			if (!stopping && (((this->maxFileSize > 0) && (this->fileSize >= this->maxFileSize))
+				|| ((this->rotationInterval > 0) && (now - this->fileOpenTime >= (uint64_t)this->rotationInterval * 1000))))
+				this->rotateOutput();
+		} catch (Poco::Exception& e) {
+			this->setWriterError(e.displayText());
+		} catch (std::exception& e) {
+			this->setWriterError(e.what());
+		}
+
+		if (stopping)
+			break;
+		this->writerEvent.tryWait(waitTime);
+	}
+	this->outFile.close();
+}
+
+void LoggerPort::stopWriterThread(void) {
+	if (!this->writerThread.isRunning())
+		return;
+	this->stopWriter = true;
+	this->writerEvent.set();
+	this->writerThread.join();
 }
 
 void LoggerPort::configure(Poco::Util::AbstractConfiguration* config) {
@@ -777,18 +1312,42 @@ void LoggerPort::configure(Poco::Util::AbstractConfiguration* config) {
 	this->separator = config->getString("Separator", this->separator);
 
 	std::string formatStr = config->getString("Format", "CSV");
-	if (formatStr != "CSV")
-		throw Poco::DataException(this->ID() + ": Formats other than CSV are currently not supported");
-
-	std::string outFileStr = config->getString("OutputFile", "");
-	if (outFileStr != "") {
+	if (formatStr == "CSV")
+		this->format = CSV;
+	else if (formatStr == "Binary")
+		this->format = BINARY;
+	else
+		throw Poco::DataException(this->ID() + ": Format must be either 'CSV' or 'Binary': " + formatStr);
+
+	int flushInterval = config->getInt("FlushInterval", this->flushInterval);
+	if (flushInterval < 0)
+		throw Poco::DataException(this->ID() + ": FlushInterval may not be negative: " + this->to_string(flushInterval));
+	this->flushInterval = flushInterval;
+	int blockSize = config->getInt("BlockSize", this->blockSize);
+	if (blockSize < 1)
+		throw Poco::DataException(this->ID() + ": BlockSize must be greater than 0: " + this->to_string(blockSize));
+	this->blockSize = blockSize;
+	int queueSize = config->getInt("QueueSize", this->queueSize);
+	if (queueSize < 1)
+		throw Poco::DataException(this->ID() + ": QueueSize must be greater than 0: " + this->to_string(queueSize));
+	this->queueSize = queueSize;
+
+	int maxFileSize = config->getInt("MaxFileSize", 0);
+	if (maxFileSize < 0)
+		throw Poco::DataException(this->ID() + ": MaxFileSize may not be negative: " + this->to_string(maxFileSize));
+	this->maxFileSize = maxFileSize;
+	int rotationInterval = config->getInt("RotationInterval", this->rotationInterval);
+	if (rotationInterval < 0)
+		throw Poco::DataException(this->ID() + ": RotationInterval may not be negative: " + this->to_string(rotationInterval));
+	this->rotationInterval = rotationInterval;
+	this->maxRotatedFiles = config->getInt("MaxRotatedFiles", this->maxRotatedFiles);
+	if (this->maxRotatedFiles < 0)
+		throw Poco::DataException(this->ID() + ": MaxRotatedFiles may not be negative: " + this->to_string(this->maxRotatedFiles));
+
+	this->outFileStr = config->getString("OutputFile", "");
+	if (this->outFileStr != "") {
 		// try to lock the output file name as a resource
-		this->opdid->lockResource(outFileStr, this->getID());
-
-		this->logVerbose("Opening output log file " + outFileStr);
-
-		// open the stream in append mode
-		this->outFile.open(outFileStr, std::ios_base::app);
+		this->opdid->lockResource(this->outFileStr, this->getID());
 	} else
 		throw Poco::DataException(this->ID() + ": The OutputFile setting must be specified");
 
@@ -811,7 +1370,7 @@ int LoggerPort::read(char* /*result*/) {
 }
 
 bool LoggerPort::hasError(void) const {
-	return false;
+	return this->writerFailed;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1054,6 +1613,10 @@ SceneSelectPort::SceneSelectPort(AbstractOPDID* opdid, const char* id) : opdi::S
 }
 
 SceneSelectPort::~SceneSelectPort() {
+	if (this->opdid->fileWatcher != nullptr) {
+		for (auto it = this->fileList.begin(), ite = this->fileList.end(); it != ite; ++it)
+			this->opdid->fileWatcher->removeWatch(*it, this);
+	}
 }
 
 void SceneSelectPort::configure(Poco::Util::AbstractConfiguration* config, Poco::Util::AbstractConfiguration* parentConfig) {
@@ -1114,9 +1677,10 @@ void SceneSelectPort::prepare() {
 	this->logDebug("Preparing port");
 	opdi::SelectPort::prepare();
 
-	// check files
+	// check and parse files
+	this->scenes.clear();
 	auto fi = this->fileList.begin();
-	auto fie = this->fileList.begin();
+	auto fie = this->fileList.end();
 	while (fi != fie) {
 		std::string sceneFile = *fi;
 
@@ -1136,78 +1700,108 @@ void SceneSelectPort::prepare() {
 		// store absolute scene file path
 		*fi = sceneFile;
 
+		this->scenes.push_back(this->parseScene(sceneFile));
+
+		// parse the file again if it changes
+		this->opdid->fileWatcher->addWatch(sceneFile, this);
+
 		++fi;
 	}
 }
 
-uint8_t SceneSelectPort::doWork(uint8_t canSend)  {
-	opdi::SelectPort::doWork(canSend);
+SceneSelectPort::Scene SceneSelectPort::parseScene(const std::string& sceneFile) {
+	Scene scene;
 
-	// position changed?
-	if (this->positionSet) {
-		this->logVerbose(std::string("Scene selected: ") + this->getPositionLabel(this->position));
+	// prepare scene file parameters (environment, ports, ...)
+	std::map<std::string, std::string> parameters;
+	this->opdid->getEnvironment(parameters);
+
+	if (this->logVerbosity >= opdi::LogVerbosity::DEBUG) {
+		this->logDebug("Scene file parameters:");
+		auto it = parameters.begin();
+		auto ite = parameters.end();
+		while (it != ite) {
+			this->logDebug("  " + (*it).first + " = " + (*it).second);
+			++it;
+		}
+	}
 
-		std::string sceneFile = this->fileList[this->position];
+	// open the config file
+	OPDIDConfigurationFile config(sceneFile, parameters);
 
-		// prepare scene file parameters (environment, ports, ...)
-		std::map<std::string, std::string> parameters;
-		this->opdid->getEnvironment(parameters);
+	// go through sections of the scene file
+	Poco::Util::AbstractConfiguration::Keys sectionKeys;
+	config.keys("", sectionKeys);
 
-		if (this->logVerbosity >= opdi::LogVerbosity::DEBUG) {
-			this->logDebug("Scene file parameters:");
-			auto it = parameters.begin();
-			auto ite = parameters.end();
-			while (it != ite) {
-				this->logDebug("  " + (*it).first + " = " + (*it).second);
-				++it;
+	if (sectionKeys.size() == 0)
+		this->logWarning("Scene file " + sceneFile + " does not contain any scene information, is this intended?");
+	else
+		this->logDebug("Parsing scene file: " + sceneFile);
+
+	for (auto it = sectionKeys.begin(), ite = sectionKeys.end(); it != ite; ++it) {
+		// find port corresponding to this section
+		opdi::Port* port = this->opdid->findPortByID((*it).c_str());
+		if (port == nullptr) {
+			this->logWarning("In scene file " + sceneFile + ": Port with ID " + (*it) + " not present in current configuration");
+			continue;
+		}
+
+		Poco::AutoPtr<Poco::Util::AbstractConfiguration> portConfig = config.createView(*it);
+
+		// only the state of the port is specified - not the general setup
+		AbstractOPDID::PortState state;
+		try {
+			if (!this->opdid->parsePortState(portConfig, port, state)) {
+				this->logWarning("In scene file " + sceneFile + ": Port with ID " + (*it) + " has an unknown type");
+				continue;
 			}
+		} catch (Poco::Exception &e) {
+			throw Poco::DataException("In scene file " + sceneFile + ": Error in settings for port " + (*it) + ": " + e.message());
 		}
 
-		// open the config file
-		OPDIDConfigurationFile config(sceneFile, parameters);
+		scene.push_back(state);
+	}
 
-		// go through sections of the scene file
-		Poco::Util::AbstractConfiguration::Keys sectionKeys;
-		config.keys("", sectionKeys);
+	return scene;
+}
 
-		if (sectionKeys.size() == 0)
-			this->logWarning("Scene file " + sceneFile + " does not contain any scene information, is this intended?");
-		else
-			this->logDebug("Applying settings from scene file: " + sceneFile);
+void SceneSelectPort::applyScene(const Scene& scene) {
+	// all values have been validated when the scene was parsed
+	for (auto it = scene.begin(), ite = scene.end(); it != ite; ++it) {
+		this->logDebug("Applying settings to port: " + it->port->ID());
+		try {
+			this->opdid->applyPortState(*it);
+		} catch (Poco::Exception &e) {
+			this->logWarning("Error applying scene settings to port " + it->port->ID() + ": " + e.message());
+		}
+	}
+}
 
-		for (auto it = sectionKeys.begin(), ite = sectionKeys.end(); it != ite; ++it) {
-			// find port corresponding to this section
-			opdi::Port* port = this->opdid->findPortByID((*it).c_str());
-			if (port == nullptr)
-				this->logWarning("In scene file " + sceneFile + ": Port with ID " + (*it) + " not present in current configuration");
-			else {
-				this->logDebug("Applying settings to port: " + *it);
-
-				// configure port according to settings 
-				Poco::AutoPtr<Poco::Util::AbstractConfiguration> portConfig = config.createView(*it);
-
-				// configure only state - not the general setup
-				try {
-					if (port->getType()[0] == OPDI_PORTTYPE_DIGITAL[0]) {
-						this->opdid->configureDigitalPort(portConfig, (opdi::DigitalPort*)port, true);
-					} else
-					if (port->getType()[0] == OPDI_PORTTYPE_ANALOG[0]) {
-						this->opdid->configureAnalogPort(portConfig, (opdi::AnalogPort*)port, true);
-					} else
-					if (port->getType()[0] == OPDI_PORTTYPE_SELECT[0]) {
-						this->opdid->configureSelectPort(portConfig, &config, (opdi::SelectPort*)port, true);
-					} else
-					if (port->getType()[0] == OPDI_PORTTYPE_DIAL[0]) {
-						this->opdid->configureDialPort(portConfig, (opdi::DialPort*)port, true);
-					} else
-						this->logWarning("In scene file " + sceneFile + ": Port with ID " + (*it) + " has an unknown type");
-				} catch (Poco::Exception &e) {
-					this->logWarning("In scene file " + sceneFile + ": Error configuring port " + (*it) + ": " + e.message());
-				}
-			}
+void SceneSelectPort::fileChanged(const std::string& path) {
+	for (size_t i = 0; i < this->fileList.size(); i++) {
+		if (this->fileList[i] != path)
+			continue;
+		this->logVerbose("Scene file has changed, parsing it again: " + path);
+		// keep the previous version of the scene if the file is invalid
+		try {
+			this->scenes[i] = this->parseScene(path);
+		} catch (Poco::Exception &e) {
+			this->logWarning("Unable to parse the changed scene file " + path + ", keeping the previous version: " + e.message());
 		}
+	}
+}
+
+uint8_t SceneSelectPort::doWork(uint8_t canSend)  {
+	opdi::SelectPort::doWork(canSend);
+
+	// position changed?
+	if (this->positionSet) {
+		this->logVerbose(std::string("Scene selected: ") + this->getPositionLabel(this->position));
 
-		// refresh all ports of a connected master
+		if (this->position < this->scenes.size())
+			this->applyScene(this->scenes[this->position]);
+
+		// refresh all ports of a connected master (this replaces the refreshes of the individual ports)
 		this->opdid->refresh(nullptr);
 
 		this->positionSet = false;
@@ -1231,8 +1825,6 @@ uint8_t FilePort::doWork(uint8_t canSend) {
 	if (result != OPDI_STATUS_OK)
 		return result;
 
-	Poco::Mutex::ScopedLock(this->mutex);
-
 	// expiry time over?
 	if ((this->expiryMs > 0) && (this->lastReloadTime > 0) && (opdi_get_time_ms() - lastReloadTime > (uint64_t)this->expiryMs)) {
 		// only if the port's value is ok
@@ -1248,121 +1840,131 @@ uint8_t FilePort::doWork(uint8_t canSend) {
 		return OPDI_STATUS_OK;
 	}
 
+	// a reload has been deferred (initial load or reload delay)?
+	if (this->needsReload && this->isReloadDue())
+		this->reload();
+
+	return OPDI_STATUS_OK;
+}
+
+bool FilePort::isReloadDue(void) {
 	// if a delay is specified, ignore reloads until it's up
-	if ((this->reloadDelayMs > 0) && (this->lastReloadTime > 0) && (opdi_get_time_ms() - lastReloadTime < (uint64_t)this->reloadDelayMs))
-		return OPDI_STATUS_OK;
+	return (this->reloadDelayMs == 0) || (this->lastReloadTime == 0) || (opdi_get_time_ms() - lastReloadTime >= (uint64_t)this->reloadDelayMs);
+}
 
-	if (this->needsReload) {
-		this->logDebug("Reloading file: " + this->filePath);
+void FilePort::fileChanged(const std::string& /*path*/) {
+	// called by the file watcher on the main thread
+	if (this->line == 0)
+		return;
 
-		this->lastReloadTime = opdi_get_time_ms();
+	this->logDebug("Detected file modification: " + this->filePath);
 
-		this->needsReload = false;
+	if (this->isReloadDue())
+		this->reload();
+	else
+		// reload in doWork when the delay is up
+		this->needsReload = true;
+}
 
-		// read file and parse content
-		try {
-			std::string content;
-			Poco::FileInputStream fis(this->filePath);
-			fis >> content;
-			fis.close();
-
-			content = Poco::trim(content);
-			if (content == "")
-				// This case may happen frequently when files are copied.
-				// Apparently, on Linux, cp clears the file first or perhaps
-				// creates an empty file before filling it with content.
-				// To avoid generating too many log warnings, this case
-				// is being silently ignored.
-				// When the file is being modified, the DirectoryWatcher will
-				// hopefully catch this change so data is not lost.
-				// So, instead of:
-				// throw Poco::DataFormatException("File is empty");
-				// do:
-				return OPDI_STATUS_OK;
+void FilePort::reload(void) {
+	this->logDebug("Reloading file: " + this->filePath);
 
-			switch (this->portType) {
-			case DIGITAL_PORT: {
-				uint8_t line;
-				if (content == "0")
-					line = 0;
-				else
-				if (content == "1")
-					line = 1;
-				else {
-					std::string errorContent = (content.length() > 50 ? content.substr(0, 50) + "..." : content);
-					throw Poco::DataFormatException("Expected '0' or '1' but got: " + errorContent);
-				}
-				this->logDebug("Setting line of digital port '" + this->valuePort->ID() + "' to " + this->to_string((int)line));
-				((opdi::DigitalPort*)this->valuePort)->setLine(line);
-				break;
-			}
-			case ANALOG_PORT: {
-				double value;
-				if (!Poco::NumberParser::tryParseFloat(content, value) || (value < 0) || (value > 1)) {
-					std::string errorContent = (content.length() > 50 ? content.substr(0, 50) + "..." : content);
-					throw Poco::DataFormatException("Expected decimal value between 0 and 1 but got: " + errorContent);
-				}
-				value = value * this->numerator / this->denominator;
-				this->logDebug("Setting value of analog port '" + this->valuePort->ID() + "' to " + this->to_string(value));
-				((opdi::AnalogPort*)this->valuePort)->setRelativeValue(value);
-				break;
+	this->lastReloadTime = opdi_get_time_ms();
+
+	this->needsReload = false;
+
+	// read file and parse content
+	try {
+		std::string content;
+		Poco::FileInputStream fis(this->filePath);
+		fis >> content;
+		fis.close();
+
+		content = Poco::trim(content);
+		if (content == "")
+			// This case may happen frequently when files are copied.
+			// Apparently, on Linux, cp clears the file first or perhaps
+			// creates an empty file before filling it with content.
+			// To avoid generating too many log warnings, this case
+			// is being silently ignored.
+			// When the file is being modified, the file watcher will
+			// hopefully catch this change so data is not lost.
+			// So, instead of:
+			// throw Poco::DataFormatException("File is empty");
+			// do:
+			return;
+
+		switch (this->portType) {
+		case DIGITAL_PORT: {
+			uint8_t line;
+			if (content == "0")
+				line = 0;
+			else
+			if (content == "1")
+				line = 1;
+			else {
+				std::string errorContent = (content.length() > 50 ? content.substr(0, 50) + "..." : content);
+				throw Poco::DataFormatException("Expected '0' or '1' but got: " + errorContent);
 			}
-			case DIAL_PORT: {
-				int64_t value;
-				int64_t min = ((opdi::DialPort*)this->valuePort)->getMin();
-				int64_t max = ((opdi::DialPort*)this->valuePort)->getMax();
-				if (!Poco::NumberParser::tryParse64(content, value)) {
-					std::string errorContent = (content.length() > 50 ? content.substr(0, 50) + "..." : content);
-					throw Poco::DataFormatException("Expected integer value but got: " + errorContent);
-				}
-				value = value * this->numerator / this->denominator;
-				if ((value < min) || (value > max)) {
-					std::string errorContent = (content.length() > 50 ? content.substr(0, 50) + "..." : content);
-					throw Poco::DataFormatException("Expected integer value between " + this->to_string(min) + " and " + this->to_string(max) + " but got: " + errorContent);
-				}
-				this->logDebug("Setting position of dial port '" + this->valuePort->ID() + "' to " + this->to_string(value));
-				((opdi::DialPort*)this->valuePort)->setPosition(value);
-				break;
+			this->logDebug("Setting line of digital port '" + this->valuePort->ID() + "' to " + this->to_string((int)line));
+			((opdi::DigitalPort*)this->valuePort)->setLine(line);
+			break;
+		}
+		case ANALOG_PORT: {
+			double value;
+			if (!Poco::NumberParser::tryParseFloat(content, value) || (value < 0) || (value > 1)) {
+				std::string errorContent = (content.length() > 50 ? content.substr(0, 50) + "..." : content);
+				throw Poco::DataFormatException("Expected decimal value between 0 and 1 but got: " + errorContent);
 			}
-			case SELECT_PORT: {
-				int32_t value;
-				uint16_t min = 0;
-				uint16_t max = ((opdi::SelectPort*)this->valuePort)->getMaxPosition();
-				if (!Poco::NumberParser::tryParse(content, value) || (value < min) || (value > max)) {
-					std::string errorContent = (content.length() > 50 ? content.substr(0, 50) + "..." : content);
-					throw Poco::DataFormatException("Expected integer value between " + this->to_string(min) + " and " + this->to_string(max) + " but got: " + errorContent);
-				}
-				this->logDebug("Setting position of select port '" + this->valuePort->ID() + "' to " + this->to_string(value));
-				((opdi::SelectPort*)this->valuePort)->setPosition(value);
-				break;
+			value = value * this->numerator / this->denominator;
+			this->logDebug("Setting value of analog port '" + this->valuePort->ID() + "' to " + this->to_string(value));
+			((opdi::AnalogPort*)this->valuePort)->setRelativeValue(value);
+			break;
+		}
+		case DIAL_PORT: {
+			int64_t value;
+			int64_t min = ((opdi::DialPort*)this->valuePort)->getMin();
+			int64_t max = ((opdi::DialPort*)this->valuePort)->getMax();
+			if (!Poco::NumberParser::tryParse64(content, value)) {
+				std::string errorContent = (content.length() > 50 ? content.substr(0, 50) + "..." : content);
+				throw Poco::DataFormatException("Expected integer value but got: " + errorContent);
 			}
-			default:
-				throw Poco::ApplicationException("Port type is unknown or not supported");
+			value = value * this->numerator / this->denominator;
+			if ((value < min) || (value > max)) {
+				std::string errorContent = (content.length() > 50 ? content.substr(0, 50) + "..." : content);
+				throw Poco::DataFormatException("Expected integer value between " + this->to_string(min) + " and " + this->to_string(max) + " but got: " + errorContent);
 			}
-		} catch (Poco::Exception &e) {
-			this->logWarning("Error setting port state from file '" + this->filePath + "': " + e.message());
+			this->logDebug("Setting position of dial port '" + this->valuePort->ID() + "' to " + this->to_string(value));
+			((opdi::DialPort*)this->valuePort)->setPosition(value);
+			break;
 		}
-		if (this->deleteAfterRead) {
-			Poco::File file(this->filePath);
-			try {
-				this->logDebug("Trying to delete file: " + this->filePath);
-				file.remove();
-			}
-			catch (Poco::Exception &e) {
-				this->logWarning("Unable to delete file '" + this->filePath + "': " + e.message());
+		case SELECT_PORT: {
+			int32_t value;
+			uint16_t min = 0;
+			uint16_t max = ((opdi::SelectPort*)this->valuePort)->getMaxPosition();
+			if (!Poco::NumberParser::tryParse(content, value) || (value < min) || (value > max)) {
+				std::string errorContent = (content.length() > 50 ? content.substr(0, 50) + "..." : content);
+				throw Poco::DataFormatException("Expected integer value between " + this->to_string(min) + " and " + this->to_string(max) + " but got: " + errorContent);
 			}
+			this->logDebug("Setting position of select port '" + this->valuePort->ID() + "' to " + this->to_string(value));
+			((opdi::SelectPort*)this->valuePort)->setPosition(value);
+			break;
 		}
+		default:
+			throw Poco::ApplicationException("Port type is unknown or not supported");
+		}
+	} catch (Poco::Exception &e) {
+		this->logWarning("Error setting port state from file '" + this->filePath + "': " + e.message());
 	}
-
-	return OPDI_STATUS_OK;
-}
-
-void FilePort::fileChangedEvent(const void*, const Poco::DirectoryWatcher::DirectoryEvent& evt) {
-	if (evt.item.path() == this->filePath) {
-		this->logDebug("Detected file modification: " + this->filePath);
-		
-		Poco::Mutex::ScopedLock(this->mutex);
-		this->needsReload = true;
+	if (this->deleteAfterRead) {
+		Poco::File file(this->filePath);
+		try {
+			this->logDebug("Trying to delete file: " + this->filePath);
+			file.remove();
+		}
+		catch (Poco::Exception &e) {
+			this->logWarning("Unable to delete file '" + this->filePath + "': " + e.message());
+		}
 	}
 }
 
@@ -1420,7 +2022,6 @@ void FilePort::writeContent() {
 
 FilePort::FilePort(AbstractOPDID* opdid, const char* id) : opdi::DigitalPort(id) {
 	this->opdid = opdid;
-	this->directoryWatcher = nullptr;
 	this->reloadDelayMs = 0;
 	this->expiryMs = 0;
 	this->deleteAfterRead = false;
@@ -1438,8 +2039,8 @@ FilePort::FilePort(AbstractOPDID* opdid, const char* id) : opdi::DigitalPort(id)
 }
 
 FilePort::~FilePort() {
-	if (this->directoryWatcher != nullptr)
-		delete this->directoryWatcher;
+	if (!this->filePath.empty() && (this->opdid->fileWatcher != nullptr))
+		this->opdid->fileWatcher->removeWatch(this->filePath, this);
 }
 
 void FilePort::configure(Poco::Util::AbstractConfiguration* config, Poco::Util::AbstractConfiguration* parentConfig) {
@@ -1522,14 +2123,9 @@ void FilePort::configure(Poco::Util::AbstractConfiguration* config, Poco::Util::
 	this->filePath = absPath.toString();
 	this->directory = absPath.parent();
 
-	this->logDebug("Preparing DirectoryWatcher for folder '" + this->directory.path() + "'");
+	this->logDebug("Watching file '" + this->filePath + "'");
 
-	this->directoryWatcher = new Poco::DirectoryWatcher(this->directory, 
-			Poco::DirectoryWatcher::DW_ITEM_MODIFIED | Poco::DirectoryWatcher::DW_ITEM_ADDED | Poco::DirectoryWatcher::DW_ITEM_MOVED_TO, 
-			Poco::DirectoryWatcher::DW_DEFAULT_SCAN_INTERVAL);
-	this->directoryWatcher->itemModified += Poco::delegate(this, &FilePort::fileChangedEvent);
-	this->directoryWatcher->itemAdded += Poco::delegate(this, &FilePort::fileChangedEvent);
-	this->directoryWatcher->itemMovedTo += Poco::delegate(this, &FilePort::fileChangedEvent);
+	this->opdid->fileWatcher->addWatch(this->filePath, this);
 
 	// can the file be loaded initially?
 	Poco::File file(this->filePath);
@@ -1557,6 +2153,109 @@ void FilePort::configure(Poco::Util::AbstractConfiguration* config, Poco::Util::
 // AggregatorPort
 ///////////////////////////////////////////////////////////////////////////////
 
+AggregatorPort::ValueBuffer::ValueBuffer() {
+	this->head = 0;
+	this->count = 0;
+	this->sequence = 0;
+	this->valueSum = 0;
+}
+
+void AggregatorPort::ValueBuffer::setCapacity(size_t capacity) {
+	this->buffer.assign(capacity, 0);
+	this->clear();
+}
+
+size_t AggregatorPort::ValueBuffer::capacity(void) const {
+	return this->buffer.size();
+}
+
+size_t AggregatorPort::ValueBuffer::size(void) const {
+	return this->count;
+}
+
+bool AggregatorPort::ValueBuffer::empty(void) const {
+	return this->count == 0;
+}
+
+void AggregatorPort::ValueBuffer::clear(void) {
+	this->head = 0;
+	this->count = 0;
+	this->valueSum = 0;
+	this->minQueue.clear();
+	this->maxQueue.clear();
+}
+
+void AggregatorPort::ValueBuffer::push_back(int64_t value) {
+	if (this->buffer.empty())
+		throw Poco::InvalidAccessException("Aggregator value buffer has no capacity (programming error)");
+
+	size_t capacity = this->buffer.size();
+	// buffer full? drop the oldest value
+	if (this->count == capacity) {
+		this->valueSum -= this->buffer[this->head];
+		this->head = (this->head + 1) % capacity;
+		--this->count;
+	}
+	this->buffer[(this->head + this->count) % capacity] = value;
+	++this->count;
+	this->valueSum += value;
+
+	uint64_t seq = this->sequence++;
+	// the oldest valid sequence number after this insertion
+	uint64_t oldest = this->sequence - this->count;
+
+	// maintain the monotonic queues; values that can never become the minimum
+	// (or maximum) again are removed from the back, expired values from the front
+	while (!this->minQueue.empty() && (this->minQueue.back().second >= value))
+		this->minQueue.pop_back();
+	this->minQueue.push_back(SequencedValue(seq, value));
+	while (this->minQueue.front().first < oldest)
+		this->minQueue.pop_front();
+
+	while (!this->maxQueue.empty() && (this->maxQueue.back().second <= value))
+		this->maxQueue.pop_back();
+	this->maxQueue.push_back(SequencedValue(seq, value));
+	while (this->maxQueue.front().first < oldest)
+		this->maxQueue.pop_front();
+}
+
+int64_t AggregatorPort::ValueBuffer::at(size_t index) const {
+	if (index >= this->count)
+		throw Poco::RangeException("Aggregator value index out of range");
+	return this->buffer[(this->head + index) % this->buffer.size()];
+}
+
+int64_t AggregatorPort::ValueBuffer::front(void) const {
+	return this->at(0);
+}
+
+int64_t AggregatorPort::ValueBuffer::back(void) const {
+	return this->at(this->count - 1);
+}
+
+int64_t AggregatorPort::ValueBuffer::sum(void) const {
+	return this->valueSum;
+}
+
+int64_t AggregatorPort::ValueBuffer::min(void) const {
+	if (this->minQueue.empty())
+		throw Poco::RangeException("No aggregator values available");
+	return this->minQueue.front().second;
+}
+
+int64_t AggregatorPort::ValueBuffer::max(void) const {
+	if (this->maxQueue.empty())
+		throw Poco::RangeException("No aggregator values available");
+	return this->maxQueue.front().second;
+}
+
+void AggregatorPort::ValueBuffer::copyTo(std::vector<int64_t>& target) const {
+	target.resize(this->count);
+	size_t capacity = this->buffer.size();
+	for (size_t i = 0; i < this->count; i++)
+		target[i] = this->buffer[(this->head + i) % capacity];
+}
+
 AggregatorPort::Calculation::Calculation(std::string id) : opdi::DialPort(id.c_str()) {
 	this->algorithm = UNKNOWN;
 	this->allowIncomplete = false;
@@ -1566,15 +2265,17 @@ void AggregatorPort::Calculation::calculate(AggregatorPort* aggregator) {
 	aggregator->logExtreme("Calculating new value");
 	if ((aggregator->values.size() < aggregator->totalValues) && !this->allowIncomplete)
 		aggregator->logDebug("Cannot compute result because not all values have been collected and AllowIncomplete is false");
+	else
+	if (aggregator->values.empty())
+		this->setError(Error::VALUE_NOT_AVAILABLE);
 	else {
-		// copy values, multiply if necessary
-		std::vector<int64_t> values = aggregator->values;
-		if (aggregator->multiplier != 1) {
-			std::transform(values.begin(), values.end(), values.begin(), std::bind1st(std::multiplies<int64_t>(), aggregator->multiplier));
-		}
+		// the statistics are maintained by the value buffer; apply the multiplier to the results
+		// (a negative multiplier swaps minimum and maximum)
+		const ValueBuffer& values = aggregator->values;
+		int64_t multiplier = aggregator->multiplier;
 		switch (this->algorithm) {
 		case DELTA: {
-			int64_t newValue = values.at(values.size() - 1) - values.at(0);
+			int64_t newValue = values.back() * multiplier - values.front() * multiplier;
 			aggregator->logDebug(std::string() + "New value according to Delta algorithm: " + this->to_string(newValue));
 			if ((newValue >= this->getMin()) && (newValue <= this->getMax()))
 				this->setPosition(newValue);
@@ -1583,8 +2284,8 @@ void AggregatorPort::Calculation::calculate(AggregatorPort* aggregator) {
 			break;
 		}
 		case ARITHMETIC_MEAN: {
-			int64_t sum = std::accumulate(values.begin(), values.end(), (int64_t)0);
-			int64_t mean = sum / values.size();
+			int64_t sum = values.sum() * multiplier;
+			int64_t mean = sum / (int64_t)values.size();
 			aggregator->logDebug(std::string() + "New value according to ArithmeticMean algorithm: " + this->to_string(mean));
 			if ((mean >= this->getMin()) && (mean <= this->getMax()))
 				this->setPosition(mean);
@@ -1593,10 +2294,7 @@ void AggregatorPort::Calculation::calculate(AggregatorPort* aggregator) {
 			break;
 		}
 		case MINIMUM: {
-			auto minimum = std::min_element(values.begin(), values.end());
-			if (minimum == values.end())
-				this->setError(Error::VALUE_NOT_AVAILABLE);
-			int64_t min = *minimum;
+			int64_t min = (multiplier >= 0 ? values.min() : values.max()) * multiplier;
 			aggregator->logDebug(std::string() + "New value according to Minimum algorithm: " + this->to_string(min));
 			if ((min >= this->getMin()) && (min <= this->getMax()))
 				this->setPosition(min);
@@ -1605,10 +2303,7 @@ void AggregatorPort::Calculation::calculate(AggregatorPort* aggregator) {
 			break;
 		}
 		case MAXIMUM: {
-			auto maximum = std::max_element(values.begin(), values.end());
-			if (maximum == values.end())
-				this->setError(Error::VALUE_NOT_AVAILABLE);
-			int64_t max = *maximum;
+			int64_t max = (multiplier >= 0 ? values.max() : values.min()) * multiplier;
 			aggregator->logDebug(std::string() + "New value according to Maximum algorithm: " + this->to_string(max));
 			if ((max >= this->getMin()) && (max <= this->getMax()))
 				this->setPosition(max);
@@ -1624,6 +2319,206 @@ void AggregatorPort::Calculation::calculate(AggregatorPort* aggregator) {
 
 // AggregatorPort class implementation
 
+// binary snapshot file layout (all numbers little endian):
+// offset 0: magic "OPDA", offset 4: format version, offset 8: 64 bit timestamp,
+// offset 16: 32 bit number of records, offset 20: records.
+// Each record is the zigzag varint encoded difference to the previous value
+// (the first record is relative to 0). New values are appended as records and
+// the header is updated in place; the file is compacted when it grows too large.
+// Bytes after the number of records (left by an interrupted append) are ignored
+// and overwritten by the next append.
+#define AGGREGATOR_SNAPSHOT_MAGIC		"OPDA"
+#define AGGREGATOR_SNAPSHOT_VERSION		1
+#define AGGREGATOR_SNAPSHOT_TIME_OFFSET	8
+#define AGGREGATOR_SNAPSHOT_COUNT_OFFSET	16
+#define AGGREGATOR_SNAPSHOT_HEADER_SIZE	20
+
+static void appendVarint(std::string& data, int64_t value) {
+	// zigzag encoding maps small negative and positive numbers to small unsigned numbers
+	uint64_t v = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+	while (v >= 0x80) {
+		data.push_back((char)((v & 0x7f) | 0x80));
+		v >>= 7;
+	}
+	data.push_back((char)v);
+}
+
+static bool readVarint(const std::string& data, size_t& pos, int64_t& value) {
+	uint64_t v = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (pos >= data.size())
+			return false;
+		uint8_t b = (uint8_t)data[pos++];
+		v |= (uint64_t)(b & 0x7f) << shift;
+		if ((b & 0x80) == 0) {
+			value = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+void AggregatorPort::writeSnapshot() {
+	std::string data(AGGREGATOR_SNAPSHOT_MAGIC);
+	appendLittleEndian(data, AGGREGATOR_SNAPSHOT_VERSION, 4);
+	appendLittleEndian(data, opdi_get_time_ms(), 8);
+	appendLittleEndian(data, this->values.size(), 4);
+	uint64_t last = 0;
+	for (size_t i = 0; i < this->values.size(); i++) {
+		uint64_t value = (uint64_t)this->values.at(i);
+		appendVarint(data, (int64_t)(value - last));
+		last = value;
+	}
+
+	// write to a temporary file first to avoid losing the snapshot in case of errors
+	std::string tempFile = this->snapshotFile + ".tmp";
+	Poco::FileOutputStream fos(tempFile, std::ios::out | std::ios::trunc | std::ios::binary);
+	fos.write(data.c_str(), data.size());
+	fos.close();
+	if (!fos.good())
+		throw Poco::WriteFileException("Unable to write aggregator snapshot file", tempFile);
+	Poco::File(tempFile).renameTo(this->snapshotFile);
+
+	this->snapshotRecords = this->values.size();
+	this->snapshotSize = data.size();
+	this->lastPersistedValue = this->values.back();
+	this->unpersistedValues = 0;
+	this->logExtreme("Aggregator snapshot written: " + this->snapshotFile);
+}
+
+void AggregatorPort::appendSnapshot() {
+	std::string data;
+	uint64_t last = (uint64_t)this->lastPersistedValue;
+	for (size_t i = this->values.size() - this->unpersistedValues; i < this->values.size(); i++) {
+		uint64_t value = (uint64_t)this->values.at(i);
+		appendVarint(data, (int64_t)(value - last));
+		last = value;
+	}
+	std::string header;
+	appendLittleEndian(header, opdi_get_time_ms(), 8);
+	appendLittleEndian(header, this->snapshotRecords + this->unpersistedValues, 4);
+
+	// write the records after the valid ones first; the header is updated afterwards so that
+	// an interrupted write leaves a consistent (if slightly outdated) snapshot. Records of an
+	// earlier interrupted write that follow the valid records are overwritten.
+	Poco::FileStream fs(this->snapshotFile, std::ios::in | std::ios::out | std::ios::binary);
+	fs.seekp(this->snapshotSize, std::ios::beg);
+	fs.write(data.c_str(), data.size());
+	fs.seekp(AGGREGATOR_SNAPSHOT_TIME_OFFSET, std::ios::beg);
+	fs.write(header.c_str(), header.size());
+	fs.close();
+	if (!fs.good())
+		throw Poco::WriteFileException("Unable to append to aggregator snapshot file", this->snapshotFile);
+
+	this->snapshotRecords += this->unpersistedValues;
+	this->snapshotSize += data.size();
+	this->lastPersistedValue = (int64_t)last;
+	this->unpersistedValues = 0;
+}
+
+void AggregatorPort::removeSnapshot() {
+	Poco::File file(this->snapshotFile);
+	if (file.exists())
+		file.remove();
+	this->snapshotRecords = 0;
+	this->unpersistedValues = 0;
+}
+
+bool AggregatorPort::readSnapshot() {
+	Poco::File file(this->snapshotFile);
+	if (!file.exists()) {
+		this->logVerbose("Persisted aggregator snapshot not found: " + this->snapshotFile);
+		return false;
+	}
+
+	std::string data;
+	Poco::FileInputStream fis(this->snapshotFile, std::ios::in | std::ios::binary);
+	data.assign(std::istreambuf_iterator<char>(fis), std::istreambuf_iterator<char>());
+	fis.close();
+
+	if ((data.size() < AGGREGATOR_SNAPSHOT_HEADER_SIZE) || (data.compare(0, 4, AGGREGATOR_SNAPSHOT_MAGIC) != 0)
+		|| (readLittleEndian(data, 4, 4) != AGGREGATOR_SNAPSHOT_VERSION)) {
+		this->logWarning("Ignoring invalid aggregator snapshot file: " + this->snapshotFile);
+		return false;
+	}
+
+	// timestamp acceptable? must be in the past and within the query interval
+	uint64_t persistTime = readLittleEndian(data, AGGREGATOR_SNAPSHOT_TIME_OFFSET, 8);
+	int64_t elapsed = opdi_get_time_ms() - persistTime;
+	if ((elapsed <= 0) || (elapsed >= this->queryInterval * 1000)) {
+		this->logVerbose("Persisted aggregator values outdated, timestamp was: " + to_string(persistTime));
+		return false;
+	}
+
+	uint32_t count = (uint32_t)readLittleEndian(data, AGGREGATOR_SNAPSHOT_COUNT_OFFSET, 4);
+	size_t pos = AGGREGATOR_SNAPSHOT_HEADER_SIZE;
+	uint64_t last = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		int64_t delta;
+		if (!readVarint(data, pos, delta)) {
+			// any error causes a reset and aborts processing
+			this->resetValues("The aggregator snapshot file is truncated: " + this->snapshotFile, opdi::LogVerbosity::NORMAL);
+			return false;
+		}
+		last += (uint64_t)delta;
+		// the buffer keeps only the most recent values
+		this->values.push_back((int64_t)last);
+	}
+
+	// remember persistent time as last query time
+	this->lastQueryTime = persistTime;
+	this->snapshotRecords = count;
+	this->snapshotSize = pos;
+	this->lastPersistedValue = (int64_t)last;
+	this->unpersistedValues = 0;
+	this->logVerbose("Total persisted aggregator values read: " + this->to_string(this->values.size()));
+	return true;
+}
+
+bool AggregatorPort::readLegacyValues() {
+	bool result = false;
+	// read timestamp
+	uint64_t persistTime = this->opdid->persistentConfig->getUInt64(this->ID() + ".Time", 0);
+	// timestamp acceptable? must be in the past and within the query interval
+	int64_t elapsed = opdi_get_time_ms() - persistTime;
+	if ((elapsed > 0) && (elapsed < this->queryInterval * 1000)) {
+		// remember persistent time as last query time
+		this->lastQueryTime = persistTime;
+		// read values
+		std::string persistedValues = this->opdid->persistentConfig->getString(this->ID() + ".Values", "");
+		// tokenize along commas
+		std::stringstream ss(persistedValues);
+		std::string item;
+		result = true;
+		while (std::getline(ss, item, ',')) {
+			// parse item and store it
+			try {
+				int64_t value = Poco::NumberParser::parse64(item);
+				this->values.push_back(value);
+			}
+			catch (Poco::Exception& e) {
+				// any error causes a reset and aborts processing
+				this->lastQueryTime = 0;
+				this->resetValues("An error occurred deserializing persisted values: " + e.message(), opdi::LogVerbosity::NORMAL);
+				result = false;
+				break;
+			}
+		}	// read values
+		this->logVerbose("Total persisted aggregator values read from persistent configuration: " + this->to_string(this->values.size()));
+	}	// timestamp valid
+	else
+		this->logVerbose("Persisted aggregator values outdated, timestamp was: " + to_string(persistTime));
+
+	// values are now stored in the snapshot file
+	this->opdid->removePersistentValue(this->ID() + ".Time");
+	this->opdid->removePersistentValue(this->ID() + ".Values");
+	if (result) {
+		this->unpersistedValues = this->values.size();
+		this->persist();
+	}
+	return result;
+}
+
 void AggregatorPort::persist() {
 	// update persistent storage?
 	if (this->isPersistent() && (this->opdid->persistentConfig != nullptr)) {
@@ -1632,35 +2527,27 @@ void AggregatorPort::persist() {
 				this->logVerbose("Trying to persist aggregator values on shutdown");
 			else
 				this->logDebug("Trying to persist aggregator values");
+			// rewrite the snapshot if there is none, if older values have been dropped
+			// before they could be appended, or if the file has grown too large
 			if (this->values.size() == 0) {
-				this->opdid->persistentConfig->remove(this->ID() + ".Time");
-				this->opdid->persistentConfig->remove(this->ID() + ".Values");
-			}
-			else {
-				// use current time as persistence timestamp
-				this->opdid->persistentConfig->setUInt64(this->ID() + ".Time", opdi_get_time_ms());
-				std::stringstream ss;
-				auto vit = this->values.cbegin();
-				auto vitb = this->values.cbegin();
-				auto vite = this->values.cend();
-				while (vit != vite) {
-					if (vit != vitb)
-						ss << ",";
-					ss << this->to_string(*vit);
-					++vit;
-				}
-				this->opdid->persistentConfig->setString(this->ID() + ".Values", ss.str());
+				this->removeSnapshot();
+			} else
+			if ((this->snapshotRecords == 0) || (this->unpersistedValues >= this->values.size())
+				|| (this->snapshotRecords + this->unpersistedValues > 2 * (size_t)this->totalValues)) {
+				this->writeSnapshot();
+			} else {
+				// append new values and update the timestamp (on shutdown, there may be no new values)
+				this->appendSnapshot();
 			}
-			// save configuration only if not already shutting down
-			// the config will be saved on shutdown automatically
-			if (!this->opdid->shutdownRequested)
-				this->opdid->savePersistentConfig();
 		}
 		catch (Poco::Exception& e) {
 			this->logWarning("Error persisting aggregator values: " + e.message());
+			// start over with a full snapshot
+			this->snapshotRecords = 0;
 		}
 		catch (std::exception& e) {
 			this->logWarning(std::string("Error persisting aggregator values: ") + e.what());
+			this->snapshotRecords = 0;
 		}
 	}
 }
@@ -1685,11 +2572,15 @@ void AggregatorPort::resetValues(std::string reason, opdi::LogVerbosity logVerbo
 		++it;
 	}
 	this->values.clear();
+	this->unpersistedValues = 0;
 	// remove values from persistent storage
 	if (clearPersistent && this->isPersistent() && (this->opdid->persistentConfig != nullptr)) {
-		this->opdid->persistentConfig->remove(this->ID() + ".Time");
-		this->opdid->persistentConfig->remove(this->ID() + ".Values");
-		this->opdid->savePersistentConfig();
+		try {
+			this->removeSnapshot();
+		}
+		catch (Poco::Exception& e) {
+			this->logWarning("Error removing aggregator snapshot: " + e.message());
+		}
 	}
 	// clear history of associated port
 	if (this->setHistory && this->historyPort != nullptr)
@@ -1715,36 +2606,10 @@ uint8_t AggregatorPort::doWork(uint8_t canSend) {
 		// try to read values from persistent storage?
 		if (this->isPersistent() && (this->opdid->persistentConfig != nullptr)) {
 			this->logVerbose("Trying to read persisted aggregator values with current time being " + this->to_string(opdi_get_time_ms()));
-			// read timestamp
-			uint64_t persistTime = this->opdid->persistentConfig->getUInt64(this->ID() + ".Time", 0);
-			// timestamp acceptable? must be in the past and within the query interval
-			int64_t elapsed = opdi_get_time_ms() - persistTime;
-			if ((elapsed > 0) && (elapsed < this->queryInterval * 1000)) {
-				// remember persistent time as last query time
-				this->lastQueryTime = persistTime;
-				// read values
-				std::string persistedValues = this->opdid->persistentConfig->getString(this->ID() + ".Values", "");
-				// tokenize along commas
-				std::stringstream ss(persistedValues);
-				std::string item;
-				while (std::getline(ss, item, ',')) {
-					// parse item and store it
-					try {
-						int64_t value = Poco::NumberParser::parse64(item);
-						this->values.push_back(value);
-					}
-					catch (Poco::Exception& e) {
-						// any error causes a reset and aborts processing
-						this->lastQueryTime = 0;
-						this->resetValues("An error occurred deserializing persisted values: " + e.message(), opdi::LogVerbosity::NORMAL);
-						break;
-					}
-				}	// read values
-				valuesAvailable = true;
-				this->logVerbose("Total persisted aggregator values read: " + this->to_string(this->values.size()));
-			}	// timestamp valid
-			else
-				this->logVerbose("Persisted aggregator values not found or outdated, timestamp was: " + to_string(persistTime));
+			valuesAvailable = this->readSnapshot();
+			// values persisted by an earlier version are migrated to the snapshot file
+			if (!valuesAvailable && this->opdid->persistentConfig->hasProperty(this->ID() + ".Values"))
+				valuesAvailable = this->readLegacyValues();
 		}	// persistence enabled
 	}
 
@@ -1765,7 +2630,7 @@ uint8_t AggregatorPort::doWork(uint8_t canSend) {
 			if ((this->values.size() > 0) && (this->allowedErrors > 0) && (this->errors < this->allowedErrors)) {
 				++errors;
 				// fallback to last value
-				value = (double)this->values.at(this->values.size() - 1);
+				value = (double)this->values.back();
 				this->logDebug("Fallback to last read value, remaining allowed errors: " + this->to_string(this->allowedErrors - this->errors));
 			}
 			else {
@@ -1782,13 +2647,10 @@ uint8_t AggregatorPort::doWork(uint8_t canSend) {
 		this->logDebug("Newly aggregated value: " + this->to_string(longValue));
 
 		// use first value without check
+		// (the buffer drops the oldest value automatically when it is full)
 		if (this->values.size() > 0) {
-			// vector overflow?
-			if (this->values.size() >= this->totalValues) {
-				this->values.erase(this->values.begin());
-			}
 			// compare against last element
-			int64_t diff = this->values.at(this->values.size() - 1) - longValue;
+			int64_t diff = this->values.back() - longValue;
 			// diff may not exceed deltas
 			if ((diff < this->minDelta) || (diff > this->maxDelta)) {
 				this->logWarning("The new source port value of " + this->to_string(longValue) + " is outside of the specified limits (diff = " + this->to_string(diff) + ")");
@@ -1796,7 +2658,7 @@ uint8_t AggregatorPort::doWork(uint8_t canSend) {
 				if ((this->values.size() > 0) && (this->allowedErrors > 0) && (this->errors < this->allowedErrors)) {
 					++errors;
 					// fallback to last value
-					value = (double)this->values.at(this->values.size() - 1);
+					value = (double)this->values.back();
 					this->logDebug("Fallback to last read value, remaining allowed errors: " + this->to_string(this->allowedErrors - this->errors));
 				}
 				else {
@@ -1811,14 +2673,17 @@ uint8_t AggregatorPort::doWork(uint8_t canSend) {
 			// value is ok
 		}
 		this->values.push_back(longValue);
+		++this->unpersistedValues;
 		// persist values
 		this->persist();
 		valuesAvailable = true;
 	}
 
 	if (valuesAvailable) {
-		if (this->setHistory && this->historyPort != nullptr)
-			this->historyPort->setHistory(this->queryInterval, this->totalValues, this->values);
+		if (this->setHistory && this->historyPort != nullptr) {
+			this->values.copyTo(this->historyValues);
+			this->historyPort->setHistory(this->queryInterval, this->totalValues, this->historyValues);
+		}
 		// perform all calculations
 		auto it = this->calculations.begin();
 		auto ite = this->calculations.end();
@@ -1849,6 +2714,10 @@ AggregatorPort::AggregatorPort(AbstractOPDID* opdid, const char* id) : opdi::Dig
 	this->setLine(1);
 	this->errors = 0;
 	this->firstRun = true;
+	this->snapshotRecords = 0;
+	this->snapshotSize = 0;
+	this->unpersistedValues = 0;
+	this->lastPersistedValue = 0;
 }
 
 AggregatorPort::~AggregatorPort() {
@@ -1973,9 +2842,6 @@ void AggregatorPort::configure(Poco::Util::AbstractConfiguration* config, Poco::
 		++nli;
 	}
 
-	// allocate vector
-	this->values.reserve(this->totalValues);
-
 	// set initial state
 	this->resetValues("Setting initial state", opdi::LogVerbosity::VERBOSE, false);
 }
@@ -1984,6 +2850,17 @@ void AggregatorPort::prepare() {
 	this->logDebug("Preparing port");
 	opdi::DigitalPort::prepare();
 
+	// allocate value buffer (auto aggregators are not configured via configure())
+	if (this->values.capacity() != this->totalValues)
+		this->values.setCapacity(this->totalValues);
+
+	// the snapshot file is stored alongside the persistent configuration file
+	if (this->isPersistent() && (this->opdid->persistentConfig != nullptr)) {
+		Poco::Path snapshotPath(this->opdid->persistentConfigFile);
+		snapshotPath.setFileName(snapshotPath.getBaseName() + "." + this->ID() + ".agg");
+		this->snapshotFile = snapshotPath.toString();
+	}
+
 	// find source port; throws errors if something required is missing
 	this->sourcePort = this->findPort(this->getID(), "SourcePort", this->sourcePortID, true);
 	this->historyPort = this->sourcePort;
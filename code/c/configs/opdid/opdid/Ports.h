@@ -6,10 +6,16 @@
 #include <sstream>
 #include <fstream>
 #include <list>
+#include <deque>
+#include <atomic>
 
-#include "Poco/DirectoryWatcher.h"
 #include "Poco/TimedNotificationQueue.h"
 #include "Poco/Tuple.h"
+#include "Poco/Thread.h"
+#include "Poco/RunnableAdapter.h"
+#include "Poco/Event.h"
+#include "Poco/Mutex.h"
+#include "Poco/Timestamp.h"
 #include "Poco/Util/AbstractConfiguration.h"
 
 // serial port library
@@ -207,15 +213,24 @@ public:
 ///////////////////////////////////////////////////////////////////////////////
 
 /** Defines a serial streaming port that supports streaming from and to a serial port device.
+ * Received data is read in blocks into a ring buffer of BufferSize bytes. It is processed in chunks:
+ * a chunk is complete when ChunkSize bytes are buffered or when the oldest buffered byte has waited
+ * for MaxLatency milliseconds. The port supports the following modes:
+ * - Passthrough (default): the data is kept in the buffer for the bound master
+ * - Loopback: each chunk is written back to the serial port
+ * - Bridge: a separate thread copies data between the serial port and the BridgePort device
+ *   in both directions; the data does not pass through the main loop
  */
 class SerialStreamingPort : public opdi::StreamingPort {
 friend class OPDI;
 
 protected:
-	// a serial streaming port may pass the bytes through or return them in the doWork method (loopback)
+	// a serial streaming port may pass the bytes through, return them in the doWork method (loopback)
+	// or connect the serial port with another device (bridge)
 	enum Mode {
 		PASS_THROUGH,
-		LOOPBACK
+		LOOPBACK,
+		BRIDGE
 	};
 
 	Mode mode;
@@ -224,6 +239,46 @@ protected:
 	ctb::IOBase* device;
 	ctb::SerialPort* serialPort;
 
+	// receive buffer
+	std::vector<char> buffer;
+	size_t bufferStart;			// position of the oldest byte
+	size_t bufferCount;			// number of buffered bytes
+	size_t chunkSize;
+	uint32_t maxLatencyMs;
+	uint64_t chunkStartTime;	// time when the oldest buffered byte has been received
+
+	// bridge mode
+	std::string bridgePortName;
+	ctb::SerialPort* bridgePort;
+	int bridgeReadThreshold;	// bytes that wake up the bridge thread while data is flowing (termios VMIN)
+	Poco::Thread bridgeThread;
+	Poco::RunnableAdapter<SerialStreamingPort> bridge;
+	std::atomic<bool> stopBridge;
+	std::atomic<bool> bridgeErrorPending;
+	Poco::Mutex bridgeErrorMutex;
+	std::string bridgeError;
+	std::atomic<uint64_t> bytesToBridge;
+	std::atomic<uint64_t> bytesFromBridge;
+
+	/** Reads the available data from the device into the buffer. Returns the number of bytes read
+	* or a negative value in case of an error. */
+	int fillBuffer(void);
+
+	/** Returns true if the buffered data forms a complete chunk. */
+	bool chunkComplete(void);
+
+	/** Writes all bytes to the device unless the bridge is being stopped. Called on the bridge thread. */
+	bool writeFully(ctb::SerialPort* target, char* bytes, size_t length);
+
+	/** Copies the available data from source to target using the block. Returns the number of bytes
+	* copied or a negative value in case of an error. Called on the bridge thread. */
+	int transfer(ctb::SerialPort* source, ctb::SerialPort* target, char* block, size_t size);
+
+	/** Thread function of the bridge thread. Sleeps until one of the ports has data. */
+	void pumpData(void);
+
+	void stopBridgeThread(void);
+
 	virtual uint8_t doWork(uint8_t canSend) override;
 
 public:
@@ -233,12 +288,20 @@ public:
 
 	virtual void configure(Poco::Util::AbstractConfiguration* config);
 
+	virtual void prepare() override;
+
+	virtual void shutdown(void) override;
+
 	virtual int write(char* bytes, size_t length) override;
 
 	virtual int available(size_t count) override;
 
 	virtual int read(char* result) override;
 
+	/** Reads up to length buffered bytes. Returns the number of bytes read or a negative value
+	* in case of an error. */
+	virtual int read(char* bytes, size_t length);
+
 	virtual bool hasError(void) const override;
 };
 
@@ -247,13 +310,43 @@ public:
 ///////////////////////////////////////////////////////////////////////////////
 
 /** Defines a streaming port that can log port states and optionally write them to a log file.
+* The main loop only takes a snapshot of the port states and passes it to a writer thread
+* using a lock-free single producer, single consumer queue. The writer thread formats the
+* records and writes them to the output file in blocks (at most once per FlushInterval
+* milliseconds, or when BlockSize records have been collected).
+* Supported formats are CSV (default) and Binary, a compact columnar format:
+* The file starts with a schema header: magic "OPDL", 32 bit format version, 32 bit column count,
+* and for each column the column type (one byte: 'D' digital, 'A' analog, 'S' select, 'L' dial,
+* '?' unsupported), the 16 bit length of the port ID and the port ID.
+* Each block consists of the marker "OPDB", the 32 bit number of rows n, n 64 bit timestamps
+* (milliseconds since the epoch, UTC), and for each column a validity bitmap of (n + 7) / 8 bytes
+* followed by n fixed-width values (digital: 1 byte line, analog: 8 byte double relative value,
+* select: 2 byte position, dial: 8 byte position, unsupported: 0 bytes). All numbers are little endian.
+* The output file can be rotated when it exceeds MaxFileSize bytes or after RotationInterval seconds.
+* Rotated files get the suffixes .1 (newest) to .<MaxRotatedFiles> (oldest).
  */
 class LoggerPort : public opdi::StreamingPort {
 friend class OPDI;
 
 protected:
 	enum Format {
-		CSV
+		CSV,
+		BINARY
+	};
+
+	/** A single port state as captured by the main loop. */
+	struct Value {
+		union {
+			int64_t intValue;
+			double doubleValue;
+		};
+		bool valid;
+	};
+
+	/** A snapshot of the states of all logged ports. */
+	struct Record {
+		Poco::Timestamp timestamp;
+		std::vector<Value> values;
 	};
 
 	opdid::AbstractOPDID* opdid;
@@ -262,12 +355,74 @@ protected:
 	std::string separator;
 	std::string portsToLogStr;
 	opdi::PortList portsToLog;
-	bool writeHeader;
+	std::vector<char> columnTypes;
 	uint64_t lastEntryTime;
-	
+	std::string outFileStr;
+	std::string timestampFormat;
+
+	// writer settings
+	uint32_t flushInterval;
+	uint32_t blockSize;
+	uint32_t queueSize;
+	uint64_t maxFileSize;
+	uint32_t rotationInterval;
+	int maxRotatedFiles;
+
+	// record queue; slots are allocated in prepare() so that the main loop does not need to allocate
+	std::vector<Record> queue;
+	std::atomic<size_t> queueHead;		// next slot to be read by the writer thread
+	std::atomic<size_t> queueTail;		// next slot to be filled by the main loop
+	size_t droppedRecords;
+
+	// writer thread
+	Poco::Thread writerThread;
+	Poco::RunnableAdapter<LoggerPort> writer;
+	Poco::Event writerEvent;
+	std::atomic<bool> stopWriter;
+	std::atomic<bool> writerFailed;
+	std::atomic<bool> writerErrorPending;
+	Poco::Mutex writerErrorMutex;
+	std::string writerError;
+
+	// the following members are owned by the writer thread once it has been started
 	std::ofstream outFile;
+	bool writeHeader;
+	uint64_t fileSize;
+	uint64_t fileOpenTime;
+	uint64_t lastFlushTime;
+	std::string buffer;				// data to be written to the output file
+	std::ostringstream formatStream;
+	uint32_t blockRows;				// Binary: number of rows in the current block
+	std::string blockTimestamps;
+	std::vector<std::string> blockValues;
+	std::vector<std::string> blockValidity;
+
+	/** Captures the current port states in the given record. Called on the main thread. */
+	void takeSnapshot(Record& record);
+
+	void openOutput(void);
 
-	std::string getPortStateStr(opdi::Port* port);
+	/** Renames the output file and the already rotated files. */
+	void rotateFiles(void);
+
+	void rotateOutput(void);
+
+	/** Formats the record and appends it to the current buffer or block. */
+	void appendRecord(const Record& record);
+
+	void appendCSV(const Record& record);
+
+	void appendBinary(const Record& record);
+
+	/** Writes the buffered data to the output file. */
+	void flushOutput(void);
+
+	/** Thread function of the writer thread. */
+	void writeRecords(void);
+
+	void setWriterError(const std::string& message);
+
+	void stopWriterThread(void);
 
 	virtual uint8_t doWork(uint8_t canSend) override;
 
@@ -280,6 +435,8 @@ public:
 
 	virtual void prepare() override;
 
+	virtual void shutdown(void) override;
+
 	virtual int write(char* bytes, size_t length) override;
 
 	virtual int available(size_t count) override;
@@ -363,23 +520,40 @@ public:
 ///////////////////////////////////////////////////////////////////////////////
 
 /** A SceneSelectPort is a select port with n scene settings. Each scene setting corresponds
-* with a settings file. If a scene is selected the port opens the settings file and sets all
-* ports defined in the settings file to the specified values.
+* with a settings file. If a scene is selected the port sets all ports defined in the settings
+* file to the specified values.
+* The scene files are parsed when the port is prepared and again when a scene file changes.
+* The parsed scenes contain the resolved ports and their values, so selecting a scene does
+* not require any file access. All values of a scene are applied at once in the port's
+* doWork method.
 * The SceneSelectPort automatically sends a "Refresh all" message to a connected master when
 * a scene has been selected.
 */
-class SceneSelectPort : public opdi::SelectPort {
+class SceneSelectPort : public opdi::SelectPort, protected FileWatcher::Listener {
 protected:
 	typedef std::vector<std::string> FileList;
 
+	/** The states that a scene specifies for its ports. */
+	typedef std::vector<AbstractOPDID::PortState> Scene;
+	typedef std::vector<Scene> SceneList;
+
 	opdid::AbstractOPDID* opdid;
 	FileList fileList;
 	std::string configFilePath;
+	SceneList scenes;
 
 	bool positionSet;
 
 	virtual uint8_t doWork(uint8_t canSend) override;
 
+	/** Parses the scene file and returns the resolved port states. Throws an exception if the file is invalid. */
+	Scene parseScene(const std::string& sceneFile);
+
+	void applyScene(const Scene& scene);
+
+	/** Called by the file watcher on the main thread. */
+	virtual void fileChanged(const std::string& path) override;
+
 public:
 	SceneSelectPort(AbstractOPDID* opdid, const char* id);
 
@@ -419,7 +593,7 @@ public:
 * If the FilePort is active (High) when such a state change occurs the state of the value port
 * is written to the specified file.
 */
-class FilePort : public opdi::DigitalPort {
+class FilePort : public opdi::DigitalPort, protected FileWatcher::Listener {
 protected:
 
 	enum PortType {
@@ -457,14 +631,17 @@ protected:
 	int numerator;
 	int denominator;
 
-	Poco::DirectoryWatcher* directoryWatcher;
 	uint64_t lastReloadTime;
-	Poco::Mutex mutex;
-	bool needsReload;
+	bool needsReload;		// a reload has been deferred
 
 	virtual uint8_t doWork(uint8_t canSend) override;
 
-	void fileChangedEvent(const void*, const Poco::DirectoryWatcher::DirectoryEvent&);
+	/** Called by the file watcher on the main thread. */
+	virtual void fileChanged(const std::string& path) override;
+
+	bool isReloadDue(void);
+
+	void reload(void);
 
 	void writeContent();
 
@@ -510,14 +687,68 @@ public:
 * may occur in a row until the data is invalidated. In case of an error the last value
 * is repeated if it exists.
 * If the Persistent property of an AggregatorPort is true, the list of aggregated
-* values as well as the last timestamp of the aggregator is stored in the persistent
-* file. On startup, if there is a persisted state that is younger than the
+* values as well as the last timestamp of the aggregator is stored in a binary
+* snapshot file next to the persistent configuration file (named <base name>.<port ID>.agg).
+* New values are appended to the snapshot; it is rewritten only when it grows too large.
+* On startup, if there is a persisted state that is younger than the
 * specified interval the values are read into the list.
 * This behavior can be used to preserve values in between OPDID restarts.
 */
 class AggregatorPort : public opdi::DigitalPort {
 friend class AbstractOPDID;
 protected:
+	/** A fixed-capacity ring buffer for the aggregated values. Adding a value overwrites the
+	* oldest value if the buffer is full. The sum of the values as well as their minimum and
+	* maximum are maintained incrementally (the latter two using monotonic queues), so adding
+	* a value and querying these statistics takes amortized constant time regardless of the
+	* number of values.
+	*/
+	class ValueBuffer {
+		// a value together with its insertion sequence number (used for expiring queue entries)
+		typedef std::pair<uint64_t, int64_t> SequencedValue;
+
+		std::vector<int64_t> buffer;
+		size_t head;			// position of the oldest value
+		size_t count;			// number of values currently stored
+		uint64_t sequence;		// sequence number of the next value
+		int64_t valueSum;
+		std::deque<SequencedValue> minQueue;	// ascending values; front is the minimum
+		std::deque<SequencedValue> maxQueue;	// descending values; front is the maximum
+
+	public:
+		ValueBuffer();
+
+		/** Sets the maximum number of values. Clears the buffer. */
+		void setCapacity(size_t capacity);
+
+		size_t capacity(void) const;
+
+		size_t size(void) const;
+
+		bool empty(void) const;
+
+		void clear(void);
+
+		/** Appends the value, dropping the oldest value if the buffer is full. */
+		void push_back(int64_t value);
+
+		/** Returns the value at the specified position; 0 is the oldest value. */
+		int64_t at(size_t index) const;
+
+		int64_t front(void) const;
+
+		int64_t back(void) const;
+
+		int64_t sum(void) const;
+
+		int64_t min(void) const;
+
+		int64_t max(void) const;
+
+		/** Copies the values in order from oldest to newest into the specified vector. */
+		void copyTo(std::vector<int64_t>& target) const;
+	};
+
 	enum Algorithm {
 		UNKNOWN,
 		DELTA,
@@ -541,7 +772,7 @@ protected:
 	std::string sourcePortID;
 	opdi::Port* sourcePort;
 	int64_t queryInterval;
-	uint16_t totalValues;
+	uint32_t totalValues;
 	int32_t multiplier;
 	int64_t minDelta;
 	int64_t maxDelta;
@@ -550,17 +781,38 @@ protected:
 	opdi::Port* historyPort;
 	int32_t allowedErrors;
 
-	std::vector<int64_t> values;
+	ValueBuffer values;
+	// reused buffer for passing the values to the history port
+	std::vector<int64_t> historyValues;
 	uint64_t lastQueryTime;
 	int32_t errors;
 	bool firstRun;
 
 	std::vector<Calculation*> calculations;
 
+	// binary snapshot of the values (used if the port is persistent)
+	std::string snapshotFile;
+	size_t snapshotRecords;		// number of records in the snapshot file; 0 if there is no valid file
+	size_t snapshotSize;		// size of the header and the valid records; new records are written at this offset
+	size_t unpersistedValues;	// number of most recent values not yet written to the snapshot file
+	int64_t lastPersistedValue;	// the last value in the snapshot file (records are delta encoded)
+
 	virtual uint8_t doWork(uint8_t canSend) override;
 
 	virtual void persist(void) override;
 
+	void writeSnapshot(void);
+
+	void appendSnapshot(void);
+
+	void removeSnapshot(void);
+
+	/** Reads the values from the snapshot file. Returns false if there is no valid or current snapshot. */
+	bool readSnapshot(void);
+
+	/** Reads the values from the persistent configuration (format of earlier versions). */
+	bool readLegacyValues(void);
+
 	void resetValues(std::string reason, opdi::LogVerbosity logVerbosity, bool clearPersistent = true);
 
 public:
@@ -0,0 +1,312 @@
+#include "ProcessManager.h"
+
+#include <algorithm>
+
+#ifdef linux
+#include <spawn.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+extern char** environ;
+
+// output that is read from a pipe per frame; a process that writes continuously must not block the main loop
+#define OUTPUT_READ_LIMIT				16384
+// output that is read from a pipe after the process has terminated; larger than the maximum pipe
+// capacity, so that only the output of processes that have inherited the pipe is discarded
+#define FINAL_OUTPUT_READ_LIMIT			(2 * 1024 * 1024)
+#endif
+
+#include "Poco/Exception.h"
+
+#include "AbstractOPDID.h"
+
+namespace opdid {
+
+///////////////////////////////////////////////////////////////////////////////
+// Process Manager
+///////////////////////////////////////////////////////////////////////////////
+
+ProcessManager::ProcessManager(AbstractOPDID* opdid) {
+	this->opdid = opdid;
+}
+
+ProcessManager::~ProcessManager() {
+	// processes that are still running are not waited for
+	for (auto it = this->children.begin(), ite = this->children.end(); it != ite; ++it)
+		this->release(it->second);
+}
+
+#ifdef linux
+
+// closes the inherited file descriptors of the daemon (sockets, log files etc.) in the child
+static void addCloseActions(posix_spawn_file_actions_t* actions) {
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ >= 34)))
+	posix_spawn_file_actions_addclosefrom_np(actions, 3);
+#else
+	DIR* dir = opendir("/proc/self/fd");
+	if (dir == nullptr)
+		return;
+	int dirFd = dirfd(dir);
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != nullptr) {
+		int fd = atoi(entry->d_name);
+		if ((fd > 2) && (fd != dirFd))
+			posix_spawn_file_actions_addclose(actions, fd);
+	}
+	closedir(dir);
+#endif
+}
+
+// creates a pipe whose read end is non-blocking; the write end is to be passed to the child
+static void createPipe(int fds[2]) {
+	if (pipe(fds) != 0)
+		throw Poco::SystemException("Unable to create pipe", strerror(errno));
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+}
+
+ProcessManager::PID ProcessManager::launch(const std::string& program, const std::vector<std::string>& args, Listener* listener, bool captureOutput) {
+	std::vector<char*> argv;
+	argv.reserve(args.size() + 2);
+	argv.push_back(const_cast<char*>(program.c_str()));
+	for (auto it = args.begin(), ite = args.end(); it != ite; ++it)
+		argv.push_back(const_cast<char*>(it->c_str()));
+	argv.push_back(nullptr);
+
+	int outPipe[2] = { -1, -1 };
+	int errPipe[2] = { -1, -1 };
+	if (captureOutput) {
+		createPipe(outPipe);
+		try {
+			createPipe(errPipe);
+		} catch (...) {
+			close(outPipe[0]);
+			close(outPipe[1]);
+			throw;
+		}
+	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+	if (captureOutput) {
+		// dup2 clears the close-on-exec flag of the target descriptors
+		posix_spawn_file_actions_adddup2(&actions, outPipe[1], STDOUT_FILENO);
+		posix_spawn_file_actions_adddup2(&actions, errPipe[1], STDERR_FILENO);
+	} else {
+		posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+		posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+	}
+	addCloseActions(&actions);
+
+	// the child starts with an empty signal mask and default signal handling
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	sigset_t signals;
+	sigemptyset(&signals);
+	posix_spawnattr_setsigmask(&attr, &signals);
+	sigaddset(&signals, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &signals);
+	short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+#ifdef POSIX_SPAWN_USEVFORK
+	// older glibc versions use fork unless told otherwise
+	flags |= POSIX_SPAWN_USEVFORK;
+#endif
+	posix_spawnattr_setflags(&attr, flags);
+
+	pid_t pid;
+	int err = posix_spawnp(&pid, program.c_str(), &actions, &attr, &argv[0], environ);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+
+	// the write ends belong to the child
+	if (captureOutput) {
+		close(outPipe[1]);
+		close(errPipe[1]);
+	}
+	if (err != 0) {
+		if (captureOutput) {
+			close(outPipe[0]);
+			close(errPipe[0]);
+		}
+		throw Poco::SystemException(strerror(err), program);
+	}
+
+	Child child;
+	child.listener = listener;
+#ifdef SYS_pidfd_open
+	child.pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+	child.pidfd = -1;
+#endif
+	child.outFd = outPipe[0];
+	child.errFd = errPipe[0];
+	this->children[pid] = child;
+
+	return pid;
+}
+
+void ProcessManager::kill(PID pid) {
+	if (this->children.find(pid) != this->children.end())
+		::kill(pid, SIGKILL);
+}
+
+bool ProcessManager::hasTerminated(PID pid, Child& child, bool pidfdReady, int& exitCode) {
+	// without a pidfd, the process state must be queried
+	if ((child.pidfd >= 0) && !pidfdReady)
+		return false;
+	int status;
+	pid_t result = waitpid(pid, &status, WNOHANG);
+	if (result == 0)
+		return false;
+	if (result < 0)
+		// the process has already been reaped elsewhere
+		exitCode = -1;
+	else
+	if (WIFEXITED(status))
+		exitCode = WEXITSTATUS(status);
+	else
+	if (WIFSIGNALED(status))
+		exitCode = 128 + WTERMSIG(status);
+	else
+		return false;
+	return true;
+}
+
+void ProcessManager::readOutput(PID pid, Child& child, int& fd, bool isStderr, size_t limit) {
+	size_t total = 0;
+	while ((fd >= 0) && (total < limit)) {
+		ssize_t count = read(fd, this->readBuffer, std::min(sizeof(this->readBuffer), limit - total));
+		if (count > 0) {
+			total += count;
+			if (child.listener != nullptr)
+				child.listener->processOutput(pid, isStderr, this->readBuffer, count);
+			continue;
+		}
+		if ((count < 0) && (errno == EINTR))
+			continue;
+		if ((count < 0) && (errno == EAGAIN))
+			return;
+		// end of output or error
+		close(fd);
+		fd = -1;
+	}
+}
+
+void ProcessManager::release(Child& child) {
+	if (child.pidfd >= 0)
+		close(child.pidfd);
+	if (child.outFd >= 0)
+		close(child.outFd);
+	if (child.errFd >= 0)
+		close(child.errFd);
+}
+
+#else
+
+ProcessManager::PID ProcessManager::launch(const std::string& program, const std::vector<std::string>& args, Listener* listener, bool /*captureOutput*/) {
+	Child child;
+	child.listener = listener;
+	child.handle = new Poco::ProcessHandle(Poco::Process::launch(program, args));
+	PID pid = child.handle->id();
+	this->children[pid] = child;
+	return pid;
+}
+
+void ProcessManager::kill(PID pid) {
+	auto it = this->children.find(pid);
+	if (it != this->children.end())
+		Poco::Process::kill(*it->second.handle);
+}
+
+bool ProcessManager::hasTerminated(PID /*pid*/, Child& child, bool /*pidfdReady*/, int& exitCode) {
+	if (Poco::Process::isRunning(*child.handle))
+		return false;
+	// does not block as the process has terminated
+	exitCode = child.handle->wait();
+	return true;
+}
+
+void ProcessManager::release(Child& child) {
+	delete child.handle;
+}
+
+#endif
+
+bool ProcessManager::isRunning(PID pid) {
+	return this->children.find(pid) != this->children.end();
+}
+
+void ProcessManager::removeListener(Listener* listener) {
+	for (auto it = this->children.begin(), ite = this->children.end(); it != ite; ++it)
+		if (it->second.listener == listener)
+			it->second.listener = nullptr;
+}
+
+void ProcessManager::doWork(void) {
+	if (this->children.empty())
+		return;
+
+#ifdef linux
+	// check the descriptors of all children at once (negative descriptors are ignored by poll)
+	this->pollFds.clear();
+	for (auto it = this->children.begin(), ite = this->children.end(); it != ite; ++it) {
+		struct pollfd pfd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		pfd.fd = it->second.pidfd;
+		this->pollFds.push_back(pfd);
+		pfd.fd = it->second.outFd;
+		this->pollFds.push_back(pfd);
+		pfd.fd = it->second.errFd;
+		this->pollFds.push_back(pfd);
+	}
+	if (poll(&this->pollFds[0], this->pollFds.size(), 0) < 0)
+		return;
+	size_t pollIndex = 0;
+#endif
+
+	// collect terminated processes; listeners may start new processes when notified
+	typedef std::pair<PID, int> Termination;
+	std::vector<std::pair<Listener*, Termination> > terminated;
+	for (auto it = this->children.begin(); it != this->children.end(); ) {
+		bool pidfdReady = false;
+#ifdef linux
+		pidfdReady = (this->pollFds[pollIndex].revents != 0);
+		// the remaining output is read in the next frames
+		if (this->pollFds[pollIndex + 1].revents != 0)
+			this->readOutput(it->first, it->second, it->second.outFd, false, OUTPUT_READ_LIMIT);
+		if (this->pollFds[pollIndex + 2].revents != 0)
+			this->readOutput(it->first, it->second, it->second.errFd, true, OUTPUT_READ_LIMIT);
+		pollIndex += 3;
+#endif
+		int exitCode;
+		if (this->hasTerminated(it->first, it->second, pidfdReady, exitCode)) {
+#ifdef linux
+			// deliver the remaining output before the termination
+			this->readOutput(it->first, it->second, it->second.outFd, false, FINAL_OUTPUT_READ_LIMIT);
+			this->readOutput(it->first, it->second, it->second.errFd, true, FINAL_OUTPUT_READ_LIMIT);
+#endif
+			this->release(it->second);
+			terminated.push_back(std::make_pair(it->second.listener, Termination(it->first, exitCode)));
+			it = this->children.erase(it);
+		} else
+			++it;
+	}
+
+	for (auto it = terminated.begin(), ite = terminated.end(); it != ite; ++it) {
+		this->opdid->logExtreme("Process with PID " + this->opdid->to_string(it->second.first) + " has been reaped");
+		if (it->first != nullptr)
+			it->first->processTerminated(it->second.first, it->second.second);
+	}
+}
+
+}		// namespace opdid
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "Poco/Process.h"
+
+#ifdef linux
+#include <poll.h>
+#endif
+
+namespace opdid {
+
+class AbstractOPDID;
+
+///////////////////////////////////////////////////////////////////////////////
+// Process Manager
+///////////////////////////////////////////////////////////////////////////////
+
+/** The ProcessManager starts operating system processes on behalf of ports and
+*   notifies them when the processes have terminated.
+*   On Linux, processes are started using posix_spawn which avoids copying the
+*   address space of the daemon. Terminated processes are detected from the main
+*   loop, using a pidfd per process if the kernel supports it and waitpid otherwise,
+*   and reaped immediately so that no waiter threads are required.
+*   On other platforms, Poco::Process is used.
+*   The standard input of the processes is empty. Their output is discarded unless output
+*   capture is requested; captured output is read from non-blocking pipes in the main loop
+*   and passed to the listener. At most 16 kB per pipe are read in a frame, so that a process
+*   that writes continuously does not block the main loop. Output capture is only supported
+*   on Linux.
+*   Listeners are always notified on the main thread.
+*/
+class ProcessManager {
+public:
+	typedef Poco::Process::PID PID;
+
+	/** Implement this interface to receive process termination notifications. */
+	class Listener {
+	public:
+		virtual ~Listener() {};
+
+		/** Called on the main thread when a process has terminated. The exit code is
+		* 128 + the signal number if the process has been terminated by a signal,
+		* or -1 if it is unknown. */
+		virtual void processTerminated(PID pid, int exitCode) = 0;
+
+		/** Called on the main thread when a process with output capture has written output.
+		* All output has been delivered when processTerminated is called. */
+		virtual void processOutput(PID /*pid*/, bool /*isStderr*/, const char* /*data*/, size_t /*length*/) {};
+	};
+
+protected:
+	struct Child {
+		Listener* listener;
+#ifdef linux
+		int pidfd;		// -1 if pidfds are not supported
+		int outFd;		// read end of the stdout pipe, or -1
+		int errFd;		// read end of the stderr pipe, or -1
+#else
+		Poco::ProcessHandle* handle;
+#endif
+	};
+
+	typedef std::map<PID, Child> ChildMap;
+
+	AbstractOPDID* opdid;
+	ChildMap children;
+
+#ifdef linux
+	std::vector<struct pollfd> pollFds;
+	char readBuffer[4096];
+
+	/** Reads the available output from the pipe, up to limit bytes, and passes it to the listener.
+	* Closes the pipe on EOF. */
+	void readOutput(PID pid, Child& child, int& fd, bool isStderr, size_t limit);
+#endif
+
+	/** Returns true and the exit code if the child has terminated. Does not block. */
+	bool hasTerminated(PID pid, Child& child, bool pidfdReady, int& exitCode);
+
+	/** Releases the resources of a terminated child. */
+	void release(Child& child);
+
+public:
+	ProcessManager(AbstractOPDID* opdid);
+
+	virtual ~ProcessManager();
+
+	/** Starts the program with the specified arguments. The program is searched in the PATH
+	* if it does not contain a slash. If captureOutput is true, the output of the process is
+	* passed to the listener. Returns the PID of the new process.
+	* Throws an exception if the process cannot be started. */
+	virtual PID launch(const std::string& program, const std::vector<std::string>& args, Listener* listener, bool captureOutput = false);
+
+	/** Returns true if the process has been started by this manager and has not yet been reaped. */
+	virtual bool isRunning(PID pid);
+
+	/** Kills the process. */
+	virtual void kill(PID pid);
+
+	/** Removes the listener from all running processes. The processes will be reaped silently. */
+	virtual void removeListener(Listener* listener);
+
+	/** Called from the main loop; reaps terminated processes and notifies the listeners. */
+	virtual void doWork(void);
+};
+
+}		// namespace opdid
@@ -0,0 +1,355 @@
+#include "TimeSeriesStore.h"
+
+#include <string.h>
+#include <limits>
+
+#include "Poco/Exception.h"
+#include "Poco/File.h"
+#include "Poco/Path.h"
+#include "Poco/Timestamp.h"
+
+#include "opdi_platformfuncs.h"
+
+#include "AbstractOPDID.h"
+
+#define TIME_SERIES_MAGIC					"OPDT"
+#define TIME_SERIES_VERSION					1
+
+#define DEFAULT_TIME_SERIES_INTERVAL_MS		10000
+#define DEFAULT_TIME_SERIES_SAMPLES			360
+#define DEFAULT_TIME_SERIES_MINUTES			1440
+#define DEFAULT_TIME_SERIES_HOURS			744
+
+// upper limit for the number of points of a query result
+#define MAX_TIME_SERIES_QUERY_POINTS		100000
+
+namespace opdid {
+
+///////////////////////////////////////////////////////////////////////////////
+// Time Series
+///////////////////////////////////////////////////////////////////////////////
+
+const int64_t TimeSeries::periods[TimeSeries::LEVELS] = { 0, 60 * 1000, 60 * 60 * 1000 };
+
+TimeSeries::TimeSeries(uint32_t rawCapacity, uint32_t minuteCapacity, uint32_t hourCapacity, const std::string& fileName) {
+	uint32_t capacities[LEVELS] = { rawCapacity, minuteCapacity, hourCapacity };
+	size_t size = sizeof(Header) + ((size_t)rawCapacity + minuteCapacity + hourCapacity) * sizeof(Point);
+
+	if (fileName.empty()) {
+		this->memory.resize(size);
+		this->setup(&this->memory[0], capacities, true);
+		return;
+	}
+
+	Poco::File file(fileName);
+	if (!file.exists())
+		file.createFile();
+	bool reset = false;
+	if (file.getSize() != size) {
+		file.setSize(size);
+		reset = true;
+	}
+	this->mapping = Poco::SharedMemory(file, Poco::SharedMemory::AM_WRITE);
+	this->setup(this->mapping.begin(), capacities, reset);
+}
+
+TimeSeries::~TimeSeries() {
+}
+
+void TimeSeries::setup(char* base, const uint32_t capacities[LEVELS], bool reset) {
+	this->header = (Header*)base;
+	Point* next = (Point*)(base + sizeof(Header));
+	for (int level = 0; level < LEVELS; level++) {
+		this->points[level] = next;
+		next += capacities[level];
+	}
+
+	// check whether existing data can be used
+	if (!reset) {
+		reset = (memcmp(this->header->magic, TIME_SERIES_MAGIC, 4) != 0) || (this->header->version != TIME_SERIES_VERSION);
+		for (int level = 0; !reset && (level < LEVELS); level++) {
+			const Ring& ring = this->header->rings[level];
+			reset = (ring.capacity != capacities[level]) || (ring.size > ring.capacity) || ((ring.capacity > 0) && (ring.start >= ring.capacity));
+		}
+	}
+	if (!reset)
+		return;
+
+	memcpy(this->header->magic, TIME_SERIES_MAGIC, 4);
+	this->header->version = TIME_SERIES_VERSION;
+	for (int level = 0; level < LEVELS; level++) {
+		Ring& ring = this->header->rings[level];
+		ring.capacity = capacities[level];
+		ring.start = 0;
+		ring.size = 0;
+		ring.reserved = 0;
+	}
+}
+
+const TimeSeries::Point& TimeSeries::at(int level, uint32_t index) const {
+	const Ring& ring = this->header->rings[level];
+	return this->points[level][(ring.start + index) % ring.capacity];
+}
+
+void TimeSeries::push(int level, const Point& point) {
+	Ring& ring = this->header->rings[level];
+	if (ring.capacity == 0)
+		return;
+	if (ring.size < ring.capacity) {
+		this->points[level][(ring.start + ring.size) % ring.capacity] = point;
+		ring.size++;
+	} else {
+		// overwrite the oldest entry
+		this->points[level][ring.start] = point;
+		ring.start = (ring.start + 1) % ring.capacity;
+	}
+}
+
+void TimeSeries::merge(int level, int64_t periodStart, double value) {
+	Ring& ring = this->header->rings[level];
+	if (ring.capacity == 0)
+		return;
+	if (ring.size > 0) {
+		Point& last = this->points[level][(ring.start + ring.size - 1) % ring.capacity];
+		if (last.time == periodStart) {
+			if (value < last.min)
+				last.min = value;
+			if (value > last.max)
+				last.max = value;
+			last.sum += value;
+			last.count++;
+			return;
+		}
+	}
+	Point point;
+	point.time = periodStart;
+	point.min = value;
+	point.max = value;
+	point.sum = value;
+	point.count = 1;
+	point.reserved = 0;
+	this->push(level, point);
+}
+
+int64_t TimeSeries::oldest(int level) const {
+	if (this->header->rings[level].size == 0)
+		return std::numeric_limits<int64_t>::max();
+	return this->at(level, 0).time;
+}
+
+void TimeSeries::add(int64_t time, double value) {
+	// ignore samples that are older than the last one (for example, if the clock has been set back)
+	const Ring& raw = this->header->rings[RAW];
+	if ((raw.size > 0) && (time < this->at(RAW, raw.size - 1).time))
+		return;
+
+	Point point;
+	point.time = time;
+	point.min = value;
+	point.max = value;
+	point.sum = value;
+	point.count = 1;
+	point.reserved = 0;
+	this->push(RAW, point);
+
+	for (int level = MINUTES; level < LEVELS; level++)
+		this->merge(level, time - time % periods[level], value);
+}
+
+int64_t TimeSeries::query(int64_t from, int64_t to, size_t maxPoints, std::vector<Point>& result) const {
+	result.clear();
+	if ((maxPoints == 0) || (to < from))
+		return 0;
+	if (maxPoints > MAX_TIME_SERIES_QUERY_POINTS)
+		maxPoints = MAX_TIME_SERIES_QUERY_POINTS;
+
+	// determine the level to use
+	int64_t resolution = (to - from) / (int64_t)maxPoints;
+	int level = RAW;
+	for (int i = LEVELS - 1; i > RAW; i--) {
+		if (periods[i] <= resolution) {
+			level = i;
+			break;
+		}
+	}
+	while ((level < LEVELS - 1) && (this->oldest(level) > from) && (this->oldest(level + 1) < this->oldest(level)))
+		level++;
+
+	// count the entries in the range
+	const Ring& ring = this->header->rings[level];
+	size_t count = 0;
+	for (uint32_t i = 0; i < ring.size; i++) {
+		const Point& point = this->at(level, i);
+		if ((point.time >= from) && (point.time <= to))
+			count++;
+	}
+
+	// merge entries if there are too many of them
+	int64_t range = (to > from ? to - from : 1);
+	int64_t lastBucket = -1;
+	for (uint32_t i = 0; i < ring.size; i++) {
+		const Point& point = this->at(level, i);
+		if ((point.time < from) || (point.time > to))
+			continue;
+		if (count <= maxPoints) {
+			result.push_back(point);
+			continue;
+		}
+		int64_t bucket = (point.time - from) * (int64_t)maxPoints / range;
+		// the end of the range belongs to the last bucket
+		if (bucket >= (int64_t)maxPoints)
+			bucket = maxPoints - 1;
+		if (bucket != lastBucket) {
+			Point merged = point;
+			merged.time = from + bucket * range / (int64_t)maxPoints;
+			result.push_back(merged);
+			lastBucket = bucket;
+		} else {
+			Point& merged = result.back();
+			if (point.min < merged.min)
+				merged.min = point.min;
+			if (point.max > merged.max)
+				merged.max = point.max;
+			merged.sum += point.sum;
+			merged.count += point.count;
+		}
+	}
+
+	return periods[level];
+}
+
+uint32_t TimeSeries::size(int level) const {
+	return this->header->rings[level].size;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Time Series Store
+///////////////////////////////////////////////////////////////////////////////
+
+TimeSeriesStore::TimeSeriesStore(AbstractOPDID* opdid) {
+	this->opdid = opdid;
+}
+
+TimeSeriesStore::~TimeSeriesStore() {
+	for (auto it = this->entries.begin(), ite = this->entries.end(); it != ite; ++it)
+		delete it->second.series;
+}
+
+void TimeSeriesStore::configure(Poco::Util::AbstractConfiguration* general) {
+	std::string directory = this->opdid->getConfigString(general, "General", "TimeSeriesDirectory", "", false);
+	if (directory == "")
+		return;
+
+	// determine CWD-relative path depending on location of config file
+	std::string configFilePath = general->getString(OPDID_CONFIG_FILE_SETTING, "");
+	if (configFilePath == "")
+		throw Poco::DataException("Programming error: Configuration file path not specified in config settings");
+	Poco::Path filePath(configFilePath);
+	Poco::Path absPath(filePath.absolute());
+	Poco::Path parentPath = absPath.parent();
+	Poco::Path finalPath = parentPath.resolve(Poco::Path::forDirectory(directory));
+	Poco::File file(finalPath);
+	if (!file.exists() || !file.isDirectory())
+		throw Poco::DataException("TimeSeriesDirectory does not exist or is not a folder: " + finalPath.toString());
+	this->directory = finalPath.toString();
+	this->opdid->logVerbose("Time series files are stored in: " + this->directory);
+}
+
+void TimeSeriesStore::configurePort(Poco::Util::AbstractConfiguration* portConfig, opdi::Port* port) {
+	if (!portConfig->getBool("TimeSeries", false))
+		return;
+	if (this->entries.find(port->ID()) != this->entries.end())
+		return;
+
+	int interval = portConfig->getInt("TimeSeriesInterval", DEFAULT_TIME_SERIES_INTERVAL_MS);
+	if (interval <= 0)
+		throw Poco::DataException(port->ID() + ": TimeSeriesInterval must be greater than 0: " + this->opdid->to_string(interval));
+	int samples = portConfig->getInt("TimeSeriesSamples", DEFAULT_TIME_SERIES_SAMPLES);
+	int minutes = portConfig->getInt("TimeSeriesMinutes", DEFAULT_TIME_SERIES_MINUTES);
+	int hours = portConfig->getInt("TimeSeriesHours", DEFAULT_TIME_SERIES_HOURS);
+	if ((samples < 0) || (minutes < 0) || (hours < 0))
+		throw Poco::DataException(port->ID() + ": TimeSeriesSamples, TimeSeriesMinutes and TimeSeriesHours may not be negative");
+
+	std::string fileName;
+	if (this->directory != "") {
+		Poco::Path path(this->directory);
+		path.setFileName(port->ID() + ".ts");
+		fileName = path.toString();
+	}
+
+	Entry entry;
+	entry.port = port;
+	entry.series = new TimeSeries(samples, minutes, hours, fileName);
+	entry.interval = interval;
+	entry.lastSampleTime = 0;
+	this->entries[port->ID()] = entry;
+
+	this->opdid->logDebug(port->ID() + ": Recording time series every " + this->opdid->to_string(interval) + " ms"
+		+ (fileName.empty() ? "" : " in file: " + fileName));
+}
+
+TimeSeries* TimeSeriesStore::getTimeSeries(const std::string& portID) {
+	EntryMap::iterator it = this->entries.find(portID);
+	if (it == this->entries.end())
+		return nullptr;
+	return it->second.series;
+}
+
+bool TimeSeriesStore::getPortValue(opdi::Port* port, double& value) {
+	try {
+		if (port->getType()[0] == OPDI_PORTTYPE_DIGITAL[0]) {
+			uint8_t mode;
+			uint8_t line;
+			((opdi::DigitalPort*)port)->getState(&mode, &line);
+			value = line;
+			return true;
+		}
+		if (port->getType()[0] == OPDI_PORTTYPE_ANALOG[0]) {
+			uint8_t mode;
+			uint8_t resolution;
+			uint8_t reference;
+			int32_t analogValue;
+			((opdi::AnalogPort*)port)->getState(&mode, &resolution, &reference, &analogValue);
+			value = analogValue;
+			return true;
+		}
+		if (port->getType()[0] == OPDI_PORTTYPE_SELECT[0]) {
+			uint16_t position;
+			((opdi::SelectPort*)port)->getState(&position);
+			value = position;
+			return true;
+		}
+		if (port->getType()[0] == OPDI_PORTTYPE_DIAL[0]) {
+			int64_t position;
+			((opdi::DialPort*)port)->getState(&position);
+			value = (double)position;
+			return true;
+		}
+	} catch (...) {
+		// ports with errors are not sampled
+	}
+	return false;
+}
+
+void TimeSeriesStore::doWork(void) {
+	if (this->entries.empty())
+		return;
+
+	uint64_t now = opdi_get_time_ms();
+	int64_t time = 0;
+	for (auto it = this->entries.begin(), ite = this->entries.end(); it != ite; ++it) {
+		Entry& entry = it->second;
+		if ((entry.lastSampleTime > 0) && (now - entry.lastSampleTime < entry.interval))
+			continue;
+		entry.lastSampleTime = now;
+		double value;
+		if (!this->getPortValue(entry.port, value))
+			continue;
+		// the time series uses wall clock time
+		if (time == 0)
+			time = Poco::Timestamp().epochMicroseconds() / 1000;
+		entry.series->add(time, value);
+	}
+}
+
+}		// namespace opdid
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "Poco/SharedMemory.h"
+#include "Poco/Util/AbstractConfiguration.h"
+
+namespace opdi {
+	class Port;
+}
+
+namespace opdid {
+
+class AbstractOPDID;
+
+///////////////////////////////////////////////////////////////////////////////
+// Time Series
+///////////////////////////////////////////////////////////////////////////////
+
+/** A TimeSeries holds the recent values of a port in bounded memory.
+*   It consists of three ring buffers: raw samples, one minute rollups and one hour rollups.
+*   The rollups are maintained automatically when samples are added. Each ring buffer
+*   has a fixed capacity; when it is full, the oldest entries are overwritten.
+*   The ring buffers can optionally be backed by a memory-mapped file so that the data
+*   survives restarts. The file is machine-specific (native byte order and alignment)
+*   and is reinitialized if its layout does not match the configured capacities.
+*/
+class TimeSeries {
+public:
+	enum Level {
+		RAW,
+		MINUTES,
+		HOURS,
+		LEVELS
+	};
+
+	/** A raw sample or a rollup. Raw samples have a count of 1 and min = max = sum. */
+	struct Point {
+		int64_t time;		// milliseconds since the epoch (UTC); start of the period for rollups
+		double min;
+		double max;
+		double sum;
+		uint32_t count;
+		uint32_t reserved;
+	};
+
+	/** The period of the entries of each level in milliseconds (0 for raw samples). */
+	static const int64_t periods[LEVELS];
+
+protected:
+	/** Management data of a ring buffer. */
+	struct Ring {
+		uint32_t capacity;
+		uint32_t start;
+		uint32_t size;
+		uint32_t reserved;
+	};
+
+	/** Header of the time series memory (and file). */
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		Ring rings[LEVELS];
+	};
+
+	std::vector<char> memory;		// used if the time series is not backed by a file
+	Poco::SharedMemory mapping;		// used if the time series is backed by a file
+	Header* header;
+	Point* points[LEVELS];
+
+	void setup(char* base, const uint32_t capacities[LEVELS], bool reset);
+
+	const Point& at(int level, uint32_t index) const;
+
+	void push(int level, const Point& point);
+
+	/** Adds the value to the entry for the period starting at periodStart. */
+	void merge(int level, int64_t periodStart, double value);
+
+	/** Returns the time of the oldest entry of the level, or INT64_MAX if the level is empty. */
+	int64_t oldest(int level) const;
+
+public:
+	/** Creates a time series with the specified capacities. If fileName is not empty, the data
+	* is kept in the specified memory-mapped file. */
+	TimeSeries(uint32_t rawCapacity, uint32_t minuteCapacity, uint32_t hourCapacity, const std::string& fileName);
+
+	virtual ~TimeSeries();
+
+	/** Adds a sample. Samples that are older than the most recent sample are ignored. */
+	virtual void add(int64_t time, double value);
+
+	/** Returns the data for the time range from..to (inclusive), downsampled to at most maxPoints points.
+	* The coarsest level whose period does not exceed the requested resolution is used; if this level
+	* does not reach back far enough, a coarser level is used instead.
+	* Returns the period of the used level in milliseconds (0 for raw samples). */
+	virtual int64_t query(int64_t from, int64_t to, size_t maxPoints, std::vector<Point>& result) const;
+
+	/** Returns the total number of stored entries of the specified level. */
+	virtual uint32_t size(int level) const;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Time Series Store
+///////////////////////////////////////////////////////////////////////////////
+
+/** The TimeSeriesStore samples the values of ports that have the TimeSeries setting enabled
+*   and keeps them in TimeSeries objects. Sampling happens on the main thread.
+*   If the General section specifies a TimeSeriesDirectory, the time series are backed by
+*   memory-mapped files (<port ID>.ts) in that directory.
+*/
+class TimeSeriesStore {
+protected:
+	struct Entry {
+		opdi::Port* port;
+		TimeSeries* series;
+		uint32_t interval;
+		uint64_t lastSampleTime;
+	};
+
+	typedef std::map<std::string, Entry> EntryMap;
+
+	AbstractOPDID* opdid;
+	std::string directory;
+	EntryMap entries;
+
+	/** Returns the numeric value of the port. Returns false if the port has an error or is not supported. */
+	bool getPortValue(opdi::Port* port, double& value);
+
+public:
+	TimeSeriesStore(AbstractOPDID* opdid);
+
+	virtual ~TimeSeriesStore();
+
+	/** Reads the time series settings from the General section. */
+	virtual void configure(Poco::Util::AbstractConfiguration* general);
+
+	/** Reads the time series settings of a port and registers the port if they are enabled. */
+	virtual void configurePort(Poco::Util::AbstractConfiguration* portConfig, opdi::Port* port);
+
+	/** Returns the time series of the specified port, or nullptr if the port has no time series. */
+	virtual TimeSeries* getTimeSeries(const std::string& portID);
+
+	/** Called from the main loop; samples the ports as necessary. */
+	virtual void doWork(void);
+};
+
+}		// namespace opdid
@@ -297,7 +297,7 @@ int WindowsOPDID::setupTCP(std::string interface_, int port) {
 					// certain configured number of "frames" per second. On Windows, as there is no
 					// sub-millisecond sleep function and granularity would be far too coarse, we just
 					// sleep for a ms and ignore the specified fps setting (at least for now).
-					Sleep(1);
+					this->eventLoop->wait(1000);
 				} else 
 					this->logError(std::string("Error accepting connection: ") + this->to_string(lastError));
 			} else {
@@ -0,0 +1,137 @@
+// Compares the AggregatorPort value buffer with the previous implementation, which kept the
+// values in a vector, removed the oldest value with erase() and recalculated the statistics
+// over a copy of all values for each new value.
+// For each window size the window is filled first; then the time to add a value and to
+// calculate the sum, minimum, maximum and delta is measured for the specified number of values.
+// The results of both implementations are compared; the program exits with a non-zero code
+// if they differ.
+//
+// Usage: aggregator_bench [measured values per window size, default 10000]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+#include "Poco/Stopwatch.h"
+#include "Poco/Random.h"
+
+#include "Ports.h"
+
+// the main OPDI instance is declared here
+opdid::AbstractOPDID* Opdi = nullptr;
+
+// provides access to the protected value buffer
+class AggregatorCheck : public opdid::AggregatorPort {
+public:
+	typedef opdid::AggregatorPort::ValueBuffer ValueBuffer;
+};
+
+struct Statistics {
+	int64_t sum;
+	int64_t min;
+	int64_t max;
+	int64_t delta;
+
+	bool operator!=(const Statistics& other) const {
+		return (this->sum != other.sum) || (this->min != other.min) || (this->max != other.max) || (this->delta != other.delta);
+	}
+};
+
+// the implementation before the value buffer was introduced
+class VectorAggregator {
+	std::vector<int64_t> values;
+	size_t totalValues;
+
+public:
+	VectorAggregator(size_t totalValues) : totalValues(totalValues) {
+		this->values.reserve(totalValues);
+	}
+
+	void fill(int64_t value) {
+		if (this->values.size() >= this->totalValues)
+			this->values.erase(this->values.begin());
+		this->values.push_back(value);
+	}
+
+	void add(int64_t value, Statistics& stats) {
+		this->fill(value);
+
+		std::vector<int64_t> copy = this->values;
+		stats.sum = std::accumulate(copy.begin(), copy.end(), (int64_t)0);
+		stats.min = *std::min_element(copy.begin(), copy.end());
+		stats.max = *std::max_element(copy.begin(), copy.end());
+		stats.delta = copy.at(copy.size() - 1) - copy.at(0);
+	}
+};
+
+static void addToBuffer(AggregatorCheck::ValueBuffer& buffer, int64_t value, Statistics& stats) {
+	buffer.push_back(value);
+	stats.sum = buffer.sum();
+	stats.min = buffer.min();
+	stats.max = buffer.max();
+	stats.delta = buffer.back() - buffer.front();
+}
+
+int main(int argc, char* argv[]) {
+	size_t count = 10000;
+	if (argc > 1)
+		count = strtoul(argv[1], nullptr, 10);
+	if (count == 0) {
+		printf("Invalid number of values\n");
+		return 2;
+	}
+
+	const size_t windowSizes[] = { 10, 100, 1000, 10000, 100000 };
+
+	int result = 0;
+	printf("%10s %12s %12s %10s\n", "window", "vector ns", "buffer ns", "speedup");
+	for (size_t w = 0; w < sizeof(windowSizes) / sizeof(windowSizes[0]); w++) {
+		size_t windowSize = windowSizes[w];
+
+		// the same pseudo-random values are used for both implementations
+		Poco::Random random;
+		random.seed(4711);
+		std::vector<int64_t> input(windowSize + count);
+		for (size_t i = 0; i < input.size(); i++)
+			input[i] = (int64_t)random.next(2000000) - 1000000;
+
+		std::vector<Statistics> expected(count);
+		std::vector<Statistics> actual(count);
+
+		VectorAggregator vectorAggregator(windowSize);
+		for (size_t i = 0; i < windowSize; i++)
+			vectorAggregator.fill(input[i]);
+		Poco::Stopwatch vectorWatch;
+		vectorWatch.start();
+		for (size_t i = 0; i < count; i++)
+			vectorAggregator.add(input[windowSize + i], expected[i]);
+		vectorWatch.stop();
+
+		AggregatorCheck::ValueBuffer buffer;
+		buffer.setCapacity(windowSize);
+		for (size_t i = 0; i < windowSize; i++)
+			buffer.push_back(input[i]);
+		Poco::Stopwatch bufferWatch;
+		bufferWatch.start();
+		for (size_t i = 0; i < count; i++)
+			addToBuffer(buffer, input[windowSize + i], actual[i]);
+		bufferWatch.stop();
+
+		size_t mismatches = 0;
+		for (size_t i = 0; i < count; i++)
+			if (expected[i] != actual[i])
+				mismatches++;
+
+		double vectorNs = vectorWatch.elapsed() * 1000.0 / count;
+		double bufferNs = bufferWatch.elapsed() * 1000.0 / count;
+		printf("%10zu %12.1f %12.1f %9.1fx\n", windowSize, vectorNs, bufferNs, (bufferNs > 0 ? vectorNs / bufferNs : 0.0));
+		if (mismatches > 0) {
+			printf("FAILED: %zu results differ for window size %zu\n", mismatches, windowSize);
+			result = 1;
+		}
+	}
+	return result;
+}
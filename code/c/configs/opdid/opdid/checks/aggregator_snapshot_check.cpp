@@ -0,0 +1,136 @@
+// Checks how the AggregatorPort reads its snapshot file after interrupted writes.
+// An append that is interrupted before the header has been updated leaves records after the
+// number of records in the header. They must be ignored when the snapshot is read, and the next
+// append must overwrite them instead of writing after them. A truncated snapshot is rejected.
+//
+// Usage: aggregator_snapshot_check
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "Poco/File.h"
+#include "Poco/FileStream.h"
+#include "Poco/TemporaryFile.h"
+#include "Poco/Thread.h"
+
+#include "LinuxOPDID.h"
+#include "Ports.h"
+
+#include "check.h"
+
+// the main OPDI instance is declared here
+opdid::AbstractOPDID* Opdi = nullptr;
+
+/** Provides access to the values and the snapshot functions. */
+class CheckAggregator : public opdid::AggregatorPort {
+public:
+	CheckAggregator(opdid::AbstractOPDID* opdid, const std::string& file) : opdid::AggregatorPort(opdid, "Check") {
+		this->snapshotFile = file;
+		this->queryInterval = 3600;
+		this->values.setCapacity(100);
+	}
+
+	void add(int64_t value) {
+		this->values.push_back(value);
+		this->unpersistedValues++;
+	}
+
+	void write(void) {
+		this->writeSnapshot();
+	}
+
+	void append(void) {
+		this->appendSnapshot();
+	}
+
+	bool read(void) {
+		// the snapshot is only accepted if it is older than the current time
+		Poco::Thread::sleep(2);
+		return this->readSnapshot();
+	}
+
+	std::vector<int64_t> contents(void) {
+		std::vector<int64_t> result;
+		this->values.copyTo(result);
+		return result;
+	}
+};
+
+/** Appends bytes to the file like an append that was interrupted before the header was updated. */
+static void appendStaleRecords(const std::string& file) {
+	// three varint records with large deltas followed by an incomplete record
+	static const char records[] = { '\xfe', '\xff', '\x07', '\x81', '\x80', '\x10', '\x7f', '\x93' };
+	Poco::FileOutputStream fos(file, std::ios::out | std::ios::app | std::ios::binary);
+	fos.write(records, sizeof(records));
+	fos.close();
+}
+
+int main(int, char**) {
+	opdid::LinuxOPDID daemon;
+	Opdi = &daemon;
+	std::string file = Poco::TemporaryFile::tempName() + ".agg";
+
+	try {
+		std::vector<int64_t> expected;
+		{
+			CheckAggregator port(&daemon, file);
+			for (int i = 0; i < 10; i++) {
+				expected.push_back(1000 + i * 7);
+				port.add(expected.back());
+			}
+			port.write();
+			for (int i = 0; i < 5; i++) {
+				expected.push_back(-20 * i);
+				port.add(expected.back());
+			}
+			port.append();
+		}
+		{
+			CheckAggregator port(&daemon, file);
+			check(port.read() && (port.contents() == expected), "the written and appended values are read");
+		}
+
+		appendStaleRecords(file);
+		{
+			CheckAggregator port(&daemon, file);
+			check(port.read() && (port.contents() == expected), "records after the number of records in the header are ignored");
+			for (int i = 0; i < 3; i++) {
+				expected.push_back(500 + i);
+				port.add(expected.back());
+			}
+			port.append();
+		}
+		{
+			CheckAggregator port(&daemon, file);
+			check(port.read() && (port.contents() == expected), "an append after an interrupted write replaces the stale records");
+			expected.push_back(4711);
+			port.add(expected.back());
+			port.append();
+		}
+		{
+			CheckAggregator port(&daemon, file);
+			check(port.read() && (port.contents() == expected), "the values of a further append are read");
+		}
+
+		{
+			CheckAggregator port(&daemon, file);
+			port.add(100000);
+			port.add(200000);
+			port.write();
+		}
+		Poco::File snapshot(file);
+		snapshot.setSize(snapshot.getSize() - 1);
+		{
+			CheckAggregator port(&daemon, file);
+			check(!port.read() && port.contents().empty(), "a truncated snapshot is rejected");
+		}
+	} catch (Poco::Exception& e) {
+		check(false, "unexpected exception: " + e.displayText());
+	}
+
+	Poco::File snapshot(file);
+	if (snapshot.exists())
+		snapshot.remove();
+	return checkResult();
+}
@@ -0,0 +1,90 @@
+// Helpers of the standalone check programs of OPDID, its plugins and the master.
+// Each check program consists of one translation unit that includes this file.
+
+#ifndef __CHECK_H
+#define __CHECK_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pty.h>
+#include <termios.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/resource.h>
+
+#include <string>
+
+#include "Poco/Exception.h"
+
+// the number of failed checks
+static int failures = 0;
+
+/** Prints the result of a check and counts the failures. */
+inline void check(bool condition, const std::string& message) {
+	printf("%s: %s\n", (condition ? "OK    " : "FAILED"), message.c_str());
+	if (!condition)
+		failures++;
+}
+
+/** Prints the number of failed checks and returns the exit code of the program. */
+inline int checkResult(void) {
+	printf("%d check(s) failed\n", failures);
+	return (failures > 0 ? 1 : 0);
+}
+
+/** Returns the monotonic time in microseconds. */
+inline uint64_t monotonicUs(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/** Returns the CPU time (user and system) of this process in microseconds. */
+inline uint64_t cpuUs(void) {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/** Returns the number of threads of this process. */
+inline int countThreads(void) {
+	int result = 0;
+	DIR* dir = opendir("/proc/self/task");
+	if (dir == nullptr)
+		return -1;
+	while (struct dirent* entry = readdir(dir))
+		if (entry->d_name[0] != '.')
+			result++;
+	closedir(dir);
+	return result;
+}
+
+/** Opens a pseudo terminal with both sides in raw mode. */
+inline void openTerminal(int& master, int& slave, std::string* slaveName = nullptr) {
+	char name[128];
+	if (openpty(&master, &slave, name, nullptr, nullptr) != 0)
+		throw Poco::IOException("Unable to open a pseudo terminal");
+	struct termios options;
+	tcgetattr(master, &options);
+	cfmakeraw(&options);
+	tcsetattr(master, TCSANOW, &options);
+	tcgetattr(slave, &options);
+	cfmakeraw(&options);
+	tcsetattr(slave, TCSANOW, &options);
+	if (slaveName != nullptr)
+		*slaveName = name;
+}
+
+/** Opens a pseudo terminal in raw mode whose slave side is opened by name by the code under test.
+*   Returns the master side. The slave side is closed, so the master side reports a hangup until
+*   the slave side is opened again. */
+inline int openTerminal(std::string& slaveName) {
+	int master, slave;
+	openTerminal(master, slave, &slaveName);
+	close(slave);
+	return master;
+}
+
+#endif		// __CHECK_H
@@ -0,0 +1,104 @@
+# Common definitions and rules of the standalone check programs of OPDID, its plugins and the master.
+# Each program prints its results to stdout; it exits with a non-zero code if a check fails.
+# Build all checks with "make" in a checks directory and run them individually.
+#
+# The including makefile defines:
+# ROOTPATH: relative path to the code/c directory (without trailing slash)
+# CHECKS: check programs that are linked with CHECKSRC (file names without extension)
+# CLIENTS: check programs that only require the POCO libraries (optional)
+# CHECKSRC: source files of the checks (optional, default: the OPDID sources)
+# CHECKDEPS: additional prerequisites of the checks, e.g. the plugin source they include (optional)
+# CONFIGPATH: directory of the opdi_configspecs.h of the checked configuration (optional, default: the opdid directory)
+# EXTRAINCDIRS, EXTRACFLAGS, EXTRALIBS: additional include directories, compiler flags and libraries (optional)
+
+# OPDI platform specifier
+PLATFORM = linux
+
+# Relative path to the opdid application directory.
+OPDIDPATH = $(ROOTPATH)/configs/opdid/opdid
+
+# Relative path to common directory (without trailing slash)
+# This also becomes an additional include directory.
+CPATH = $(ROOTPATH)/common
+
+# Relative path to platform directory (without trailing slash)
+# This also becomes an additional include directory.
+PPATHBASE = $(ROOTPATH)/platforms
+PPATH = $(PPATHBASE)/$(PLATFORM)
+
+# master implementation
+MPATH = $(CPATH)/master
+
+# C++ wrapper
+CPPPATH = $(CPATH)/cppwrapper
+
+# libctb serial communication library
+LIBCTB = $(ROOTPATH)/libraries/libctb
+LIBCTBINC = $(LIBCTB)/include
+LIBCTBSRC = $(LIBCTB)/src/fifo.cpp $(LIBCTB)/src/getopt.cpp $(LIBCTB)/src/iobase.cpp $(LIBCTB)/src/kbhit.cpp $(LIBCTB)/src/linux/serport.cpp
+LIBCTBSRC += $(LIBCTB)/src/linux/timer.cpp $(LIBCTB)/src/portscan.cpp $(LIBCTB)/src/serportx.cpp
+
+# OPDID source files (opdid_linux.cpp is omitted because it contains the main function)
+OPDIDSRC = $(OPDIDPATH)/LinuxOPDID.cpp $(OPDIDPATH)/OPDIDConfigurationFile.cpp $(OPDIDPATH)/SunRiseSet.cpp $(OPDIDPATH)/TimerPort.cpp
+OPDIDSRC += $(OPDIDPATH)/ExpressionPort.cpp $(OPDIDPATH)/ExecPort.cpp $(OPDIDPATH)/PersistentJournal.cpp $(OPDIDPATH)/TimeSeriesStore.cpp
+OPDIDSRC += $(OPDIDPATH)/FileWatcher.cpp $(OPDIDPATH)/ProcessManager.cpp $(OPDIDPATH)/HttpClient.cpp $(OPDIDPATH)/EventLoop.cpp
+OPDIDSRC += $(OPDIDPATH)/AbstractOPDID.cpp $(OPDIDPATH)/Ports.cpp
+
+# platform specific files
+OPDIDSRC += $(PPATH)/opdi_platformfuncs.c
+
+# common files
+OPDIDSRC += $(CPATH)/opdi_message.c $(CPATH)/opdi_port.c $(CPATH)/opdi_protocol.c $(CPATH)/opdi_slave_protocol.c $(CPATH)/opdi_strings.c
+OPDIDSRC += $(CPATH)/opdi_aes.cpp $(CPATH)/opdi_rijndael.cpp
+
+# C++ wrapper files
+OPDIDSRC += $(CPPPATH)/OPDI.cpp $(CPPPATH)/OPDI_Ports.cpp
+
+OPDIDSRC += $(LIBCTBSRC)
+
+CHECKSRC ?= $(OPDIDSRC)
+CONFIGPATH ?= $(OPDIDPATH)
+
+# conio include path
+CONIOINCPATH = $(ROOTPATH)/libraries/conio
+
+# POCO include path
+POCOINCPATH = $(ROOTPATH)/libraries/POCO/Util/include $(ROOTPATH)/libraries/POCO/Foundation/include $(ROOTPATH)/libraries/POCO/Net/include
+
+# POCO library path
+POCOLIBPATH = $(ROOTPATH)/libraries/POCO/lib/Linux/x86_64
+
+# POCO libraries
+POCOLIBS = -lPocoUtil -lPocoNet -lPocoFoundation -lPocoXML -lPocoJSON
+
+# ExprTk expression library path
+EXPRTK = $(ROOTPATH)/libraries/ExprTk
+
+# Additional libraries
+LIBS = -lpthread -ldl -lrt -lutil $(EXTRALIBS)
+
+# The compiler to be used.
+CC = g++
+
+# Directories to look for include files; the configuration directory comes first
+# because it determines the opdi_configspecs.h that is used.
+INCDIRS = $(CONFIGPATH) $(CPATH) $(CPPPATH) $(MPATH) $(PPATHBASE) $(PPATH) $(POCOINCPATH) $(CONIOINCPATH) $(EXPRTK) $(LIBCTBINC)
+INCDIRS += $(OPDIDPATH)/checks $(EXTRAINCDIRS) .
+
+# Defines
+CDEFINES = -Dlinux -DPOCO_STATIC
+
+# Compiler flags.
+CFLAGS = -Wall $(EXTRACFLAGS) -L $(POCOLIBPATH) $(CDEFINES)
+CFLAGS += $(patsubst %,-I%,$(INCDIRS)) -std=c++11 -static-libstdc++ -O2
+
+all: $(CHECKS) $(CLIENTS)
+
+$(CHECKS): %: %.cpp $(CHECKDEPS) $(CHECKSRC)
+	$(CC) $(CFLAGS) $< $(CHECKSRC) -o $@ $(POCOLIBS) $(LIBS)
+
+$(CLIENTS): %: %.cpp
+	$(CC) $(CFLAGS) $< -o $@ $(POCOLIBS) $(LIBS)
+
+clean:
+	rm -f $(CHECKS) $(CLIENTS)
@@ -0,0 +1,292 @@
+// Checks the HttpClient service against a local stand-in HTTP server.
+// The server runs on an ephemeral port of the loopback interface and records the client port
+// of each request, so that the number of connections used by the client can be verified.
+// The checks cover keep-alive connection reuse, POST bodies, error status codes, timeouts,
+// connection errors, cancelled requests, the retry on a connection that the server
+// has closed while it was idle, and listeners that throw exceptions.
+//
+// Usage: http_client_check
+
+#include <stdio.h>
+
+#include <set>
+#include <stdexcept>
+#include <string>
+
+#include "Poco/Net/HTTPServer.h"
+#include "Poco/Net/HTTPServerParams.h"
+#include "Poco/Net/HTTPRequestHandler.h"
+#include "Poco/Net/HTTPRequestHandlerFactory.h"
+#include "Poco/Net/HTTPServerRequest.h"
+#include "Poco/Net/HTTPServerResponse.h"
+#include "Poco/Net/ServerSocket.h"
+#include "Poco/Net/SocketAddress.h"
+#include "Poco/Exception.h"
+#include "Poco/StreamCopier.h"
+#include "Poco/Mutex.h"
+#include "Poco/Thread.h"
+
+#include "opdi_platformfuncs.h"
+
+#include "LinuxOPDID.h"
+#include "HttpClient.h"
+
+#include "check.h"
+
+// the main OPDI instance is declared here
+opdid::AbstractOPDID* Opdi = nullptr;
+
+// client ports of the connections that the stand-in server has accepted
+static Poco::Mutex connectionMutex;
+static std::set<Poco::UInt16> connections;
+
+static size_t connectionCount(void) {
+	Poco::Mutex::ScopedLock lock(connectionMutex);
+	return connections.size();
+}
+
+static void resetConnections(void) {
+	Poco::Mutex::ScopedLock lock(connectionMutex);
+	connections.clear();
+}
+
+/** Answers the requests of the checks:
+*   /hello returns "hello", /echo returns the request body with its content type,
+*   /missing returns 404, /slow answers after three seconds, and /close closes the
+*   connection after the response. */
+class StandInHandler : public Poco::Net::HTTPRequestHandler {
+public:
+	virtual void handleRequest(Poco::Net::HTTPServerRequest& request, Poco::Net::HTTPServerResponse& response) override {
+		{
+			Poco::Mutex::ScopedLock lock(connectionMutex);
+			connections.insert(request.clientAddress().port());
+		}
+		std::string body;
+		Poco::StreamCopier::copyToString(request.stream(), body);
+
+		const std::string& uri = request.getURI();
+		response.setContentType("text/plain");
+		if (uri == "/hello") {
+			response.sendBuffer("hello", 5);
+		} else
+		if (uri == "/echo") {
+			response.setContentType(request.getContentType());
+			response.sendBuffer(body.data(), body.size());
+		} else
+		if (uri == "/slow") {
+			Poco::Thread::sleep(3000);
+			response.sendBuffer("slow", 4);
+		} else
+		if (uri == "/close") {
+			response.setKeepAlive(false);
+			response.sendBuffer("close", 5);
+		} else {
+			response.setStatusAndReason(Poco::Net::HTTPResponse::HTTP_NOT_FOUND);
+			response.sendBuffer("missing", 7);
+		}
+	}
+};
+
+class StandInHandlerFactory : public Poco::Net::HTTPRequestHandlerFactory {
+public:
+	virtual Poco::Net::HTTPRequestHandler* createRequestHandler(const Poco::Net::HTTPServerRequest& /*request*/) override {
+		return new StandInHandler();
+	}
+};
+
+/** Collects the responses. */
+class ResponseCollector : public opdid::HttpClient::Listener {
+public:
+	std::map<opdid::HttpClient::RequestID, opdid::HttpClient::Response> responses;
+
+	virtual void httpCompleted(opdid::HttpClient::RequestID id, const opdid::HttpClient::Response& response) override {
+		this->responses[id] = response;
+	}
+};
+
+/** Throws when notified, like a listener that fails to process the response. */
+class ThrowingListener : public opdid::HttpClient::Listener {
+public:
+	bool poco;
+	int notified;
+
+	ThrowingListener(bool poco) : poco(poco), notified(0) {}
+
+	virtual void httpCompleted(opdid::HttpClient::RequestID, const opdid::HttpClient::Response&) override {
+		this->notified++;
+		if (this->poco)
+			throw Poco::DataException("Check listener failed");
+		throw std::runtime_error("Check listener failed");
+	}
+};
+
+/** Runs the main loop of the client until the number of responses has been received or the time is up. */
+static bool waitForResponses(opdid::HttpClient& client, ResponseCollector& collector, size_t count, int timeoutMs) {
+	uint64_t start = opdi_get_time_ms();
+	while (collector.responses.size() < count) {
+		if (opdi_get_time_ms() - start > (uint64_t)timeoutMs)
+			return false;
+		client.doWork();
+		Poco::Thread::sleep(1);
+	}
+	return true;
+}
+
+int main(int, char**) {
+	opdid::LinuxOPDID daemon;
+	Opdi = &daemon;
+
+	Poco::Net::ServerSocket serverSocket(Poco::Net::SocketAddress("127.0.0.1", 0));
+	Poco::Net::HTTPServerParams::Ptr params = new Poco::Net::HTTPServerParams();
+	params->setKeepAlive(true);
+	// idle connections are closed by the server before the client's keep-alive timeout
+	params->setKeepAliveTimeout(Poco::Timespan(1, 0));
+	Poco::Net::HTTPServer server(new StandInHandlerFactory(), serverSocket, params);
+	server.start();
+	std::string base = "http://127.0.0.1:" + std::to_string(serverSocket.address().port());
+
+	try {
+		opdid::HttpClient client(&daemon);
+
+		// sequential requests reuse the connection
+		{
+			ResponseCollector collector;
+			bool allOk = true;
+			for (int i = 0; i < 10; i++) {
+				opdid::HttpClient::RequestID id = client.get(base + "/hello", &collector);
+				if (!waitForResponses(client, collector, i + 1, 5000))
+					break;
+				allOk = allOk && (collector.responses[id].status == 200) && (collector.responses[id].body == "hello");
+			}
+			check((collector.responses.size() == 10) && allOk, "10 sequential GET requests succeed");
+			check(connectionCount() == 1, "sequential requests use one connection (used: " + std::to_string(connectionCount()) + ")");
+		}
+
+		// concurrent requests are limited by the number of worker threads
+		resetConnections();
+		{
+			ResponseCollector collector;
+			for (int i = 0; i < 20; i++)
+				client.get(base + "/hello", &collector);
+			check(waitForResponses(client, collector, 20, 5000), "20 concurrent GET requests complete");
+			check(connectionCount() <= 2, "concurrent requests use at most one connection per worker thread (used: " + std::to_string(connectionCount()) + ")");
+		}
+
+		// POST with a body
+		{
+			ResponseCollector collector;
+			opdid::HttpClient::Request request;
+			request.method = "POST";
+			request.url = base + "/echo";
+			request.contentType = "application/json";
+			request.body = "{\"value\":42}";
+			opdid::HttpClient::RequestID id = client.submit(request, &collector);
+			waitForResponses(client, collector, 1, 5000);
+			check((collector.responses[id].status == 200) && (collector.responses[id].body == request.body), "POST body is sent and echoed");
+		}
+
+		// error status
+		{
+			ResponseCollector collector;
+			opdid::HttpClient::RequestID id = client.get(base + "/missing", &collector);
+			waitForResponses(client, collector, 1, 5000);
+			check((collector.responses[id].status == 404) && !collector.responses[id].ok(), "404 status is reported");
+		}
+
+		// timeout
+		{
+			ResponseCollector collector;
+			uint64_t start = opdi_get_time_ms();
+			opdid::HttpClient::RequestID id = client.get(base + "/slow", &collector, 1);
+			waitForResponses(client, collector, 1, 5000);
+			uint64_t elapsed = opdi_get_time_ms() - start;
+			check((collector.responses[id].status == 0) && !collector.responses[id].reason.empty() && (elapsed < 2900),
+				"request times out after one second (" + std::to_string(elapsed) + " ms): " + collector.responses[id].reason);
+		}
+
+		// a connection that the server has closed while idle is replaced
+		resetConnections();
+		{
+			ResponseCollector collector;
+			client.get(base + "/hello", &collector);
+			waitForResponses(client, collector, 1, 5000);
+			// wait for the server's keep-alive timeout
+			Poco::Thread::sleep(1500);
+			opdid::HttpClient::RequestID id = client.get(base + "/hello", &collector);
+			waitForResponses(client, collector, 2, 5000);
+			check((collector.responses[id].status == 200) && (collector.responses[id].body == "hello"), "request succeeds after the server has closed the idle connection");
+			check(connectionCount() == 2, "a new connection is opened (used: " + std::to_string(connectionCount()) + ")");
+		}
+
+		// the server closes the connection after the response
+		resetConnections();
+		{
+			ResponseCollector collector;
+			client.get(base + "/close", &collector);
+			client.get(base + "/close", &collector);
+			waitForResponses(client, collector, 2, 5000);
+			bool allOk = true;
+			for (auto it = collector.responses.begin(), ite = collector.responses.end(); it != ite; ++it)
+				allOk = allOk && (it->second.status == 200);
+			check(allOk, "responses with Connection: close are received");
+		}
+
+		// cancelled requests are not reported
+		{
+			ResponseCollector collector;
+			ResponseCollector other;
+			opdid::HttpClient::RequestID id = client.get(base + "/hello", &collector);
+			client.cancel(id);
+			client.get(base + "/hello", &other);
+			waitForResponses(client, other, 1, 5000);
+			// the cancelled request has been submitted first and has completed as well
+			Poco::Thread::sleep(100);
+			client.doWork();
+			check(collector.responses.empty(), "cancelled request is not reported");
+		}
+
+		// a listener that throws does not prevent the notification of the other listeners
+		{
+			ThrowingListener pocoThrower(true);
+			ThrowingListener stdThrower(false);
+			ResponseCollector collector;
+			client.get(base + "/hello", &pocoThrower);
+			client.get(base + "/hello", &stdThrower);
+			client.get(base + "/hello", &collector);
+			client.get(base + "/hello", &collector);
+			// let all requests complete so that they are reported in the same call
+			Poco::Thread::sleep(500);
+			waitForResponses(client, collector, 2, 5000);
+			check((pocoThrower.notified == 1) && (stdThrower.notified == 1) && (collector.responses.size() == 2),
+				"the other listeners are notified if a listener throws an exception");
+		}
+
+		// connection errors
+		{
+			Poco::Net::ServerSocket unused(Poco::Net::SocketAddress("127.0.0.1", 0));
+			std::string closedUrl = "http://127.0.0.1:" + std::to_string(unused.address().port()) + "/";
+			unused.close();
+			ResponseCollector collector;
+			opdid::HttpClient::RequestID id = client.get(closedUrl, &collector);
+			waitForResponses(client, collector, 1, 5000);
+			check((collector.responses[id].status == 0) && !collector.responses[id].reason.empty(), "connection error is reported: " + collector.responses[id].reason);
+		}
+
+		// unsupported URLs
+		{
+			ResponseCollector collector;
+			bool thrown = false;
+			try {
+				client.get("https://127.0.0.1/", &collector);
+			} catch (Poco::UnknownURISchemeException&) {
+				thrown = true;
+			}
+			check(thrown, "https URL is rejected");
+		}
+	} catch (Poco::Exception& e) {
+		check(false, "unexpected exception: " + e.displayText());
+	}
+
+	server.stop();
+	return checkResult();
+}
@@ -0,0 +1,92 @@
+// Checks that the entries of the PersistentJournal round-trip through a replay.
+// The checks cover keys and values that contain the characters that the journal escapes
+// ('=', backslashes, line feeds and carriage returns), the removal of such a key, and
+// a journal written by an earlier version that does not escape '=' in values.
+//
+// Usage: persistent_journal_check
+
+#include <stdio.h>
+
+#include <string>
+
+#include "Poco/AutoPtr.h"
+#include "Poco/File.h"
+#include "Poco/FileStream.h"
+#include "Poco/Path.h"
+#include "Poco/Process.h"
+#include "Poco/Util/MapConfiguration.h"
+
+#include "LinuxOPDID.h"
+#include "PersistentJournal.h"
+
+#include "check.h"
+
+// the main OPDI instance is declared here
+opdid::AbstractOPDID* Opdi = nullptr;
+
+namespace {
+
+/** Replays the journal of the configuration file onto an empty configuration. */
+Poco::AutoPtr<Poco::Util::MapConfiguration> replay(opdid::AbstractOPDID* daemon, const std::string& configFile) {
+	Poco::AutoPtr<Poco::Util::MapConfiguration> config = new Poco::Util::MapConfiguration();
+	opdid::PersistentJournal journal(daemon, configFile);
+	journal.replay(config);
+	return config;
+}
+
+/** Returns the value of the key, or "<missing>" if the key does not exist. */
+std::string value(Poco::Util::AbstractConfiguration* config, const std::string& key) {
+	return config->hasProperty(key) ? config->getRawString(key) : "<missing>";
+}
+
+}	// end anonymous namespace
+
+int main(int, char**) {
+	opdid::LinuxOPDID daemon;
+	Opdi = &daemon;
+
+	std::string configFile = Poco::Path::temp() + "persistent_journal_check_" + std::to_string(Poco::Process::id()) + ".ini";
+
+	try {
+		// entries with escaped characters
+		{
+			Poco::AutoPtr<Poco::Util::MapConfiguration> general = new Poco::Util::MapConfiguration();
+			general->setInt("PersistentFlushInterval", 0);
+			Poco::AutoPtr<Poco::Util::PropertyFileConfiguration> persistent = new Poco::Util::PropertyFileConfiguration();
+			opdid::PersistentJournal journal(&daemon, configFile);
+			journal.configure(general);
+			journal.set("Port=A.Line", "x=y");
+			journal.set("Back\\slash", "a\\nb\\");
+			journal.set("Multi", "line1\nline2\r\n");
+			journal.set("Removed=1", "1");
+			journal.remove("Removed=1");
+			journal.doWork(persistent);
+		}
+		Poco::AutoPtr<Poco::Util::MapConfiguration> config = replay(&daemon, configFile);
+		std::string key = value(config, "Port=A.Line");
+		check(key == "x=y", "a key that contains '=' is replayed (" + key + ")");
+		check(!config->hasProperty("Port"), "the key is not split at the escaped '='");
+		std::string backslash = value(config, "Back\\slash");
+		check(backslash == "a\\nb\\", "backslashes are replayed (" + backslash + ")");
+		check(value(config, "Multi") == "line1\nline2\r\n", "line feeds and carriage returns are replayed");
+		check(!config->hasProperty("Removed=1"), "a removed key that contains '=' is removed");
+
+		// a journal of an earlier version
+		Poco::File(configFile + ".journal").remove();
+		{
+			Poco::FileOutputStream fos(configFile + ".journal", std::ios::out | std::ios::binary);
+			fos << "S Expression=a=b\n";
+		}
+		config = replay(&daemon, configFile);
+		std::string expression = value(config, "Expression");
+		check(expression == "a=b", "an unescaped '=' in a value is replayed (" + expression + ")");
+	} catch (Poco::Exception& e) {
+		check(false, "unexpected exception: " + e.displayText());
+	}
+
+	Poco::File journalFile(configFile + ".journal");
+	if (journalFile.exists())
+		journalFile.remove();
+
+	return checkResult();
+}
@@ -0,0 +1,410 @@
+// Measures the cost of mock plugins in an emulated main loop of the daemon, and the time that
+// the daemon needs to start and stop them.
+// The polling plugin works in the style that plugins used before the lifecycle hooks existed:
+// its ports check the time in every frame, and a thread polls the event source every millisecond.
+// The event loop plugin adds a periodic timer and a watch of the event source to the EventLoop
+// in startPlugin and removes them in stopPlugin. The thread plugin starts a thread in startPlugin
+// that waits for work, and joins it in stopPlugin.
+// A generator thread writes an event with a timestamp to the event source (a pipe) every
+// 50 milliseconds. The main loop runs at 200 frames per second like the LinuxOPDID main loop;
+// it sleeps in EventLoop::wait, or in usleep as before the EventLoop existed.
+// The CPU load and the median and 99th percentile of the event latency are reported for the
+// main loop without a plugin, with the polling plugin and with the event loop plugin, as well
+// as the time that startPlugins and stopPlugins take for each kind of plugin.
+// The plugins are started and stopped by the startPlugins and stopPlugins methods of the daemon.
+// The checks cover the order of the hooks, the plugins that are stopped when a plugin fails
+// to start, the delivery of all events, the threads that must have been joined after
+// the plugins have been stopped, and a timer that another thread adds while the main loop waits.
+//
+// Usage: plugin_bench [seconds per measurement [number of plugins]]
+// The defaults are 10 seconds and 20 plugins.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <atomic>
+#include <algorithm>
+#include <vector>
+
+#include "Poco/Event.h"
+#include "Poco/Mutex.h"
+#include "Poco/Runnable.h"
+#include "Poco/SharedPtr.h"
+#include "Poco/Thread.h"
+
+#include "opdi_platformfuncs.h"
+
+#include "LinuxOPDID.h"
+#include "EventLoop.h"
+
+#include "check.h"
+
+// the main OPDI instance is declared here
+opdid::AbstractOPDID* Opdi = nullptr;
+
+/** Provides access to the plugin list and the lifecycle methods. */
+class CheckOPDID : public opdid::LinuxOPDID {
+public:
+	void addPlugin(IOPDIDPlugin* plugin) {
+		this->pluginList.push_back(Poco::SharedPtr<IOPDIDPlugin>(plugin));
+	}
+
+	void removePlugins(void) {
+		this->pluginList.clear();
+	}
+
+	void start(void) {
+		this->startPlugins();
+	}
+
+	void stop(void) {
+		this->stopPlugins();
+	}
+};
+
+// the latencies of the received events in microseconds; accessed on the main thread only
+static std::vector<uint64_t> latencies;
+
+// the number of periodic work items that the plugins have done
+static int fetches = 0;
+
+/** Reads the timestamps from the event source and records the latencies. */
+static void receive(int fd) {
+	uint64_t sent;
+	while (::read(fd, &sent, sizeof(sent)) == sizeof(sent))
+		latencies.push_back(monotonicUs() - sent);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Mock plugins
+///////////////////////////////////////////////////////////////////////////////
+
+// the hooks that have been called, in order
+static std::vector<std::string> calls;
+
+/** Records its hooks. Throws an exception in startPlugin if it should fail. */
+class RecordingPlugin : public IOPDIDPlugin {
+public:
+	std::string name;
+	bool fail;
+
+	RecordingPlugin(const std::string& name, bool fail) : name(name), fail(fail) {}
+
+	virtual void setupPlugin(opdid::AbstractOPDID*, const std::string&, Poco::Util::AbstractConfiguration*) override {}
+
+	virtual void startPlugin(void) override {
+		if (this->fail)
+			throw Poco::ApplicationException("Mock plugin failed to start: " + this->name);
+		calls.push_back("start " + this->name);
+	}
+
+	virtual void stopPlugin(void) override {
+		calls.push_back("stop " + this->name);
+	}
+};
+
+/** Works like a plugin before the lifecycle hooks existed: its ports check the time in every
+*   frame, and a thread that runs from construction until deletion polls the event source. */
+class PollingPlugin : public IOPDIDPlugin, protected Poco::Runnable {
+protected:
+	// a port that fetches data every 30 seconds
+	struct Port {
+		uint64_t nextFetch;
+	};
+
+	int fd;
+	std::vector<Port> ports;
+	Poco::Thread thread;
+	std::atomic<bool> stopping;
+
+	Poco::Mutex mutex;		// protects the received timestamps
+	std::vector<uint64_t> received;
+
+	virtual void run(void) override {
+		while (!this->stopping) {
+			uint64_t sent;
+			while (::read(this->fd, &sent, sizeof(sent)) == sizeof(sent)) {
+				Poco::Mutex::ScopedLock lock(this->mutex);
+				this->received.push_back(sent);
+			}
+			usleep(1000);
+		}
+	}
+
+public:
+	PollingPlugin(int fd, int portCount) : fd(fd), ports(portCount), stopping(false) {
+		for (auto it = this->ports.begin(), ite = this->ports.end(); it != ite; ++it)
+			it->nextFetch = 0;
+		this->thread.start(*this);
+	}
+
+	virtual ~PollingPlugin() {
+		this->stopping = true;
+		this->thread.join();
+	}
+
+	virtual void setupPlugin(opdid::AbstractOPDID*, const std::string&, Poco::Util::AbstractConfiguration*) override {}
+
+	/** Called in every frame like the doWork methods of the ports. */
+	void doWork(void) {
+		uint64_t now = opdi_get_time_ms();
+		for (auto it = this->ports.begin(), ite = this->ports.end(); it != ite; ++it) {
+			if (now >= it->nextFetch) {
+				it->nextFetch = now + 30000;
+				fetches++;
+			}
+		}
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		uint64_t arrival = monotonicUs();
+		for (auto it = this->received.begin(), ite = this->received.end(); it != ite; ++it)
+			latencies.push_back(arrival - *it);
+		this->received.clear();
+	}
+};
+
+/** Fetches data every 30 seconds using a timer and receives events using a watch. */
+class EventLoopPlugin : public IOPDIDPlugin, public opdid::EventLoop::Listener {
+protected:
+	opdid::EventLoop* eventLoop;
+	int fd;
+
+public:
+	EventLoopPlugin(opdid::EventLoop* eventLoop, int fd) : eventLoop(eventLoop), fd(fd) {}
+
+	virtual void setupPlugin(opdid::AbstractOPDID*, const std::string&, Poco::Util::AbstractConfiguration*) override {}
+
+	virtual void startPlugin(void) override {
+		this->eventLoop->addTimer(this, 0, 30000);
+		if (this->fd >= 0)
+			this->eventLoop->addWatch(this->fd, opdid::EventLoop::READABLE, this);
+	}
+
+	virtual void stopPlugin(void) override {
+		this->eventLoop->removeListener(this);
+	}
+
+	virtual void timerExpired(opdid::EventLoop::TimerID) override {
+		fetches++;
+	}
+
+	virtual void fileDescriptorReady(opdid::EventLoop::WatchID, int fd, int) override {
+		receive(fd);
+	}
+};
+
+/** Starts a thread in startPlugin that waits for work, and joins it in stopPlugin. */
+class ThreadPlugin : public IOPDIDPlugin, protected Poco::Runnable {
+protected:
+	Poco::Thread thread;
+	Poco::Event event;
+	std::atomic<bool> stopping;
+
+	virtual void run(void) override {
+		while (!this->stopping)
+			this->event.wait();
+	}
+
+public:
+	ThreadPlugin(void) : stopping(false) {}
+
+	virtual void setupPlugin(opdid::AbstractOPDID*, const std::string&, Poco::Util::AbstractConfiguration*) override {}
+
+	virtual void startPlugin(void) override {
+		this->thread.start(*this);
+	}
+
+	virtual void stopPlugin(void) override {
+		this->stopping = true;
+		this->event.set();
+		this->thread.join();
+	}
+};
+
+/** Adds a timer on its own thread while the main thread waits. */
+class TimerAdder : public Poco::Runnable, public opdid::EventLoop::Listener {
+public:
+	opdid::EventLoop* eventLoop;
+	std::atomic<bool> expired;
+
+	TimerAdder(opdid::EventLoop* eventLoop) : eventLoop(eventLoop), expired(false) {}
+
+	virtual void run(void) override {
+		Poco::Thread::sleep(20);
+		this->eventLoop->addTimer(this, 0);
+	}
+
+	virtual void timerExpired(opdid::EventLoop::TimerID) override {
+		this->expired = true;
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Measurements
+///////////////////////////////////////////////////////////////////////////////
+
+/** Writes a timestamp to the event source every 50 milliseconds. */
+class Generator : public Poco::Runnable {
+public:
+	int fd;
+	std::atomic<bool> stopping;
+	int sent;
+
+	Generator(int fd) : fd(fd), stopping(false), sent(0) {}
+
+	virtual void run(void) override {
+		while (!this->stopping) {
+			Poco::Thread::sleep(50);
+			uint64_t now = monotonicUs();
+			if (::write(this->fd, &now, sizeof(now)) == sizeof(now))
+				this->sent++;
+		}
+	}
+};
+
+/** Runs the main loop for the specified time and reports the CPU load and the latencies.
+*   Returns the number of events that have been sent. */
+static int measure(CheckOPDID& daemon, const std::string& name, int seconds, PollingPlugin* polling, bool useEventLoop, int pipeFds[2]) {
+	latencies.clear();
+	Generator generator(pipeFds[1]);
+	Poco::Thread generatorThread;
+	generatorThread.start(generator);
+
+	uint64_t cpu = cpuUs();
+	uint64_t start = monotonicUs();
+	uint64_t frames = 0;
+	while (monotonicUs() - start < (uint64_t)seconds * 1000000) {
+		uint64_t frameStart = monotonicUs();
+		daemon.eventLoop->doWork();
+		if (polling != nullptr)
+			polling->doWork();
+		frames++;
+		// 200 frames per second
+		int remaining = 5000 - (int)(monotonicUs() - frameStart);
+		if (remaining > 0) {
+			if (useEventLoop)
+				daemon.eventLoop->wait(remaining);
+			else
+				usleep(remaining);
+		}
+	}
+	uint64_t elapsed = monotonicUs() - start;
+	double load = (double)(cpuUs() - cpu) * 100 / elapsed;
+
+	generator.stopping = true;
+	generatorThread.join();
+	// deliver the remaining events
+	Poco::Thread::sleep(20);
+	daemon.eventLoop->doWork();
+	if (polling != nullptr)
+		polling->doWork();
+
+	std::sort(latencies.begin(), latencies.end());
+	printf("%-22s CPU %5.2f%% %6.0f frames/s %5zu events", name.c_str(), load, (double)frames * 1000000 / elapsed, latencies.size());
+	if (!latencies.empty())
+		printf("   latency: median %6llu us, 99th percentile %6llu us", (unsigned long long)latencies[latencies.size() / 2],
+			(unsigned long long)latencies[latencies.size() * 99 / 100]);
+	printf("\n");
+	return generator.sent;
+}
+
+/** Starts and stops the plugins and reports the time that this takes. */
+static void measureLifecycle(CheckOPDID& daemon, const std::string& name) {
+	int threads = countThreads();
+	uint64_t start = monotonicUs();
+	daemon.start();
+	uint64_t started = monotonicUs();
+	daemon.stop();
+	uint64_t stopped = monotonicUs();
+	daemon.removePlugins();
+	printf("%-22s startPlugins %6llu us, stopPlugins %6llu us\n", name.c_str(), (unsigned long long)(started - start), (unsigned long long)(stopped - started));
+	check(countThreads() == threads, name + ": no thread is left running after stopPlugins");
+}
+
+int main(int argc, char* argv[]) {
+	int seconds = (argc > 1 ? atoi(argv[1]) : 10);
+	int pluginCount = (argc > 2 ? atoi(argv[2]) : 20);
+	if ((seconds < 1) || (pluginCount < 1)) {
+		printf("Invalid number of seconds or plugins\n");
+		return 2;
+	}
+
+	CheckOPDID daemon;
+	Opdi = &daemon;
+	// the event loop is usually created when the general configuration is read
+	if (daemon.eventLoop == nullptr)
+		daemon.eventLoop = new opdid::EventLoop(&daemon);
+
+	try {
+		// plugins are started in order and stopped in reverse order
+		daemon.addPlugin(new RecordingPlugin("A", false));
+		daemon.addPlugin(new RecordingPlugin("B", false));
+		daemon.start();
+		daemon.stop();
+		daemon.stop();
+		check(calls == std::vector<std::string>({ "start A", "start B", "stop B", "stop A" }), "the plugins are stopped in reverse order, and only once");
+
+		// a failing plugin stops the plugins that have already been started
+		calls.clear();
+		daemon.addPlugin(new RecordingPlugin("C", true));
+		daemon.addPlugin(new RecordingPlugin("D", false));
+		bool thrown = false;
+		try {
+			daemon.start();
+		} catch (Poco::Exception&) {
+			thrown = true;
+		}
+		daemon.stop();
+		check(thrown && (calls == std::vector<std::string>({ "start A", "start B", "stop B", "stop A" })), "a plugin that fails to start stops the started plugins");
+		daemon.removePlugins();
+
+		// startup and shutdown
+		for (int i = 0; i < pluginCount; i++)
+			daemon.addPlugin(new EventLoopPlugin(daemon.eventLoop, -1));
+		measureLifecycle(daemon, std::to_string(pluginCount) + " event loop plugins");
+		for (int i = 0; i < pluginCount; i++)
+			daemon.addPlugin(new ThreadPlugin());
+		measureLifecycle(daemon, std::to_string(pluginCount) + " thread plugins");
+
+		// a timer that another thread adds interrupts the wait of the main loop
+		TimerAdder adder(daemon.eventLoop);
+		Poco::Thread adderThread;
+		uint64_t start = monotonicUs();
+		adderThread.start(adder);
+		daemon.eventLoop->wait(1000000);
+		uint64_t waited = (monotonicUs() - start) / 1000;
+		adderThread.join();
+		daemon.eventLoop->doWork();
+		check(adder.expired && (waited < 500), "a timer that another thread adds ends the wait (after " + std::to_string(waited) + " ms)");
+
+		// the main loop with one plugin
+		int pipeFds[2];
+		if (pipe2(pipeFds, O_NONBLOCK) != 0)
+			throw Poco::IOException("Unable to create a pipe");
+		measure(daemon, "No plugin (usleep)", seconds, nullptr, false, pipeFds);
+		measure(daemon, "No plugin (EventLoop)", seconds, nullptr, true, pipeFds);
+		// discard the events that nobody has received
+		receive(pipeFds[0]);
+
+		PollingPlugin* polling = new PollingPlugin(pipeFds[0], 20);
+		int sent = measure(daemon, "Polling plugin", seconds, polling, false, pipeFds);
+		check((int)latencies.size() == sent, "the polling plugin receives all events");
+		delete polling;
+
+		daemon.addPlugin(new EventLoopPlugin(daemon.eventLoop, pipeFds[0]));
+		daemon.start();
+		sent = measure(daemon, "Event loop plugin", seconds, nullptr, true, pipeFds);
+		check((int)latencies.size() == sent, "the event loop plugin receives all events");
+		daemon.stop();
+		daemon.removePlugins();
+		printf("Periodic work items: %d\n", fetches);
+
+		close(pipeFds[0]);
+		close(pipeFds[1]);
+	} catch (Poco::Exception& e) {
+		check(false, "unexpected exception: " + e.displayText());
+	}
+
+	return checkResult();
+}
@@ -0,0 +1,143 @@
+// Checks the port state settings that the configure*Port functions and the SceneSelectPort share.
+// The settings of a configuration section are read into a PortState without changing the port,
+// and then applied to the port. The checks cover the settings of digital, analog, select and
+// dial ports, a dial position that is out of range, the rejection of invalid settings, and the
+// state settings of a port section that is configured with configureDigitalPort.
+//
+// Usage: port_state_check
+
+#include <stdio.h>
+
+#include "Poco/Util/MapConfiguration.h"
+#include "Poco/AutoPtr.h"
+
+#include "LinuxOPDID.h"
+
+#include "check.h"
+
+// the main OPDI instance is declared here
+opdid::AbstractOPDID* Opdi = nullptr;
+
+namespace {
+
+/** Returns true if parsing the settings throws an exception. */
+bool rejected(opdid::AbstractOPDID& daemon, Poco::Util::AbstractConfiguration* config, opdi::Port* port) {
+	opdid::AbstractOPDID::PortState state;
+	try {
+		daemon.parsePortState(config, port, state);
+	} catch (Poco::Exception&) {
+		return true;
+	}
+	return false;
+}
+
+}	// end anonymous namespace
+
+int main(int, char**) {
+	opdid::LinuxOPDID daemon;
+	Opdi = &daemon;
+
+	try {
+		// digital port
+		{
+			opdi::DigitalPort port("Digital");
+			Poco::AutoPtr<Poco::Util::MapConfiguration> config = new Poco::Util::MapConfiguration();
+			config->setString("Mode", "Output");
+			config->setString("Line", "High");
+			opdid::AbstractOPDID::PortState state;
+			bool parsed = daemon.parsePortState(config, &port, state);
+			check(parsed && (state.mode == OPDI_DIGITAL_MODE_OUTPUT) && (state.line == 1), "the mode and line of a digital port are read");
+			check((port.getMode() != OPDI_DIGITAL_MODE_OUTPUT), "reading the settings does not change the port");
+			daemon.applyPortState(state);
+			uint8_t mode;
+			uint8_t line;
+			port.getState(&mode, &line);
+			check((mode == OPDI_DIGITAL_MODE_OUTPUT) && (line == 1), "the mode and line are applied to the digital port");
+
+			Poco::AutoPtr<Poco::Util::MapConfiguration> empty = new Poco::Util::MapConfiguration();
+			daemon.parsePortState(empty, &port, state);
+			check((state.mode == -1) && (state.line == -1), "unspecified settings are -1");
+			daemon.applyPortState(state);
+			port.getState(&mode, &line);
+			check((mode == OPDI_DIGITAL_MODE_OUTPUT) && (line == 1), "unspecified settings do not change the port");
+
+			config->setString("Line", "Middle");
+			check(rejected(daemon, config, &port), "an unknown line is rejected");
+			config->setString("Line", "Low");
+			config->setString("Mode", "Sideways");
+			check(rejected(daemon, config, &port), "an unknown mode is rejected");
+		}
+
+		// analog port
+		{
+			opdi::AnalogPort port("Analog", "Analog", OPDI_PORTDIRCAP_BIDI, OPDI_ANALOG_PORT_CAN_CHANGE_RES | OPDI_ANALOG_PORT_RESOLUTION_10 | OPDI_ANALOG_PORT_RESOLUTION_12);
+			Poco::AutoPtr<Poco::Util::MapConfiguration> config = new Poco::Util::MapConfiguration();
+			config->setString("Mode", "Output");
+			config->setString("Resolution", "10");
+			config->setString("Value", "512");
+			opdid::AbstractOPDID::PortState state;
+			daemon.parsePortState(config, &port, state);
+			daemon.applyPortState(state);
+			uint8_t mode;
+			uint8_t resolution;
+			uint8_t reference;
+			int32_t value;
+			port.getState(&mode, &resolution, &reference, &value);
+			check((mode == 1) && (resolution == 10) && (value == 512), "the mode, resolution and value are applied to the analog port");
+		}
+
+		// select port
+		{
+			const char* items[] = { "Off", "Low", "High", nullptr };
+			opdi::SelectPort port("Select");
+			port.setItems(items);
+			Poco::AutoPtr<Poco::Util::MapConfiguration> config = new Poco::Util::MapConfiguration();
+			config->setString("Position", "2");
+			opdid::AbstractOPDID::PortState state;
+			daemon.parsePortState(config, &port, state);
+			daemon.applyPortState(state);
+			uint16_t position;
+			port.getState(&position);
+			check(position == 2, "the position is applied to the select port");
+			config->setString("Position", "3");
+			check(rejected(daemon, config, &port), "a select position out of range is rejected");
+		}
+
+		// dial port
+		{
+			// the port is not deleted because its destructor requires the data that prepare creates
+			opdi::DialPort* port = new opdi::DialPort("Dial", "Dial", 0, 100, 1);
+			Poco::AutoPtr<Poco::Util::MapConfiguration> config = new Poco::Util::MapConfiguration();
+			config->setString("Position", "42");
+			opdid::AbstractOPDID::PortState state;
+			daemon.parsePortState(config, port, state);
+			daemon.applyPortState(state);
+			int64_t position;
+			port->getState(&position);
+			check(position == 42, "the position is applied to the dial port");
+
+			config->setString("Position", "200");
+			daemon.parsePortState(config, port, state);
+			check(state.invalid, "a dial position out of range is marked as invalid");
+			daemon.applyPortState(state);
+			check(port->getError() == opdi::Port::Error::VALUE_NOT_AVAILABLE, "an invalid dial position sets the port error");
+		}
+
+		// the state settings of a port section
+		{
+			opdi::DigitalPort port("Section");
+			Poco::AutoPtr<Poco::Util::MapConfiguration> config = new Poco::Util::MapConfiguration();
+			config->setString("Mode", "Output");
+			config->setString("Line", "High");
+			daemon.configureDigitalPort(config, &port, true);
+			uint8_t mode;
+			uint8_t line;
+			port.getState(&mode, &line);
+			check((mode == OPDI_DIGITAL_MODE_OUTPUT) && (line == 1), "configureDigitalPort applies the state settings");
+		}
+	} catch (Poco::Exception& e) {
+		check(false, "unexpected exception: " + e.displayText());
+	}
+
+	return checkResult();
+}
@@ -0,0 +1,121 @@
+// Checks the ProcessManager with real processes.
+// The checks cover the captured output and the exit code of a short process, whose output must
+// be delivered completely before its termination is reported, a process whose output exceeds
+// the capacity of the pipe, and a process that writes continuously: its output must be read in
+// bounded portions per frame, so that it cannot block the main loop, until it is killed.
+//
+// Usage: process_manager_check
+
+#include <stdio.h>
+#include <signal.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Poco/Thread.h"
+
+#include "opdi_platformfuncs.h"
+
+#include "LinuxOPDID.h"
+#include "ProcessManager.h"
+
+#include "check.h"
+
+// the main OPDI instance is declared here
+opdid::AbstractOPDID* Opdi = nullptr;
+
+namespace {
+
+/** Collects the output and the termination of a process. */
+class Collector : public opdid::ProcessManager::Listener {
+public:
+	std::string output;
+	std::string errors;
+	bool terminated;
+	int exitCode;
+	bool outputAfterTermination;
+
+	Collector() : terminated(false), exitCode(0), outputAfterTermination(false) {}
+
+	virtual void processTerminated(opdid::ProcessManager::PID, int exitCode) override {
+		this->terminated = true;
+		this->exitCode = exitCode;
+	}
+
+	virtual void processOutput(opdid::ProcessManager::PID, bool isStderr, const char* data, size_t length) override {
+		if (this->terminated)
+			this->outputAfterTermination = true;
+		(isStderr ? this->errors : this->output).append(data, length);
+	}
+};
+
+/** Runs the main loop of the process manager until the process has terminated or the time is up. */
+bool waitForTermination(opdid::ProcessManager& manager, Collector& collector, int timeoutMs) {
+	uint64_t start = opdi_get_time_ms();
+	while (!collector.terminated) {
+		if (opdi_get_time_ms() - start > (uint64_t)timeoutMs)
+			return false;
+		manager.doWork();
+		Poco::Thread::sleep(1);
+	}
+	return true;
+}
+
+}	// end anonymous namespace
+
+int main(int, char**) {
+	opdid::LinuxOPDID daemon;
+	Opdi = &daemon;
+
+	try {
+		opdid::ProcessManager manager(&daemon);
+
+		// output and exit code of a short process
+		{
+			Collector collector;
+			std::vector<std::string> args = { "-c", "echo hello; echo error >&2; exit 3" };
+			manager.launch("sh", args, &collector, true);
+			check(waitForTermination(manager, collector, 5000), "the process terminates");
+			check((collector.output == "hello\n") && (collector.errors == "error\n"), "stdout and stderr are captured");
+			check(collector.exitCode == 3, "the exit code is reported (" + std::to_string(collector.exitCode) + ")");
+			check(!collector.outputAfterTermination, "the output is delivered before the termination");
+		}
+
+		// output that exceeds the capacity of the pipe
+		{
+			Collector collector;
+			std::vector<std::string> args = { "-c", "1000000", "/dev/zero" };
+			manager.launch("head", args, &collector, true);
+			check(waitForTermination(manager, collector, 10000), "a process with a lot of output terminates");
+			check(collector.output.size() == 1000000, "the output is delivered completely (" + std::to_string(collector.output.size()) + " bytes)");
+		}
+
+		// a process that writes continuously
+		{
+			Collector collector;
+			std::vector<std::string> args;
+			opdid::ProcessManager::PID pid = manager.launch("yes", args, &collector, true);
+			size_t maxPerFrame = 0;
+			uint64_t maxFrameUs = 0;
+			for (int i = 0; i < 200; i++) {
+				size_t before = collector.output.size();
+				uint64_t start = monotonicUs();
+				manager.doWork();
+				maxFrameUs = std::max(maxFrameUs, monotonicUs() - start);
+				maxPerFrame = std::max(maxPerFrame, collector.output.size() - before);
+				Poco::Thread::sleep(1);
+			}
+			check(!collector.output.empty() && !collector.terminated, "the output of a running process is delivered");
+			check(maxPerFrame <= 16384, "the output is read in bounded portions (at most " + std::to_string(maxPerFrame) + " bytes per frame)");
+			printf("Longest frame: %.1f ms\n", maxFrameUs / 1000.0);
+			manager.kill(pid);
+			check(waitForTermination(manager, collector, 5000), "the killed process is reaped");
+			check(collector.exitCode == 128 + SIGKILL, "the signal is reported in the exit code (" + std::to_string(collector.exitCode) + ")");
+		}
+	} catch (Poco::Exception& e) {
+		check(false, "unexpected exception: " + e.displayText());
+	}
+
+	return checkResult();
+}
@@ -0,0 +1,206 @@
+// Checks the SerialStreamingPort on pseudo terminals.
+// The port opens the slave side of a pseudo terminal as its serial port, and in bridge mode
+// the slave side of a second one as its bridge port; the check writes and reads the data on
+// the master sides. A frame loop calls the port's doWork method once per millisecond.
+// The checks cover the data integrity in loopback and bridge mode and the teardown of the
+// port, which must join the bridge thread and close both serial ports (the master side of a
+// pseudo terminal reports a hangup when its slave side has been closed).
+// The throughput and the number of bytes per frame are reported for both modes.
+//
+// Usage: serial_streaming_check [number of bytes]
+// The default is 1000000 bytes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include <atomic>
+
+#include "Poco/Util/MapConfiguration.h"
+#include "Poco/AutoPtr.h"
+#include "Poco/Runnable.h"
+#include "Poco/Thread.h"
+#include "Poco/Stopwatch.h"
+
+#include "opdi_platformfuncs.h"
+
+#include "LinuxOPDID.h"
+#include "Ports.h"
+
+#include "check.h"
+
+// the main OPDI instance is declared here
+opdid::AbstractOPDID* Opdi = nullptr;
+
+/** Returns true if the master side of a pseudo terminal reports that its slave side has been closed. */
+static bool hungUp(int master) {
+	struct pollfd pfd;
+	pfd.fd = master;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	return (poll(&pfd, 1, 100) > 0) && (pfd.revents & POLLHUP);
+}
+
+/** Writes a numbered byte sequence of the specified length to the file descriptor. */
+class Writer : public Poco::Runnable {
+public:
+	int fd;
+	size_t length;
+
+	virtual void run(void) override {
+		char block[4096];
+		size_t sent = 0;
+		while (sent < this->length) {
+			size_t size = std::min(sizeof(block), this->length - sent);
+			for (size_t i = 0; i < size; i++)
+				block[i] = (char)((sent + i) % 251);
+			ssize_t code = ::write(this->fd, block, size);
+			if (code > 0) {
+				sent += code;
+			} else {
+				struct pollfd pfd;
+				pfd.fd = this->fd;
+				pfd.events = POLLOUT;
+				pfd.revents = 0;
+				poll(&pfd, 1, 100);
+			}
+		}
+	}
+};
+
+/** Provides access to the work function. */
+class CheckPort : public opdid::SerialStreamingPort {
+public:
+	CheckPort(opdid::AbstractOPDID* opdid, const char* id) : opdid::SerialStreamingPort(opdid, id) {}
+
+	void frame(void) {
+		this->doWork(0);
+	}
+};
+
+/** Calls the doWork method of the port once per millisecond and counts the frames. */
+class FrameLoop : public Poco::Runnable {
+public:
+	CheckPort* port;
+	std::atomic<bool> stopping;
+	uint64_t frames;
+
+	FrameLoop(CheckPort* port) : port(port), stopping(false), frames(0) {}
+
+	virtual void run(void) override {
+		while (!this->stopping) {
+			this->port->frame();
+			this->frames++;
+			Poco::Thread::sleep(1);
+		}
+	}
+};
+
+/** Reads the numbered byte sequence from the file descriptor. Returns false if a byte is wrong
+*   or if no data has arrived for one second. */
+static bool receive(int fd, size_t length) {
+	char block[65536];
+	size_t received = 0;
+	while (received < length) {
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, 1000) <= 0)
+			return false;
+		ssize_t code = ::read(fd, block, sizeof(block));
+		if (code <= 0)
+			continue;
+		for (ssize_t i = 0; i < code; i++)
+			if (block[i] != (char)((received + i) % 251))
+				return false;
+		received += code;
+	}
+	return true;
+}
+
+/** Creates and configures a port on a new pseudo terminal; in bridge mode, the bridge port
+*   uses a second pseudo terminal. Returns the master sides of the terminals. They are not
+*   closed, so that the terminal names, which the daemon has locked, are not reused. */
+static CheckPort* createPort(opdid::AbstractOPDID* daemon, const std::string& id, const std::string& mode, int& serialMaster, int& bridgeMaster) {
+	std::string serialName;
+	std::string bridgeName;
+	serialMaster = openTerminal(serialName);
+	fcntl(serialMaster, F_SETFL, fcntl(serialMaster, F_GETFL) | O_NONBLOCK);
+	bridgeMaster = -1;
+	Poco::AutoPtr<Poco::Util::MapConfiguration> config = new Poco::Util::MapConfiguration();
+	config->setString("SerialPort", serialName);
+	config->setInt("BaudRate", 115200);
+	config->setString("Mode", mode);
+	if (mode == "Bridge") {
+		bridgeMaster = openTerminal(bridgeName);
+		fcntl(bridgeMaster, F_SETFL, fcntl(bridgeMaster, F_GETFL) | O_NONBLOCK);
+		config->setString("BridgePort", bridgeName);
+	}
+	CheckPort* port = new CheckPort(daemon, id.c_str());
+	port->configure(config);
+	port->prepare();
+	return port;
+}
+
+/** Streams the bytes through the port; checks the data and reports the throughput. */
+static void measure(opdid::AbstractOPDID* daemon, const std::string& mode, size_t length) {
+	int serialMaster, bridgeMaster;
+	CheckPort* port = createPort(daemon, mode, mode, serialMaster, bridgeMaster);
+	FrameLoop loop(port);
+	Poco::Thread loopThread;
+	loopThread.start(loop);
+
+	Writer writer;
+	writer.fd = serialMaster;
+	writer.length = length;
+	Poco::Thread writerThread;
+	Poco::Stopwatch watch;
+	watch.start();
+	writerThread.start(writer);
+	bool complete = receive(mode == "Bridge" ? bridgeMaster : serialMaster, length);
+	watch.stop();
+	writerThread.join();
+	loop.stopping = true;
+	loopThread.join();
+
+	check(complete, mode + ": " + std::to_string(length) + " bytes arrive unchanged");
+	double seconds = (double)watch.elapsed() / 1000000;
+	printf("%-10s %10.0f bytes/s %8llu frames %10.1f bytes/frame\n", mode.c_str(), length / seconds,
+		(unsigned long long)loop.frames, (double)length / (loop.frames > 0 ? loop.frames : 1));
+
+	delete port;
+}
+
+int main(int argc, char* argv[]) {
+	long length = (argc > 1 ? atol(argv[1]) : 1000000);
+	if (length < 1) {
+		printf("Invalid number of bytes\n");
+		return 2;
+	}
+
+	opdid::LinuxOPDID daemon;
+	Opdi = &daemon;
+
+	try {
+		// deleting the port stops the bridge thread and closes both serial ports
+		int threads = countThreads();
+		int serialMaster, bridgeMaster;
+		CheckPort* port = createPort(&daemon, "Teardown", "Bridge", serialMaster, bridgeMaster);
+		check(countThreads() == threads + 1, "the bridge thread runs");
+		check(!hungUp(serialMaster) && !hungUp(bridgeMaster), "both serial ports are open");
+		delete port;
+		check(countThreads() == threads, "the bridge thread has been joined when the port is deleted");
+		check(hungUp(serialMaster), "the serial port has been closed");
+		check(hungUp(bridgeMaster), "the bridge port has been closed");
+
+		measure(&daemon, "Loopback", length);
+		measure(&daemon, "Bridge", length);
+	} catch (Poco::Exception& e) {
+		check(false, "unexpected exception: " + e.displayText());
+	}
+
+	return checkResult();
+}
@@ -75,6 +75,9 @@ extern "C" {
 // this device supports the extended protocol
 #define OPDI_EXTENDED_PROTOCOL			1
 
+// this device can send time series data of ports (requires the extended protocol)
+#define OPDI_HAS_TIME_SERIES			1
+
 // extended protocol info buffer (on stack)
 // used for extended device info and extended port state
 #define OPDI_EXTENDED_INFO_LENGTH		64
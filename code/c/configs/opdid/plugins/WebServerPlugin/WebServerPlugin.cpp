@@ -1,4 +1,12 @@
 #include <sstream>
+#include <vector>
+#include <map>
+#include <set>
+#include <atomic>
+#include <typeinfo>
+#include <fstream>
+#include <cfloat>
+#include <iterator>
 
 #include <Poco/File.h>
 #include <Poco/Path.h>
@@ -6,8 +14,15 @@
 #include <Poco/JSON/JSON.h>
 #include <Poco/JSON/Parser.h>
 #include <Poco/JSON/Object.h>
+#include <Poco/JSON/Stringifier.h>
 #include "Poco/BasicEvent.h"
+#include "Poco/Timestamp.h"
 #include "Poco/Delegate.h"
+#include "Poco/Thread.h"
+#include "Poco/Mutex.h"
+#include "Poco/Runnable.h"
+#include "Poco/String.h"
+#include "Poco/StringTokenizer.h"
 
 #include "opdi_constants.h"
 #include "opdi_platformfuncs.h"
@@ -21,13 +36,420 @@
 #include <windows.h>
 #endif
 
+// maximum time the network thread waits for socket events
+#define NETWORK_POLL_TIMEOUT_MS		500
+
+// default time during which port refreshes are collected before their states are pushed to websocket clients
+#define DEFAULT_WEBSOCKET_PUSH_DELAY_MS	100
+
+// no messages are sent to a websocket client while more than this number of bytes are waiting to be sent
+#define MAX_WEBSOCKET_BACKLOG			65536
+
+// default maximum size of the static file cache in kilobytes
+#define DEFAULT_FILE_CACHE_SIZE_KB		4096
+
+// default time in seconds that browsers may use cached static files without revalidation
+#define DEFAULT_CACHE_MAX_AGE			3600
+
+// default time in seconds after which idle keep-alive connections are closed
+#define DEFAULT_KEEP_ALIVE_TIMEOUT		30
+
+// minimum interval in milliseconds between checks whether a cached file has changed
+#define FILE_CACHE_CHECK_INTERVAL_MS	1000
+
 namespace {
 
+////////////////////////////////////////////////////////////////////////
+// Static file cache
+////////////////////////////////////////////////////////////////////////
+
+/** Holds the content of static files in memory together with a strong ETag that is
+*   derived from the content. If a precompressed variant (file name plus ".gz") exists,
+*   it is cached as well. Files are checked for changes at most once per second.
+*   Files in directories that contain an authentication file are not cached so that
+*   they are served (and protected) by Mongoose.
+*   The cache is used on the network thread only.
+*/
+class StaticFileCache {
+public:
+	struct Entry {
+		std::string content;
+		std::string etag;
+		std::string gzContent;		// empty if there is no precompressed variant
+		std::string gzETag;
+		std::string mimeType;
+		Poco::Timestamp modified;
+		Poco::Timestamp gzModified;
+		uint64_t lastCheck;
+	};
+
+protected:
+	typedef std::map<std::string, Entry> EntryMap;
+
+	EntryMap entries;
+	size_t maxSize;
+	size_t size;
+	std::string authFile;
+
+	static std::string calculateETag(const std::string& content);
+
+	static std::string getMimeType(const std::string& path);
+
+	static bool readFile(const std::string& path, std::string& content);
+
+	void remove(EntryMap::iterator it);
+
+public:
+	StaticFileCache() {
+		this->maxSize = 0;
+		this->size = 0;
+	};
+
+	/** Sets the maximum total size of the cached content in bytes (0 disables the cache)
+	* and the name of the per-directory authentication file. */
+	void configure(size_t maxSize, const std::string& authFile);
+
+	bool isEnabled(void) {
+		return this->maxSize > 0;
+	};
+
+	/** Returns the entry for the file with the specified path, or nullptr if the file
+	* does not exist or cannot be cached. */
+	const Entry* get(const std::string& path);
+};
+
+void StaticFileCache::configure(size_t maxSize, const std::string& authFile) {
+	this->maxSize = maxSize;
+	this->authFile = authFile;
+}
+
+std::string StaticFileCache::calculateETag(const std::string& content) {
+	// 64 bit FNV-1a hash of the content
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < content.size(); i++) {
+		hash ^= (uint8_t)content[i];
+		hash *= 1099511628211ULL;
+	}
+	char buf[40];
+	snprintf(buf, sizeof(buf), "\"%08x%08x-%x\"", (uint32_t)(hash >> 32), (uint32_t)hash, (unsigned int)content.size());
+	return buf;
+}
+
+std::string StaticFileCache::getMimeType(const std::string& path) {
+	static const char* types[][2] = {
+		{ "html", "text/html; charset=utf-8" },
+		{ "htm", "text/html; charset=utf-8" },
+		{ "css", "text/css" },
+		{ "js", "application/javascript" },
+		{ "json", "application/json" },
+		{ "txt", "text/plain" },
+		{ "xml", "text/xml" },
+		{ "png", "image/png" },
+		{ "gif", "image/gif" },
+		{ "jpg", "image/jpeg" },
+		{ "jpeg", "image/jpeg" },
+		{ "svg", "image/svg+xml" },
+		{ "ico", "image/x-icon" },
+		{ "woff", "application/font-woff" },
+		{ "woff2", "font/woff2" },
+		{ "ttf", "application/x-font-ttf" }
+	};
+	std::string extension = Poco::toLower(Poco::Path(path).getExtension());
+	for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+		if (extension == types[i][0])
+			return types[i][1];
+	return "application/octet-stream";
+}
+
+bool StaticFileCache::readFile(const std::string& path, std::string& content) {
+	std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+	if (!in.is_open())
+		return false;
+	content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	return !in.bad();
+}
+
+void StaticFileCache::remove(EntryMap::iterator it) {
+	this->size -= it->second.content.size() + it->second.gzContent.size();
+	this->entries.erase(it);
+}
+
+const StaticFileCache::Entry* StaticFileCache::get(const std::string& path) {
+	uint64_t now = opdi_get_time_ms();
+	auto it = this->entries.find(path);
+	if ((it != this->entries.end()) && (now - it->second.lastCheck < FILE_CACHE_CHECK_INTERVAL_MS))
+		return &it->second;
+
+	try {
+		Poco::Path filePath(path);
+		Poco::File file(path);
+		if ((filePath.getFileName() == this->authFile) || !file.exists() || !file.isFile()
+			|| Poco::File(filePath.parent().toString() + this->authFile).exists()) {
+			if (it != this->entries.end())
+				this->remove(it);
+			return nullptr;
+		}
+
+		Poco::Timestamp modified = file.getLastModified();
+		Poco::File gzFile(path + ".gz");
+		Poco::Timestamp gzModified(0);
+		if (gzFile.exists() && gzFile.isFile())
+			gzModified = gzFile.getLastModified();
+
+		if (it != this->entries.end()) {
+			if ((it->second.modified == modified) && (it->second.gzModified == gzModified)
+				&& (it->second.content.size() == (size_t)file.getSize())) {
+				it->second.lastCheck = now;
+				return &it->second;
+			}
+			this->remove(it);
+		}
+
+		// the size is checked before loading to avoid reading large files
+		size_t fileSize = (size_t)file.getSize() + (gzModified.epochMicroseconds() != 0 ? (size_t)gzFile.getSize() : 0);
+		if (this->size + fileSize > this->maxSize)
+			return nullptr;
+
+		Entry entry;
+		if (!readFile(path, entry.content))
+			return nullptr;
+		entry.etag = calculateETag(entry.content);
+		if ((gzModified.epochMicroseconds() != 0) && readFile(path + ".gz", entry.gzContent))
+			entry.gzETag = calculateETag(entry.gzContent);
+		entry.mimeType = getMimeType(path);
+		entry.modified = modified;
+		entry.gzModified = gzModified;
+		entry.lastCheck = now;
+
+		size_t entrySize = entry.content.size() + entry.gzContent.size();
+		if (this->size + entrySize > this->maxSize)
+			return nullptr;
+		this->size += entrySize;
+		return &(this->entries[path] = entry);
+	} catch (Poco::Exception&) {
+		// the file is served by Mongoose
+		return nullptr;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////
+// JSON writer
+////////////////////////////////////////////////////////////////////////
+
+/** Writes JSON directly into a string buffer without building a document tree.
+*   Commas are inserted automatically; the caller is responsible for a correct nesting
+*   of objects and arrays. The buffer is not cleared so that it can be reused.
+*/
+class JsonWriter {
+protected:
+	std::string& out;
+	std::vector<bool> first;	// per nesting level: no value written yet
+	bool afterKey;
+
+	void separate(void) {
+		if (this->afterKey) {
+			this->afterKey = false;
+			return;
+		}
+		if (this->first.empty())
+			return;
+		if (!this->first.back())
+			this->out.push_back(',');
+		this->first.back() = false;
+	};
+
+	void writeString(const char* str, size_t length);
+
+public:
+	explicit JsonWriter(std::string& buffer): out(buffer) {
+		this->afterKey = false;
+	};
+
+	void beginObject(void) {
+		this->separate();
+		this->out.push_back('{');
+		this->first.push_back(true);
+	};
+
+	void endObject(void) {
+		this->out.push_back('}');
+		this->first.pop_back();
+	};
+
+	void beginArray(void) {
+		this->separate();
+		this->out.push_back('[');
+		this->first.push_back(true);
+	};
+
+	void endArray(void) {
+		this->out.push_back(']');
+		this->first.pop_back();
+	};
+
+	void key(const char* name) {
+		this->separate();
+		this->writeString(name, strlen(name));
+		this->out.push_back(':');
+		this->afterKey = true;
+	};
+
+	void value(const char* str) {
+		this->separate();
+		this->writeString(str, strlen(str));
+	};
+
+	void value(const std::string& str) {
+		this->separate();
+		this->writeString(str.c_str(), str.size());
+	};
+
+	void value(int64_t number);
+
+	void value(uint64_t number);
+
+	void value(int number) {
+		this->value((int64_t)number);
+	};
+
+	void value(unsigned int number) {
+		this->value((uint64_t)number);
+	};
+
+	void value(bool flag) {
+		this->separate();
+		this->out.append(flag ? "true" : "false");
+	};
+
+	void value(double number);
+
+	/** Writes the value of a JSON-RPC id or parameter. */
+	void value(const Poco::Dynamic::Var& var);
+
+	void null(void) {
+		this->separate();
+		this->out.append("null");
+	};
+
+	template <typename T>
+	void property(const char* name, const T& v) {
+		this->key(name);
+		this->value(v);
+	};
+};
+
+void JsonWriter::writeString(const char* str, size_t length) {
+	static const char hex[] = "0123456789abcdef";
+	this->out.push_back('"');
+	// copy runs of characters that need no escaping at once
+	size_t start = 0;
+	for (size_t i = 0; i < length; i++) {
+		unsigned char c = (unsigned char)str[i];
+		if ((c >= 0x20) && (c != '"') && (c != '\\'))
+			continue;
+		this->out.append(str + start, i - start);
+		start = i + 1;
+		this->out.push_back('\\');
+		switch (c) {
+		case '"': this->out.push_back('"'); break;
+		case '\\': this->out.push_back('\\'); break;
+		case '\n': this->out.push_back('n'); break;
+		case '\r': this->out.push_back('r'); break;
+		case '\t': this->out.push_back('t'); break;
+		case '\b': this->out.push_back('b'); break;
+		case '\f': this->out.push_back('f'); break;
+		default:
+			this->out.append("u00");
+			this->out.push_back(hex[c >> 4]);
+			this->out.push_back(hex[c & 0x0f]);
+		}
+	}
+	this->out.append(str + start, length - start);
+	this->out.push_back('"');
+}
+
+void JsonWriter::value(int64_t number) {
+	if (number < 0) {
+		this->separate();
+		this->out.push_back('-');
+		// negate as unsigned to handle the minimum value
+		uint64_t magnitude = (uint64_t)0 - (uint64_t)number;
+		char buf[24];
+		char* p = buf + sizeof(buf);
+		do {
+			*--p = (char)('0' + magnitude % 10);
+			magnitude /= 10;
+		} while (magnitude > 0);
+		this->out.append(p, buf + sizeof(buf) - p);
+	} else
+		this->value((uint64_t)number);
+}
+
+void JsonWriter::value(uint64_t number) {
+	this->separate();
+	char buf[24];
+	char* p = buf + sizeof(buf);
+	do {
+		*--p = (char)('0' + number % 10);
+		number /= 10;
+	} while (number > 0);
+	this->out.append(p, buf + sizeof(buf) - p);
+}
+
+void JsonWriter::value(double number) {
+	// JSON does not support infinity and NaN
+	if (number != number || number > DBL_MAX || number < -DBL_MAX) {
+		this->null();
+		return;
+	}
+	this->separate();
+	char buf[32];
+	int len = snprintf(buf, sizeof(buf), "%.15g", number);
+	this->out.append(buf, len);
+}
+
+void JsonWriter::value(const Poco::Dynamic::Var& var) {
+	if (var.isEmpty())
+		this->null();
+	else
+	if (var.isString())
+		this->value(var.extract<std::string>());
+	else
+	if (var.isBoolean())
+		this->value(var.convert<bool>());
+	else
+	if (var.isInteger())
+		if (var.isSigned())
+			this->value(var.convert<int64_t>());
+		else
+			this->value(var.convert<uint64_t>());
+	else
+	if (var.isNumeric())
+		this->value(var.convert<double>());
+	else {
+		// structured values are rare; use the Poco stringifier
+		std::stringstream sOut;
+		Poco::JSON::Stringifier::stringify(var, sOut);
+		this->separate();
+		this->out.append(sOut.str());
+	}
+}
+
 ////////////////////////////////////////////////////////////////////////
 // Plugin main class
 ////////////////////////////////////////////////////////////////////////
 
-class WebServerPlugin : public IOPDIDPlugin, public opdid::IOPDIDConnectionListener, public opdi::DigitalPort {
+/** The web server runs on its own network thread which handles all socket I/O and serves static files.
+*   The network thread runs while the plugin is started.
+*   JSON-RPC requests are parsed on the network thread and queued; they are executed on the main thread
+*   because ports may only be accessed from the main thread. When the queue becomes non-empty, the network
+*   thread starts an event loop timer which executes all queued requests in one batch.
+*   The responses and websocket messages are queued for the network thread which is woken up using a socket pair.
+*   Mongoose connections are only ever accessed on the network thread.
+*   Refreshed ports are collected for the push delay; then their states are sent to the websocket clients.
+*   The states are coalesced per client so that a slow client receives the latest states instead of a backlog.
+*/
+class WebServerPlugin : public IOPDIDPlugin, public opdid::IOPDIDConnectionListener, public opdi::DigitalPort, public Poco::Runnable, protected opdid::EventLoop::Listener {
 
 	class InvalidRequestException : public Poco::Exception
 	{
@@ -58,6 +480,107 @@ class WebServerPlugin : public IOPDIDPlugin, public opdid::IOPDIDConnectionListe
 
 	std::string jsonRpcUrl;
 
+	// static file serving (network thread only)
+	StaticFileCache fileCache;
+	std::string documentRootDir;		// with trailing separator
+	int cacheMaxAge;
+	int keepAliveTimeout;
+
+	/** A single call of a JSON-RPC request. */
+	struct JsonRpcCall {
+		Poco::Dynamic::Var id;
+		std::string method;
+		Poco::Dynamic::Var params;
+		bool notification;			// the call has no id and is not answered
+		std::string response;		// already set if the call is invalid
+	};
+
+	/** A JSON-RPC request or batch that has been received on the network thread. */
+	struct JsonRpcRequest {
+		uintptr_t connection;
+		bool batch;
+		std::vector<JsonRpcCall> calls;
+	};
+
+	/** Port info JSON strings by port ID. */
+	typedef std::map<std::string, std::string> PortStateMap;
+
+	/** A message that is to be sent on the network thread. */
+	struct OutgoingMessage {
+		enum Type {
+			JSON_RPC_RESPONSE,
+			PORT_STATES,
+			REFRESH_ALL
+		};
+		Type type;
+		uintptr_t connection;		// connection of the JSON-RPC request
+		std::string data;			// JSON-RPC response
+		PortStateMap states;		// states of the refreshed ports
+	};
+
+	/** The messages that are waiting to be sent to a websocket client. */
+	struct WebSocketClient {
+		bool refreshAll;
+		PortStateMap states;
+	};
+
+	Poco::Thread networkThread;
+	std::atomic<bool> stopping;
+
+	// queues shared between the main thread and the network thread
+	Poco::Mutex queueMutex;
+	std::vector<JsonRpcRequest> requests;
+	std::vector<OutgoingMessage> outgoing;
+
+	// the main thread writes to the first socket to wake up the network thread
+	sock_t wakeupSockets[2];
+	std::atomic<bool> wakeupPending;
+
+	// connections that wait for a JSON-RPC response (network thread only)
+	uintptr_t lastConnectionID;
+	std::map<uintptr_t, struct mg_connection*> waitingConnections;
+
+	// websocket clients (network thread only)
+	std::map<struct mg_connection*, WebSocketClient> webSocketClients;
+	std::atomic<int> webSocketClientCount;
+
+	// reused for building JSON-RPC responses (main thread only)
+	std::string responseBuffer;
+
+	// refreshed ports whose states have not yet been pushed (main thread only)
+	std::set<std::string> refreshedPorts;
+	opdid::EventLoop::TimerID pushTimer;		// pushes the states after the push delay
+	uint64_t pushDelayMs;
+
+	/** Queues the message for the network thread. */
+	void queueMessage(const OutgoingMessage& message);
+
+	/** Sends the pending messages to the websocket client unless its backlog is too large. */
+	void sendToWebSocketClient(struct mg_connection* nc, WebSocketClient& client);
+
+	/** Makes the network thread send the queued messages. */
+	void wakeupNetworkThread(void);
+
+	/** Parses the JSON-RPC request on the network thread and queues it for execution. */
+	void receiveJsonRpc(struct mg_connection* nc, struct http_message* hm);
+
+	/** Validates the request object and stores its content in the call. */
+	void parseJsonRpcCall(Poco::Dynamic::Var& request, JsonRpcCall& call);
+
+	/** Executes the JSON-RPC request or batch on the main thread and appends the response to the buffer.
+	* Nothing is appended if the request consists of notifications only. */
+	void executeJsonRpc(JsonRpcRequest& request, std::string& out);
+
+	/** Executes a single JSON-RPC call and appends its response object to the buffer unless the call is a notification. */
+	void executeJsonRpcCall(JsonRpcCall& call, std::string& out);
+
+	/** Sends the JSON content as HTTP response, or 204 No Content if it is empty.
+	* Closes the connection afterwards unless keep-alive has been requested. */
+	void sendHttpResponse(struct mg_connection* nc, const std::string& json);
+
+	/** Serves the requested file from the static file cache. Returns false if the request is to be handled by Mongoose. */
+	bool serveStaticFile(struct mg_connection* nc, struct http_message* hm);
+
 public:
 	WebServerPlugin(): opdi::DigitalPort("WebServerPlugin"), mgr() {
 		memset(&this->s_http_server_opts, 0, sizeof(mg_serve_http_opts));
@@ -67,13 +590,41 @@ public:
 		this->indexFiles = "index.html";
 		this->jsonRpcUrl = "/api/jsonrpc";
 		this->nc = nullptr;
+		this->wakeupSockets[0] = INVALID_SOCKET;
+		this->wakeupSockets[1] = INVALID_SOCKET;
+		this->wakeupPending = false;
+		this->lastConnectionID = 0;
+		this->webSocketClientCount = 0;
+		this->stopping = false;
+		this->pushTimer = 0;
+		this->pushDelayMs = DEFAULT_WEBSOCKET_PUSH_DELAY_MS;
+		this->cacheMaxAge = DEFAULT_CACHE_MAX_AGE;
+		this->keepAliveTimeout = DEFAULT_KEEP_ALIVE_TIMEOUT;
 	};
 
 	virtual void setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std::string& node, Poco::Util::AbstractConfiguration* nodeConfig) override;
 
+	virtual void startPlugin(void) override;
+
+	virtual void stopPlugin(void) override;
+
 	void handleEvent(struct mg_connection* nc, int ev, void* p);
 
-	virtual uint8_t doWork(uint8_t canSend) override;
+	/** Sends the queued messages; called on the network thread. */
+	void sendOutgoing(void);
+
+	// network thread method
+	virtual void run(void) override;
+
+	/** Executes the received JSON-RPC requests on the main thread and queues the responses. */
+	void executeRequests(void);
+
+	/** Queues the states of the ports that have been refreshed during the push delay. */
+	void pushPortStates(void);
+
+	/** The push timer pushes the port states; other timers are started by the network thread
+	* when requests have been received. */
+	virtual void timerExpired(opdid::EventLoop::TimerID id) override;
 
 	virtual void masterConnected(void) override;
 	virtual void masterDisconnected(void) override;
@@ -83,41 +634,58 @@ public:
 	
 	// JSON-RPC functions
 
+	/** Writes a JSON-RPC error response to the buffer. */
+	void writeJsonRpcError(std::string& out, const Poco::Dynamic::Var& id, int code, const std::string& message);
+
+	/** Returns the JSON-RPC error response. */
+	std::string jsonRpcError(Poco::Dynamic::Var id, int code, const std::string& message);
+
 	void sendJsonRpcError(struct mg_connection* nc, Poco::Dynamic::Var id, int code, const std::string& message);
 
-	/** This method returns the state of the given port as a JSON object. */
-	Poco::JSON::Object jsonGetPortState(opdi::Port* port);
+	/** Writes the state of the given port as a JSON object. */
+	void writePortState(JsonWriter& writer, opdi::Port* port);
+
+	/** Writes information about the given port as a JSON object. */
+	void writePortInfo(JsonWriter& writer, opdi::Port* port);
 
-	/** This method returns information about the given port as a JSON object. */
-	Poco::JSON::Object jsonGetPortInfo(opdi::Port* port);
+	/** Writes the list of (non-hidden) ports as a JSON array. */
+	void writePortList(JsonWriter& writer);
 
-	/** This method returns the list of (non-hidden) ports as a JSON array. */
-	Poco::JSON::Array jsonGetPortList();
+	/** Writes the list of groups as a JSON array. */
+	void writePortGroups(JsonWriter& writer);
 
-	/** This method returns the list of groups as a JSON array. */
-	Poco::JSON::Array jsonGetPortGroups();
+	/** This method writes information about the device (name, ports, groups, ...) as a JSON object. */
+	void jsonRpcGetDeviceInfo(Poco::Dynamic::Var& params, JsonWriter& writer);
 
-	/** This method returns information about the device (name, ports, groups, ...) as a JSON object. */
-	Poco::JSON::Object jsonRpcGetDeviceInfo(struct mg_connection* nc, struct http_message* hm, Poco::Dynamic::Var& params);
+	/** This method expects the port ID in the portID parameter of the params object.
+	* It returns the port whose info object is to be sent. */
+	opdi::Port* jsonRpcGetPortInfo(Poco::Dynamic::Var& params);
 
-	/** This method expects the port ID in the portID parameter of the params object. */
-	Poco::JSON::Object jsonRpcGetPortInfo(struct mg_connection* nc, struct http_message* hm, Poco::Dynamic::Var& params);
+	/** This method writes the info objects of all (non-hidden) ports as a JSON array. If the optional
+	* group parameter is specified, only the ports of this group and its subgroups are written. */
+	void jsonRpcGetAllPortStates(Poco::Dynamic::Var& params, JsonWriter& writer);
 
 	/** This method expects the port ID in the portID parameter and the new line state in the line parameter of the params object.
-	* It returns the port info object. */
-	Poco::JSON::Object jsonRpcSetDigitalState(struct mg_connection* nc, struct http_message* hm, Poco::Dynamic::Var& params);
+	* It returns the port whose info object is to be sent. */
+	opdi::Port* jsonRpcSetDigitalState(Poco::Dynamic::Var& params);
 
 	/** This method expects the port ID in the portID parameter and the new value in the value parameter of the params object.
-	* It returns the port info object. */
-	Poco::JSON::Object jsonRpcSetAnalogValue(struct mg_connection* nc, struct http_message* hm, Poco::Dynamic::Var& params);
+	* It returns the port whose info object is to be sent. */
+	opdi::Port* jsonRpcSetAnalogValue(Poco::Dynamic::Var& params);
 
 	/** This method expects the port ID in the portID parameter and the new position in the position parameter of the params object.
-	* It returns the port info object. */
-	Poco::JSON::Object jsonRpcSetDialPosition(struct mg_connection* nc, struct http_message* hm, Poco::Dynamic::Var& params);
+	* It returns the port whose info object is to be sent. */
+	opdi::Port* jsonRpcSetDialPosition(Poco::Dynamic::Var& params);
 
 	/** This method expects the port ID in the portID parameter and the new position in the position parameter of the params object.
-	* It returns the port info object. */
-	Poco::JSON::Object jsonRpcSetSelectPosition(struct mg_connection* nc, struct http_message* hm, Poco::Dynamic::Var& params);
+	* It returns the port whose info object is to be sent. */
+	opdi::Port* jsonRpcSetSelectPosition(Poco::Dynamic::Var& params);
+
+	/** This method expects the port ID in the portID parameter. Optional parameters are from and to (milliseconds
+	* since the epoch; default is the last 24 hours) and maxPoints (default 500).
+	* It writes the resolution in milliseconds (0 for raw samples) and the points as an array of
+	* [time, min, max, average] arrays. */
+	void jsonRpcGetTimeSeries(Poco::Dynamic::Var& params, JsonWriter& writer);
 };
 
 }	// end anonymous namespace
@@ -130,20 +698,29 @@ static void ev_handler(struct mg_connection* nc, int ev, void* p) {
 	instance->handleEvent(nc, ev, p);
 }
 
-Poco::JSON::Object WebServerPlugin::jsonGetPortState(opdi::Port* port) {
-	Poco::JSON::Object result;
+// Mongoose event handler function for the wakeup socket
+static void wakeup_handler(struct mg_connection* nc, int ev, void* /*p*/) {
+	if (ev == MG_EV_RECV) {
+		// the content is irrelevant
+		mbuf_remove(&nc->recv_mbuf, nc->recv_mbuf.len);
+		instance->sendOutgoing();
+	}
+}
+
+void WebServerPlugin::writePortState(JsonWriter& writer, opdi::Port* port) {
+	writer.beginObject();
 	if (port->hasError())
-		result.set("error", this->to_string(port->getError()));
+		writer.property("error", this->to_string(port->getError()));
 	else
 		try {
-			// query port state
+			// query port state (before writing, as querying may fail)
 			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_DIGITAL)) {
 				opdi::DigitalPort* dport = (opdi::DigitalPort*)port;
 				uint8_t mode;
 				uint8_t line;
 				dport->getState(&mode, &line);
-				result.set("mode", mode);
-				result.set("line", line);
+				writer.property("mode", mode);
+				writer.property("line", line);
 			} else
 			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_ANALOG)) {
 				uint8_t mode;
@@ -151,60 +728,61 @@ Poco::JSON::Object WebServerPlugin::jsonGetPortState(opdi::Port* port) {
 				uint8_t reference;
 				int32_t value;
 				((opdi::AnalogPort*)port)->getState(&mode, &resolution, &reference, &value);
-				result.set("mode", mode);
-				result.set("resolution", resolution);
-				result.set("reference", reference);
-				result.set("value", value);
+				writer.property("mode", mode);
+				writer.property("resolution", resolution);
+				writer.property("reference", reference);
+				writer.property("value", value);
 			} else
 			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_DIAL)) {
 				opdi::DialPort* dport = (opdi::DialPort*)port;
 				int64_t position;
 				dport->getState(&position);
-				result.set("position", position);
+				writer.property("position", position);
 			} else
 			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_SELECT)) {
 				opdi::SelectPort* sport = (opdi::SelectPort*)port;
 				uint16_t position;
 				sport->getState(&position);
-				result.set("position", position);
+				writer.property("position", position);
 			} else
 				throw Poco::Exception("Port " + port->ID() + ": The port type is unknown");
 		} catch (Poco::Exception&) {
-			result.set("error", this->to_string(port->getError()));
+			writer.property("error", this->to_string(port->getError()));
 		}
-
-	return result;
+	writer.endObject();
 }
 
-Poco::JSON::Object WebServerPlugin::jsonGetPortInfo(opdi::Port* port) {
-	Poco::JSON::Object result;
-	result.set("id", port->ID());
-	result.set("type", port->getType());
-	result.set("label", port->getLabel());
-	result.set("dirCaps", port->getDirCaps());
-	result.set("flags", port->getFlags());
-	result.set("readonly", port->isReadonly());
+void WebServerPlugin::writePortInfo(JsonWriter& writer, opdi::Port* port) {
+	writer.beginObject();
+	writer.property("id", port->ID());
+	writer.property("type", port->getType());
+	writer.property("label", port->getLabel());
+	writer.property("dirCaps", port->getDirCaps());
+	writer.property("flags", port->getFlags());
+	writer.property("readonly", port->isReadonly());
 	if (0 == strcmp(port->getType(), OPDI_PORTTYPE_DIAL)) {
 		opdi::DialPort* dport = (opdi::DialPort*)port;
-		result.set("min", dport->getMin());
-		result.set("max", dport->getMax());
-		result.set("step", dport->getStep());
+		writer.property("min", dport->getMin());
+		writer.property("max", dport->getMax());
+		writer.property("step", dport->getStep());
 	} else
 		if (0 == strcmp(port->getType(), OPDI_PORTTYPE_SELECT)) {
 		opdi::SelectPort* sport = (opdi::SelectPort*)port;
-		Poco::JSON::Array positions;
+		writer.key("positions");
+		writer.beginArray();
 		for (uint16_t i = 0; i <= sport->getMaxPosition(); i++) {
-			positions.add(sport->getPositionLabel(i));
+			writer.value(sport->getPositionLabel(i));
 		}
-		result.set("positions", positions);
+		writer.endArray();
 	}
-	result.set("state", this->jsonGetPortState(port));
-	result.set("extendedInfo", port->getExtendedInfo());
-	result.set("extendedState", port->getExtendedState());
-	return result;
+	writer.key("state");
+	this->writePortState(writer, port);
+	writer.property("extendedInfo", port->getExtendedInfo());
+	writer.property("extendedState", port->getExtendedState());
+	writer.endObject();
 }
 
-Poco::JSON::Object WebServerPlugin::jsonRpcGetPortInfo(struct mg_connection* /*nc*/, struct http_message* /*hm*/, Poco::Dynamic::Var& params) {
+opdi::Port* WebServerPlugin::jsonRpcGetPortInfo(Poco::Dynamic::Var& params) {
 	Poco::JSON::Object::Ptr object = params.extract<Poco::JSON::Object::Ptr>();
 	Poco::Dynamic::Var portID = object->get("portID");
 	std::string portIDStr = portID.convert<std::string>();
@@ -216,56 +794,99 @@ Poco::JSON::Object WebServerPlugin::jsonRpcGetPortInfo(struct mg_connection* /*n
 	if (port == NULL)
 		throw Poco::InvalidArgumentException(std::string("Method getPortData: port not found: ") + portIDStr);
 
-	return this->jsonGetPortInfo(port);
+	return port;
 }
 
-Poco::JSON::Array WebServerPlugin::jsonGetPortList() {
-	// return an array of port objects
-	Poco::JSON::Array result;
-	opdi::PortList pl = this->opdi->getPorts();
+void WebServerPlugin::writePortList(JsonWriter& writer) {
+	// write an array of port objects
+	writer.beginArray();
+	opdi::PortList& pl = this->opdi->getPorts();
 	auto it = pl.begin();
 	auto ite = pl.end();
 	while (it != ite) {
 		if (!(*it)->isHidden())
-			result.add(this->jsonGetPortInfo(*it));
+			this->writePortInfo(writer, *it);
 		++it;
 	}
-
-	return result;
+	writer.endArray();
 }
 
-Poco::JSON::Array WebServerPlugin::jsonGetPortGroups() {
-	// return an array of group objects
-	Poco::JSON::Array result;
-	opdi::PortGroupList gl = this->opdi->getPortGroups();
+void WebServerPlugin::writePortGroups(JsonWriter& writer) {
+	// write an array of group objects
+	writer.beginArray();
+	opdi::PortGroupList& gl = this->opdi->getPortGroups();
 	auto it = gl.begin();
 	auto ite = gl.end();
 	while (it != ite) {
-		Poco::JSON::Object group;
-		group.set("id", std::string((*it)->getID()));
-		group.set("label", std::string((*it)->getLabel()));
-		group.set("parent", std::string((*it)->getParent()));
-		result.add(group);
+		writer.beginObject();
+		writer.property("id", (*it)->getID());
+		writer.property("label", (*it)->getLabel());
+		writer.property("parent", (*it)->getParent());
+		writer.endObject();
 		++it;
 	}
-
-	return result;
+	writer.endArray();
 }
 
-Poco::JSON::Object WebServerPlugin::jsonRpcGetDeviceInfo(struct mg_connection* /*nc*/, struct http_message* /*hm*/, Poco::Dynamic::Var& /*params*/) {
-	// return an object that represents the top group
+void WebServerPlugin::jsonRpcGetDeviceInfo(Poco::Dynamic::Var& /*params*/, JsonWriter& writer) {
+	// write an object that represents the top group
 	// sub-groups will be contained in its subgroups member
-	Poco::JSON::Object result;
+	writer.beginObject();
+	writer.property("name", this->opdi->getSlaveName());
+	writer.key("ports");
+	this->writePortList(writer);
+	writer.key("groups");
+	this->writePortGroups(writer);
+	writer.property("info", this->opdid->getDeviceInfo());
+	writer.endObject();
+}
+
+// returns true if the group or one of its parent groups is the specified group
+static bool isInGroup(std::string groupID, const std::string& group, const std::map<std::string, std::string>& parents) {
+	// the depth is limited in case of cyclic group definitions
+	for (size_t depth = 0; (groupID != "") && (depth <= parents.size()); depth++) {
+		if (groupID == group)
+			return true;
+		auto it = parents.find(groupID);
+		if (it == parents.end())
+			return false;
+		groupID = it->second;
+	}
+	return false;
+}
+
+void WebServerPlugin::jsonRpcGetAllPortStates(Poco::Dynamic::Var& params, JsonWriter& writer) {
+	std::string group;
+	if (!params.isEmpty()) {
+		Poco::JSON::Object::Ptr object = params.extract<Poco::JSON::Object::Ptr>();
+		Poco::Dynamic::Var groupVar = object->get("group");
+		if (!groupVar.isEmpty())
+			group = groupVar.convert<std::string>();
+	}
 
-	result.set("name", this->opdi->getSlaveName());
-	result.set("ports", this->jsonGetPortList());
-	result.set("groups", this->jsonGetPortGroups());
-	result.set("info", this->opdid->getDeviceInfo());
+	// parent group IDs by group ID
+	std::map<std::string, std::string> parents;
+	if (group != "") {
+		opdi::PortGroupList& gl = this->opdi->getPortGroups();
+		for (auto it = gl.begin(), ite = gl.end(); it != ite; ++it)
+			parents[(*it)->getID()] = (*it)->getParent();
+		if (parents.find(group) == parents.end())
+			throw Poco::InvalidArgumentException(std::string("Method getAllPortStates: group not found: ") + group);
+	}
 
-	return result;
+	writer.beginArray();
+	opdi::PortList& pl = this->opdi->getPorts();
+	for (auto it = pl.begin(), ite = pl.end(); it != ite; ++it) {
+		if ((*it)->isHidden())
+			continue;
+		if ((group != "") && !isInGroup((*it)->getGroup(), group, parents))
+			continue;
+		this->writePortInfo(writer, *it);
+	}
+	writer.endArray();
 }
 
-Poco::JSON::Object WebServerPlugin::jsonRpcSetDigitalState(struct mg_connection* /*nc*/, struct http_message* /*hm*/, Poco::Dynamic::Var& params) {
+opdi::Port* WebServerPlugin::jsonRpcSetDigitalState(Poco::Dynamic::Var& params) {
 	Poco::JSON::Object::Ptr object = params.extract<Poco::JSON::Object::Ptr>();
 	Poco::Dynamic::Var portID = object->get("portID");
 	if (portID.isEmpty())
@@ -292,10 +913,10 @@ Poco::JSON::Object WebServerPlugin::jsonRpcSetDigitalState(struct mg_connection*
 
 	((opdi::DigitalPort*)port)->setLine(newLine, opdi::Port::ChangeSource::CHANGESOURCE_USER);
 
-	return this->jsonGetPortInfo(port);
+	return port;
 }
 
-Poco::JSON::Object WebServerPlugin::jsonRpcSetAnalogValue(struct mg_connection* /*nc*/, struct http_message* /*hm*/, Poco::Dynamic::Var& params) {
+opdi::Port* WebServerPlugin::jsonRpcSetAnalogValue(Poco::Dynamic::Var& params) {
 	Poco::JSON::Object::Ptr object = params.extract<Poco::JSON::Object::Ptr>();
 	Poco::Dynamic::Var portID = object->get("portID");
 	if (portID.isEmpty())
@@ -319,10 +940,10 @@ Poco::JSON::Object WebServerPlugin::jsonRpcSetAnalogValue(struct mg_connection*
 
 	((opdi::AnalogPort*)port)->setValue(newValue, opdi::Port::ChangeSource::CHANGESOURCE_USER);
 
-	return this->jsonGetPortInfo(port);
+	return port;
 }
 
-Poco::JSON::Object WebServerPlugin::jsonRpcSetDialPosition(struct mg_connection* /*nc*/, struct http_message* /*hm*/, Poco::Dynamic::Var& params) {
+opdi::Port* WebServerPlugin::jsonRpcSetDialPosition(Poco::Dynamic::Var& params) {
 	Poco::JSON::Object::Ptr object = params.extract<Poco::JSON::Object::Ptr>();
 	Poco::Dynamic::Var portID = object->get("portID");
 	if (portID.isEmpty())
@@ -346,10 +967,10 @@ Poco::JSON::Object WebServerPlugin::jsonRpcSetDialPosition(struct mg_connection*
 
 	((opdi::DialPort*)port)->setPosition(newPosition, opdi::Port::ChangeSource::CHANGESOURCE_USER);
 
-	return this->jsonGetPortInfo(port);
+	return port;
 }
 
-Poco::JSON::Object WebServerPlugin::jsonRpcSetSelectPosition(struct mg_connection* /*nc*/, struct http_message* /*hm*/, Poco::Dynamic::Var& params) {
+opdi::Port* WebServerPlugin::jsonRpcSetSelectPosition(Poco::Dynamic::Var& params) {
 	Poco::JSON::Object::Ptr object = params.extract<Poco::JSON::Object::Ptr>();
 	Poco::Dynamic::Var portID = object->get("portID");
 	if (portID.isEmpty())
@@ -373,7 +994,55 @@ Poco::JSON::Object WebServerPlugin::jsonRpcSetSelectPosition(struct mg_connectio
 
 	((opdi::SelectPort*)port)->setPosition(newPosition, opdi::Port::ChangeSource::CHANGESOURCE_USER);
 
-	return this->jsonGetPortInfo(port);
+	return port;
+}
+
+void WebServerPlugin::jsonRpcGetTimeSeries(Poco::Dynamic::Var& params, JsonWriter& writer) {
+	Poco::JSON::Object::Ptr object = params.extract<Poco::JSON::Object::Ptr>();
+	Poco::Dynamic::Var portID = object->get("portID");
+	if (portID.isEmpty())
+		throw Poco::InvalidArgumentException("Method getTimeSeries: parameter portID is missing");
+
+	std::string portIDStr = portID.convert<std::string>();
+	opdid::TimeSeries* series = this->opdid->timeSeriesStore->getTimeSeries(portIDStr);
+	if (series == nullptr)
+		throw Poco::InvalidArgumentException(std::string("Method getTimeSeries: port not found or port has no time series: ") + portIDStr);
+
+	int64_t to = Poco::Timestamp().epochMicroseconds() / 1000;
+	Poco::Dynamic::Var toVar = object->get("to");
+	if (!toVar.isEmpty())
+		to = toVar.convert<int64_t>();
+	int64_t from = to - 24 * 60 * 60 * 1000;
+	Poco::Dynamic::Var fromVar = object->get("from");
+	if (!fromVar.isEmpty())
+		from = fromVar.convert<int64_t>();
+	int maxPoints = 500;
+	Poco::Dynamic::Var maxPointsVar = object->get("maxPoints");
+	if (!maxPointsVar.isEmpty())
+		maxPoints = maxPointsVar.convert<int>();
+	if (maxPoints <= 0)
+		throw Poco::InvalidArgumentException("Method getTimeSeries: parameter maxPoints must be greater than 0");
+
+	std::vector<opdid::TimeSeries::Point> points;
+	int64_t resolution = series->query(from, to, maxPoints, points);
+
+	writer.beginObject();
+	writer.property("portID", portIDStr);
+	writer.property("from", from);
+	writer.property("to", to);
+	writer.property("resolution", resolution);
+	writer.key("points");
+	writer.beginArray();
+	for (auto it = points.begin(), ite = points.end(); it != ite; ++it) {
+		writer.beginArray();
+		writer.value(it->time);
+		writer.value(it->min);
+		writer.value(it->max);
+		writer.value(it->sum / it->count);
+		writer.endArray();
+	}
+	writer.endArray();
+	writer.endObject();
 }
 
 // get sockaddr, IPv4 or IPv6:
@@ -384,27 +1053,352 @@ static void* get_in_addr(struct sockaddr* sa)
     return &(((struct sockaddr_in6*)sa)->sin6_addr);
 }
 
-void WebServerPlugin::sendJsonRpcError(struct mg_connection* nc, Poco::Dynamic::Var id, int code, const std::string& message) {
-	Poco::JSON::Object error;
-	error.set("code", code);
-	error.set("message", message);
+void WebServerPlugin::writeJsonRpcError(std::string& out, const Poco::Dynamic::Var& id, int code, const std::string& message) {
+	JsonWriter writer(out);
+	writer.beginObject();
+	writer.property("jsonrpc", "2.0");
+	writer.property("id", id);
+	writer.key("error");
+	writer.beginObject();
+	writer.property("code", code);
+	writer.property("message", message);
+	writer.endObject();
+	writer.key("result");
+	writer.null();	// will resolve to null on the client
+	writer.endObject();
+}
 
-	// send error response
-	Poco::JSON::Object response;
-	response.set("jsonrpc", "2.0");
-	response.set("id", id);
-	response.set("error", error);
-	response.set("result", Poco::Dynamic::Var());	// will resolve to null on the client
-					
-	std::stringstream sOut;
-	response.stringify(sOut);
-	std::string strOut = sOut.str();
+std::string WebServerPlugin::jsonRpcError(Poco::Dynamic::Var id, int code, const std::string& message) {
+	std::string strOut;
+	this->writeJsonRpcError(strOut, id, code, message);
 
 	this->logDebug("Sending JSON-RPC error: " + strOut);
 
-	mg_printf(nc, "HTTP/1.0 200 OK\r\nContent-Length: %d\r\n"
-		"Content-Type: application/json\r\n\r\n%s",
-		strOut.size(), strOut.c_str());
+	return strOut;
+}
+
+void WebServerPlugin::sendJsonRpcError(struct mg_connection* nc, Poco::Dynamic::Var id, int code, const std::string& message) {
+	this->sendHttpResponse(nc, this->jsonRpcError(id, code, message));
+}
+
+// the connection is to be closed after the response (set when the request is received)
+#define MG_F_CLOSE_AFTER_RESPONSE	MG_F_USER_1
+
+// returns true if the connection may be kept open after the response
+static bool isKeepAlive(struct http_message* hm) {
+	struct mg_str* connection = mg_get_http_header(hm, "Connection");
+	if (mg_vcmp(&hm->proto, "HTTP/1.1") == 0)
+		return (connection == NULL) || (mg_vcasecmp(connection, "close") != 0);
+	return (connection != NULL) && (mg_vcasecmp(connection, "keep-alive") == 0);
+}
+
+void WebServerPlugin::sendHttpResponse(struct mg_connection* nc, const std::string& json) {
+	bool close = (nc->flags & MG_F_CLOSE_AFTER_RESPONSE) != 0;
+	if (json.empty())
+		// a request that consists of notifications only
+		mg_printf(nc, "HTTP/1.1 204 No Content\r\nCache-Control: no-cache\r\nConnection: %s\r\n\r\n",
+			close ? "close" : "keep-alive");
+	else {
+		mg_printf(nc, "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n"
+			"Content-Type: application/json\r\nCache-Control: no-cache\r\nConnection: %s\r\n\r\n",
+			(int)json.size(), close ? "close" : "keep-alive");
+		mg_send(nc, json.c_str(), json.size());
+	}
+	// send data
+	if (close)
+		nc->flags |= MG_F_SEND_AND_CLOSE;
+}
+
+bool WebServerPlugin::serveStaticFile(struct mg_connection* nc, struct http_message* hm) {
+	if (!this->fileCache.isEnabled())
+		return false;
+	bool head = (mg_vcmp(&hm->method, "HEAD") == 0);
+	if (!head && (mg_vcmp(&hm->method, "GET") != 0))
+		return false;
+
+	// determine the file path; unusual requests are left to Mongoose
+	std::vector<char> buf(hm->uri.len + 1);
+	int len = mg_url_decode(hm->uri.p, hm->uri.len, &buf[0], buf.size(), 0);
+	if ((len <= 0) || (buf[0] != '/'))
+		return false;
+	std::string uri(&buf[0] + 1, len - 1);
+	if ((uri.find("..") != std::string::npos) || (uri.find('\\') != std::string::npos))
+		return false;
+
+	const StaticFileCache::Entry* entry = nullptr;
+	if (uri.empty() || (uri[uri.size() - 1] == '/')) {
+		// try the index files
+		Poco::StringTokenizer tokenizer(this->indexFiles, ",", Poco::StringTokenizer::TOK_TRIM | Poco::StringTokenizer::TOK_IGNORE_EMPTY);
+		for (auto it = tokenizer.begin(), ite = tokenizer.end(); (it != ite) && (entry == nullptr); ++it)
+			entry = this->fileCache.get(this->documentRootDir + uri + *it);
+	} else
+		entry = this->fileCache.get(this->documentRootDir + uri);
+	if (entry == nullptr)
+		return false;
+
+	// use the precompressed variant if the client accepts it
+	struct mg_str* acceptEncoding = mg_get_http_header(hm, "Accept-Encoding");
+	bool gzip = !entry->gzContent.empty() && (acceptEncoding != NULL)
+		&& (std::string(acceptEncoding->p, acceptEncoding->len).find("gzip") != std::string::npos);
+	const std::string& content = (gzip ? entry->gzContent : entry->content);
+	const std::string& etag = (gzip ? entry->gzETag : entry->etag);
+
+	bool keepAlive = (this->keepAliveTimeout > 0) && isKeepAlive(hm);
+	std::string headers = "ETag: " + etag + "\r\nCache-Control: max-age=" + this->to_string(this->cacheMaxAge) + "\r\n";
+	if (!entry->gzContent.empty())
+		headers.append("Vary: Accept-Encoding\r\n");
+	headers.append(keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+
+	struct mg_str* ifNoneMatch = mg_get_http_header(hm, "If-None-Match");
+	if ((ifNoneMatch != NULL) && (std::string(ifNoneMatch->p, ifNoneMatch->len).find(etag) != std::string::npos)) {
+		mg_printf(nc, "HTTP/1.1 304 Not Modified\r\n%s\r\n", headers.c_str());
+	} else {
+		if (gzip)
+			headers.append("Content-Encoding: gzip\r\n");
+		mg_printf(nc, "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %d\r\n%s\r\n",
+			entry->mimeType.c_str(), (int)content.size(), headers.c_str());
+		if (!head)
+			mg_send(nc, content.c_str(), content.size());
+	}
+	if (!keepAlive)
+		nc->flags |= MG_F_SEND_AND_CLOSE;
+	return true;
+}
+
+void WebServerPlugin::parseJsonRpcCall(Poco::Dynamic::Var& request, JsonRpcCall& call) {
+	// invalid requests are always answered
+	call.notification = false;
+	Poco::JSON::Object::Ptr object = request.extract<Poco::JSON::Object::Ptr>();
+	Poco::Dynamic::Var method = object->get("method");
+	std::string methodStr = method.convert<std::string>();
+	call.params = object->get("params");
+	call.id = object->get("id");
+	Poco::Dynamic::Var jsonrpc = object->get("jsonrpc");
+	std::string jsonrpcStr = jsonrpc.convert<std::string>();
+
+	// validate request
+	if (jsonrpcStr != "2.0")
+		throw InvalidRequestException("Invalid version number, expected 2.0");
+	if (methodStr == "")
+		throw InvalidRequestException("Method name missing");
+	call.method = methodStr;
+	call.notification = !object->has("id");
+}
+
+void WebServerPlugin::receiveJsonRpc(struct mg_connection* nc, struct http_message* hm) {
+	std::string json(hm->body.p, hm->body.len);
+	this->logDebug("Received JSON-RPC request: " + json);
+	if ((this->keepAliveTimeout > 0) && isKeepAlive(hm))
+		nc->flags &= ~MG_F_CLOSE_AFTER_RESPONSE;
+	else
+		nc->flags |= MG_F_CLOSE_AFTER_RESPONSE;
+	// parse JSON
+	Poco::Dynamic::Var id;
+	try {
+		Poco::JSON::Parser parser;
+		Poco::Dynamic::Var request = parser.parse(json);
+
+		JsonRpcRequest rpcRequest;
+		rpcRequest.batch = (request.type() == typeid(Poco::JSON::Array::Ptr));
+		if (rpcRequest.batch) {
+			// batch: invalid calls are answered in the response array
+			Poco::JSON::Array::Ptr array = request.extract<Poco::JSON::Array::Ptr>();
+			if (array->size() == 0)
+				throw InvalidRequestException("Empty batch");
+			rpcRequest.calls.resize(array->size());
+			for (size_t i = 0; i < array->size(); i++) {
+				JsonRpcCall& call = rpcRequest.calls[i];
+				try {
+					Poco::Dynamic::Var element = array->get(i);
+					this->parseJsonRpcCall(element, call);
+				} catch (Poco::Exception& e) {
+					std::string err("Invalid JSON request: ");
+					err.append(e.message());
+					this->logVerbose("" + err);
+					call.response = this->jsonRpcError(call.id, -32600, err);	// Invalid Request
+				}
+			}
+		} else {
+			rpcRequest.calls.resize(1);
+			JsonRpcCall& call = rpcRequest.calls[0];
+			try {
+				this->parseJsonRpcCall(request, call);
+			} catch (...) {
+				id = call.id;
+				throw;
+			}
+		}
+
+		// the connection is identified by a number because it may be closed before the response is ready
+		rpcRequest.connection = ++this->lastConnectionID;
+		if (nc->user_data != nullptr)
+			// a previous request on this connection will not be answered
+			this->waitingConnections.erase((uintptr_t)nc->user_data);
+		nc->user_data = (void*)rpcRequest.connection;
+		this->waitingConnections[rpcRequest.connection] = nc;
+
+		// the request is executed on the main thread
+		Poco::Mutex::ScopedLock lock(this->queueMutex);
+		this->requests.push_back(rpcRequest);
+		// one timer executes all requests that are received until it expires
+		if (this->requests.size() == 1)
+			this->opdid->eventLoop->addTimer(this, 0);
+
+	// Error handling:
+	// http://www.jsonrpc.org/specification, section 5.1
+	} catch (Poco::JSON::JSONException& e) {
+		// Parse error
+		std::string err("Error processing JSON: ");
+		err.append(e.what());
+		err.append(": ");
+		err.append(e.message());
+		this->logVerbose("" + err);
+		this->sendJsonRpcError(nc, id, -32700, err);	// Parse error
+	} catch (InvalidRequestException& e) {
+		// Invalid Request
+		std::string err("Invalid JSON request: ");
+		err.append(e.message());
+		this->logVerbose("" + err);
+		this->sendJsonRpcError(nc, id, -32600, err);	// Invalid Request
+	} catch (Poco::Exception& e) {
+		// Internal error
+		std::string err("Error processing request: ");
+		err.append(e.what());
+		err.append(": ");
+		err.append(e.message());
+		this->logVerbose("" + err);
+		this->sendJsonRpcError(nc, id, -32603, err);	// Internal error
+	} catch (std::exception& e) {
+		// Internal error
+		std::string err("Error processing request: ");
+		err.append(e.what());
+		this->logVerbose("" + err);
+		this->sendJsonRpcError(nc, id, -32603, err);	// Internal error
+	}
+}
+
+void WebServerPlugin::executeJsonRpc(JsonRpcRequest& request, std::string& out) {
+	size_t start = out.size();
+	for (auto it = request.calls.begin(), ite = request.calls.end(); it != ite; ++it) {
+		size_t callStart = out.size();
+		if (callStart > start)
+			out.push_back(',');
+		size_t responseStart = out.size();
+		// invalid calls have already been answered
+		if (it->response.empty())
+			this->executeJsonRpcCall(*it, out);
+		else
+			out.append(it->response);
+		// notifications have no response
+		if (out.size() == responseStart)
+			out.resize(callStart);
+	}
+	// a batch of notifications is not answered with an empty array
+	if (request.batch && (out.size() > start)) {
+		out.insert(start, 1, '[');
+		out.push_back(']');
+	}
+}
+
+void WebServerPlugin::executeJsonRpcCall(JsonRpcCall& call, std::string& out) {
+	// a partially written response is discarded in case of errors
+	size_t start = out.size();
+	try {
+		JsonWriter writer(out);
+		writer.beginObject();
+		writer.property("jsonrpc", "2.0");
+		writer.property("id", call.id);
+		writer.key("error");
+		writer.null();	// will resolve to null on the client
+		writer.key("result");
+		writer.beginObject();
+		if (call.method == "getDeviceInfo") {
+			writer.key("deviceInfo");
+			this->jsonRpcGetDeviceInfo(call.params, writer);
+		} else
+		if (call.method == "getPortInfo") {
+			opdi::Port* port = this->jsonRpcGetPortInfo(call.params);
+			writer.key("port");
+			this->writePortInfo(writer, port);
+		} else
+		if (call.method == "getAllPortStates") {
+			writer.key("ports");
+			this->jsonRpcGetAllPortStates(call.params, writer);
+		} else
+		if (call.method == "setDigitalState") {
+			opdi::Port* port = this->jsonRpcSetDigitalState(call.params);
+			writer.key("port");
+			this->writePortInfo(writer, port);
+		} else
+		if (call.method == "setAnalogValue") {
+			opdi::Port* port = this->jsonRpcSetAnalogValue(call.params);
+			writer.key("port");
+			this->writePortInfo(writer, port);
+		} else
+		if (call.method == "setDialPosition") {
+			opdi::Port* port = this->jsonRpcSetDialPosition(call.params);
+			writer.key("port");
+			this->writePortInfo(writer, port);
+		} else
+		if (call.method == "setSelectPosition") {
+			opdi::Port* port = this->jsonRpcSetSelectPosition(call.params);
+			writer.key("port");
+			this->writePortInfo(writer, port);
+		} else
+		if (call.method == "getTimeSeries") {
+			writer.key("timeSeries");
+			this->jsonRpcGetTimeSeries(call.params, writer);
+		} else
+			throw MethodNotFoundException(std::string("Unknown JSON-RPC method: ") + call.method);
+		writer.endObject();
+		writer.endObject();
+
+		if (!call.notification)
+			this->logDebug("Sending JSON-RPC response: " + out.substr(start));
+
+	// Error handling:
+	// http://www.jsonrpc.org/specification, section 5.1
+	} catch (MethodNotFoundException& e) {
+		// Method not found
+		std::string err("Method not found: ");
+		err.append(e.message());
+		this->logVerbose("" + err);
+		out.resize(start);
+		out.append(this->jsonRpcError(call.id, -32601, err));	// Method not found
+	} catch (Poco::InvalidArgumentException& e) {
+		// Invalid params
+		std::string err("Invalid parameters: ");
+		err.append(e.message());
+		this->logVerbose("" + err);
+		out.resize(start);
+		out.append(this->jsonRpcError(call.id, -32602, err));	// Invalid params
+	} catch (Poco::Exception& e) {
+		// Internal error
+		std::string err("Error processing request: ");
+		err.append(e.what());
+		err.append(": ");
+		err.append(e.message());
+		this->logVerbose("" + err);
+		out.resize(start);
+		out.append(this->jsonRpcError(call.id, -32603, err));	// Internal error
+	} catch (std::exception& e) {
+		// Internal error
+		std::string err("Error processing request: ");
+		err.append(e.what());
+		this->logVerbose("" + err);
+		out.resize(start);
+		out.append(this->jsonRpcError(call.id, -32603, err));	// Internal error
+	} catch (...) {
+		// Internal error
+		std::string err("Error processing request (unknown error)");
+		this->logVerbose("" + err);
+		out.resize(start);
+		out.append(this->jsonRpcError(call.id, -32603, err));	// Internal error
+	}
+
+	// notifications are executed without a response, even if they fail
+	if (call.notification)
+		out.resize(start);
 }
 
 void WebServerPlugin::handleEvent(struct mg_connection* nc, int ev, void* p) {
@@ -420,148 +1414,152 @@ void WebServerPlugin::handleEvent(struct mg_connection* nc, int ev, void* p) {
 
 			// JSON-RPC url received?
 			if (mg_vcmp(&hm->uri, jsonRpcUrl.c_str()) == 0) {
-				std::string json(hm->body.p, hm->body.len);
-				this->logDebug("Received JSON-RPC request: " + json);
-				// parse JSON
-				Poco::Dynamic::Var id;
-				try {
-					Poco::JSON::Parser parser;
-					Poco::Dynamic::Var request = parser.parse(json);
-					Poco::JSON::Object::Ptr object = request.extract<Poco::JSON::Object::Ptr>();
-					Poco::Dynamic::Var method = object->get("method");
-					std::string methodStr = method.convert<std::string>();
-					Poco::Dynamic::Var params = object->get("params");
-					id = object->get("id");
-					Poco::Dynamic::Var jsonrpc = object->get("jsonrpc");
-					std::string jsonrpcStr = jsonrpc.convert<std::string>();
-
-					// validate request
-					if (jsonrpcStr != "2.0")
-						throw InvalidRequestException("Invalid version number, expected 2.0");
-					if (methodStr == "")
-						throw InvalidRequestException("Method name missing");
-					
-					Poco::JSON::Object result;
-					if (methodStr == "getDeviceInfo") {
-						result.set("deviceInfo", this->jsonRpcGetDeviceInfo(nc, hm, params));
-					} else
-					if (methodStr == "getPortInfo") {
-						result.set("port", this->jsonRpcGetPortInfo(nc, hm, params));
-					} else
-					if (methodStr == "setDigitalState") {
-						result.set("port", this->jsonRpcSetDigitalState(nc, hm, params));
-					} else
-					if (methodStr == "setAnalogValue") {
-						result.set("port", this->jsonRpcSetAnalogValue(nc, hm, params));
-					} else
-					if (methodStr == "setDialPosition") {
-						result.set("port", this->jsonRpcSetDialPosition(nc, hm, params));
-					} else
-					if (methodStr == "setSelectPosition") {
-						result.set("port", this->jsonRpcSetSelectPosition(nc, hm, params));
-					} else
-						throw MethodNotFoundException(std::string("Unknown JSON-RPC method: ") + methodStr);
-
-					// create JSON-RPC response object
-					
-					Poco::JSON::Object response;
-					response.set("jsonrpc", "2.0");
-					response.set("id", id);
-					response.set("error", Poco::Dynamic::Var());	// will resolve to null on the client
-					response.set("result", result);
-					
-					std::stringstream sOut;
-					response.stringify(sOut);
-					std::string strOut = sOut.str();
-
-					this->logDebug("Sending JSON-RPC response: " + strOut);
-
-					// send result
-					mg_printf(nc, "HTTP/1.0 200 OK\r\nContent-Length: %d\r\n"
-						"Content-Type: application/json\r\n\r\n%s",
-						strOut.size(), strOut.c_str());
-
-				// Error handling:
-				// http://www.jsonrpc.org/specification, section 5.1
-				} catch (Poco::JSON::JSONException& e) {
-					// Parse error
-					std::string err("Error processing JSON: ");
-					err.append(e.what());
-					err.append(": ");
-					err.append(e.message());
-					this->logVerbose("" + err);
-					this->sendJsonRpcError(nc, id, -32700, err);	// Parse error
-				} catch (InvalidRequestException& e) {
-					// Invalid Request
-					std::string err("Invalid JSON request: ");
-					err.append(e.message());
-					this->logVerbose("" + err);
-					this->sendJsonRpcError(nc, id, -32600, err);	// Invalid Request
-				} catch (MethodNotFoundException& e) {
-					// Method not found
-					std::string err("Method not found: ");
-					err.append(e.message());
-					this->logVerbose("" + err);
-					this->sendJsonRpcError(nc, id, -32601, err);	// Method not found
-				} catch (Poco::InvalidArgumentException& e) {
-					// Invalid params
-					std::string err("Invalid parameters: ");
-					err.append(e.message());
-					this->logVerbose("" + err);
-					this->sendJsonRpcError(nc, id, -32602, err);	// Invalid params
-				} catch (Poco::Exception& e) {
-					// Internal error
-					std::string err("Error processing request: ");
-					err.append(e.what());
-					err.append(": ");
-					err.append(e.message());
-					this->logVerbose("" + err);
-					this->sendJsonRpcError(nc, id, -32603, err);	// Internal error
-				} catch (std::exception& e) {
-					// Internal error
-					std::string err("Error processing request: ");
-					err.append(e.what());
-					this->logVerbose("" + err);
-					this->sendJsonRpcError(nc, id, -32603, err);	// Internal error
-				} catch (...) {
-					// Internal error
-					std::string err("Error processing request (unknown error)");
-					this->logVerbose("" + err);
-					this->sendJsonRpcError(nc, id, -32603, err);	// Internal error
-				}
-				// send data
-				nc->flags |= MG_F_SEND_AND_CLOSE;
-				break;
+				this->receiveJsonRpc(nc, hm);
 			} else
-				// serve static content
+			// serve static content
+			if (!this->serveStaticFile(nc, hm))
 				mg_serve_http(nc, hm, this->s_http_server_opts);
 			break;
+		case MG_EV_POLL:
+			// close idle keep-alive connections that do not wait for a response
+			if ((this->keepAliveTimeout > 0) && !(nc->flags & (MG_F_LISTENING | MG_F_IS_WEBSOCKET)) && (nc->user_data == nullptr)
+				&& (nc->send_mbuf.len == 0) && (*(time_t*)p - nc->last_io_time > this->keepAliveTimeout))
+				nc->flags |= MG_F_CLOSE_IMMEDIATELY;
+			break;
+		case MG_EV_WEBSOCKET_HANDSHAKE_DONE: {
+			WebSocketClient client;
+			client.refreshAll = false;
+			this->webSocketClients[nc] = client;
+			this->webSocketClientCount = (int)this->webSocketClients.size();
+			break;
+		}
+		case MG_EV_SEND: {
+			// send the states that have been held back
+			auto wsit = this->webSocketClients.find(nc);
+			if (wsit != this->webSocketClients.end())
+				this->sendToWebSocketClient(nc, wsit->second);
+			break;
+		}
+		case MG_EV_CLOSE:
+			// a response that is still being executed can no longer be sent
+			if (nc->user_data != nullptr)
+				this->waitingConnections.erase((uintptr_t)nc->user_data);
+			if (this->webSocketClients.erase(nc) > 0)
+				this->webSocketClientCount = (int)this->webSocketClients.size();
+			break;
 		default:
 			break;
 	  }
 }
 
-void WebServerPlugin::onAllPortsRefreshed(const void* /*pSender*/) {
-	struct mg_connection *c;
-	const char* message = "RefreshAll";
-	int msgLen = strlen(message);
+void WebServerPlugin::queueMessage(const OutgoingMessage& message) {
+	{
+		Poco::Mutex::ScopedLock lock(this->queueMutex);
+		this->outgoing.push_back(message);
+	}
+	this->wakeupNetworkThread();
+}
 
-	for (c = mg_next(&this->mgr, NULL); c != NULL; c = mg_next(&this->mgr, c)) {
-		if (c->flags & MG_F_IS_WEBSOCKET)
-			mg_send_websocket_frame(c, WEBSOCKET_OP_TEXT, message, msgLen);
+void WebServerPlugin::wakeupNetworkThread(void) {
+	// one pending byte is enough; the network thread sends all queued messages
+	if (!this->wakeupPending.exchange(true)) {
+		char signal = 0;
+		send(this->wakeupSockets[0], &signal, 1, 0);
 	}
 }
 
-void WebServerPlugin::onPortRefreshed(const void* /*pSender*/, opdi::Port*& port) {
-	struct mg_connection *c;
-	char buf[255];
+void WebServerPlugin::sendOutgoing(void) {
+	// reset the flag first so that messages queued from now on cause another wakeup
+	this->wakeupPending = false;
 
-	snprintf(buf, sizeof(buf), "Refresh %s", port->ID().c_str());
-	int bufLen = strlen(buf);
-	for (c = mg_next(&this->mgr, NULL); c != NULL; c = mg_next(&this->mgr, c)) {
-		if (c->flags & MG_F_IS_WEBSOCKET)
-			mg_send_websocket_frame(c, WEBSOCKET_OP_TEXT, buf, bufLen);
+	std::vector<OutgoingMessage> messages;
+	{
+		Poco::Mutex::ScopedLock lock(this->queueMutex);
+		messages.swap(this->outgoing);
 	}
+
+	bool webSocketMessages = false;
+	for (auto it = messages.begin(), ite = messages.end(); it != ite; ++it) {
+		if (it->type == OutgoingMessage::REFRESH_ALL) {
+			// the clients will query all ports; pending states are obsolete
+			for (auto wsit = this->webSocketClients.begin(), wsite = this->webSocketClients.end(); wsit != wsite; ++wsit) {
+				wsit->second.refreshAll = true;
+				wsit->second.states.clear();
+			}
+			webSocketMessages = true;
+			continue;
+		}
+		if (it->type == OutgoingMessage::PORT_STATES) {
+			// newer states replace older states that have not yet been sent
+			for (auto wsit = this->webSocketClients.begin(), wsite = this->webSocketClients.end(); wsit != wsite; ++wsit) {
+				if (wsit->second.refreshAll)
+					continue;
+				for (auto sit = it->states.begin(), site = it->states.end(); sit != site; ++sit)
+					wsit->second.states[sit->first] = sit->second;
+			}
+			webSocketMessages = true;
+			continue;
+		}
+		auto wcit = this->waitingConnections.find(it->connection);
+		if (wcit == this->waitingConnections.end()) {
+			this->logDebug("Connection has been closed before the JSON-RPC response could be sent");
+			continue;
+		}
+		struct mg_connection* c = wcit->second;
+		this->waitingConnections.erase(wcit);
+		c->user_data = nullptr;
+		this->sendHttpResponse(c, it->data);
+	}
+
+	if (webSocketMessages) {
+		for (auto wsit = this->webSocketClients.begin(), wsite = this->webSocketClients.end(); wsit != wsite; ++wsit)
+			this->sendToWebSocketClient(wsit->first, wsit->second);
+	}
+}
+
+void WebServerPlugin::sendToWebSocketClient(struct mg_connection* nc, WebSocketClient& client) {
+	// a client that cannot keep up receives the latest states once its backlog has been sent
+	if (nc->send_mbuf.len > MAX_WEBSOCKET_BACKLOG)
+		return;
+
+	if (client.refreshAll) {
+		std::string message("{\"event\":\"refreshAll\"}");
+		mg_send_websocket_frame(nc, WEBSOCKET_OP_TEXT, message.c_str(), message.size());
+		client.refreshAll = false;
+		return;
+	}
+
+	if (client.states.empty())
+		return;
+	std::string message("{\"event\":\"state\",\"ports\":[");
+	for (auto it = client.states.begin(), ite = client.states.end(); it != ite; ++it) {
+		if (it != client.states.begin())
+			message.append(",");
+		message.append(it->second);
+	}
+	message.append("]}");
+	mg_send_websocket_frame(nc, WEBSOCKET_OP_TEXT, message.c_str(), message.size());
+	client.states.clear();
+}
+
+void WebServerPlugin::onAllPortsRefreshed(const void* /*pSender*/) {
+	this->refreshedPorts.clear();
+	this->opdid->eventLoop->cancelTimer(this->pushTimer);
+	if (this->webSocketClientCount == 0)
+		return;
+	OutgoingMessage message;
+	message.type = OutgoingMessage::REFRESH_ALL;
+	message.connection = 0;
+	this->queueMessage(message);
+}
+
+void WebServerPlugin::onPortRefreshed(const void* /*pSender*/, opdi::Port*& port) {
+	if (this->webSocketClientCount == 0)
+		return;
+	// the states are collected and sent when the push delay has elapsed
+	if (this->refreshedPorts.empty())
+		this->pushTimer = this->opdid->eventLoop->addTimer(this, (int)this->pushDelayMs);
+	this->refreshedPorts.insert(port->ID());
 }
 
 void WebServerPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std::string& node, Poco::Util::AbstractConfiguration* config) {
@@ -601,6 +1599,9 @@ void WebServerPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std
 	this->jsonRpcUrl = nodeConfig->getString("JsonRpcUrl", this->jsonRpcUrl);
 		
 	this->s_http_server_opts.document_root = this->documentRoot.c_str();
+	Poco::Path rootDir(finalPath);
+	rootDir.makeDirectory();
+	this->documentRootDir = rootDir.toString();
 	this->enableDirListing = nodeConfig->getBool("EnableDirListing", false) ? "yes" : "";
 	this->s_http_server_opts.enable_directory_listing = this->enableDirListing.c_str();
 	this->indexFiles = nodeConfig->getString("IndexFiles", this->indexFiles);
@@ -618,6 +1619,21 @@ void WebServerPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std
 	if (this->ipACL != "")
 		this->s_http_server_opts.ip_acl = this->ipACL.c_str();
 
+	// the file cache is not used if access is restricted globally; per-directory restrictions are checked by the cache
+	// a KeepAliveTimeout of 0 disables keep-alive connections
+	int fileCacheSize = nodeConfig->getInt("FileCacheSize", DEFAULT_FILE_CACHE_SIZE_KB);
+	if (fileCacheSize < 0)
+		throw Poco::DataException(this->ID() + ": FileCacheSize must not be negative: " + this->to_string(fileCacheSize));
+	if ((this->globalAuthFile != "") || (this->ipACL != ""))
+		fileCacheSize = 0;
+	this->fileCache.configure((size_t)fileCacheSize * 1024, this->perDirectoryAuthFile != "" ? this->perDirectoryAuthFile : ".htpasswd");
+	this->cacheMaxAge = nodeConfig->getInt("CacheMaxAge", this->cacheMaxAge);
+	if (this->cacheMaxAge < 0)
+		throw Poco::DataException(this->ID() + ": CacheMaxAge must not be negative: " + this->to_string(this->cacheMaxAge));
+	this->keepAliveTimeout = nodeConfig->getInt("KeepAliveTimeout", this->keepAliveTimeout);
+	if (this->keepAliveTimeout < 0)
+		throw Poco::DataException(this->ID() + ": KeepAliveTimeout must not be negative: " + this->to_string(this->keepAliveTimeout));
+
 	this->logVerbose("Setting up web server at: " + this->httpPort);
 
 	const char* errorString[256];
@@ -642,21 +1658,124 @@ void WebServerPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std
 	// set HTTP server parameters
 	mg_set_protocol_http_websocket(this->nc);
 
+	int pushDelay = nodeConfig->getInt("WebSocketPushDelay", (int)this->pushDelayMs);
+	if (pushDelay < 0)
+		throw Poco::DataException(this->ID() + ": WebSocketPushDelay must not be negative: " + this->to_string(pushDelay));
+	this->pushDelayMs = pushDelay;
+
+	// setup the socket pair that is used to wake up the network thread
+	if (!mg_socketpair(this->wakeupSockets, SOCK_STREAM))
+		throw Poco::ApplicationException(this->ID() + ": Unable to create wakeup socket pair for web server");
+	mg_add_sock(&this->mgr, this->wakeupSockets[1], wakeup_handler);
+
 	this->logVerbose("WebServerPlugin setup completed successfully at: " + this->httpPort);
 	
-	// register port (necessary for doWork to be called regularly)
+	// register port
 	this->opdi->addPort(this);
 
 	// register port refresh events (for websocket broadcasts)
 	this->opdid->allPortsRefreshed += Poco::delegate(this, &WebServerPlugin::onAllPortsRefreshed);
 	this->opdid->portRefreshed += Poco::delegate(this, &WebServerPlugin::onPortRefreshed);
+
 }
 
-uint8_t WebServerPlugin::doWork(uint8_t /*canSend*/) {
-	// call Mongoose work function
-	mg_mgr_poll(&this->mgr, 1);
-	
-	return OPDI_STATUS_OK;
+void WebServerPlugin::startPlugin(void) {
+	// from now on, the Mongoose structures are accessed by the network thread only
+	this->stopping = false;
+	this->networkThread.setName(std::string(this->ID()) + " network thread");
+	this->networkThread.start(*this);
+}
+
+void WebServerPlugin::stopPlugin(void) {
+	// the push timer must not be started again after the network thread has stopped
+	this->opdid->allPortsRefreshed -= Poco::delegate(this, &WebServerPlugin::onAllPortsRefreshed);
+	this->opdid->portRefreshed -= Poco::delegate(this, &WebServerPlugin::onPortRefreshed);
+
+	if (this->networkThread.isRunning()) {
+		this->stopping = true;
+		this->wakeupNetworkThread();
+		this->networkThread.join();
+	}
+	this->opdid->eventLoop->removeListener(this);
+
+	// requests that have not been executed are discarded; their connections have been closed
+	Poco::Mutex::ScopedLock lock(this->queueMutex);
+	this->requests.clear();
+	this->outgoing.clear();
+	this->wakeupPending = false;
+}
+
+void WebServerPlugin::run(void) {
+	this->logDebug("Web server network thread started");
+
+	while (!this->stopping) {
+		// call Mongoose work function
+		mg_mgr_poll(&this->mgr, NETWORK_POLL_TIMEOUT_MS);
+	}
+
+	// the clients of requests that will not be answered should not wait for a response
+	for (auto it = this->waitingConnections.begin(), ite = this->waitingConnections.end(); it != ite; ++it) {
+		it->second->user_data = nullptr;
+		it->second->flags |= MG_F_CLOSE_IMMEDIATELY;
+	}
+	this->waitingConnections.clear();
+	mg_mgr_poll(&this->mgr, 0);
+
+	this->logDebug("Web server network thread terminated");
+}
+
+void WebServerPlugin::timerExpired(opdid::EventLoop::TimerID id) {
+	if (id == this->pushTimer)
+		this->pushPortStates();
+	else
+		this->executeRequests();
+}
+
+void WebServerPlugin::executeRequests(void) {
+	std::vector<JsonRpcRequest> received;
+	{
+		Poco::Mutex::ScopedLock lock(this->queueMutex);
+		received.swap(this->requests);
+	}
+
+	// execute all requests that have been received since the timer was started in one batch
+	std::vector<OutgoingMessage> messages;
+	messages.reserve(received.size());
+	for (auto it = received.begin(), ite = received.end(); it != ite; ++it) {
+		OutgoingMessage response;
+		response.type = OutgoingMessage::JSON_RPC_RESPONSE;
+		response.connection = it->connection;
+		this->responseBuffer.clear();
+		this->executeJsonRpc(*it, this->responseBuffer);
+		response.data = this->responseBuffer;
+		messages.push_back(response);
+	}
+
+	if (messages.empty())
+		return;
+
+	{
+		Poco::Mutex::ScopedLock lock(this->queueMutex);
+		this->outgoing.insert(this->outgoing.end(), messages.begin(), messages.end());
+	}
+	this->wakeupNetworkThread();
+}
+
+void WebServerPlugin::pushPortStates(void) {
+	// push the states of the ports that have been refreshed during the push delay
+	OutgoingMessage states;
+	states.type = OutgoingMessage::PORT_STATES;
+	states.connection = 0;
+	for (auto it = this->refreshedPorts.begin(), ite = this->refreshedPorts.end(); it != ite; ++it) {
+		opdi::Port* port = this->opdi->findPortByID(it->c_str());
+		if ((port == NULL) || port->isHidden())
+			continue;
+		JsonWriter writer(states.states[*it]);
+		this->writePortInfo(writer, port);
+	}
+	this->refreshedPorts.clear();
+	if (!states.states.empty())
+		this->queueMessage(states);
 }
 
 void WebServerPlugin::masterConnected() {
@@ -0,0 +1,315 @@
+// Compares the JsonWriter used for JSON-RPC responses with the previous implementation, which
+// built a tree of Poco::JSON::Object values and stringified it through a std::stringstream.
+// Both variants produce a getAllPortStates response for the same set of ports, writing the
+// properties in the same way as WebServerPlugin::writePortInfo (which is private). The program
+// reports the time and the number of heap allocations per response, and checks that both
+// responses parse to the same port objects; it exits with a non-zero code otherwise.
+//
+// Usage: json_writer_bench [number of ports [number of responses]]
+// The defaults are 300 ports and 1000 responses.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <atomic>
+
+// the plugin is compiled into this program to get access to its JSON writer
+#include "../WebServerPlugin.cpp"
+
+#include "Poco/Stopwatch.h"
+
+// the main OPDI instance is declared here
+opdid::AbstractOPDID* Opdi = nullptr;
+
+// counts the heap allocations of the whole program
+static std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size) {
+	allocations++;
+	void* p = malloc(size == 0 ? 1 : size);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+namespace {
+
+const char* selectItems[] = { "Off", "Low", "Medium", "High", nullptr };
+
+// the implementation before the JsonWriter was introduced
+Poco::JSON::Object jsonGetPortState(opdi::Port* port) {
+	Poco::JSON::Object result;
+	if (port->hasError())
+		result.set("error", std::to_string((int)port->getError()));
+	else
+		try {
+			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_DIGITAL)) {
+				uint8_t mode;
+				uint8_t line;
+				((opdi::DigitalPort*)port)->getState(&mode, &line);
+				result.set("mode", mode);
+				result.set("line", line);
+			} else
+			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_ANALOG)) {
+				uint8_t mode;
+				uint8_t resolution;
+				uint8_t reference;
+				int32_t value;
+				((opdi::AnalogPort*)port)->getState(&mode, &resolution, &reference, &value);
+				result.set("mode", mode);
+				result.set("resolution", resolution);
+				result.set("reference", reference);
+				result.set("value", value);
+			} else
+			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_DIAL)) {
+				int64_t position;
+				((opdi::DialPort*)port)->getState(&position);
+				result.set("position", position);
+			} else
+			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_SELECT)) {
+				uint16_t position;
+				((opdi::SelectPort*)port)->getState(&position);
+				result.set("position", position);
+			}
+		} catch (Poco::Exception&) {
+			result.set("error", std::to_string((int)port->getError()));
+		}
+	return result;
+}
+
+Poco::JSON::Object jsonGetPortInfo(opdi::Port* port) {
+	Poco::JSON::Object result;
+	result.set("id", port->ID());
+	result.set("type", port->getType());
+	result.set("label", port->getLabel());
+	result.set("dirCaps", port->getDirCaps());
+	result.set("flags", port->getFlags());
+	result.set("readonly", port->isReadonly());
+	if (0 == strcmp(port->getType(), OPDI_PORTTYPE_DIAL)) {
+		opdi::DialPort* dport = (opdi::DialPort*)port;
+		result.set("min", dport->getMin());
+		result.set("max", dport->getMax());
+		result.set("step", dport->getStep());
+	} else
+	if (0 == strcmp(port->getType(), OPDI_PORTTYPE_SELECT)) {
+		opdi::SelectPort* sport = (opdi::SelectPort*)port;
+		Poco::JSON::Array positions;
+		for (uint16_t i = 0; i <= sport->getMaxPosition(); i++)
+			positions.add(sport->getPositionLabel(i));
+		result.set("positions", positions);
+	}
+	result.set("state", jsonGetPortState(port));
+	result.set("extendedInfo", port->getExtendedInfo());
+	result.set("extendedState", port->getExtendedState());
+	return result;
+}
+
+// as WebServerPlugin::writePortState
+void writePortState(JsonWriter& writer, opdi::Port* port) {
+	writer.beginObject();
+	if (port->hasError())
+		writer.property("error", std::to_string((int)port->getError()));
+	else
+		try {
+			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_DIGITAL)) {
+				uint8_t mode;
+				uint8_t line;
+				((opdi::DigitalPort*)port)->getState(&mode, &line);
+				writer.property("mode", mode);
+				writer.property("line", line);
+			} else
+			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_ANALOG)) {
+				uint8_t mode;
+				uint8_t resolution;
+				uint8_t reference;
+				int32_t value;
+				((opdi::AnalogPort*)port)->getState(&mode, &resolution, &reference, &value);
+				writer.property("mode", mode);
+				writer.property("resolution", resolution);
+				writer.property("reference", reference);
+				writer.property("value", value);
+			} else
+			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_DIAL)) {
+				int64_t position;
+				((opdi::DialPort*)port)->getState(&position);
+				writer.property("position", position);
+			} else
+			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_SELECT)) {
+				uint16_t position;
+				((opdi::SelectPort*)port)->getState(&position);
+				writer.property("position", position);
+			}
+		} catch (Poco::Exception&) {
+			writer.property("error", std::to_string((int)port->getError()));
+		}
+	writer.endObject();
+}
+
+// as WebServerPlugin::writePortInfo
+void writePortInfo(JsonWriter& writer, opdi::Port* port) {
+	writer.beginObject();
+	writer.property("id", port->ID());
+	writer.property("type", port->getType());
+	writer.property("label", port->getLabel());
+	writer.property("dirCaps", port->getDirCaps());
+	writer.property("flags", port->getFlags());
+	writer.property("readonly", port->isReadonly());
+	if (0 == strcmp(port->getType(), OPDI_PORTTYPE_DIAL)) {
+		opdi::DialPort* dport = (opdi::DialPort*)port;
+		writer.property("min", dport->getMin());
+		writer.property("max", dport->getMax());
+		writer.property("step", dport->getStep());
+	} else
+	if (0 == strcmp(port->getType(), OPDI_PORTTYPE_SELECT)) {
+		opdi::SelectPort* sport = (opdi::SelectPort*)port;
+		writer.key("positions");
+		writer.beginArray();
+		for (uint16_t i = 0; i <= sport->getMaxPosition(); i++)
+			writer.value(sport->getPositionLabel(i));
+		writer.endArray();
+	}
+	writer.key("state");
+	writePortState(writer, port);
+	writer.property("extendedInfo", port->getExtendedInfo());
+	writer.property("extendedState", port->getExtendedState());
+	writer.endObject();
+}
+
+std::string treeResponse(std::vector<opdi::Port*>& ports, int id) {
+	Poco::JSON::Array portArray;
+	for (auto it = ports.begin(), ite = ports.end(); it != ite; ++it)
+		portArray.add(jsonGetPortInfo(*it));
+	Poco::JSON::Object result;
+	result.set("ports", portArray);
+	Poco::JSON::Object response;
+	response.set("jsonrpc", "2.0");
+	response.set("id", id);
+	response.set("result", result);
+
+	std::stringstream sOut;
+	response.stringify(sOut);
+	return sOut.str();
+}
+
+void writerResponse(std::vector<opdi::Port*>& ports, int id, std::string& out) {
+	out.clear();
+	JsonWriter writer(out);
+	writer.beginObject();
+	writer.property("jsonrpc", "2.0");
+	writer.property("id", id);
+	writer.key("result");
+	writer.beginObject();
+	writer.key("ports");
+	writer.beginArray();
+	for (auto it = ports.begin(), ite = ports.end(); it != ite; ++it)
+		writePortInfo(writer, *it);
+	writer.endArray();
+	writer.endObject();
+	writer.endObject();
+}
+
+// returns the port objects of a response, stringified in a canonical form
+std::vector<std::string> parsePorts(const std::string& json) {
+	Poco::JSON::Parser parser;
+	Poco::JSON::Object::Ptr response = parser.parse(json).extract<Poco::JSON::Object::Ptr>();
+	Poco::JSON::Array::Ptr ports = response->getObject("result")->getArray("ports");
+	std::vector<std::string> result;
+	for (size_t i = 0; i < ports->size(); i++) {
+		Poco::JSON::Object::Ptr port = ports->getObject(i);
+		std::stringstream sOut;
+		// the keys of Poco::JSON::Object are sorted, so that the order of the properties does not matter
+		port->stringify(sOut);
+		result.push_back(sOut.str());
+	}
+	return result;
+}
+
+}	// end anonymous namespace
+
+int main(int argc, char* argv[]) {
+	int portCount = (argc > 1 ? atoi(argv[1]) : 300);
+	int responses = (argc > 2 ? atoi(argv[2]) : 1000);
+	if ((portCount < 1) || (responses < 1)) {
+		printf("Invalid number of ports or responses\n");
+		return 2;
+	}
+
+	// create a mix of port types with varying states
+	std::vector<opdi::Port*> ports;
+	for (int i = 0; i < portCount; i++) {
+		std::string id = "Port" + std::to_string(i);
+		switch (i % 4) {
+		case 0: {
+			opdi::DigitalPort* port = new opdi::DigitalPort(id.c_str(), ("Digital \"" + id + "\"").c_str(), OPDI_PORTDIRCAP_OUTPUT, 0);
+			port->setLine(i % 3 == 0 ? 1 : 0);
+			ports.push_back(port);
+			break;
+		}
+		case 1: {
+			opdi::AnalogPort* port = new opdi::AnalogPort(id.c_str(), ("Analog " + id).c_str(), OPDI_PORTDIRCAP_OUTPUT, 0);
+			port->setRelativeValue((i % 100) / 100.0);
+			ports.push_back(port);
+			break;
+		}
+		case 2: {
+			opdi::SelectPort* port = new opdi::SelectPort(id.c_str(), ("Select " + id).c_str(), selectItems);
+			port->setPosition(i % 4);
+			ports.push_back(port);
+			break;
+		}
+		default: {
+			opdi::DialPort* port = new opdi::DialPort(id.c_str(), ("Dial " + id).c_str(), -1000, 100000, 5);
+			port->setPosition(i * 5);
+			ports.push_back(port);
+		}
+		}
+	}
+
+	// compare the results
+	std::string out;
+	writerResponse(ports, 1, out);
+	std::string tree = treeResponse(ports, 1);
+	if (parsePorts(out) != parsePorts(tree)) {
+		printf("FAILED: The responses differ\nJsonWriter: %s\nPoco::JSON: %s\n", out.c_str(), tree.c_str());
+		return 1;
+	}
+	printf("%d ports, %d responses, %zu bytes per response\n", portCount, responses, out.size());
+	printf("%-12s %12s %14s\n", "variant", "us/response", "allocs/response");
+
+	size_t length = 0;
+	size_t startAllocations = allocations;
+	Poco::Stopwatch treeWatch;
+	treeWatch.start();
+	for (int i = 0; i < responses; i++)
+		length += treeResponse(ports, i).size();
+	treeWatch.stop();
+	size_t treeAllocations = allocations - startAllocations;
+
+	startAllocations = allocations;
+	Poco::Stopwatch writerWatch;
+	writerWatch.start();
+	for (int i = 0; i < responses; i++) {
+		// the buffer is reused as in the plugin
+		writerResponse(ports, i, out);
+		length -= out.size();
+	}
+	writerWatch.stop();
+	size_t writerAllocations = allocations - startAllocations;
+
+	printf("%-12s %12.1f %14.1f\n", "Poco::JSON", (double)treeWatch.elapsed() / responses, (double)treeAllocations / responses);
+	printf("%-12s %12.1f %14.1f\n", "JsonWriter", (double)writerWatch.elapsed() / responses, (double)writerAllocations / responses);
+
+	for (auto it = ports.begin(), ite = ports.end(); it != ite; ++it)
+		delete *it;
+
+	// both variants must have produced the same amount of output
+	if (length != 0) {
+		printf("FAILED: The response lengths differ\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,158 @@
+// Measures how long a full refresh of all port states takes via the JSON-RPC API of a running
+// OPDID with the WebServer plugin. Three variants are compared:
+// - one getPortInfo request per port (the way the web UI refreshed all ports before)
+// - a single JSON-RPC batch containing a getPortInfo call for each port
+// - a single getAllPortStates request
+// All requests use the same keep-alive connection. The results of the variants are compared;
+// the program exits with a non-zero code if a request fails or the number of ports differs.
+//
+// Usage: jsonrpc_bench [host [port [rounds [JSON-RPC URL]]]]
+// The defaults are localhost, 8080, 10 rounds and /api/jsonrpc.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include "Poco/Net/HTTPClientSession.h"
+#include "Poco/Net/HTTPRequest.h"
+#include "Poco/Net/HTTPResponse.h"
+#include "Poco/JSON/Parser.h"
+#include "Poco/JSON/Object.h"
+#include "Poco/JSON/Array.h"
+#include "Poco/StreamCopier.h"
+#include "Poco/Stopwatch.h"
+#include "Poco/Exception.h"
+
+class JsonRpcClient {
+	Poco::Net::HTTPClientSession session;
+	std::string url;
+
+public:
+	size_t bytesReceived;
+	size_t requests;
+
+	JsonRpcClient(const std::string& host, int port, const std::string& url) : session(host, port), url(url) {
+		this->session.setKeepAlive(true);
+		this->bytesReceived = 0;
+		this->requests = 0;
+	}
+
+	/** Posts the request and returns the parsed response. */
+	Poco::Dynamic::Var post(const std::string& json) {
+		Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, this->url, Poco::Net::HTTPMessage::HTTP_1_1);
+		request.setKeepAlive(true);
+		request.setContentType("application/json");
+		request.setContentLength(json.size());
+		this->session.sendRequest(request) << json;
+
+		Poco::Net::HTTPResponse response;
+		std::istream& in = this->session.receiveResponse(response);
+		std::string body;
+		Poco::StreamCopier::copyToString(in, body);
+		if (response.getStatus() != Poco::Net::HTTPResponse::HTTP_OK)
+			throw Poco::IOException("Unexpected HTTP status " + std::to_string((int)response.getStatus()) + " for request: " + json);
+		this->bytesReceived += body.size();
+		this->requests++;
+
+		Poco::JSON::Parser parser;
+		return parser.parse(body);
+	}
+};
+
+static std::string callJson(const std::string& method, const std::string& params, int id) {
+	return "{\"jsonrpc\":\"2.0\",\"id\":" + std::to_string(id) + ",\"method\":\"" + method + "\",\"params\":" + params + "}";
+}
+
+static Poco::JSON::Object::Ptr checkResult(const Poco::Dynamic::Var& response) {
+	Poco::JSON::Object::Ptr object = response.extract<Poco::JSON::Object::Ptr>();
+	if (!object->isNull("error"))
+		throw Poco::DataException("JSON-RPC error: " + object->get("error").toString());
+	return object->getObject("result");
+}
+
+static void printResult(const char* name, const Poco::Stopwatch& watch, int rounds, const JsonRpcClient& client) {
+	printf("%-26s %10.2f %10zu %12zu\n", name, watch.elapsed() / 1000.0 / rounds, client.requests / rounds, client.bytesReceived / rounds);
+}
+
+int main(int argc, char* argv[]) {
+	std::string host = (argc > 1 ? argv[1] : "localhost");
+	int port = (argc > 2 ? atoi(argv[2]) : 8080);
+	int rounds = (argc > 3 ? atoi(argv[3]) : 10);
+	std::string url = (argc > 4 ? argv[4] : "/api/jsonrpc");
+	if (rounds < 1) {
+		printf("Invalid number of rounds\n");
+		return 2;
+	}
+
+	try {
+		// determine the port IDs
+		std::vector<std::string> portIDs;
+		{
+			JsonRpcClient client(host, port, url);
+			Poco::JSON::Array::Ptr ports = checkResult(client.post(callJson("getAllPortStates", "{}", 1)))->getArray("ports");
+			for (size_t i = 0; i < ports->size(); i++)
+				portIDs.push_back(ports->getObject(i)->getValue<std::string>("id"));
+		}
+		printf("%zu ports on %s:%d, %d rounds\n", portIDs.size(), host.c_str(), port, rounds);
+		if (portIDs.empty())
+			return 0;
+		printf("%-26s %10s %10s %12s\n", "variant", "ms/refresh", "requests", "bytes");
+
+		// one request per port
+		{
+			JsonRpcClient client(host, port, url);
+			Poco::Stopwatch watch;
+			watch.start();
+			for (int r = 0; r < rounds; r++)
+				for (size_t i = 0; i < portIDs.size(); i++)
+					checkResult(client.post(callJson("getPortInfo", "{\"portID\":\"" + portIDs[i] + "\"}", (int)i)));
+			watch.stop();
+			printResult("getPortInfo per port", watch, rounds, client);
+		}
+
+		// one batch with a call per port
+		{
+			std::string batch("[");
+			for (size_t i = 0; i < portIDs.size(); i++) {
+				if (i > 0)
+					batch.push_back(',');
+				batch += callJson("getPortInfo", "{\"portID\":\"" + portIDs[i] + "\"}", (int)i);
+			}
+			batch.push_back(']');
+
+			JsonRpcClient client(host, port, url);
+			Poco::Stopwatch watch;
+			watch.start();
+			for (int r = 0; r < rounds; r++) {
+				Poco::JSON::Array::Ptr responses = client.post(batch).extract<Poco::JSON::Array::Ptr>();
+				if (responses->size() != portIDs.size())
+					throw Poco::DataException("Batch response contains " + std::to_string(responses->size()) + " responses, expected " + std::to_string(portIDs.size()));
+				for (size_t i = 0; i < responses->size(); i++)
+					checkResult(responses->get(i));
+			}
+			watch.stop();
+			printResult("getPortInfo batch", watch, rounds, client);
+		}
+
+		// a single getAllPortStates call
+		{
+			JsonRpcClient client(host, port, url);
+			Poco::Stopwatch watch;
+			watch.start();
+			for (int r = 0; r < rounds; r++) {
+				Poco::JSON::Array::Ptr ports = checkResult(client.post(callJson("getAllPortStates", "{}", r)))->getArray("ports");
+				if (ports->size() != portIDs.size())
+					throw Poco::DataException("getAllPortStates returned " + std::to_string(ports->size()) + " ports, expected " + std::to_string(portIDs.size()));
+			}
+			watch.stop();
+			printResult("getAllPortStates", watch, rounds, client);
+		}
+	} catch (Poco::Exception& e) {
+		printf("FAILED: %s\n", e.displayText().c_str());
+		return 1;
+	}
+	return 0;
+}
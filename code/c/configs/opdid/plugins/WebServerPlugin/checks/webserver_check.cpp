@@ -0,0 +1,601 @@
+// Checks the WebServer plugin with clients that connect to it via the loopback interface.
+// The plugin is set up on a free port and its network thread is started by startPlugin, as
+// the daemon does. The main loop is emulated by calling the waiting method of the daemon,
+// which runs the event loop that executes the queued JSON-RPC requests, and sleeping in
+// EventLoop::wait.
+// The checks cover concurrent JSON-RPC requests and batches of several clients on keep-alive
+// connections, which must be answered with the results of their own calls and executed on
+// the main thread, and stopping the plugin while a request is queued: the network thread is
+// joined without waiting for its poll timeout, the timer of the request is cancelled, the
+// connection of the client is closed, and requests are answered again after a restart.
+// Notifications (calls without an id) are executed without a response: a batch contains the
+// responses of the other calls only, and a request of notifications only is answered with 204.
+// The websocket checks cover the push delay, the coalescing of repeated refreshes of a port
+// into one state, the refresh of all ports that supersedes pending states, and a slow client
+// that does not read while more than 64 KB are waiting for it: it keeps its connection and
+// receives the latest state instead of every push, while a fast client receives every push.
+// The static file checks cover the ETag and caching headers of files served from the cache,
+// If-None-Match requests that are answered with 304, the selection of the precompressed
+// variant by Accept-Encoding, the index file, changed files, files in directories with an
+// authentication file that are left to Mongoose, and the keep-alive handling: requests on
+// one connection, Connection: close and HTTP/1.0 requests, and idle connections that are
+// closed after the KeepAliveTimeout.
+//
+// Usage: webserver_check
+
+#include <stdio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+
+#include <thread>
+#include <functional>
+
+#include "Poco/Util/MapConfiguration.h"
+#include "Poco/TemporaryFile.h"
+
+// the plugin is compiled into this program to get access to its classes
+#include "../WebServerPlugin.cpp"
+
+#include "LinuxOPDID.h"
+#include "EventLoop.h"
+
+#include "check.h"
+
+// the main OPDI instance is declared here
+opdid::AbstractOPDID* Opdi = nullptr;
+
+namespace {
+
+const int CLIENTS = 8;
+const int REQUESTS = 50;
+const int PUSH_DELAY = 20;
+const int PUSHES = 100;
+const int KEEP_ALIVE_TIMEOUT = 1;
+
+/** A digital port that records whether its line has been set on another thread than the main thread. */
+class CheckPort : public opdi::DigitalPort {
+public:
+	static std::thread::id mainThread;
+	static std::atomic<int> foreignThreadAccesses;
+
+	std::string extendedState;
+
+	explicit CheckPort(const std::string& id) : opdi::DigitalPort(id.c_str(), id.c_str(), OPDI_PORTDIRCAP_OUTPUT, 0) {}
+
+	virtual std::string getExtendedState(void) const override {
+		return this->extendedState;
+	}
+
+	virtual void setLine(uint8_t line, ChangeSource changeSource = Port::ChangeSource::CHANGESOURCE_INT) override {
+		if (std::this_thread::get_id() != mainThread)
+			foreignThreadAccesses++;
+		opdi::DigitalPort::setLine(line, changeSource);
+	}
+};
+
+std::thread::id CheckPort::mainThread;
+std::atomic<int> CheckPort::foreignThreadAccesses(0);
+
+/** Provides access to the number of timers. */
+class CheckEventLoop : public opdid::EventLoop {
+public:
+	CheckEventLoop(opdid::AbstractOPDID* opdid) : opdid::EventLoop(opdid) {}
+
+	size_t timerCount(void) {
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		return this->timers.size();
+	}
+};
+
+struct HttpResponse {
+	int status;
+	std::map<std::string, std::string> headers;		// with lower case names
+	std::string body;
+};
+
+/** A client connection to the web server. Receiving times out after five seconds. */
+class HttpConnection {
+protected:
+	int fd;
+	std::string buffer;		// received data that has not been processed
+
+	/** Receives more data into the buffer. Returns false if the connection has been closed or the time is up. */
+	bool fill(void) {
+		char data[4096];
+		ssize_t count = recv(this->fd, data, sizeof(data), 0);
+		if (count == 0)
+			this->closed = true;
+		if (count <= 0)
+			return false;
+		this->buffer.append(data, count);
+		return true;
+	}
+
+public:
+	bool closed;
+
+	/** Connects to the web server. A receive buffer size greater than 0 limits the data that the
+	* server can send before the client reads. */
+	explicit HttpConnection(int port, int receiveBufferSize = 0) : closed(false) {
+		this->fd = socket(AF_INET, SOCK_STREAM, 0);
+		this->setTimeout(5000);
+		if (receiveBufferSize > 0)
+			setsockopt(this->fd, SOL_SOCKET, SO_RCVBUF, &receiveBufferSize, sizeof(receiveBufferSize));
+		struct sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (connect(this->fd, (struct sockaddr*)&address, sizeof(address)) != 0)
+			throw Poco::IOException("Unable to connect to the web server", strerror(errno));
+	}
+
+	~HttpConnection() {
+		close(this->fd);
+	}
+
+	void setTimeout(int ms) {
+		struct timeval timeout = { ms / 1000, (ms % 1000) * 1000 };
+		setsockopt(this->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	}
+
+	void send(const std::string& data) {
+		if (::send(this->fd, data.c_str(), data.size(), MSG_NOSIGNAL) != (ssize_t)data.size())
+			throw Poco::IOException("Unable to send to the web server");
+	}
+
+	void get(const std::string& uri, const std::string& headers = "", const std::string& protocol = "HTTP/1.1") {
+		this->send("GET " + uri + " " + protocol + "\r\nHost: localhost\r\n" + headers + "\r\n");
+	}
+
+	void post(const std::string& uri, const std::string& body) {
+		this->send("POST " + uri + " HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/json\r\nContent-Length: "
+			+ std::to_string(body.size()) + "\r\n\r\n" + body);
+	}
+
+	/** Returns true if data or the end of the connection can be received without blocking. */
+	bool readable(void) {
+		if (!this->buffer.empty())
+			return true;
+		struct pollfd pfd = { this->fd, POLLIN, 0 };
+		return poll(&pfd, 1, 0) > 0;
+	}
+
+	/** Receives a response. Returns false if the connection has been closed or the time is up. */
+	bool receive(HttpResponse& response) {
+		size_t end;
+		while ((end = this->buffer.find("\r\n\r\n")) == std::string::npos)
+			if (!this->fill())
+				return false;
+		std::string head = this->buffer.substr(0, end);
+		this->buffer.erase(0, end + 4);
+		response.status = atoi(head.c_str() + head.find(' ') + 1);
+		response.headers.clear();
+		for (size_t pos = head.find("\r\n"); pos != std::string::npos; ) {
+			size_t next = head.find("\r\n", pos + 2);
+			std::string line = head.substr(pos + 2, next == std::string::npos ? std::string::npos : next - pos - 2);
+			size_t colon = line.find(':');
+			if (colon != std::string::npos)
+				response.headers[Poco::toLower(line.substr(0, colon))] = line.substr(line.find_first_not_of(' ', colon + 1));
+			pos = next;
+		}
+		size_t length = atoi(response.headers["content-length"].c_str());
+		while (this->buffer.size() < length)
+			if (!this->fill())
+				return false;
+		response.body = this->buffer.substr(0, length);
+		this->buffer.erase(0, length);
+		return true;
+	}
+};
+
+/** A websocket connection to the web server. */
+class WebSocketConnection : public HttpConnection {
+public:
+	explicit WebSocketConnection(int port, int receiveBufferSize = 0) : HttpConnection(port, receiveBufferSize) {
+		this->send("GET /websocket HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+			"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n");
+		HttpResponse response;
+		if (!this->receive(response) || (response.status != 101))
+			throw Poco::IOException("The websocket handshake has failed");
+	}
+
+	/** Receives the payload of a frame. Returns false if the connection has been closed or the time is up. */
+	bool receiveFrame(std::string& message) {
+		while (this->buffer.size() < 2)
+			if (!this->fill())
+				return false;
+		// the frames of the server are not masked
+		size_t length = (uint8_t)this->buffer[1] & 0x7f;
+		size_t header = 2;
+		if (length >= 126) {
+			header = (length == 126 ? 4 : 10);
+			while (this->buffer.size() < header)
+				if (!this->fill())
+					return false;
+			length = 0;
+			for (size_t i = 2; i < header; i++)
+				length = (length << 8) | (uint8_t)this->buffer[i];
+		}
+		while (this->buffer.size() < header + length)
+			if (!this->fill())
+				return false;
+		message = this->buffer.substr(header, length);
+		this->buffer.erase(0, header + length);
+		return true;
+	}
+};
+
+void writeFile(const std::string& path, const std::string& content) {
+	std::ofstream out(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	out << content;
+}
+
+/** Returns a port of the loopback interface that is currently not in use. */
+int findFreePort(void) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t length = sizeof(address);
+	if ((bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0) || (getsockname(fd, (struct sockaddr*)&address, &length) != 0))
+		throw Poco::IOException("Unable to find a free port");
+	close(fd);
+	return ntohs(address.sin_port);
+}
+
+std::string callJson(const std::string& method, const std::string& params, int id) {
+	return "{\"jsonrpc\":\"2.0\",\"id\":" + std::to_string(id) + ",\"method\":\"" + method + "\",\"params\":" + params + "}";
+}
+
+std::string notificationJson(const std::string& method, const std::string& params) {
+	return "{\"jsonrpc\":\"2.0\",\"method\":\"" + method + "\",\"params\":" + params + "}";
+}
+
+/** Returns an error message if the response is not the result of the call with the id for the port
+*   with the line, or an empty string. */
+std::string verifyPortResult(const Poco::Dynamic::Var& response, int id, const std::string& portID, int line) {
+	Poco::JSON::Object::Ptr object = response.extract<Poco::JSON::Object::Ptr>();
+	if (object->getValue<int>("id") != id)
+		return "unexpected id " + object->get("id").toString() + " instead of " + std::to_string(id);
+	if (!object->isNull("error"))
+		return "JSON-RPC error: " + object->get("error").toString();
+	Poco::JSON::Object::Ptr port = object->getObject("result")->getObject("port");
+	if (port->getValue<std::string>("id") != portID)
+		return "unexpected port " + port->getValue<std::string>("id") + " instead of " + portID;
+	if (port->getObject("state")->getValue<int>("line") != line)
+		return "unexpected line of port " + portID;
+	return "";
+}
+
+/** Sends the requests of a client on a keep-alive connection and verifies the responses.
+*   The client sets the line of its own port; every fifth request is a batch that also queries the port. */
+void runClient(int httpPort, int client, int& answered, std::string& error) {
+	try {
+		HttpConnection connection(httpPort);
+		std::string portID = "Port" + std::to_string(client);
+		for (int i = 0; i < REQUESTS; i++) {
+			int line = i % 2;
+			int id = client * 1000 + i * 2;
+			std::string call = callJson("setDigitalState", "{\"portID\":\"" + portID + "\",\"line\":" + std::to_string(line) + "}", id);
+			bool batch = (i % 5 == 4);
+			if (batch)
+				call = "[" + call + "," + callJson("getPortInfo", "{\"portID\":\"" + portID + "\"}", id + 1) + "]";
+			connection.post("/api/jsonrpc", call);
+			HttpResponse response;
+			if (!connection.receive(response))
+				throw Poco::IOException("No response to request " + std::to_string(i) + (connection.closed ? ": the connection has been closed" : ""));
+			if ((response.status != 200) || (response.headers["connection"] != "keep-alive"))
+				throw Poco::IOException("Unexpected status or Connection header of request " + std::to_string(i));
+			Poco::JSON::Parser parser;
+			Poco::Dynamic::Var result = parser.parse(response.body);
+			if (batch) {
+				Poco::JSON::Array::Ptr array = result.extract<Poco::JSON::Array::Ptr>();
+				if (array->size() != 2)
+					throw Poco::DataException("Unexpected number of responses in the batch");
+				error = verifyPortResult(array->get(0), id, portID, line);
+				if (error.empty())
+					error = verifyPortResult(array->get(1), id + 1, portID, line);
+			} else
+				error = verifyPortResult(result, id, portID, line);
+			if (!error.empty())
+				return;
+			answered++;
+		}
+	} catch (Poco::Exception& e) {
+		error = e.displayText();
+	}
+}
+
+/** Returns the pushed port info objects by port ID; the message must be a state event. */
+std::map<std::string, Poco::JSON::Object::Ptr> pushedStates(const std::string& message) {
+	std::map<std::string, Poco::JSON::Object::Ptr> result;
+	Poco::JSON::Object::Ptr object = Poco::JSON::Parser().parse(message).extract<Poco::JSON::Object::Ptr>();
+	if (object->getValue<std::string>("event") != "state")
+		throw Poco::DataException("Unexpected websocket message: " + message.substr(0, 100));
+	Poco::JSON::Array::Ptr ports = object->getArray("ports");
+	for (size_t i = 0; i < ports->size(); i++) {
+		Poco::JSON::Object::Ptr port = ports->getObject(i);
+		if (result.find(port->getValue<std::string>("id")) != result.end())
+			throw Poco::DataException("Port pushed twice in one message: " + port->getValue<std::string>("id"));
+		result[port->getValue<std::string>("id")] = port;
+	}
+	return result;
+}
+
+/** Refreshes the port like the daemon does after its state has changed. */
+void refreshPort(opdid::AbstractOPDID& daemon, opdi::Port* port) {
+	opdi::Port* ports[] = { port, nullptr };
+	daemon.refresh(ports);
+}
+
+/** Runs one frame of the main loop. */
+void frame(opdid::AbstractOPDID& daemon) {
+	uint64_t start = monotonicUs();
+	daemon.waiting(0);
+	int remaining = 5000 - (int)(monotonicUs() - start);
+	if (remaining > 0)
+		daemon.eventLoop->wait(remaining);
+}
+
+/** Runs the main loop until the condition is met or the time is up.
+*   Returns the elapsed time in milliseconds, or -1 if the time is up. */
+int runUntil(opdid::AbstractOPDID& daemon, std::function<bool(void)> condition, int timeoutMs) {
+	uint64_t start = monotonicUs();
+	while (!condition()) {
+		if (monotonicUs() - start > (uint64_t)timeoutMs * 1000)
+			return -1;
+		frame(daemon);
+	}
+	return (int)((monotonicUs() - start) / 1000);
+}
+
+/** Runs the main loop for the specified time. */
+void runFor(opdid::AbstractOPDID& daemon, int ms) {
+	runUntil(daemon, []() { return false; }, ms);
+}
+
+}	// end anonymous namespace
+
+int main(int, char**) {
+	opdid::LinuxOPDID daemon;
+	Opdi = &daemon;
+	// the event loop is usually created when the general configuration is read
+	CheckEventLoop* eventLoop = new CheckEventLoop(&daemon);
+	daemon.eventLoop = eventLoop;
+	// this flag is usually reset when the daemon starts up
+	daemon.shutdownRequested = false;
+	CheckPort::mainThread = std::this_thread::get_id();
+
+	// the document root is the directory of the configuration file
+	std::string documentRoot = Poco::TemporaryFile::tempName();
+	Poco::File(documentRoot + "/protected").createDirectories();
+	std::string script("function check() { return 42; }\n");
+	std::string compressedScript("\x1f\x8b compressed script\x00\xff", 23);
+	writeFile(documentRoot + "/index.html", "<html></html>\n");
+	writeFile(documentRoot + "/app.js", script);
+	writeFile(documentRoot + "/app.js.gz", compressedScript);
+	writeFile(documentRoot + "/style.css", "body { margin: 0; }\n");
+	writeFile(documentRoot + "/protected/secret.txt", "secret\n");
+	writeFile(documentRoot + "/protected/.htpasswd", "user:domain:0123456789abcdef0123456789abcdef\n");
+
+	try {
+		for (int i = 0; i < CLIENTS; i++)
+			daemon.addPort(new CheckPort("Port" + std::to_string(i)));
+		CheckPort* bulky = new CheckPort("Bulky");
+		daemon.addPort(bulky);
+
+		int httpPort = findFreePort();
+		Poco::AutoPtr<Poco::Util::MapConfiguration> config = new Poco::Util::MapConfiguration();
+		config->setString(OPDID_CONFIG_FILE_SETTING, documentRoot + "/check.ini");
+		config->setString("WebServer.Port", "127.0.0.1:" + std::to_string(httpPort));
+		config->setInt("WebServer.WebSocketPushDelay", PUSH_DELAY);
+		config->setInt("WebServer.KeepAliveTimeout", KEEP_ALIVE_TIMEOUT);
+		IOPDIDPlugin* plugin = GetOPDIDPluginInstance(OPDID_MAJOR_VERSION, OPDID_MINOR_VERSION, 0);
+		plugin->setupPlugin(&daemon, "WebServer", config);
+		daemon.preparePorts();
+
+		int threads = countThreads();
+		plugin->startPlugin();
+		check(countThreads() == threads + 1, "startPlugin starts the network thread");
+
+		// concurrent clients; the main loop executes their requests
+		int answered[CLIENTS] = { 0 };
+		std::string errors[CLIENTS];
+		std::vector<std::thread> clients;
+		for (int i = 0; i < CLIENTS; i++)
+			clients.push_back(std::thread(runClient, httpPort, i, std::ref(answered[i]), std::ref(errors[i])));
+		std::atomic<int> finished(0);
+		std::thread joiner([&]() {
+			for (auto it = clients.begin(), ite = clients.end(); it != ite; ++it)
+				it->join();
+			finished = 1;
+		});
+		int elapsed = runUntil(daemon, [&]() { return finished != 0; }, 30000);
+		joiner.join();
+		int total = 0;
+		for (int i = 0; i < CLIENTS; i++) {
+			total += answered[i];
+			if (!errors[i].empty())
+				check(false, "client " + std::to_string(i) + ": " + errors[i]);
+		}
+		check(total == CLIENTS * REQUESTS, "the concurrent requests of " + std::to_string(CLIENTS) + " clients have been answered with their own results ("
+			+ std::to_string(total) + " of " + std::to_string(CLIENTS * REQUESTS) + " in " + std::to_string(elapsed) + " ms)");
+		check(CheckPort::foreignThreadAccesses == 0, "the requests have been executed on the main thread");
+
+		// the refreshes of a port during the push delay are sent as one state
+		WebSocketConnection fast(httpPort);
+		CheckPort* port0 = (CheckPort*)daemon.findPortByID("Port0");
+		for (int i = 0; i < 20; i++) {
+			port0->setLine(i % 2);
+			refreshPort(daemon, port0);
+		}
+		refreshPort(daemon, daemon.findPortByID("Port1"));
+		elapsed = runUntil(daemon, [&]() { return fast.readable(); }, 1000);
+		check((elapsed >= PUSH_DELAY - 5) && (elapsed <= PUSH_DELAY + 30), "the states of the refreshed ports are pushed after the push delay (after: " + std::to_string(elapsed) + " ms)");
+		std::string message;
+		std::map<std::string, Poco::JSON::Object::Ptr> states;
+		if (fast.receiveFrame(message))
+			states = pushedStates(message);
+		check((states.size() == 2) && (states.count("Port0") == 1) && (states.count("Port1") == 1),
+			"20 refreshes of a port and the refresh of another port are pushed as one message with one state per port");
+		check((states.count("Port0") == 1) && (states["Port0"]->getObject("state")->getValue<int>("line") == 1), "the pushed state is the latest state of the port");
+		runFor(daemon, PUSH_DELAY * 3);
+		check(!fast.readable(), "nothing else is pushed for the coalesced refreshes");
+
+		// a refresh of all ports supersedes the pending states
+		refreshPort(daemon, port0);
+		daemon.refresh(nullptr);
+		elapsed = runUntil(daemon, [&]() { return fast.readable(); }, 1000);
+		check(fast.receiveFrame(message) && (message == "{\"event\":\"refreshAll\"}"), "a refresh of all ports is pushed (after: " + std::to_string(elapsed) + " ms)");
+		runFor(daemon, PUSH_DELAY * 3);
+		check(!fast.readable(), "the state that was pending before the refresh of all ports is not pushed");
+
+		// a slow client does not read while states of 100 KB are pushed
+		WebSocketConnection slow(httpPort, 4096);
+		int fastPushes = 0;
+		for (int i = 0; i < PUSHES; i++) {
+			bulky->extendedState = "push " + std::to_string(i) + " " + std::string(100000, '.');
+			refreshPort(daemon, bulky);
+			if ((runUntil(daemon, [&]() { return fast.readable(); }, 1000) >= 0) && fast.receiveFrame(message)
+				&& (pushedStates(message)["Bulky"]->getValue<std::string>("extendedState") == bulky->extendedState))
+				fastPushes++;
+		}
+		check(fastPushes == PUSHES, "a client that keeps up receives every push (" + std::to_string(fastPushes) + " of " + std::to_string(PUSHES) + ")");
+		// the network thread sends the held back states when the slow client reads
+		int slowPushes = 0;
+		std::string lastState;
+		slow.setTimeout(500);
+		while (slow.receiveFrame(message)) {
+			slowPushes++;
+			lastState = pushedStates(message)["Bulky"]->getValue<std::string>("extendedState");
+		}
+		check(!slow.closed, "the connection of the slow client remains open");
+		check(slowPushes < PUSHES / 4, "the slow client receives fewer pushes than the fast client (" + std::to_string(slowPushes) + " of " + std::to_string(PUSHES) + ")");
+		check(lastState == bulky->extendedState, "the slow client receives the latest state");
+
+		// static files are served by the network thread; all requests use one keep-alive connection
+		HttpConnection browser(httpPort);
+		HttpResponse response;
+		browser.get("/app.js");
+		bool received = browser.receive(response);
+		std::string etag = response.headers["etag"];
+		check(received && (response.status == 200) && (response.body == script) && (response.headers["content-type"] == "application/javascript")
+			&& (response.headers.count("content-encoding") == 0), "a file is served without compression if the client does not accept it");
+		check((etag.size() > 2) && (etag[0] == '"') && (response.headers["cache-control"] == "max-age=" + std::to_string(DEFAULT_CACHE_MAX_AGE))
+			&& (response.headers["vary"] == "Accept-Encoding"), "the response has an ETag, Cache-Control and Vary header (ETag: " + etag + ")");
+		check(response.headers["connection"] == "keep-alive", "the connection of an HTTP/1.1 request is kept alive");
+		browser.get("/app.js", "If-None-Match: " + etag + "\r\n");
+		check(browser.receive(response) && (response.status == 304) && response.body.empty() && (response.headers["etag"] == etag),
+			"a request with the current ETag in If-None-Match is answered with 304 Not Modified");
+		browser.get("/app.js", "Accept-Encoding: deflate, gzip\r\n");
+		received = browser.receive(response);
+		std::string gzETag = response.headers["etag"];
+		check(received && (response.status == 200) && (response.body == compressedScript) && (response.headers["content-encoding"] == "gzip")
+			&& (response.headers["content-type"] == "application/javascript"), "the precompressed variant is served if the client accepts gzip");
+		check(!gzETag.empty() && (gzETag != etag), "the precompressed variant has its own ETag");
+		browser.get("/app.js", "Accept-Encoding: gzip\r\nIf-None-Match: " + gzETag + "\r\n");
+		check(browser.receive(response) && (response.status == 304), "the ETag of the precompressed variant is answered with 304 if the client accepts gzip");
+		browser.get("/app.js", "If-None-Match: " + gzETag + "\r\n");
+		check(browser.receive(response) && (response.status == 200) && (response.body == script), "the ETag of the precompressed variant does not match the uncompressed file");
+		browser.get("/style.css", "Accept-Encoding: gzip\r\n");
+		check(browser.receive(response) && (response.status == 200) && (response.body == "body { margin: 0; }\n")
+			&& (response.headers.count("content-encoding") == 0) && (response.headers.count("vary") == 0), "a file without a precompressed variant is served uncompressed");
+		browser.get("/");
+		check(browser.receive(response) && (response.status == 200) && (response.body == "<html></html>\n")
+			&& (response.headers["content-type"] == "text/html; charset=utf-8"), "the index file is served for the directory");
+		browser.get("/protected/secret.txt");
+		check(browser.receive(response) && (response.status == 401), "a file in a directory with an authentication file is left to Mongoose");
+		check(!browser.closed, "the requests have been answered on one connection");
+
+		// keep-alive is not used if the client does not request it
+		HttpConnection closing(httpPort);
+		closing.get("/style.css", "Connection: close\r\n");
+		check(closing.receive(response) && (response.status == 200) && (response.headers["connection"] == "close")
+			&& !closing.receive(response) && closing.closed, "the connection is closed after a request with Connection: close");
+		HttpConnection legacy(httpPort);
+		legacy.get("/style.css", "", "HTTP/1.0");
+		check(legacy.receive(response) && (response.status == 200) && (response.headers["connection"] == "close")
+			&& !legacy.receive(response) && legacy.closed, "the connection is closed after an HTTP/1.0 request without keep-alive");
+
+		// idle connections are closed after the keep-alive timeout; meanwhile the cache notices changed files
+		HttpConnection idle(httpPort);
+		idle.get("/style.css");
+		check(idle.receive(response) && (response.status == 200), "a file is served on the connection that becomes idle");
+		std::string changedScript("function check() { return 43; }\n");
+		writeFile(documentRoot + "/app.js", changedScript);
+		uint64_t start = monotonicUs();
+		idle.setTimeout(KEEP_ALIVE_TIMEOUT * 1000 + 3000);
+		received = idle.receive(response);
+		elapsed = (int)((monotonicUs() - start) / 1000);
+		check(!received && idle.closed && (elapsed >= KEEP_ALIVE_TIMEOUT * 1000 - 100), "an idle connection is closed after the keep-alive timeout (after: "
+			+ std::to_string(elapsed) + " ms)");
+		HttpConnection reload(httpPort);
+		reload.get("/app.js", "If-None-Match: " + etag + "\r\n");
+		check(reload.receive(response) && (response.status == 200) && (response.body == changedScript) && (response.headers["etag"] != etag),
+			"a changed file is served with a new ETag");
+
+		// the main loop does not run, so the request remains queued
+		HttpConnection pending(httpPort);
+		pending.post("/api/jsonrpc", callJson("getPortInfo", "{\"portID\":\"Port0\"}", 1));
+		start = monotonicUs();
+		while ((eventLoop->timerCount() == 0) && (monotonicUs() - start < 2000000))
+			Poco::Thread::sleep(1);
+		check(eventLoop->timerCount() == 1, "the network thread has started a timer for the queued request");
+		start = monotonicUs();
+		plugin->stopPlugin();
+		elapsed = (int)((monotonicUs() - start) / 1000);
+		check(elapsed < NETWORK_POLL_TIMEOUT_MS / 5, "stopPlugin wakes up the network thread (after: " + std::to_string(elapsed) + " ms)");
+		check(countThreads() == threads, "stopPlugin joins the network thread");
+		check(eventLoop->timerCount() == 0, "stopPlugin cancels the timer of the queued request");
+		check(!pending.receive(response) && pending.closed, "the connection of the queued request is closed");
+		runFor(daemon, 50);
+
+		// the queue works again after a restart
+		plugin->startPlugin();
+		HttpConnection restarted(httpPort);
+		restarted.post("/api/jsonrpc", callJson("getPortInfo", "{\"portID\":\"Port1\"}", 2));
+		elapsed = runUntil(daemon, [&]() { return restarted.readable(); }, 2000);
+		received = (elapsed >= 0) && restarted.receive(response);
+		check(received && verifyPortResult(Poco::JSON::Parser().parse(response.body), 2, "Port1", 1).empty(),
+			"a request is answered after the plugin has been restarted (after: " + std::to_string(elapsed) + " ms)");
+
+		// notifications
+		restarted.post("/api/jsonrpc", notificationJson("setDigitalState", "{\"portID\":\"Port1\",\"line\":0}"));
+		elapsed = runUntil(daemon, [&]() { return restarted.readable(); }, 2000);
+		received = (elapsed >= 0) && restarted.receive(response);
+		check(received && (response.status == 204) && response.body.empty() && (response.headers["connection"] == "keep-alive"),
+			"a notification is answered with 204 No Content");
+		restarted.post("/api/jsonrpc", "[" + notificationJson("setDigitalState", "{\"portID\":\"Port1\",\"line\":1}") + ","
+			+ callJson("getPortInfo", "{\"portID\":\"Port1\"}", 3) + "," + notificationJson("unknownMethod", "{}") + "]");
+		elapsed = runUntil(daemon, [&]() { return restarted.readable(); }, 2000);
+		received = (elapsed >= 0) && restarted.receive(response);
+		std::string batchError("no response");
+		if (received && (response.status == 200)) {
+			Poco::JSON::Array::Ptr array = Poco::JSON::Parser().parse(response.body).extract<Poco::JSON::Array::Ptr>();
+			batchError = (array->size() == 1) ? verifyPortResult(array->get(0), 3, "Port1", 1) : "unexpected number of responses: " + response.body;
+		}
+		check(batchError.empty(), "a batch contains no responses to its notifications, which have been executed"
+			+ (batchError.empty() ? "" : " (" + batchError + ")"));
+		restarted.post("/api/jsonrpc", "[" + notificationJson("setDigitalState", "{\"portID\":\"Port1\",\"line\":0}") + ","
+			+ notificationJson("getPortInfo", "{\"portID\":\"Port1\"}") + "]");
+		elapsed = runUntil(daemon, [&]() { return restarted.readable(); }, 2000);
+		received = (elapsed >= 0) && restarted.receive(response);
+		check(received && (response.status == 204) && response.body.empty(), "a batch of notifications is answered with 204 No Content");
+		plugin->stopPlugin();
+		check(countThreads() == threads, "stopPlugin joins the restarted network thread");
+
+		// the ports and the plugin are shut down and deleted in the next frame
+		daemon.shutdown();
+		daemon.waiting(0);
+		check(daemon.getPorts().empty(), "the ports have been deleted");
+	} catch (Poco::Exception& e) {
+		check(false, "unexpected exception: " + e.displayText());
+	}
+
+	Poco::File(documentRoot).remove(true);
+	return checkResult();
+}
@@ -1,11 +1,8 @@
 #include <sstream>
+#include <deque>
+#include <map>
 
 #include "Poco/Tuple.h"
-#include "Poco/Runnable.h"
-#include <Poco/Net/HTTPClientSession.h>
-#include <Poco/Net/HTTPRequest.h>
-#include <Poco/Net/HTTPResponse.h>
-#include <Poco/StreamCopier.h>
 #include <Poco/Path.h>
 #include <Poco/URI.h>
 #include <Poco/Exception.h>
@@ -15,12 +12,13 @@
 #include "Poco/DOM/NodeFilter.h"
 #include "Poco/DOM/AutoPtr.h"
 #include "Poco/SAX/InputSource.h"
+#include "Poco/SAX/SAXParser.h"
+#include "Poco/SAX/DefaultHandler.h"
+#include "Poco/SAX/Attributes.h"
 #include "Poco/DigestStream.h"
 #include "Poco/MD5Engine.h"
 #include "Poco/UTF16Encoding.h"
 #include "Poco/UnicodeConverter.h"
-#include "Poco/Notification.h"
-#include "Poco/NotificationQueue.h"
 #include "Poco/AutoPtr.h"
 #include "Poco/NumberParser.h"
 
@@ -31,53 +29,97 @@
 
 #define INVALID_SID		"0000000000000000"
 
+// status code returned by the FritzBox for requests with an expired session ID
+#define HTTP_FORBIDDEN	403
+
 namespace {
 
 class FritzBoxPlugin;
 
+/** The values of an actor as reported by getdevicelistinfos. -1 means unknown. */
+struct DeviceInfo {
+	bool present;
+	int8_t switchState;
+	int32_t power;		// mW
+	int32_t energy;		// Wh
+
+	DeviceInfo() : present(false), switchState(-1), power(-1), energy(-1) {};
+};
+
+// device information by AIN (without blanks)
+typedef std::map<std::string, DeviceInfo> DeviceInfoMap;
+
 class FritzPort  {
 	std::string id;
 public:
 	FritzPort(std::string id) : id(id) {};
 
 	virtual void query() = 0;
+
+	/** Applies the values of the device list. info is nullptr if the actor is not in the list. */
+	virtual void update(const DeviceInfo* info) = 0;
+
+	virtual std::string getAIN(void) = 0;
 };
 
-class ActionNotification : public Poco::Notification {
+/** Collects the actor values while the device list is being parsed. */
+class DeviceListHandler : public Poco::XML::DefaultHandler {
+protected:
+	DeviceInfoMap& devices;
+	DeviceInfo* device;					// the device element that is being parsed, or nullptr
+	std::vector<std::string> elements;	// names of the open elements
+	std::string text;
+
+	int32_t parseValue(void);
+
 public:
-	typedef Poco::AutoPtr<ActionNotification> Ptr;
+	DeviceListHandler(DeviceInfoMap& devices) : devices(devices), device(nullptr) {};
+
+	virtual void startElement(const Poco::XML::XMLString& uri, const Poco::XML::XMLString& localName, const Poco::XML::XMLString& qname, const Poco::XML::Attributes& attributes) override;
+
+	virtual void endElement(const Poco::XML::XMLString& uri, const Poco::XML::XMLString& localName, const Poco::XML::XMLString& qname) override;
+
+	virtual void characters(const Poco::XML::XMLChar ch[], int start, int length) override;
+};
 
+/** An operation on a FritzBox actor that is waiting to be performed. */
+struct Action {
 	enum ActionType {
-		LOGIN,
-		LOGOUT,
-		GETSWITCHSTATE,
+		GETDEVICELIST,		// queries all actors; port is nullptr
 		SETSWITCHSTATEHIGH,
-		SETSWITCHSTATELOW,
-		GETSWITCHPOWER,
-		GETSWITCHENERGY
+		SETSWITCHSTATELOW
 	};
 
 	ActionType type;
 	FritzPort* port;
+	bool retried;		// the action has been repeated after the session had expired
 
-	ActionNotification(ActionType type, FritzPort* port);
+	Action(ActionType type, FritzPort* port) : type(type), port(port), retried(false) {};
 };
 
-ActionNotification::ActionNotification(ActionType type, FritzPort* port) {
-	this->type = type;
-	this->port = port;
-}
-
 ////////////////////////////////////////////////////////////////////////
 // Plugin main class
 ////////////////////////////////////////////////////////////////////////
 
-class FritzBoxPlugin : public IOPDIDPlugin, public opdid::IOPDIDConnectionListener, public Poco::Runnable {
+/** The plugin performs one request at a time using the daemon's shared HTTP client.
+* The session ID is kept between requests; the login is only repeated when the
+* FritzBox reports that the session has expired.
+* The values of all actors are read with a single getdevicelistinfos request whose
+* result is parsed once and distributed to the ports.
+*/
+class FritzBoxPlugin : public IOPDIDPlugin, public opdid::IOPDIDConnectionListener, protected opdid::HttpClient::Listener {
 	friend class FritzDECT200Switch;
 	friend class FritzDECT200Power;
 	friend class FritzDECT200Energy;
 
 protected:
+	enum State {
+		IDLE,
+		CHECK_SESSION,		// waiting for the login page
+		LOGIN,				// waiting for the response to the challenge
+		COMMAND				// waiting for the result of the first queued action
+	};
+
 	std::string nodeID;
 
 	std::string host;
@@ -95,42 +137,51 @@ protected:
 	typedef std::vector<FritzPort*> FritzPorts;
 	FritzPorts fritzPorts;
 
-	Poco::NotificationQueue queue;
+	std::deque<Action> actions;
+	State state;
+	opdid::HttpClient::RequestID requestID;
+	std::string requestUrl;
 
-	Poco::Thread workThread;
+	// queries of ports are answered by the last device list if it is not older than this
+	uint64_t deviceListMaxAge;
+	uint64_t deviceListTime;
 
 	void errorOccurred(const std::string& message);
 
+	virtual void httpCompleted(opdid::HttpClient::RequestID id, const opdid::HttpClient::Response& response) override;
+
 public:
 	opdid::AbstractOPDID* opdid;
 
-	virtual std::string httpGet(const std::string& url);
+	virtual void httpGet(const std::string& url);
 
-	virtual std::string getResponse(const std::string& challenge, const std::string& password);
+	virtual std::string getContent(const opdid::HttpClient::Response& response);
 
-	virtual std::string getSessionID(const std::string& user, const std::string& password);
+	virtual std::string getResponse(const std::string& challenge, const std::string& password);
 
 	virtual std::string getXMLValue(const std::string& xml, const std::string& node);
 
-	virtual void login(void);
+	virtual void enqueue(Action::ActionType type, FritzPort* port);
+
+	virtual void queryDevices(void);
 
-	virtual void checkLogin(void);
+	virtual void deviceListReceived(const std::string& xml);
 
-	virtual void logout(void);
+	virtual void processActions(void);
 
-	virtual void getSwitchState(FritzPort* port);
+	virtual void sessionReceived(const std::string& loginPage, bool challengeAnswered);
 
-	virtual void setSwitchState(FritzPort* port, uint8_t line);
+	virtual void loginFailed(void);
 
-	virtual void getSwitchEnergy(FritzPort* port);
+	virtual void performAction(const Action& action);
 
-	virtual void getSwitchPower(FritzPort* port);
+	virtual void actionCompleted(const Action& action, const std::string& result);
+
+	virtual void actionFailed(const Action& action);
 
 	virtual void masterConnected(void) override;
 	virtual void masterDisconnected(void) override;
 
-	virtual void run(void);
-
 	virtual void setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std::string& node, Poco::Util::AbstractConfiguration* nodeConfig) override;
 };
 
@@ -156,6 +207,10 @@ public:
 
 	virtual void query() override;
 
+	virtual void update(const DeviceInfo* info) override;
+
+	virtual std::string getAIN(void) override;
+
 	virtual void setLine(uint8_t line, ChangeSource changeSource = opdi::Port::ChangeSource::CHANGESOURCE_INT) override;
 
 	virtual void getState(uint8_t* mode, uint8_t* line) const override;
@@ -179,6 +234,10 @@ public:
 
 	virtual void query() override;
 
+	virtual void update(const DeviceInfo* info) override;
+
+	virtual std::string getAIN(void) override;
+
 	virtual void getState(int64_t* position) const override;
 
 	virtual void doRefresh(void) override;
@@ -203,6 +262,10 @@ public:
 
 	virtual void query() override;
 
+	virtual void update(const DeviceInfo* info) override;
+
+	virtual std::string getAIN(void) override;
+
 	virtual void getState(int64_t* position) const override;
 
 	virtual void doRefresh(void) override;
@@ -232,7 +295,19 @@ void FritzDECT200Switch::configure(Poco::Util::AbstractConfiguration* portConfig
 }
 
 void FritzDECT200Switch::query() {
-	this->plugin->queue.enqueueNotification(new ActionNotification(ActionNotification::GETSWITCHSTATE, this));
+	this->plugin->queryDevices();
+}
+
+std::string FritzDECT200Switch::getAIN(void) {
+	return this->ain;
+}
+
+void FritzDECT200Switch::update(const DeviceInfo* info) {
+	if ((info == nullptr) || !info->present) {
+		this->setError(Error::VALUE_NOT_AVAILABLE);
+		return;
+	}
+	this->setSwitchState(info->switchState);
 }
 
 void FritzDECT200Switch::setLine(uint8_t line, ChangeSource /*changeSource*/) {
@@ -240,10 +315,10 @@ void FritzDECT200Switch::setLine(uint8_t line, ChangeSource /*changeSource*/) {
 		return;
 
 	if (line == 0)
-		this->plugin->queue.enqueueNotification(new ActionNotification(ActionNotification::SETSWITCHSTATELOW, this));
+		this->plugin->enqueue(Action::SETSWITCHSTATELOW, this);
 	else
 	if (line == 1)
-		this->plugin->queue.enqueueNotification(new ActionNotification(ActionNotification::SETSWITCHSTATEHIGH, this));
+		this->plugin->enqueue(Action::SETSWITCHSTATEHIGH, this);
 }
 
 void FritzDECT200Switch::getState(uint8_t* mode, uint8_t* line) const {
@@ -319,7 +394,19 @@ void FritzDECT200Power::configure(Poco::Util::AbstractConfiguration* portConfig)
 }
 
 void FritzDECT200Power::query() {
-	this->plugin->queue.enqueueNotification(new ActionNotification(ActionNotification::GETSWITCHPOWER, this));
+	this->plugin->queryDevices();
+}
+
+std::string FritzDECT200Power::getAIN(void) {
+	return this->ain;
+}
+
+void FritzDECT200Power::update(const DeviceInfo* info) {
+	if ((info == nullptr) || !info->present) {
+		this->setError(Error::VALUE_NOT_AVAILABLE);
+		return;
+	}
+	this->setPower(info->power);
 }
 
 void FritzDECT200Power::getState(int64_t* position) const {
@@ -400,7 +487,19 @@ void FritzDECT200Energy::configure(Poco::Util::AbstractConfiguration* portConfig
 }
 
 void FritzDECT200Energy::query() {
-	this->plugin->queue.enqueueNotification(new ActionNotification(ActionNotification::GETSWITCHENERGY, this));
+	this->plugin->queryDevices();
+}
+
+std::string FritzDECT200Energy::getAIN(void) {
+	return this->ain;
+}
+
+void FritzDECT200Energy::update(const DeviceInfo* info) {
+	if ((info == nullptr) || !info->present) {
+		this->setError(Error::VALUE_NOT_AVAILABLE);
+		return;
+	}
+	this->setEnergy(info->energy);
 }
 
 void FritzDECT200Energy::getState(int64_t* position) const {
@@ -445,6 +544,67 @@ unsigned int msb32(unsigned int x)
 	return r + bval[x];
 }
 
+// AINs are displayed with a blank by the FritzBox; compare them without blanks
+static std::string normalizeAIN(const std::string& ain) {
+	std::string result;
+	for (size_t i = 0; i < ain.size(); i++)
+		if (ain[i] != ' ')
+			result += ain[i];
+	return result;
+}
+
+int32_t DeviceListHandler::parseValue(void) {
+	// empty or non-numeric values (e. g. "inval") mean that the value is unknown
+	int value = -1;
+	if (!Poco::NumberParser::tryParse(this->text, value))
+		return -1;
+	return value;
+}
+
+void DeviceListHandler::startElement(const Poco::XML::XMLString& /*uri*/, const Poco::XML::XMLString& localName, const Poco::XML::XMLString& qname, const Poco::XML::Attributes& attributes) {
+	const std::string& name = (localName.empty() ? qname : localName);
+	this->elements.push_back(name);
+	this->text.clear();
+
+	// groups of actors are ignored
+	if ((name == "device") && (this->elements.size() == 2)) {
+		std::string identifier = attributes.getValue("", "identifier");
+		if (identifier.empty())
+			identifier = attributes.getValue("identifier");
+		this->device = &this->devices[normalizeAIN(identifier)];
+		*this->device = DeviceInfo();
+	}
+}
+
+void DeviceListHandler::endElement(const Poco::XML::XMLString& /*uri*/, const Poco::XML::XMLString& localName, const Poco::XML::XMLString& qname) {
+	const std::string& name = (localName.empty() ? qname : localName);
+	if (this->device != nullptr) {
+		std::string parent = (this->elements.size() >= 2 ? this->elements[this->elements.size() - 2] : "");
+		if ((name == "present") && (parent == "device"))
+			this->device->present = (this->parseValue() == 1);
+		else
+		if ((name == "state") && (parent == "switch")) {
+			int32_t state = this->parseValue();
+			this->device->switchState = ((state == 0) || (state == 1) ? state : -1);
+		} else
+		if ((name == "power") && (parent == "powermeter"))
+			this->device->power = this->parseValue();
+		else
+		if ((name == "energy") && (parent == "powermeter"))
+			this->device->energy = this->parseValue();
+		else
+		if (name == "device")
+			this->device = nullptr;
+	}
+	if (!this->elements.empty())
+		this->elements.pop_back();
+}
+
+void DeviceListHandler::characters(const Poco::XML::XMLChar ch[], int start, int length) {
+	if (this->device != nullptr)
+		this->text.append(ch + start, length);
+}
+
 void FritzBoxPlugin::errorOccurred(const std::string& message) {
 	// this method is for errors that are usually logged in verbosity Normal
 	// identical error message?
@@ -465,51 +625,33 @@ void FritzBoxPlugin::errorOccurred(const std::string& message) {
 	}
 }
 
-std::string FritzBoxPlugin::httpGet(const std::string& url) {
-	Poco::URI uri(std::string("http://") + this->host + ":" + this->opdid->to_string(this->port) + url);
-	try {
-		// prepare session
-		Poco::Net::HTTPClientSession session(uri.getHost(), uri.getPort());
-		session.setTimeout(Poco::Timespan(this->timeoutSeconds, 0));
-
-		// prepare path
-		std::string path(uri.getPathAndQuery());
-		if (path.empty()) path = "/";
-
-		this->opdid->logDebug(this->nodeID + ": HTTP GET: " + uri.toString(), this->logVerbosity);
-
-		// send request
-		Poco::Net::HTTPRequest req(Poco::Net::HTTPRequest::HTTP_GET, path, Poco::Net::HTTPMessage::HTTP_1_1);
-		session.sendRequest(req);
+void FritzBoxPlugin::httpGet(const std::string& url) {
+	this->requestUrl = std::string("http://") + this->host + ":" + this->opdid->to_string(this->port) + url;
 
-		// get response
-		Poco::Net::HTTPResponse res;
+	this->opdid->logDebug(this->nodeID + ": HTTP GET: " + this->requestUrl, this->logVerbosity);
 
-		// print response
-		std::istream &is = session.receiveResponse(res);
-
-		if (res.getStatus() != 200) {
-			this->errorOccurred(this->nodeID + ": HTTP GET: " + uri.toString() + ": The server returned an error: " + this->opdid->to_string(res.getStatus()) + " " + res.getReason());
-			return "";
-		} else
-			this->opdid->logDebug(this->nodeID + ": HTTP Response: " + this->opdid->to_string(res.getStatus()) + " " + res.getReason(), this->logVerbosity);
-
-		std::stringstream ss;
-
-		Poco::StreamCopier::copyStream(is, ss);
-
-		if (this->errorCount > 0) {
-			this->opdid->logNormal(this->nodeID + ": HTTP GET successful: " + uri.toString(), this->logVerbosity);
-			this->errorCount = 0;
-		} else
-			this->opdid->logDebug(this->nodeID + ": HTTP GET successful: " + uri.toString(), this->logVerbosity);
+	this->requestID = this->opdid->httpClient->get(this->requestUrl, this, this->timeoutSeconds);
+}
 
-		return ss.str().erase(ss.str().find_last_not_of("\n") + 1);
-	} catch (Poco::Exception &e) {
-		this->errorOccurred(this->nodeID + ": Error during HTTP GET for " + uri.toString() + ": " + e.message());
+std::string FritzBoxPlugin::getContent(const opdid::HttpClient::Response& response) {
+	if (response.status == 0) {
+		this->errorOccurred(this->nodeID + ": Error during HTTP GET for " + this->requestUrl + ": " + response.reason);
+		return "";
 	}
+	if (response.status != 200) {
+		this->errorOccurred(this->nodeID + ": HTTP GET: " + this->requestUrl + ": The server returned an error: " + this->opdid->to_string(response.status) + " " + response.reason);
+		return "";
+	} else
+		this->opdid->logDebug(this->nodeID + ": HTTP Response: " + this->opdid->to_string(response.status) + " " + response.reason, this->logVerbosity);
+
+	if (this->errorCount > 0) {
+		this->opdid->logNormal(this->nodeID + ": HTTP GET successful: " + this->requestUrl, this->logVerbosity);
+		this->errorCount = 0;
+	} else
+		this->opdid->logDebug(this->nodeID + ": HTTP GET successful: " + this->requestUrl, this->logVerbosity);
 
-	return "";
+	std::string content = response.body;
+	return content.erase(content.find_last_not_of("\n") + 1);
 }
 
 std::string FritzBoxPlugin::getXMLValue(const std::string& xml, const std::string& node) {
@@ -555,181 +697,188 @@ std::string FritzBoxPlugin::getResponse(const std::string& challenge, const std:
 	return challenge + "-" + Poco::DigestEngine::digestToHex(digest);
 }
 
-std::string FritzBoxPlugin::getSessionID(const std::string& user, const std::string& password) {
-
-	std::string loginPage = this->httpGet("/login_sid.lua?sid=" + this->sid);
-	if (loginPage.empty())
-		return INVALID_SID;
-	std::string sid = getXMLValue(loginPage, "SID");
-	if (sid == INVALID_SID) {
-		std::string challenge = getXMLValue(loginPage, "Challenge");
-		std::string uri = "/login_sid.lua?username=" + user + "&response=" + this->getResponse(challenge, password);
-		loginPage = this->httpGet(uri);
-		if (loginPage.empty())
-			return INVALID_SID;
-		sid = getXMLValue(loginPage,  "SID");
+void FritzBoxPlugin::enqueue(Action::ActionType type, FritzPort* port) {
+	// an identical action that is still waiting makes this one redundant
+	for (auto it = this->actions.begin(), ite = this->actions.end(); it != ite; ++it) {
+		// the first action may already be in progress
+		if ((it == this->actions.begin()) && (this->state == COMMAND))
+			continue;
+		if ((it->type == type) && (it->port == port))
+			return;
 	}
-	return sid;
+	this->actions.push_back(Action(type, port));
+	this->processActions();
 }
 
-void FritzBoxPlugin::login(void) {
-	this->opdid->logDebug(this->nodeID + ": Attempting to login to FritzBox " + this->host + " with user " + this->user, this->logVerbosity);
-
-	this->sid = this->getSessionID(this->user, this->password);
-
-	if (sid == INVALID_SID) {
-		this->errorOccurred(this->nodeID + ": Login to FritzBox " + this->host + " with user " + this->user + " failed");
+void FritzBoxPlugin::queryDevices(void) {
+	// recent values are still valid
+	if ((this->deviceListTime > 0) && (opdi_get_time_ms() - this->deviceListTime < this->deviceListMaxAge))
 		return;
-	}
-	if (this->errorCount > 0) {
-		this->opdid->logNormal(this->nodeID + ": Login to FritzBox " + this->host + " with user " + this->user + " successful; sid = " + this->sid, this->logVerbosity);
-		this->errorCount = 0;
-	} else
-		this->opdid->logDebug(this->nodeID + ": Login to FritzBox " + this->host + " with user " + this->user + " successful; sid = " + this->sid, this->logVerbosity);
-
-	// query ports (post notifications to query)
-	auto it = this->fritzPorts.begin();
-	auto ite = this->fritzPorts.end();
-	while (it != ite) {
-		(*it)->query();
-		++it;
-	}
+	// a device list that is being or will be requested answers the query as well
+	for (auto it = this->actions.begin(), ite = this->actions.end(); it != ite; ++it)
+		if (it->type == Action::GETDEVICELIST)
+			return;
+	this->enqueue(Action::GETDEVICELIST, nullptr);
 }
 
-void FritzBoxPlugin::checkLogin(void) {
-	// check whether we're currently logged in
-	std::string loginPage = this->httpGet("/login_sid.lua?sid=" + this->sid);
-	// error case
-	if (loginPage.empty()) {
-		this->sid = INVALID_SID;
-		return;
-	}
-	this->sid = getXMLValue(loginPage, "SID");
-	if (sid == INVALID_SID) {
-		// try to log in
-		this->login();
+void FritzBoxPlugin::deviceListReceived(const std::string& xml) {
+	// parse the list once and collect the values of all actors
+	DeviceInfoMap devices;
+	DeviceListHandler handler(devices);
+	Poco::XML::SAXParser parser;
+	parser.setContentHandler(&handler);
+	try {
+		parser.parseMemoryBuffer(xml.data(), xml.size());
+	} catch (Poco::Exception &e) {
+		throw Poco::Exception("Error parsing device list", e);
 	}
-}
-
-void FritzBoxPlugin::logout(void) {
-	// not connected?
-	if (this->sid == INVALID_SID)
-		return;
-
-	this->opdid->logDebug(this->nodeID + ": Logout from FritzBox " + this->host, this->logVerbosity);
+	this->deviceListTime = opdi_get_time_ms();
 
-	this->httpGet("/login_sid.lua?logout=true&sid=" + this->sid);
+	this->opdid->logDebug(this->nodeID + ": Device list received with " + this->opdid->to_string(devices.size()) + " actor(s)", this->logVerbosity);
 
-	this->sid = INVALID_SID;
+	for (auto it = this->fritzPorts.begin(), ite = this->fritzPorts.end(); it != ite; ++it) {
+		auto device = devices.find(normalizeAIN((*it)->getAIN()));
+		(*it)->update(device == devices.end() ? nullptr : &device->second);
+	}
 }
 
-void FritzBoxPlugin::getSwitchState(FritzPort* port) {
-	// port must be a DECT 200 switch port
-	FritzDECT200Switch* switchPort = (FritzDECT200Switch*)port;
-
-	this->checkLogin();
-	// problem?
-	if (this->sid == INVALID_SID) {
-		switchPort->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
+void FritzBoxPlugin::processActions(void) {
+	// request in progress or nothing to do?
+	if ((this->state != IDLE) || this->actions.empty())
 		return;
-	}
 
-	// query the FritzBox
-	std::string result = httpGet("/webservices/homeautoswitch.lua?ain=" + switchPort->ain + "&switchcmd=getswitchstate&sid=" + this->sid);
-	// problem?
-	if (result.empty()) {
-		switchPort->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
+	if (this->sid == INVALID_SID) {
+		this->opdid->logDebug(this->nodeID + ": Attempting to login to FritzBox " + this->host + " with user " + this->user, this->logVerbosity);
+		this->state = CHECK_SESSION;
+		this->httpGet("/login_sid.lua?sid=" + this->sid);
 		return;
 	}
 
-	if (result == "1") {
-		switchPort->setSwitchState(1);
-	} else
-	if (result == "0") {
-		switchPort->setSwitchState(0);
-	} else
-		switchPort->setSwitchState(-1);
+	this->state = COMMAND;
+	this->performAction(this->actions.front());
 }
 
-void FritzBoxPlugin::setSwitchState(FritzPort* port, uint8_t line) {
-	// port must be a DECT 200 switch port
-	FritzDECT200Switch* switchPort = (FritzDECT200Switch*)port;
-
-	this->checkLogin();
-	// problem?
-	if (this->sid == INVALID_SID) {
-		switchPort->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
+void FritzBoxPlugin::httpCompleted(opdid::HttpClient::RequestID id, const opdid::HttpClient::Response& response) {
+	if (id != this->requestID)
 		return;
+	State completedState = this->state;
+	this->state = IDLE;
+
+	try {
+		if (completedState == COMMAND) {
+			Action action = this->actions.front();
+			this->actions.pop_front();
+			if ((response.status == HTTP_FORBIDDEN) && !action.retried) {
+				// the session has expired; login again and repeat the action
+				this->opdid->logDebug(this->nodeID + ": Session expired; logging in again", this->logVerbosity);
+				this->sid = INVALID_SID;
+				action.retried = true;
+				this->actions.push_front(action);
+			} else {
+				std::string result = this->getContent(response);
+				if (result.empty())
+					this->actionFailed(action);
+				else
+					this->actionCompleted(action, result);
+			}
+		} else {
+			std::string loginPage = this->getContent(response);
+			if (loginPage.empty())
+				this->loginFailed();
+			else
+				this->sessionReceived(loginPage, completedState == LOGIN);
+		}
+	} catch (Poco::Exception &e) {
+		this->opdid->logNormal(this->nodeID + ": Error processing FritzBox response: " + e.message(), this->logVerbosity);
+		if (completedState != COMMAND)
+			this->loginFailed();
 	}
 
-	std::string cmd = (line == 1 ? "setswitchon" : "setswitchoff");
-	std::string result = this->httpGet("/webservices/homeautoswitch.lua?ain=" + switchPort->ain + "&switchcmd=" + cmd + "&sid=" + this->sid);
-	// problem?
-	if (result.empty()) {
-		switchPort->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
+	this->processActions();
+}
+
+void FritzBoxPlugin::sessionReceived(const std::string& loginPage, bool challengeAnswered) {
+	std::string sid = this->getXMLValue(loginPage, "SID");
+	if (sid == INVALID_SID) {
+		if (challengeAnswered) {
+			this->loginFailed();
+			return;
+		}
+		std::string challenge = this->getXMLValue(loginPage, "Challenge");
+		this->state = LOGIN;
+		this->httpGet("/login_sid.lua?username=" + this->user + "&response=" + this->getResponse(challenge, this->password));
 		return;
 	}
 
-	if (result == "1") {
-		switchPort->setSwitchState(1);
-	} else
-	if (result == "0") {
-		switchPort->setSwitchState(0);
+	this->sid = sid;
+	if (this->errorCount > 0) {
+		this->opdid->logNormal(this->nodeID + ": Login to FritzBox " + this->host + " with user " + this->user + " successful; sid = " + this->sid, this->logVerbosity);
+		this->errorCount = 0;
 	} else
-		switchPort->setSwitchState(-1);
-}
+		this->opdid->logDebug(this->nodeID + ": Login to FritzBox " + this->host + " with user " + this->user + " successful; sid = " + this->sid, this->logVerbosity);
 
-void FritzBoxPlugin::getSwitchEnergy(FritzPort* port) {
-	// port must be a DECT 200 energy port
-	FritzDECT200Energy* energyPort = (FritzDECT200Energy*)port;
+	// query ports
+	this->queryDevices();
+}
 
-	this->checkLogin();
+void FritzBoxPlugin::loginFailed(void) {
+	this->sid = INVALID_SID;
+	this->errorOccurred(this->nodeID + ": Login to FritzBox " + this->host + " with user " + this->user + " failed");
 
-	// problem?
-	if (this->sid == INVALID_SID) {
-		energyPort->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
-		return;
+	// the action that caused the login fails; the next action will try again
+	if (!this->actions.empty()) {
+		Action action = this->actions.front();
+		this->actions.pop_front();
+		this->actionFailed(action);
 	}
+}
 
-	// query the FritzBox
-	std::string result = httpGet("/webservices/homeautoswitch.lua?ain=" + energyPort->ain + "&switchcmd=getswitchenergy&sid=" + this->sid);
-	// problem?
-	if (result.empty()) {
-		energyPort->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
-		return;
+void FritzBoxPlugin::performAction(const Action& action) {
+	// the AIN is passed without blanks because it is part of the URL
+	switch (action.type) {
+	case Action::GETDEVICELIST:
+		this->httpGet("/webservices/homeautoswitch.lua?switchcmd=getdevicelistinfos&sid=" + this->sid);
+		break;
+	case Action::SETSWITCHSTATELOW:
+		this->httpGet("/webservices/homeautoswitch.lua?ain=" + normalizeAIN(action.port->getAIN()) + "&switchcmd=setswitchoff&sid=" + this->sid);
+		break;
+	case Action::SETSWITCHSTATEHIGH:
+		this->httpGet("/webservices/homeautoswitch.lua?ain=" + normalizeAIN(action.port->getAIN()) + "&switchcmd=setswitchon&sid=" + this->sid);
+		break;
 	}
-
-	// parse result
-	int energy = -1;
-	Poco::NumberParser::tryParse(result, energy);
-
-	energyPort->setEnergy(energy);
 }
 
-void FritzBoxPlugin::getSwitchPower(FritzPort* port) {
-	// port must be a DECT 200 power port
-	FritzDECT200Power* powerPort = (FritzDECT200Power*)port;
-
-	this->checkLogin();
-	// problem?
-	if (this->sid == INVALID_SID) {
-		powerPort->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
-		return;
+void FritzBoxPlugin::actionCompleted(const Action& action, const std::string& result) {
+	switch (action.type) {
+	case Action::GETDEVICELIST:
+		this->deviceListReceived(result);
+		break;
+	case Action::SETSWITCHSTATELOW:
+	case Action::SETSWITCHSTATEHIGH: {
+		// port must be a DECT 200 switch port
+		FritzDECT200Switch* switchPort = (FritzDECT200Switch*)action.port;
+		if (result == "1") {
+			switchPort->setSwitchState(1);
+		} else
+		if (result == "0") {
+			switchPort->setSwitchState(0);
+		} else
+			switchPort->setSwitchState(-1);
+		break;
 	}
+	}
+}
 
-	// query the FritzBox
-	std::string result = httpGet("/webservices/homeautoswitch.lua?ain=" + powerPort->ain + "&switchcmd=getswitchpower&sid=" + this->sid);
-	// problem?
-	if (result.empty()) {
-		powerPort->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
+void FritzBoxPlugin::actionFailed(const Action& action) {
+	if (action.type == Action::GETDEVICELIST) {
+		// the values of all ports are unavailable
+		for (auto it = this->fritzPorts.begin(), ite = this->fritzPorts.end(); it != ite; ++it)
+			(*it)->update(nullptr);
 		return;
 	}
-
-	// parse result
-	int power = -1;
-	Poco::NumberParser::tryParse(result, power);
-
-	powerPort->setPower(power);
+	opdi::Port* port = dynamic_cast<opdi::Port*>(action.port);
+	if (port != nullptr)
+		port->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
 }
 
 void FritzBoxPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std::string& node, Poco::Util::AbstractConfiguration* config) {
@@ -739,6 +888,9 @@ void FritzBoxPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std:
 	this->timeoutSeconds = 2;			// short timeout (assume local network)
 
 	this->errorCount = 0;
+	this->state = IDLE;
+	this->requestID = 0;
+	this->deviceListTime = 0;
 
 	Poco::AutoPtr<Poco::Util::AbstractConfiguration> nodeConfig = config->createView(node);
 
@@ -795,6 +947,9 @@ void FritzBoxPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std:
 		this->opdid->logWarning("No devices configured in " + node + ".Devices; is this intended?");
 	}
 
+	// shortest refresh time of the meter ports
+	uint32_t shortestRefreshTime = 0;
+
 	// go through items, create ports in specified order
 	auto nli = orderedItems.begin();
 	auto nlie = orderedItems.end();
@@ -841,16 +996,25 @@ void FritzBoxPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std:
 			// remember port in plugin
 			this->fritzPorts.push_back(powerPort);
 
+			if ((energyPort->periodicRefreshTime > 0) && ((shortestRefreshTime == 0) || (energyPort->periodicRefreshTime < shortestRefreshTime)))
+				shortestRefreshTime = energyPort->periodicRefreshTime;
+			if ((powerPort->periodicRefreshTime > 0) && ((shortestRefreshTime == 0) || (powerPort->periodicRefreshTime < shortestRefreshTime)))
+				shortestRefreshTime = powerPort->periodicRefreshTime;
+
 		} else
 			throw Poco::DataException("This plugin does not support the port type", portType);
 
 		++nli;
 	}
 
-	// this->opdid->addConnectionListener(this);
+	// one device list provides the values of all ports; by default, it answers the queries
+	// of the ports during half of the shortest refresh time (milliseconds)
+	int maxAge = nodeConfig->getInt("DeviceListMaxAge", shortestRefreshTime / 2);
+	if (maxAge < 0)
+		throw Poco::DataException(node + ": DeviceListMaxAge must not be negative: " + this->opdid->to_string(maxAge));
+	this->deviceListMaxAge = maxAge;
 
-	this->workThread.setName(node + " work thread");
-	this->workThread.start(*this);
+	// this->opdid->addConnectionListener(this);
 
 	this->opdid->logVerbose(this->nodeID + ": FritzBoxPlugin setup completed successfully", this->logVerbosity);
 }
@@ -861,37 +1025,6 @@ void FritzBoxPlugin::masterConnected() {
 void FritzBoxPlugin::masterDisconnected() {
 }
 
-void FritzBoxPlugin::run(void) {
-
-	this->opdid->logDebug(this->nodeID + ": FritzBoxPlugin worker thread started", this->logVerbosity);
-
-	while (!this->opdid->shutdownRequested) {
-		try {
-
-			Poco::Notification::Ptr notification = this->queue.waitDequeueNotification(100);
-			if (notification) {
-				ActionNotification::Ptr workNf = notification.cast<ActionNotification>();
-				if (workNf) {
-					// inspect action and decide what to do
-					switch (workNf->type) {
-					case ActionNotification::LOGIN: this->login(); break;
-					case ActionNotification::LOGOUT: this->logout(); break;
-					case ActionNotification::GETSWITCHSTATE: this->getSwitchState(workNf->port); break;
-					case ActionNotification::SETSWITCHSTATELOW: this->setSwitchState(workNf->port, 0); break;
-					case ActionNotification::SETSWITCHSTATEHIGH: this->setSwitchState(workNf->port, 1); break;
-					case ActionNotification::GETSWITCHENERGY: this->getSwitchEnergy(workNf->port); break;
-					case ActionNotification::GETSWITCHPOWER: this->getSwitchPower(workNf->port); break;
-					}
-				}
-			}
-		} catch (Poco::Exception &e) {
-			this->opdid->logNormal(this->nodeID + ": Unhandled exception in worker thread: " + e.message(), this->logVerbosity);
-		}
-	}
-
-	this->opdid->logDebug(this->nodeID + ": FritzBoxPlugin worker thread terminated", this->logVerbosity);
-}
-
 // plugin instance factory function
 
 #ifdef _WINDOWS
@@ -0,0 +1,281 @@
+// Checks the FritzBox plugin against a local stand-in for the FritzBox HTTP interface.
+// The stand-in server runs on an ephemeral port of the loopback interface. It implements the
+// session ID login of login_sid.lua (using the test vector of the AVM technical note "Session ID")
+// and replays a getdevicelistinfos response in the format of the AVM AHA HTTP interface
+// documentation for the homeautoswitch.lua requests. It counts the requests that it receives.
+// The checks cover the login, the distribution of one device list to all ports, the values
+// of the switch, power and energy ports, actors that are missing from the device list,
+// switching, and the repeated login after the session has expired.
+//
+// Usage: fritzbox_check
+
+#include <stdio.h>
+
+#include <functional>
+
+#include "Poco/Net/HTTPServer.h"
+#include "Poco/Net/HTTPServerParams.h"
+#include "Poco/Net/HTTPRequestHandler.h"
+#include "Poco/Net/HTTPRequestHandlerFactory.h"
+#include "Poco/Net/HTTPServerRequest.h"
+#include "Poco/Net/HTTPServerResponse.h"
+#include "Poco/Net/ServerSocket.h"
+#include "Poco/Net/SocketAddress.h"
+#include "Poco/Util/MapConfiguration.h"
+#include "Poco/URI.h"
+#include "Poco/Mutex.h"
+#include "Poco/Thread.h"
+
+// the plugin is compiled into this program to get access to its classes
+#include "../FritzBoxPlugin.cpp"
+
+#include "LinuxOPDID.h"
+
+#include "check.h"
+
+// the main OPDI instance is declared here
+opdid::AbstractOPDID* Opdi = nullptr;
+
+namespace {
+
+// password "äbc" (UTF-8) and the challenge of the AVM technical note with its response
+const char* PASSWORD = "\xc3\xa4" "bc";
+const char* CHALLENGE = "1234567z";
+const char* CHALLENGE_RESPONSE = "1234567z-9e224a41eeefa284df7bb0f26c2913e2";
+
+// the device list in the format of the AHA HTTP interface documentation
+// Plug1 is switched on, Plug2 is switched off, Plug3 is not contained in the list
+const char* DEVICE_LIST =
+	"<devicelist version=\"1\">"
+	"<device identifier=\"08761 0000434\" id=\"17\" functionbitmask=\"896\" fwversion=\"03.33\" manufacturer=\"AVM\" productname=\"FRITZ!DECT 200\">"
+	"<present>1</present><name>Plug1</name>"
+	"<switch><state>1</state><mode>auto</mode><lock>0</lock><devicelock>0</devicelock></switch>"
+	"<powermeter><power>12340</power><energy>707</energy></powermeter>"
+	"<temperature><celsius>285</celsius><offset>0</offset></temperature>"
+	"</device>"
+	"<device identifier=\"08761 0000435\" id=\"18\" functionbitmask=\"896\" fwversion=\"03.33\" manufacturer=\"AVM\" productname=\"FRITZ!DECT 200\">"
+	"<present>1</present><name>Plug2</name>"
+	"<switch><state>0</state><mode>manuell</mode><lock>0</lock><devicelock>0</devicelock></switch>"
+	"<powermeter><power>0</power><energy>12</energy></powermeter>"
+	"<temperature><celsius>210</celsius><offset>0</offset></temperature>"
+	"</device>"
+	"<group identifier=\"65:3A:18-900\" id=\"900\" functionbitmask=\"512\" fwversion=\"1.0\" manufacturer=\"AVM\" productname=\"\">"
+	"<present>1</present><name>Group</name>"
+	"<switch><state>0</state><mode>manuell</mode><lock>0</lock><devicelock>0</devicelock></switch>"
+	"<groupinfo><masterdeviceid>0</masterdeviceid><members>17,18</members></groupinfo>"
+	"</group>"
+	"</devicelist>";
+
+/** The state of the stand-in server, shared by its request handler threads. */
+struct ServerState {
+	Poco::Mutex mutex;
+	std::string sid;			// the current session ID; empty if there is no session
+	int sessionCount;			// number of successful logins
+	int deviceListRequests;
+	int switchRequests;
+	std::string lastSwitchCommand;
+
+	ServerState() : sessionCount(0), deviceListRequests(0), switchRequests(0) {};
+};
+
+ServerState serverState;
+
+std::string queryParameter(const Poco::URI& uri, const std::string& name) {
+	Poco::URI::QueryParameters parameters = uri.getQueryParameters();
+	for (auto it = parameters.begin(), ite = parameters.end(); it != ite; ++it)
+		if (it->first == name)
+			return it->second;
+	return "";
+}
+
+std::string loginPage(const std::string& sid) {
+	return std::string("<?xml version=\"1.0\" encoding=\"utf-8\"?><SessionInfo><SID>") + sid + "</SID><Challenge>"
+		+ CHALLENGE + "</Challenge><BlockTime>0</BlockTime><Rights></Rights></SessionInfo>";
+}
+
+/** Answers login_sid.lua and homeautoswitch.lua requests like a FritzBox. */
+class StandInHandler : public Poco::Net::HTTPRequestHandler {
+public:
+	virtual void handleRequest(Poco::Net::HTTPServerRequest& request, Poco::Net::HTTPServerResponse& response) override {
+		Poco::URI uri(request.getURI());
+		std::string body;
+
+		Poco::Mutex::ScopedLock lock(serverState.mutex);
+		if (uri.getPath() == "/login_sid.lua") {
+			response.setContentType("text/xml");
+			std::string sid = queryParameter(uri, "sid");
+			if (!serverState.sid.empty() && (sid == serverState.sid))
+				body = loginPage(sid);
+			else
+			if ((queryParameter(uri, "username") == "admin") && (queryParameter(uri, "response") == CHALLENGE_RESPONSE)) {
+				serverState.sessionCount++;
+				serverState.sid = "a1b2c3d4e5f6070" + std::to_string(serverState.sessionCount % 10);
+				body = loginPage(serverState.sid);
+			} else
+				body = loginPage(INVALID_SID);
+		} else
+		if (uri.getPath() == "/webservices/homeautoswitch.lua") {
+			if (serverState.sid.empty() || (queryParameter(uri, "sid") != serverState.sid)) {
+				response.setStatusAndReason(Poco::Net::HTTPResponse::HTTP_FORBIDDEN);
+				body = "Forbidden";
+			} else {
+				response.setContentType("text/plain");
+				std::string command = queryParameter(uri, "switchcmd");
+				if (command == "getdevicelistinfos") {
+					serverState.deviceListRequests++;
+					response.setContentType("text/xml");
+					body = DEVICE_LIST;
+				} else
+				if ((command == "setswitchon") || (command == "setswitchoff")) {
+					serverState.switchRequests++;
+					serverState.lastSwitchCommand = queryParameter(uri, "ain") + " " + command;
+					body = (command == "setswitchon" ? "1\n" : "0\n");
+				} else {
+					response.setStatusAndReason(Poco::Net::HTTPResponse::HTTP_BAD_REQUEST);
+					body = "Bad request";
+				}
+			}
+		} else {
+			response.setStatusAndReason(Poco::Net::HTTPResponse::HTTP_NOT_FOUND);
+			body = "Not found";
+		}
+		response.sendBuffer(body.data(), body.size());
+	}
+};
+
+class StandInHandlerFactory : public Poco::Net::HTTPRequestHandlerFactory {
+public:
+	virtual Poco::Net::HTTPRequestHandler* createRequestHandler(const Poco::Net::HTTPServerRequest& /*request*/) override {
+		return new StandInHandler();
+	}
+};
+
+/** Runs the main loop of the HTTP client until the condition is met or the time is up. */
+bool waitFor(opdid::AbstractOPDID& daemon, std::function<bool(void)> condition, int timeoutMs) {
+	uint64_t start = opdi_get_time_ms();
+	while (!condition()) {
+		if (opdi_get_time_ms() - start > (uint64_t)timeoutMs)
+			return false;
+		daemon.httpClient->doWork();
+		Poco::Thread::sleep(1);
+	}
+	return true;
+}
+
+int serverCount(int ServerState::*counter) {
+	Poco::Mutex::ScopedLock lock(serverState.mutex);
+	return serverState.*counter;
+}
+
+std::string lastSwitchCommand(void) {
+	Poco::Mutex::ScopedLock lock(serverState.mutex);
+	return serverState.lastSwitchCommand;
+}
+
+int64_t dialPosition(opdi::Port* port) {
+	int64_t position = -1;
+	((opdi::DialPort*)port)->getState(&position);
+	return position;
+}
+
+uint8_t switchLine(opdi::Port* port) {
+	uint8_t mode;
+	uint8_t line;
+	((opdi::DigitalPort*)port)->getState(&mode, &line);
+	return line;
+}
+
+}	// end anonymous namespace
+
+int main(int, char**) {
+	opdid::LinuxOPDID daemon;
+	Opdi = &daemon;
+
+	Poco::Net::ServerSocket serverSocket(Poco::Net::SocketAddress("127.0.0.1", 0));
+	Poco::Net::HTTPServer server(new StandInHandlerFactory(), serverSocket, new Poco::Net::HTTPServerParams());
+	server.start();
+
+	try {
+		daemon.httpClient = new opdid::HttpClient(&daemon);
+
+		Poco::AutoPtr<Poco::Util::MapConfiguration> config = new Poco::Util::MapConfiguration();
+		config->setString("FritzBox.Host", "127.0.0.1");
+		config->setInt("FritzBox.Port", serverSocket.address().port());
+		config->setString("FritzBox.User", "admin");
+		config->setString("FritzBox.Password", PASSWORD);
+		// each query requests a new device list unless one is already pending
+		config->setInt("FritzBox.DeviceListMaxAge", 0);
+		const char* plugs[] = { "Plug1", "Plug2", "Plug3" };
+		const char* ains[] = { "087610000434", "08761 0000435", "08761 0000999" };
+		for (int i = 0; i < 3; i++) {
+			config->setInt(std::string("FritzBox.Devices.") + plugs[i], i + 1);
+			config->setString(std::string(plugs[i]) + ".Type", "FritzDECT200");
+			config->setString(std::string(plugs[i]) + ".AIN", ains[i]);
+			config->setInt(std::string(plugs[i]) + ".RefreshTime", 30000);
+		}
+
+		FritzBoxPlugin plugin;
+		plugin.setupPlugin(&daemon, "FritzBox", config);
+
+		check(daemon.getPorts().size() == 9, "three ports per device are created (created: " + std::to_string(daemon.getPorts().size()) + ")");
+		opdi::Port* plug1 = daemon.findPortByID("Plug1");
+		opdi::Port* plug1Power = daemon.findPortByID("Plug1Power");
+		opdi::Port* plug1Energy = daemon.findPortByID("Plug1Energy");
+		opdi::Port* plug2 = daemon.findPortByID("Plug2");
+		opdi::Port* plug2Energy = daemon.findPortByID("Plug2Energy");
+		opdi::Port* plug3 = daemon.findPortByID("Plug3");
+		opdi::Port* plug3Power = daemon.findPortByID("Plug3Power");
+		if ((plug1 == nullptr) || (plug1Power == nullptr) || (plug1Energy == nullptr) || (plug2 == nullptr)
+			|| (plug2Energy == nullptr) || (plug3 == nullptr) || (plug3Power == nullptr))
+			throw Poco::NotFoundException("FritzBox port not found");
+
+		// all ports query at the same time as on a periodic refresh
+		auto ports = daemon.getPorts();
+		for (auto it = ports.begin(), ite = ports.end(); it != ite; ++it)
+			dynamic_cast<FritzPort*>(*it)->query();
+		check(waitFor(daemon, [&]() { return !plug1Power->hasError() && (plug3->getError() == opdi::Port::Error::VALUE_NOT_AVAILABLE); }, 5000),
+			"device list is received after the login");
+		check(serverCount(&ServerState::sessionCount) == 1, "one login is performed (performed: " + std::to_string(serverCount(&ServerState::sessionCount)) + ")");
+		check(serverCount(&ServerState::deviceListRequests) == 1, "one device list is requested for the queries of all ports (requested: "
+			+ std::to_string(serverCount(&ServerState::deviceListRequests)) + ")");
+
+		// the values of the device list
+		check(!plug1->hasError() && (switchLine(plug1) == 1), "Plug1 is switched on");
+		check(!plug1Power->hasError() && (dialPosition(plug1Power) == 12340), "Plug1Power is 12340 mW");
+		check(!plug1Energy->hasError() && (dialPosition(plug1Energy) == 707), "Plug1Energy is 707 Wh");
+		check(!plug2->hasError() && (switchLine(plug2) == 0), "Plug2 (AIN with blank) is switched off");
+		check(!plug2Energy->hasError() && (dialPosition(plug2Energy) == 12), "Plug2Energy is 12 Wh");
+		check(plug3Power->getError() == opdi::Port::Error::VALUE_NOT_AVAILABLE, "Plug3Power is unavailable because the actor is missing from the device list");
+
+		// switching uses the existing session
+		((opdi::DigitalPort*)plug2)->setLine(1);
+		check(waitFor(daemon, [&]() { return !plug2->hasError() && (switchLine(plug2) == 1); }, 5000), "Plug2 is switched on");
+		check(lastSwitchCommand() == "087610000435 setswitchon", "setswitchon is sent for the AIN of Plug2 without blank (sent: " + lastSwitchCommand() + ")");
+		check(serverCount(&ServerState::sessionCount) == 1, "the session is reused");
+
+		// the FritzBox forgets the session; the plugin logs in again, repeats the action
+		// and queries the devices after the login
+		{
+			Poco::Mutex::ScopedLock lock(serverState.mutex);
+			serverState.sid.clear();
+		}
+		((opdi::DigitalPort*)plug2)->setLine(0);
+		check(waitFor(daemon, [&]() { return !plug2->hasError() && (switchLine(plug2) == 0); }, 5000), "Plug2 is switched off after the session has expired");
+		check(serverCount(&ServerState::sessionCount) == 2, "a new login is performed (performed: " + std::to_string(serverCount(&ServerState::sessionCount)) + ")");
+		check(serverCount(&ServerState::switchRequests) == 2, "each switch command is performed once (performed: " + std::to_string(serverCount(&ServerState::switchRequests)) + ")");
+		check(waitFor(daemon, [&]() { return serverCount(&ServerState::deviceListRequests) == 2; }, 5000), "the device list is requested after the new login");
+
+		// the next refresh requests one new device list
+		for (auto it = ports.begin(), ite = ports.end(); it != ite; ++it)
+			dynamic_cast<FritzPort*>(*it)->query();
+		check(waitFor(daemon, [&]() { return serverCount(&ServerState::deviceListRequests) == 3; }, 5000), "a refresh requests the device list again");
+		Poco::Thread::sleep(100);
+		daemon.httpClient->doWork();
+		check(serverCount(&ServerState::deviceListRequests) == 3, "no further device list is requested (requested: " + std::to_string(serverCount(&ServerState::deviceListRequests)) + ")");
+	} catch (Poco::Exception& e) {
+		check(false, "unexpected exception: " + e.displayText());
+	}
+
+	server.stop();
+	return checkResult();
+}
@@ -1,10 +1,14 @@
 #include <sstream>
 #include <exception>
 #include <memory>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "Poco/Tuple.h"
 #include "Poco/Runnable.h"
 #include "Poco/Mutex.h"
+#include "Poco/Event.h"
 #include "Poco/ScopedLock.h"
 #include "Poco/FileStreamFactory.h"
 #include <Poco/Net/HTTPStreamFactory.h>
@@ -26,15 +30,19 @@
 #include "Poco/DateTimeParser.h"
 #include "Poco/Timezone.h"
 #include "Poco/RegularExpression.h"
-#include "Poco/JSON/Parser.h"
 
 #include "opdi_constants.h"
 #include "opdi_platformfuncs.h"
 
 #include "AbstractOPDID.h"
 
+// path of the element that contains the current values in Weewx JSON documents
+#define WEEWX_JSON_CURRENT	"stats/current/"
+
 namespace {
 
+class WeatherPlugin;
+
 /** Interface for weather ports */
 class WeatherPort {
 	std::string id;
@@ -60,23 +68,25 @@ class WeatherGaugePort : public opdi::DialPort, public WeatherPort {
 
 protected:
 	opdid::AbstractOPDID* opdid;
+	WeatherPlugin* plugin;
 		
 	bool isValid;
 	mutable bool lastRequestedValidState;
 	std::string dataElement;
 	std::string regexMatch;
 	std::string regexReplace;
+	// compiled once when the port is configured
+	std::unique_ptr<Poco::RegularExpression> matchRegex;
+	std::unique_ptr<Poco::RegularExpression> replaceRegex;
 	std::string replaceBy;
 	int numerator;
 	int denominator;
 
-	std::string rawValue;	// stores the value for in-thread processing
-
 	mutable Poco::Mutex mutex;	// mutex for thread-safe accessing
 
 public:
 
-	WeatherGaugePort(opdid::AbstractOPDID* opdid, const char* id);
+	WeatherGaugePort(opdid::AbstractOPDID* opdid, WeatherPlugin* plugin, const char* id);
 
 	virtual std::string getDataElement(void);
 
@@ -86,8 +96,6 @@ public:
 
 	virtual void extract(const std::string& rawValue);
 
-	virtual uint8_t doWork(uint8_t canSend) override;
-
 	virtual void prepare(void) override;
 
 	virtual void getState(int64_t* position) const override;
@@ -98,10 +106,136 @@ public:
 	virtual bool hasError(void) const override;
 };
 
+/** Extracts values from a JSON document without building a tree.
+* The document is scanned once. The values of the requested paths (member names joined
+* by '/', e. g. "stats/current/outTemp") are stored as strings; the objects along these
+* paths are stored with an empty value. Strings are unescaped, other values are stored
+* as they appear in the document; null is stored as an empty string.
+* Members of other objects and array elements are only checked for syntax.
+*/
+class FlatJSONScanner {
+public:
+	typedef std::unordered_map<std::string, std::string> Values;
+
+protected:
+	std::unordered_set<std::string> paths;
+	// paths of the objects that contain requested paths
+	std::unordered_set<std::string> prefixes;
+
+	// the path of the document root; its members have no leading '/'
+	const std::string rootPath;
+
+	const char* current;
+	const char* end;
+
+	void skipWhitespace(void);
+
+	void expect(char c);
+
+	/** Parses the four hex digits of a \u escape sequence. */
+	uint32_t parseHex4(void);
+
+	/** Parses a string; the unescaped value is stored in result unless it is nullptr. */
+	void parseString(std::string* result);
+
+	/** Parses a number, true, false or null. */
+	void parseLiteral(std::string* result);
+
+	/** Parses any value. path is nullptr if the value and its members are not requested. */
+	void parseValue(const std::string* path, Values& values);
+
+public:
+	void addPath(const std::string& path);
+
+	/** Throws a Poco::SyntaxException if the document is not valid JSON. */
+	void scan(const std::string& json, Values& values);
+};
+
+////////////////////////////////////////////////////////////////////////
+// Plugin main class
+////////////////////////////////////////////////////////////////////////
+
+/** The plugin downloads the weather data periodically. http URLs are fetched by the daemon's
+* shared HTTP client, triggered by a periodic timer of the event loop; other URLs (file, ftp)
+* are fetched by a work thread of the plugin that runs while the plugin is started.
+* The data is always processed on the main thread.
+*/
+class WeatherPlugin : public IOPDIDPlugin, public opdid::IOPDIDConnectionListener, public Poco::Runnable, protected opdid::HttpClient::Listener, protected opdid::EventLoop::Listener {
+
+protected:
+	std::string nodeID;
+
+	opdi::LogVerbosity logVerbosity;
+
+	std::string url;
+	int timeoutSeconds;
+
+	// weather data provider identification
+	std::string provider;
+
+	std::string xpath;
+	int64_t dataValiditySeconds;
+
+	int refreshTime;
+
+	std::string sid;
+
+	bool useHttpClient;
+	bool requestPending;
+	opdid::EventLoop::TimerID refreshTimer;
+
+	Poco::Thread workThread;
+	std::atomic<bool> stopping;
+	Poco::Event stopEvent;		// interrupts the refresh wait of the work thread
+
+	// content fetched by the work thread
+	Poco::Mutex contentMutex;
+	std::string fetchedContent;
+	bool contentAvailable;
+
+	typedef std::vector<WeatherPort*> WeatherPortList;
+	WeatherPortList weatherPorts;
+
+	// ports by data element; built once during setup
+	typedef std::unordered_map<std::string, WeatherPortList> WeatherPortIndex;
+	WeatherPortIndex portIndex;
+
+	// extracts the time and the referenced elements of Weewx JSON documents
+	FlatJSONScanner jsonScanner;
+
+	/** Passes the data of the element to the ports that use it. */
+	void extract(const std::string& dataElement, const std::string& data);
+
+	virtual void httpCompleted(opdid::HttpClient::RequestID id, const opdid::HttpClient::Response& response) override;
+
+	/** The refresh timer starts an HTTP request; other timers deliver the content of the work thread. */
+	virtual void timerExpired(opdid::EventLoop::TimerID id) override;
+
+public:
+	opdid::AbstractOPDID* opdid;
+
+	virtual void masterConnected(void) override;
+	virtual void masterDisconnected(void) override;
+
+	virtual void invalidatePorts(void);
+
+	virtual void processContent(std::string& content);
+
+	// weather data download thread method (for URLs that are not fetched by the HTTP client)
+	virtual void run(void);
+
+	virtual void setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std::string& node, Poco::Util::AbstractConfiguration* config) override;
+
+	virtual void startPlugin(void) override;
+
+	virtual void stopPlugin(void) override;
+};
+
 }	// end anonymous namespace
 
-WeatherGaugePort::WeatherGaugePort(opdid::AbstractOPDID* opdid, const char* id) : opdi::DialPort(id), WeatherPort(id) {
+WeatherGaugePort::WeatherGaugePort(opdid::AbstractOPDID* opdid, WeatherPlugin* plugin, const char* id) : opdi::DialPort(id), WeatherPort(id) {
 	this->opdid = opdid;
+	this->plugin = plugin;
 	this->numerator = 1;
 	this->denominator = 1;
 	this->isValid = false;
@@ -119,6 +253,10 @@ void WeatherGaugePort::configure(Poco::Util::AbstractConfiguration* nodeConfig,
 	this->dataElement = opdid->getConfigString(nodeConfig, this->ID(), "DataElement", "", true);
 	this->regexMatch = opdid->getConfigString(nodeConfig, this->ID(), "RegexMatch", "", false);
 	this->regexReplace = opdid->getConfigString(nodeConfig, this->ID(), "RegexReplace", "", false);
+	if (this->regexMatch != "")
+		this->matchRegex.reset(new Poco::RegularExpression(this->regexMatch, 0, true));
+	if (this->regexReplace != "")
+		this->replaceRegex.reset(new Poco::RegularExpression(this->regexReplace, 0, true));
 	this->replaceBy = opdid->getConfigString(nodeConfig, this->ID(), "ReplaceBy", "", false);
 	this->numerator = nodeConfig->getInt("Numerator", this->numerator);
 	this->denominator = nodeConfig->getInt("Denominator", this->denominator);
@@ -146,59 +284,43 @@ bool WeatherGaugePort::hasError(void) const {
 }
 
 void WeatherGaugePort::extract(const std::string& rawValue) {
-	// important! Do not process on the weather plugin's thread;
-	// instead, store the value for processing on the OPDID thread
-	Poco::Mutex::ScopedLock lock(this->mutex);
-	this->rawValue = rawValue;
-}
-
-uint8_t WeatherGaugePort::doWork(uint8_t canSend) {
-	opdi::DialPort::doWork(canSend);
-
+	// the plugin passes the data on the main thread, so the value can be processed immediately
 	Poco::Mutex::ScopedLock lock(this->mutex);
 
-	std::string rawValue = this->rawValue;
-
 	// no value to process?
 	if (rawValue == "")
-		return OPDI_STATUS_OK;
+		return;
 
 	// mark as invalid
 	this->isValid = false;
 
 	std::string value = rawValue;
-	if (this->regexMatch != "") {
-		Poco::RegularExpression regex(this->regexMatch, 0, true);
+	if (this->matchRegex) {
 		this->logDebug("WeatherGaugePort for element " + this->dataElement + ": Matching regex against weather data: " + rawValue);
-		if (regex.extract(rawValue, value, 0) == 0) {
+		if (this->matchRegex->extract(rawValue, value, 0) == 0) {
 		this->logDebug("WeatherGaugePort for element " + this->dataElement + ": Warning: Matching regex returned no result; weather data: " + rawValue);
 		}
 	}
-	if (this->regexReplace != "") {
-		Poco::RegularExpression regex(this->regexReplace, 0, true);
-		if (regex.subst(value, this->replaceBy, Poco::RegularExpression::RE_GLOBAL) == 0) {
+	if (this->replaceRegex) {
+		if (this->replaceRegex->subst(value, this->replaceBy, Poco::RegularExpression::RE_GLOBAL) == 0) {
 			this->logDebug("WeatherGaugePort for element " + this->dataElement + ": Warning: Replacement regex did not match in value: " + value);
 		}
 	}
 
-	// clear the raw value
-	this->rawValue = "";
-
 	// try to parse the value as double
 	double result = 0;
 	try {
 		result = Poco::NumberParser::parseFloat(value);
 	} catch (Poco::Exception e) {
 		this->logDebug("WeatherGaugePort for element " + this->dataElement + ": Warning: Unable to parse weather data: " + value);
-		return OPDI_STATUS_OK;
+		return;
 	}
 
 	// scale the result
 	int64_t newPos = (int64_t)(result * this->numerator / this->denominator * 1.0);
 	this->logDebug("WeatherGaugePort for element " + this->dataElement + ": Extracted value is: " + to_string(newPos));
 
-	// correct value; a standard dial port will throw exceptions
-	// but exceptions must be avoided in this threaded code because they will cause strange messages on Linux
+	// correct value; a standard dial port would throw an exception which would invalidate all other ports
 	if (newPos < this->minValue) {
 		this->logDebug("Warning: Value too low (" + to_string(newPos) + " < " + to_string(this->minValue) + "), correcting");
 		newPos = this->minValue;
@@ -216,8 +338,6 @@ uint8_t WeatherGaugePort::doWork(uint8_t canSend) {
 	// to update the master (except it's disabled)
 	if (!this->lastRequestedValidState && (this->refreshMode != RefreshMode::REFRESH_OFF))
 		this->refreshRequired = true;
-
-	return OPDI_STATUS_OK;
 }
 
 // function that fills in the current port state
@@ -237,48 +357,247 @@ void WeatherGaugePort::getState(int64_t* position) const {
 	opdi::DialPort::getState(position);
 }
 
-////////////////////////////////////////////////////////////////////////
-// Plugin main class
-////////////////////////////////////////////////////////////////////////
-
-class WeatherPlugin : public IOPDIDPlugin, public opdid::IOPDIDConnectionListener, public Poco::Runnable {
-
-protected:
-	std::string nodeID;
-
-	opdi::LogVerbosity logVerbosity;
-
-	std::string url;
-	int timeoutSeconds;
+void FlatJSONScanner::addPath(const std::string& path) {
+	this->paths.insert(path);
+	// the document root and all objects along the path must be descended into
+	this->prefixes.insert("");
+	size_t pos = path.find('/');
+	while (pos != std::string::npos) {
+		this->prefixes.insert(path.substr(0, pos));
+		pos = path.find('/', pos + 1);
+	}
+}
 
-	// weather data provider identification
-	std::string provider;
+void FlatJSONScanner::scan(const std::string& json, Values& values) {
+	this->current = json.data();
+	this->end = json.data() + json.size();
 
-	std::string xpath;
-	int64_t dataValiditySeconds;
+	this->parseValue(&this->rootPath, values);
+	this->skipWhitespace();
+	if (this->current != this->end)
+		throw Poco::SyntaxException("Unexpected data after the JSON value at position " + std::to_string(this->current - json.data()));
+}
 
-	int refreshTime;
+void FlatJSONScanner::skipWhitespace(void) {
+	while ((this->current != this->end) && ((*this->current == ' ') || (*this->current == '\t') || (*this->current == '\n') || (*this->current == '\r')))
+		this->current++;
+}
 
-	std::string sid;
+void FlatJSONScanner::expect(char c) {
+	this->skipWhitespace();
+	if (this->current == this->end)
+		throw Poco::SyntaxException(std::string("Unexpected end of JSON data; expected: ") + c);
+	if (*this->current != c)
+		throw Poco::SyntaxException(std::string("Unexpected character in JSON data: ") + *this->current + "; expected: " + c);
+	this->current++;
+}
 
-	Poco::Thread workThread;
+static void appendUTF8(std::string& str, uint32_t codePoint) {
+	if (codePoint < 0x80)
+		str += (char)codePoint;
+	else
+	if (codePoint < 0x800) {
+		str += (char)(0xC0 | (codePoint >> 6));
+		str += (char)(0x80 | (codePoint & 0x3F));
+	} else
+	if (codePoint < 0x10000) {
+		str += (char)(0xE0 | (codePoint >> 12));
+		str += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+		str += (char)(0x80 | (codePoint & 0x3F));
+	} else {
+		str += (char)(0xF0 | (codePoint >> 18));
+		str += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+		str += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+		str += (char)(0x80 | (codePoint & 0x3F));
+	}
+}
 
-	typedef std::vector<WeatherPort*> WeatherPortList;
-	WeatherPortList weatherPorts;
+uint32_t FlatJSONScanner::parseHex4(void) {
+	uint32_t result = 0;
+	for (int i = 0; i < 4; i++) {
+		if (this->current == this->end)
+			throw Poco::SyntaxException("Unterminated JSON string");
+		char h = *this->current++;
+		result <<= 4;
+		if ((h >= '0') && (h <= '9'))
+			result |= h - '0';
+		else
+		if ((h >= 'a') && (h <= 'f'))
+			result |= h - 'a' + 10;
+		else
+		if ((h >= 'A') && (h <= 'F'))
+			result |= h - 'A' + 10;
+		else
+			throw Poco::SyntaxException("Invalid unicode escape sequence in JSON string");
+	}
+	return result;
+}
 
-public:
-	opdid::AbstractOPDID* opdid;
+void FlatJSONScanner::parseString(std::string* result) {
+	this->expect('"');
+	if (result != nullptr)
+		result->clear();
+	while (true) {
+		// copy the characters up to the next quote or escape sequence at once
+		const char* start = this->current;
+		while ((this->current != this->end) && (*this->current != '"') && (*this->current != '\\')) {
+			if ((unsigned char)*this->current < 0x20)
+				throw Poco::SyntaxException("Control character in JSON string");
+			this->current++;
+		}
+		if (result != nullptr)
+			result->append(start, this->current - start);
+		if (this->current == this->end)
+			throw Poco::SyntaxException("Unterminated JSON string");
+		if (*this->current == '"') {
+			this->current++;
+			return;
+		}
 
-	virtual void masterConnected(void) override;
-	virtual void masterDisconnected(void) override;
+		// escape sequence
+		this->current++;
+		if (this->current == this->end)
+			throw Poco::SyntaxException("Unterminated JSON string");
+		char c = *this->current++;
+		switch (c) {
+		case '"':
+		case '\\':
+		case '/': break;
+		case 'b': c = '\b'; break;
+		case 'f': c = '\f'; break;
+		case 'n': c = '\n'; break;
+		case 'r': c = '\r'; break;
+		case 't': c = '\t'; break;
+		case 'u': {
+			uint32_t codePoint = this->parseHex4();
+			// a surrogate pair encodes a character outside of the basic multilingual plane
+			if ((codePoint >= 0xD800) && (codePoint <= 0xDBFF) && (this->end - this->current >= 2)
+				&& (this->current[0] == '\\') && (this->current[1] == 'u')) {
+				this->current += 2;
+				uint32_t low = this->parseHex4();
+				if ((low < 0xDC00) || (low > 0xDFFF))
+					throw Poco::SyntaxException("Invalid surrogate pair in JSON string");
+				codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+			}
+			if (result != nullptr)
+				appendUTF8(*result, codePoint);
+			continue;
+		}
+		default:
+			throw Poco::SyntaxException(std::string("Invalid escape sequence in JSON string: \\") + c);
+		}
+		if (result != nullptr)
+			*result += c;
+	}
+}
 
-	virtual void refreshData(void);
+static bool isJSONNumber(const char* p, const char* end) {
+	if ((p != end) && (*p == '-'))
+		p++;
+	if ((p == end) || !isdigit((unsigned char)*p))
+		return false;
+	if (*p == '0')
+		p++;
+	else
+		while ((p != end) && isdigit((unsigned char)*p))
+			p++;
+	if ((p != end) && (*p == '.')) {
+		p++;
+		if ((p == end) || !isdigit((unsigned char)*p))
+			return false;
+		while ((p != end) && isdigit((unsigned char)*p))
+			p++;
+	}
+	if ((p != end) && ((*p == 'e') || (*p == 'E'))) {
+		p++;
+		if ((p != end) && ((*p == '+') || (*p == '-')))
+			p++;
+		if ((p == end) || !isdigit((unsigned char)*p))
+			return false;
+		while ((p != end) && isdigit((unsigned char)*p))
+			p++;
+	}
+	return (p == end);
+}
 
-	// weather data collection thread method
-	virtual void run(void);
+void FlatJSONScanner::parseLiteral(std::string* result) {
+	const char* start = this->current;
+	while ((this->current != this->end) && (isalnum((unsigned char)*this->current) || (*this->current == '-') || (*this->current == '+') || (*this->current == '.')))
+		this->current++;
+	size_t length = this->current - start;
+	bool isNull = (length == 4) && (strncmp(start, "null", 4) == 0);
+	if (!isNull && !((length == 4) && (strncmp(start, "true", 4) == 0)) && !((length == 5) && (strncmp(start, "false", 5) == 0)) && !isJSONNumber(start, this->current))
+		throw Poco::SyntaxException("Invalid value in JSON data: " + (length == 0 ? std::string(1, *start) : std::string(start, length)));
+	if (result != nullptr) {
+		if (isNull)
+			result->clear();
+		else
+			result->assign(start, length);
+	}
+}
 
-	virtual void setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std::string& node, Poco::Util::AbstractConfiguration* config) override;
-};
+void FlatJSONScanner::parseValue(const std::string* path, Values& values) {
+	this->skipWhitespace();
+	if (this->current == this->end)
+		throw Poco::SyntaxException("Unexpected end of JSON data");
+
+	bool requested = (path != nullptr) && (this->paths.find(*path) != this->paths.end());
+	switch (*this->current) {
+	case '{': {
+		this->current++;
+		if (requested)
+			values[*path] = "";
+		// the member names are only needed if the object contains requested paths
+		bool descend = (path != nullptr) && (this->prefixes.find(*path) != this->prefixes.end());
+		std::string key;
+		std::string memberPath;
+		this->skipWhitespace();
+		if ((this->current != this->end) && (*this->current == '}')) {
+			this->current++;
+			return;
+		}
+		while (true) {
+			if (descend) {
+				this->parseString(&key);
+				memberPath = (path == &this->rootPath ? key : *path + "/" + key);
+			} else
+				this->parseString(nullptr);
+			this->expect(':');
+			this->parseValue(descend ? &memberPath : nullptr, values);
+			this->skipWhitespace();
+			if ((this->current != this->end) && (*this->current == ',')) {
+				this->current++;
+				continue;
+			}
+			this->expect('}');
+			return;
+		}
+	}
+	case '[': {
+		this->current++;
+		this->skipWhitespace();
+		if ((this->current != this->end) && (*this->current == ']')) {
+			this->current++;
+			return;
+		}
+		while (true) {
+			this->parseValue(nullptr, values);
+			this->skipWhitespace();
+			if ((this->current != this->end) && (*this->current == ',')) {
+				this->current++;
+				continue;
+			}
+			this->expect(']');
+			return;
+		}
+	}
+	case '"':
+		this->parseString(requested ? &values[*path] : nullptr);
+		return;
+	default:
+		this->parseLiteral(requested ? &values[*path] : nullptr);
+	}
+}
 
 void WeatherPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std::string& node, Poco::Util::AbstractConfiguration* config) {
 	this->opdid = abstractOPDID;
@@ -371,27 +690,63 @@ void WeatherPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std::
 
 		if (portType == "WeatherGaugePort") {
 
-			WeatherGaugePort* port = new WeatherGaugePort(this->opdid, nodeName.c_str());
+			WeatherGaugePort* port = new WeatherGaugePort(this->opdid, this, nodeName.c_str());
 			port->setGroup(group);
 			port->configure(portConfig, this->logVerbosity);
 			opdid->addPort(port);
 			// add port to internal list
 			this->weatherPorts.push_back(port);
+			this->portIndex[port->getDataElement()].push_back(port);
 		} else
 			throw Poco::DataException("This plugin does not support the port type", portType);
 
 		++nli;
 	}
 
+	if (this->provider == "Weewx-JSON") {
+		// only the time and the referenced elements are extracted from the documents
+		this->jsonScanner.addPath("time");
+		this->jsonScanner.addPath("stats");
+		this->jsonScanner.addPath("stats/current");
+		for (auto it = this->portIndex.begin(), ite = this->portIndex.end(); it != ite; ++it)
+			this->jsonScanner.addPath(WEEWX_JSON_CURRENT + it->first);
+	}
+
 	this->opdid->addConnectionListener(this);
 
-	// initialize and start thread
-	this->workThread.setName(node + " work thread");
-	this->workThread.start(*this);
+	// http URLs are fetched by the shared HTTP client
+	this->useHttpClient = (Poco::URI(this->url).getScheme() == "http");
+	this->requestPending = false;
+	this->refreshTimer = 0;
+	this->contentAvailable = false;
+	this->stopping = false;
 
 	this->opdid->logVerbose(this->nodeID + ": WeatherPlugin setup completed successfully", this->logVerbosity);
 }
 
+void WeatherPlugin::startPlugin(void) {
+	if (this->useHttpClient) {
+		// fetch the data now and then every refresh period
+		this->refreshTimer = this->opdid->eventLoop->addTimer(this, 0, this->refreshTime * 1000);
+	} else {
+		this->stopping = false;
+		this->workThread.setName(this->nodeID + " work thread");
+		this->workThread.start(*this);
+	}
+}
+
+void WeatherPlugin::stopPlugin(void) {
+	if (this->workThread.isRunning()) {
+		this->stopping = true;
+		this->stopEvent.set();
+		this->workThread.join();
+	}
+	// cancels the refresh timer and undelivered content of the work thread
+	this->opdid->eventLoop->removeListener(this);
+	this->opdid->httpClient->removeListener(this);
+	this->requestPending = false;
+}
+
 void WeatherPlugin::masterConnected() {
 }
 
@@ -408,45 +763,71 @@ void replaceAll(std::string& str, const std::string& from, const std::string& to
     }
 }
 
-static std::string GetJSONStringValue(Poco::JSON::Object::Ptr aoJsonObject, std::string aszKey) {
-    Poco::Dynamic::Var loVariable;
-    std::string lsReturn;
+void WeatherPlugin::timerExpired(opdid::EventLoop::TimerID id) {
+	if (id == this->refreshTimer) {
+		// the previous request has not yet completed
+		if (this->requestPending)
+			return;
+
+		this->opdid->logDebug(this->nodeID + ": Fetching content of URL: " + this->url, this->logVerbosity);
 
-    loVariable = aoJsonObject->get(aszKey);
-    lsReturn = loVariable.convert<std::string>();
+		this->opdid->httpClient->get(this->url, this, this->timeoutSeconds);
+		this->requestPending = true;
+		return;
+	}
 
-    return lsReturn;
+	// content fetched by the work thread
+	std::string content;
+	{
+		Poco::Mutex::ScopedLock lock(this->contentMutex);
+		if (!this->contentAvailable)
+			return;
+		content.swap(this->fetchedContent);
+		this->contentAvailable = false;
+	}
+	this->invalidatePorts();
+	if (!content.empty())
+		this->processContent(content);
 }
 
-static Poco::JSON::Object::Ptr GetJSONObject(Poco::JSON::Object::Ptr aoJsonObject, std::string aszKey) {
-    Poco::Dynamic::Var loVariable;
-    Poco::JSON::Object::Ptr lsReturn;
+void WeatherPlugin::httpCompleted(opdid::HttpClient::RequestID /*id*/, const opdid::HttpClient::Response& response) {
+	this->requestPending = false;
 
-    loVariable = aoJsonObject->get(aszKey);
-    lsReturn = loVariable.extract<Poco::JSON::Object::Ptr>();
+	this->invalidatePorts();
 
-    return lsReturn;
-}
-
-void WeatherPlugin::refreshData(void) {
-	try {
-		// invalidate all ports
-		auto it = this->weatherPorts.begin();
-		auto ite = this->weatherPorts.end();
-		while (it != ite) {
-			(*it)->invalidate();
-			++it;
-		}
+	if (response.status == 0) {
+		this->opdid->logVerbose(this->nodeID + ": Network problem: " + response.reason, this->logVerbosity);
+		return;
+	}
+	if (!response.ok()) {
+		this->opdid->logVerbose(this->nodeID + ": The server returned an error: " + this->opdid->to_string(response.status) + " " + response.reason, this->logVerbosity);
+		return;
+	}
 
-		this->opdid->logDebug(this->nodeID + ": Fetching content of URL: " + this->url, this->logVerbosity);
+	std::string content = response.body;
+	this->processContent(content);
+}
 
-		Poco::URI uri(this->url);
-		std::unique_ptr<std::istream> pStr(Poco::URIStreamOpener::defaultOpener().open(uri));
+void WeatherPlugin::invalidatePorts(void) {
+	auto it = this->weatherPorts.begin();
+	auto ite = this->weatherPorts.end();
+	while (it != ite) {
+		(*it)->invalidate();
+		++it;
+	}
+}
 
-		// save stream content
-		std::string content;
-		Poco::StreamCopier::copyToString(*pStr.get(), content);
+void WeatherPlugin::extract(const std::string& dataElement, const std::string& data) {
+	auto it = this->portIndex.find(dataElement);
+	if (it == this->portIndex.end())
+		return;
+	this->opdid->logDebug(this->nodeID + ": Evaluating weather data element: " + dataElement + " with data: " + data, this->logVerbosity);
+	for (auto pit = it->second.begin(), pite = it->second.end(); pit != pite; ++pit)
+		(*pit)->extract(data);
+}
 
+void WeatherPlugin::processContent(std::string& content) {
+	try {
 		if (this->provider == "Weewx") {
 			// this code is not reliable (experimental only)
 			// likely to break with minor changes to the HTML; does not support complete data set
@@ -483,37 +864,29 @@ void WeatherPlugin::refreshData(void) {
 				if ((labelNode == nullptr) || (dataNode == nullptr) || (labelNode == dataNode))
 					continue;
 
+				// only the text of referenced elements is needed
 				std::string dataElement = labelNode->innerText();
-
-				// find weather port for the data element
-				auto it = this->weatherPorts.begin();
-				auto ite = this->weatherPorts.end();
-				while (it != ite) {
-					if ((*it)->getDataElement() == dataElement) {
-						this->opdid->logDebug(this->nodeID + ": Evaluating XML weather data element: " + dataElement + " with data: " + dataNode->innerText(), this->logVerbosity);
-						(*it)->extract(dataNode->innerText());
-					}
-					++it;
-				}
+				if (this->portIndex.find(dataElement) != this->portIndex.end())
+					this->extract(dataElement, dataNode->innerText());
 			}
 			children->release();
 		} else
 		if (this->provider == "Weewx-JSON") {
 
-			// parse content as JSON
-			this->opdid->logDebug(this->nodeID + ": Parsing weather data content as JSON", this->logVerbosity);
+			// scan content as JSON; the HTML of the Weewx provider is still parsed into a DOM
+			// because the element is located using the configured XPath
+			this->opdid->logDebug(this->nodeID + ": Scanning weather data content as JSON", this->logVerbosity);
 
-			Poco::JSON::Parser jsonParser;
-			Poco::Dynamic::Var loParsedJson = jsonParser.parse(content);
-			Poco::Dynamic::Var loParsedJsonResult = jsonParser.result();
-			Poco::JSON::Object::Ptr loJsonObject = loParsedJsonResult.extract<Poco::JSON::Object::Ptr>();
+			FlatJSONScanner::Values values;
+			this->jsonScanner.scan(content, values);
 
 			// validate object
-			if (loJsonObject.isNull()) {
+			auto timeValue = values.find("time");
+			if (timeValue == values.end()) {
 				this->opdid->logVerbose(this->nodeID + ": Error: File format mismatch for weather data provider " + this->provider, this->logVerbosity);
 				return;
 			}
-			std::string time = GetJSONStringValue(loJsonObject, "time");
+			const std::string& time = timeValue->second;
 			this->opdid->logDebug(this->nodeID + ": Found weather data; time: " + time, this->logVerbosity);
 
 			// parse time
@@ -531,45 +904,24 @@ void WeatherPlugin::refreshData(void) {
 						+ Poco::DateTimeFormatter::format(jsonLocalTime, "%m/%d/%Y %h:%M:%S %A"), this->logVerbosity);
 				return;
 			}
-			// get stats/current object
-			Poco::JSON::Object::Ptr stats = GetJSONObject(loJsonObject, "stats");
-			if (stats.isNull()) {
+			// check for stats/current object
+			if (values.find("stats") == values.end()) {
 				this->opdid->logNormal(this->nodeID + ": Error: File format mismatch for weather data provider " + this->provider + "; expected element 'stats' not found", this->logVerbosity);
 				return;
 			}
-			Poco::JSON::Object::Ptr current = GetJSONObject(stats, "current");
-			if (current.isNull()) {
+			if (values.find("stats/current") == values.end()) {
 				this->opdid->logNormal(this->nodeID + ": Error: File format mismatch for weather data provider " + this->provider + "; expected element 'current' not found", this->logVerbosity);
 				return;
 			}
 
-			// get data keys
-			std::vector<std::string> keys;
-			current->getNames(keys);
-
-			for (size_t i = 0; i < keys.size(); i++) {
-				std::string dataElement = keys[i];
-				std::string data = GetJSONStringValue(current, dataElement);
-
-				// find weather port for the data element
-				auto it = this->weatherPorts.begin();
-				auto ite = this->weatherPorts.end();
-				while (it != ite) {
-					if ((*it)->getDataElement() == dataElement) {
-						this->opdid->logDebug(this->nodeID + ": Evaluating JSON weather data element: " + dataElement + " with data: " + data, this->logVerbosity);
-						(*it)->extract(data);
-					}
-					++it;
-				}
+			// the scanner has only extracted the referenced elements
+			for (auto it = this->portIndex.begin(), ite = this->portIndex.end(); it != ite; ++it) {
+				auto value = values.find(WEEWX_JSON_CURRENT + it->first);
+				if (value != values.end())
+					this->extract(it->first, value->second);
 			}
 		}
 
-	} catch (Poco::FileNotFoundException &fnfe) {
-		this->opdid->logVerbose(this->nodeID + ": The file was not found: " + fnfe.message(), this->logVerbosity);
-	} catch (Poco::Net::NetException &ne) {
-		this->opdid->logVerbose(this->nodeID + ": Network problem: " + ne.className() + ": " + ne.message(), this->logVerbosity);
-	} catch (Poco::UnknownURISchemeException &uuse) {
-		this->opdid->logVerbose(this->nodeID + ": Unknown URI scheme: " + uuse.message(), this->logVerbosity);
 	} catch (Poco::Exception &e) {
 		this->opdid->logVerbose(this->nodeID + ": " + e.className() + ": " + e.message(), this->logVerbosity);
 	}
@@ -582,16 +934,37 @@ void WeatherPlugin::run(void) {
 	// Poco::Net::HTTPSStreamFactory::registerFactory();
 	Poco::Net::FTPStreamFactory::registerFactory();
 
-	while (!this->opdid->shutdownRequested) {
+	while (!this->stopping) {
+		std::string content;
 		try {
-			this->refreshData();
-
+			this->opdid->logDebug(this->nodeID + ": Fetching content of URL: " + this->url, this->logVerbosity);
+
+			Poco::URI uri(this->url);
+			std::unique_ptr<std::istream> pStr(Poco::URIStreamOpener::defaultOpener().open(uri));
+
+			// save stream content
+			Poco::StreamCopier::copyToString(*pStr.get(), content);
+		} catch (Poco::FileNotFoundException &fnfe) {
+			this->opdid->logVerbose(this->nodeID + ": The file was not found: " + fnfe.message(), this->logVerbosity);
+		} catch (Poco::Net::NetException &ne) {
+			this->opdid->logVerbose(this->nodeID + ": Network problem: " + ne.className() + ": " + ne.message(), this->logVerbosity);
+		} catch (Poco::UnknownURISchemeException &uuse) {
+			this->opdid->logVerbose(this->nodeID + ": Unknown URI scheme: " + uuse.message(), this->logVerbosity);
 		} catch (Poco::Exception &e) {
 			this->opdid->logNormal(this->nodeID + ": Unhandled exception in worker thread: " + e.message(), this->logVerbosity);
 		}
 
-		// sleep for the specified refresh time (milliseconds)
-		Poco::Thread::sleep(this->refreshTime * 1000);
+		// the content is processed on the main thread
+		{
+			Poco::Mutex::ScopedLock lock(this->contentMutex);
+			this->fetchedContent = content;
+			this->contentAvailable = true;
+		}
+		this->opdid->eventLoop->addTimer(this, 0);
+
+		// wait for the specified refresh time (milliseconds) unless the plugin is stopped
+		if (this->stopEvent.tryWait(this->refreshTime * 1000))
+			break;
 	}
 
 	this->opdid->logDebug(this->nodeID + ": WeatherPlugin worker thread terminated", this->logVerbosity);
@@ -0,0 +1,208 @@
+// Compares the FlatJSONScanner used for the Weewx-JSON provider with the previous implementation,
+// which parsed each document into a tree of Poco::JSON objects and looked up the time and the
+// elements of stats/current in it. Both variants extract the elements referenced by the
+// WeatherGaugePorts of testconfigs/opdid_config.ini. The program reports the time and the number
+// of heap allocations per document, and checks that both variants extract the same values;
+// it exits with a non-zero code otherwise.
+// The built-in payloads are the example output of the JSON skin in weewx/readme.txt and the same
+// document with an additional array of 1000 archive records, as a larger skin might publish.
+// Recorded documents (e. g. copies of current.json from a running Weewx) can be specified
+// on the command line.
+//
+// Usage: weewx_json_bench [documents per payload [recorded JSON file...]]
+// The default is 10000 documents per payload.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <atomic>
+#include <map>
+#include <fstream>
+#include <iterator>
+
+// the plugin is compiled into this program to get access to its JSON scanner
+#include "../WeatherPlugin.cpp"
+
+#include "Poco/JSON/Parser.h"
+#include "Poco/Stopwatch.h"
+
+// the main OPDI instance is declared here
+opdid::AbstractOPDID* Opdi = nullptr;
+
+// counts the heap allocations of the whole program
+static std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size) {
+	allocations++;
+	void* p = malloc(size == 0 ? 1 : size);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+namespace {
+
+// the data elements of the WeatherGaugePorts in testconfigs/opdid_config.ini
+const char* dataElements[] = { "outTemp", "outHumidity", "inTemp", "inHumidity", "extraTemp1", "extraHumid1", "barometer", "windSpeed", "rainRate", nullptr };
+
+// example output of the JSON skin (weewx/readme.txt)
+const char* readmeSample =
+	"{\n"
+	"  \"title\":\"Current Values\",\n"
+	"  \"location\":\"rpi\",\n"
+	"  \"time\":\"02/05/15 15:55:00\",\n"
+	"  \"lat\":\"47&deg; 39.68' N\",\n"
+	"  \"lon\":\"008&deg; 53.32' E\",\n"
+	"  \"alt\":\"450\",\n"
+	"  \"hardware\":\"TE923\",\n"
+	"  \"uptime\":\"0, 0, 1\",\n"
+	"  \"serverUptime\":\"0, 1, 51\",\n"
+	"  \"weewxVersion\":\"3.1.0\",\n"
+	"  \"stats\": {\n"
+	"    \"current\": {\n"
+	"      \"inTemp\":\"18.2\",\n"
+	"      \"inHumidity\":\"58\",\n"
+	"      \"outTemp\":\"   N/A\",\n"
+	"      \"outHumidity\":\"   N/A\",\n"
+	"      \"dewpoint\":\"   N/A\",\n"
+	"      \"heatIndex\":\"   N/A\",\n"
+	"      \"barometer\":\"1015.2\",\n"
+	"      \"windSpeed\":\"1\",\n"
+	"      \"windchill\":\"18.5\",\n"
+	"      \"windDir\":\"234\",\n"
+	"      \"windDirText\":\"SW\",\n"
+	"      \"windGust\":\"3\",\n"
+	"      \"windGustDir\":\"225\",\n"
+	"      \"rainRate\":\"0.0\",\n"
+	"      \"extraTemp1\":\"18.3\",\n"
+	"      \"extraHumid1\":\"68\",\n"
+	"      \"extraTemp2\":\"   N/A\",\n"
+	"      \"extraHumid2\":\"   N/A\",\n"
+	"      \"extraTemp3\":\"   N/A\",\n"
+	"      \"extraHumid3\":\"?'extraHumid3'?\",\n"
+	"      \"extraTemp4\":\"?'extraTemp4'?\",\n"
+	"      \"extraHumid4\":\"?'extraHumid4'?\"\n"
+	"    }\n"
+	"  }\n"
+	"}\n";
+
+typedef std::map<std::string, std::string> Result;
+
+// the implementation before the scanner was introduced
+void treeExtract(const std::string& content, Result& result) {
+	Poco::JSON::Parser jsonParser;
+	Poco::JSON::Object::Ptr root = jsonParser.parse(content).extract<Poco::JSON::Object::Ptr>();
+	result["time"] = root->get("time").convert<std::string>();
+	Poco::JSON::Object::Ptr current = root->getObject("stats")->getObject("current");
+	for (const char** element = dataElements; *element != nullptr; element++)
+		if (current->has(*element))
+			result[*element] = current->get(*element).convert<std::string>();
+}
+
+// as WeatherPlugin::processContent
+void scannerExtract(FlatJSONScanner& scanner, const std::string& content, Result& result) {
+	FlatJSONScanner::Values values;
+	scanner.scan(content, values);
+	result["time"] = values["time"];
+	for (const char** element = dataElements; *element != nullptr; element++) {
+		auto value = values.find(WEEWX_JSON_CURRENT + std::string(*element));
+		if (value != values.end())
+			result[*element] = value->second;
+	}
+}
+
+// the readme sample with an array of archive records before the stats object
+std::string extendedSample(int records) {
+	std::string content = readmeSample;
+	std::string history = "  \"history\": [\n";
+	for (int i = 0; i < records; i++) {
+		if (i > 0)
+			history += ",\n";
+		history += "    {\"dateTime\":" + std::to_string(1430578500 + i * 300) + ",\"outTemp\":\"" + std::to_string(10 + i % 15)
+			+ ".4\",\"outHumidity\":\"" + std::to_string(40 + i % 50) + "\",\"barometer\":\"1015.2\",\"windSpeed\":\"" + std::to_string(i % 7) + "\",\"rainRate\":\"0.0\"}";
+	}
+	history += "\n  ],\n";
+	content.insert(content.find("  \"stats\""), history);
+	return content;
+}
+
+}	// end anonymous namespace
+
+int main(int argc, char* argv[]) {
+	int documents = (argc > 1 ? atoi(argv[1]) : 10000);
+	if (documents < 1) {
+		printf("Invalid number of documents\n");
+		return 2;
+	}
+
+	std::vector<std::pair<std::string, std::string> > payloads;
+	payloads.push_back(std::make_pair(std::string("readme sample"), std::string(readmeSample)));
+	payloads.push_back(std::make_pair(std::string("with 1000 records"), extendedSample(1000)));
+	for (int i = 2; i < argc; i++) {
+		std::ifstream in(argv[i], std::ios::binary);
+		if (!in) {
+			printf("Unable to read file: %s\n", argv[i]);
+			return 2;
+		}
+		payloads.push_back(std::make_pair(std::string(argv[i]), std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>())));
+	}
+
+	FlatJSONScanner scanner;
+	scanner.addPath("time");
+	scanner.addPath("stats");
+	scanner.addPath("stats/current");
+	for (const char** element = dataElements; *element != nullptr; element++)
+		scanner.addPath(WEEWX_JSON_CURRENT + std::string(*element));
+
+	int result = 0;
+	printf("%-20s %8s %-12s %12s %14s\n", "payload", "bytes", "variant", "us/document", "allocs/document");
+	for (auto it = payloads.begin(), ite = payloads.end(); it != ite; ++it) {
+		const std::string& content = it->second;
+		try {
+			// compare the results
+			Result expected;
+			Result actual;
+			treeExtract(content, expected);
+			scannerExtract(scanner, content, actual);
+			if (expected != actual) {
+				printf("FAILED: The extracted values differ for payload %s\n", it->first.c_str());
+				for (auto rit = expected.begin(), rite = expected.end(); rit != rite; ++rit)
+					printf("  %s: Poco::JSON '%s', scanner '%s'\n", rit->first.c_str(), rit->second.c_str(), actual[rit->first].c_str());
+				result = 1;
+				continue;
+			}
+
+			Result values;
+			size_t startAllocations = allocations;
+			Poco::Stopwatch treeWatch;
+			treeWatch.start();
+			for (int i = 0; i < documents; i++) {
+				values.clear();
+				treeExtract(content, values);
+			}
+			treeWatch.stop();
+			size_t treeAllocations = allocations - startAllocations;
+
+			startAllocations = allocations;
+			Poco::Stopwatch scannerWatch;
+			scannerWatch.start();
+			for (int i = 0; i < documents; i++) {
+				values.clear();
+				scannerExtract(scanner, content, values);
+			}
+			scannerWatch.stop();
+			size_t scannerAllocations = allocations - startAllocations;
+
+			printf("%-20s %8zu %-12s %12.1f %14.1f\n", it->first.c_str(), content.size(), "Poco::JSON", (double)treeWatch.elapsed() / documents, (double)treeAllocations / documents);
+			printf("%-20s %8s %-12s %12.1f %14.1f\n", "", "", "scanner", (double)scannerWatch.elapsed() / documents, (double)scannerAllocations / documents);
+		} catch (Poco::Exception& e) {
+			printf("FAILED: Payload %s: %s\n", it->first.c_str(), e.displayText().c_str());
+			result = 1;
+		}
+	}
+	return result;
+}
@@ -12,7 +12,7 @@
 
 namespace {
 
-class WindowPort : public opdi::SelectPort {
+class WindowPort : public opdi::SelectPort, protected opdi::Port::StateListener, protected opdid::EventLoop::Listener {
 friend class WindowPlugin;
 protected:
 
@@ -77,6 +77,7 @@ protected:
 	ResetTo resetTo;
 	int16_t positionAfterClose;
 	int16_t positionAfterOpen;
+	uint64_t pollInterval;
 
 	// processed configuration
 	opdi::DigitalPort* sensorClosedPort;
@@ -104,9 +105,39 @@ protected:
 	bool positionNewlySet;
 	bool isMotorEnabled;
 	bool isMotorOn;
+	// set to true when an input port has changed, a transition has occurred or a timer has expired
+	bool inputChanged;
+	// time of the next timer expiry of the current state, or 0
+	uint64_t nextDeadline;
+	// event loop timer that expires at the deadline, or 0
+	opdid::EventLoop::TimerID deadlineTimer;
+	// event loop timer that expires every PollInterval milliseconds, or 0
+	opdid::EventLoop::TimerID pollTimer;
 
 	void prepare() override;
 
+	// unregisters this port from the ports it watches
+	void shutdown(void) override;
+
+	// registers this port as a state listener of the ports
+	void watchPorts(opdi::DigitalPortList& ports);
+
+	// unregisters this port as a state listener of the ports
+	void unwatchPorts(opdi::DigitalPortList& ports);
+
+	virtual void portStateChanged(opdi::Port* port) override;
+
+	virtual void timerExpired(opdid::EventLoop::TimerID id) override;
+
+	// returns the time at which the timer of the current state expires, or 0
+	uint64_t getDeadline(void);
+
+	// schedules the deadline timer if the deadline has changed
+	void scheduleDeadline(uint64_t now);
+
+	// returns true if the state machine needs to be evaluated
+	bool isEvaluationRequired(void);
+
 	// gets the line status from the digital port
 	uint8_t getPortLine(opdi::DigitalPort* port);
 
@@ -197,6 +228,11 @@ WindowPort::WindowPort(opdid::AbstractOPDID* opdid, const char* id) : opdi::Sele
 	this->motorBPort = nullptr;
 	this->delayTimer = 0;
 	this->openTimer = 0;
+	this->pollInterval = 0;
+	this->inputChanged = true;
+	this->nextDeadline = 0;
+	this->deadlineTimer = 0;
+	this->pollTimer = 0;
 }
 
 void WindowPort::setPosition(uint16_t position, ChangeSource changeSource) {
@@ -269,12 +305,117 @@ void WindowPort::prepare() {
 	this->findDigitalPorts(this->ID(), "ForceClose", this->forceCloseStr, this->forceClosePorts);
 	this->findDigitalPorts(this->ID(), "ErrorPorts", this->errorPortStr, this->errorPorts);
 	this->findDigitalPorts(this->ID(), "ResetPorts", this->resetPortStr, this->resetPorts);
+
+	// the state machine is evaluated when one of its inputs changes
+	if (this->sensorClosedPort != nullptr)
+		this->sensorClosedPort->addStateListener(this);
+	if (this->sensorOpenPort != nullptr)
+		this->sensorOpenPort->addStateListener(this);
+	this->watchPorts(this->autoOpenPorts);
+	this->watchPorts(this->autoClosePorts);
+	this->watchPorts(this->forceOpenPorts);
+	this->watchPorts(this->forceClosePorts);
+	this->watchPorts(this->resetPorts);
+
+	// inputs that read their state from hardware do not notify their listeners; they are polled
+	if (this->pollInterval > 0)
+		this->pollTimer = this->opdid->eventLoop->addTimer(this, (int)this->pollInterval, (int)this->pollInterval);
 	
 	// a window port normally refreshes itself automatically unless specified otherwise
 	if (this->refreshMode == RefreshMode::REFRESH_NOT_SET)
 		this->refreshMode = RefreshMode::REFRESH_AUTO;
 }
 
+void WindowPort::watchPorts(opdi::DigitalPortList& ports) {
+	for (auto it = ports.begin(), ite = ports.end(); it != ite; ++it)
+		(*it)->addStateListener(this);
+}
+
+void WindowPort::unwatchPorts(opdi::DigitalPortList& ports) {
+	for (auto it = ports.begin(), ite = ports.end(); it != ite; ++it)
+		(*it)->removeStateListener(this);
+}
+
+void WindowPort::shutdown(void) {
+	// the watched ports may notify their listeners while they are shut down;
+	// this must be done here because they may already be deleted when this port is deleted
+	if (this->sensorClosedPort != nullptr)
+		this->sensorClosedPort->removeStateListener(this);
+	if (this->sensorOpenPort != nullptr)
+		this->sensorOpenPort->removeStateListener(this);
+	this->unwatchPorts(this->autoOpenPorts);
+	this->unwatchPorts(this->autoClosePorts);
+	this->unwatchPorts(this->forceOpenPorts);
+	this->unwatchPorts(this->forceClosePorts);
+	this->unwatchPorts(this->resetPorts);
+	this->opdid->eventLoop->removeListener(this);
+	this->deadlineTimer = 0;
+	this->pollTimer = 0;
+
+	opdi::SelectPort::shutdown();
+}
+
+void WindowPort::portStateChanged(opdi::Port* /*port*/) {
+	this->inputChanged = true;
+}
+
+void WindowPort::timerExpired(opdid::EventLoop::TimerID id) {
+	if (id == this->deadlineTimer)
+		this->deadlineTimer = 0;
+	// the deadline has been reached or the inputs are due to be polled
+	this->inputChanged = true;
+}
+
+uint64_t WindowPort::getDeadline(void) {
+	// the timers expire when the elapsed time exceeds the delay
+	switch (this->currentState) {
+	case WAITING_AFTER_ENABLE:
+	case WAITING_AFTER_DISABLE:
+	case WAITING_BEFORE_DISABLE_ERROR:
+	case WAITING_BEFORE_ENABLE_OPENING:
+	case WAITING_BEFORE_ENABLE_CLOSING:
+		return this->delayTimer + this->enableDelay + 1;
+	case WAITING_BEFORE_DISABLE_OPEN:
+	case WAITING_BEFORE_DISABLE_CLOSED:
+		// the motor is stopped before it is disabled
+		if (this->isMotorOn && (this->motorDelay < this->enableDelay))
+			return this->delayTimer + this->motorDelay + 1;
+		return this->delayTimer + this->enableDelay + 1;
+	case OPENING:
+		return this->openTimer + this->openingTime + 1;
+	case CLOSING:
+		return this->openTimer + this->closingTime + 1;
+	default:
+		return 0;
+	}
+}
+
+void WindowPort::scheduleDeadline(uint64_t now) {
+	uint64_t deadline = this->getDeadline();
+	if (deadline == this->nextDeadline)
+		return;
+	if (this->deadlineTimer != 0) {
+		this->opdid->eventLoop->cancelTimer(this->deadlineTimer);
+		this->deadlineTimer = 0;
+	}
+	this->nextDeadline = deadline;
+	if (deadline > 0)
+		this->deadlineTimer = this->opdid->eventLoop->addTimer(this, (deadline > now ? (int)(deadline - now) : 0));
+}
+
+bool WindowPort::isEvaluationRequired(void) {
+	if (this->inputChanged || this->positionNewlySet)
+		return true;
+	// the initial state is left in the next evaluation
+	if (this->currentState == UNKNOWN)
+		return true;
+	// sensors that read their state from hardware do not notify their listeners;
+	// if they are polled they are checked in every frame while the motor is running
+	if ((this->pollInterval > 0) && ((this->currentState == OPENING) || (this->currentState == CLOSING)))
+		return true;
+	return false;
+}
+
 uint8_t WindowPort::getPortLine(opdi::DigitalPort* port) {
 	uint8_t mode;
 	uint8_t line;
@@ -492,6 +633,13 @@ void WindowPort::checkCloseHBridge(void) {
 uint8_t WindowPort::doWork(uint8_t canSend)  {
 	opdi::SelectPort::doWork(canSend);
 
+	// the state machine is idle unless an input has changed or a timer has expired
+	if (!this->isEvaluationRequired())
+		return OPDI_STATUS_OK;
+	this->inputChanged = false;
+	WindowState previousState = this->currentState;
+	WindowState previousTarget = this->targetState;
+
 	// state machine implementations
 
 	if (this->mode == H_BRIDGE) {
@@ -1081,6 +1229,11 @@ uint8_t WindowPort::doWork(uint8_t canSend)  {
 		}
 	}
 
+	// a transition may enable further transitions in the next frame
+	if ((this->currentState != previousState) || (this->targetState != previousTarget))
+		this->inputChanged = true;
+	this->scheduleDeadline(opdi_get_time_ms());
+
 	return OPDI_STATUS_OK;
 }
 
@@ -1166,6 +1319,10 @@ void WindowPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std::s
 		throw Poco::DataException("Invalid value for the ResetTo setting; expected 'Off', 'Closed' or 'Open'", resetTo);
 	port->positionAfterClose = nodeConfig->getInt("PositionAfterClose", -1);
 	port->positionAfterOpen = nodeConfig->getInt("PositionAfterOpen", -1);
+	int pollInterval = nodeConfig->getInt("PollInterval", 0);
+	if (pollInterval < 0)
+		throw Poco::DataException("PollInterval may not be negative: " + abstractOPDID->to_string(pollInterval));
+	port->pollInterval = pollInterval;
 
 	abstractOPDID->addPort(port);
 
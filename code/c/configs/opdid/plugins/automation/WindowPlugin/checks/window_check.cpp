@@ -0,0 +1,280 @@
+// Checks when the Window plugin evaluates the state machine of a window in H-Bridge mode.
+// Two windows are configured by the setupPlugin method of the plugin. Their sensor, AutoOpen,
+// motor and enable ports are simulated digital ports that count how often their state is read.
+// The sensors of the first window report their changes to their listeners like ports whose state
+// is set by OPDID; the first window uses the default configuration without a PollInterval.
+// The sensors of the second window change their lines without notifying their listeners like
+// ports that read a GPIO pin; the second window polls its inputs with a PollInterval.
+// The main loop is emulated at 200 frames per second by calling the waiting method of the daemon,
+// which runs the ports and the event loop, and sleeping in EventLoop::wait.
+// As the AutoOpen ports are read in every evaluation of the state machine while the position is
+// automatic, the reads of the AutoOpen port count the evaluations of its window.
+// The checks cover the idle frames without evaluations, the reaction to sensor, AutoOpen and
+// position changes, the enable delay and the closing time that expire through event loop timers,
+// the polling of hardware inputs at the PollInterval, and the hardware sensor that stops the
+// running motor of the polling window.
+//
+// Usage: window_check
+
+#include <stdio.h>
+
+#include <functional>
+
+#include "Poco/Util/MapConfiguration.h"
+
+// the plugin is compiled into this program to get access to its classes
+#include "../WindowPlugin.cpp"
+
+#include "LinuxOPDID.h"
+#include "EventLoop.h"
+
+#include "check.h"
+
+// the main OPDI instance is declared here
+opdid::AbstractOPDID* Opdi = nullptr;
+
+namespace {
+
+// the delays of both windows in milliseconds
+const int ENABLE_DELAY = 100;
+const int OPENING_TIME = 300;
+const int POLL_INTERVAL = 50;
+
+/** A digital port that counts how often its state is read. A port that simulates hardware
+*   changes its line without notifying its listeners. */
+class SimulatedPort : public opdi::DigitalPort {
+protected:
+	bool hardware;
+	uint8_t hardwareLine;
+
+public:
+	mutable int reads;
+
+	SimulatedPort(const char* id, bool hardware = false) : opdi::DigitalPort(id), hardware(hardware), hardwareLine(0), reads(0) {}
+
+	virtual void getState(uint8_t* mode, uint8_t* line) const override {
+		this->reads++;
+		opdi::DigitalPort::getState(mode, line);
+		if (this->hardware)
+			*line = this->hardwareLine;
+	}
+
+	/** Changes the line like the simulated input would. */
+	void change(uint8_t line) {
+		if (this->hardware)
+			this->hardwareLine = line;
+		else
+			this->setLine(line);
+	}
+
+	uint8_t current(void) const {
+		uint8_t mode;
+		uint8_t line;
+		opdi::DigitalPort::getState(&mode, &line);
+		return (this->hardware ? this->hardwareLine : line);
+	}
+};
+
+/** Provides access to the number of timers. */
+class CheckEventLoop : public opdid::EventLoop {
+public:
+	CheckEventLoop(opdid::AbstractOPDID* opdid) : opdid::EventLoop(opdid) {}
+
+	size_t timerCount(void) {
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		return this->timers.size();
+	}
+};
+
+/** The simulated ports of a window. */
+struct Window {
+	std::string id;
+	WindowPlugin plugin;
+	SimulatedPort* sensorClosed;
+	SimulatedPort* sensorOpen;
+	SimulatedPort* autoOpen;
+	SimulatedPort* motorA;
+	SimulatedPort* motorB;
+	SimulatedPort* enable;
+	opdi::SelectPort* port;
+
+	Window(opdid::AbstractOPDID& daemon, Poco::Util::AbstractConfiguration* config, const std::string& id, bool hardwareSensors, int pollInterval) : id(id) {
+		this->sensorClosed = this->add(daemon, "SensorClosed", hardwareSensors);
+		this->sensorOpen = this->add(daemon, "SensorOpen", hardwareSensors);
+		this->autoOpen = this->add(daemon, "AutoOpen", false);
+		this->motorA = this->add(daemon, "MotorA", false);
+		this->motorB = this->add(daemon, "MotorB", false);
+		this->enable = this->add(daemon, "Enable", false);
+		// the window is closed
+		this->sensorClosed->change(1);
+
+		config->setString(id + ".ControlMode", "H-Bridge");
+		config->setString(id + ".SensorClosed", this->sensorClosed->ID());
+		config->setString(id + ".SensorOpen", this->sensorOpen->ID());
+		config->setString(id + ".AutoOpen", this->autoOpen->ID());
+		config->setString(id + ".MotorA", this->motorA->ID());
+		config->setString(id + ".MotorB", this->motorB->ID());
+		config->setString(id + ".Enable", this->enable->ID());
+		config->setInt(id + ".EnableDelay", ENABLE_DELAY);
+		config->setInt(id + ".OpeningTime", OPENING_TIME);
+		if (pollInterval > 0)
+			config->setInt(id + ".PollInterval", pollInterval);
+		config->setInt(id + ".Items.Off", 1);
+		config->setInt(id + ".Items.Closed", 2);
+		config->setInt(id + ".Items.Open", 3);
+		config->setInt(id + ".Items.Automatic", 4);
+
+		this->plugin.setupPlugin(&daemon, id, config);
+		this->port = (opdi::SelectPort*)daemon.findPortByID(id.c_str());
+		if (this->port == nullptr)
+			throw Poco::NotFoundException("Window port not found", id);
+	}
+
+	SimulatedPort* add(opdid::AbstractOPDID& daemon, const std::string& name, bool hardware) {
+		SimulatedPort* result = new SimulatedPort((this->id + name).c_str(), hardware);
+		daemon.addPort(result);
+		return result;
+	}
+
+	bool isOpening(void) const {
+		return (this->enable->current() == 1) && (this->motorA->current() == 1) && (this->motorB->current() == 0);
+	}
+
+	bool isClosing(void) const {
+		return (this->enable->current() == 1) && (this->motorA->current() == 0) && (this->motorB->current() == 1);
+	}
+
+	bool isDisabled(void) const {
+		return (this->enable->current() == 0);
+	}
+};
+
+/** Runs one frame of the main loop. */
+void frame(opdid::AbstractOPDID& daemon) {
+	uint64_t start = monotonicUs();
+	daemon.waiting(0);
+	int remaining = 5000 - (int)(monotonicUs() - start);
+	if (remaining > 0)
+		daemon.eventLoop->wait(remaining);
+}
+
+/** Runs the main loop until the condition is met or the time is up.
+*   Returns the elapsed time in milliseconds, or -1 if the time is up. */
+int runUntil(opdid::AbstractOPDID& daemon, std::function<bool(void)> condition, int timeoutMs) {
+	uint64_t start = monotonicUs();
+	while (!condition()) {
+		if (monotonicUs() - start > (uint64_t)timeoutMs * 1000)
+			return -1;
+		frame(daemon);
+	}
+	return (int)((monotonicUs() - start) / 1000);
+}
+
+/** Runs the main loop for the specified time. Returns the number of frames. */
+int runFor(opdid::AbstractOPDID& daemon, int ms) {
+	uint64_t start = monotonicUs();
+	int frames = 0;
+	while (monotonicUs() - start < (uint64_t)ms * 1000) {
+		frame(daemon);
+		frames++;
+	}
+	return frames;
+}
+
+}	// end anonymous namespace
+
+int main(int, char**) {
+	opdid::LinuxOPDID daemon;
+	Opdi = &daemon;
+	// the event loop is usually created when the general configuration is read
+	CheckEventLoop* eventLoop = new CheckEventLoop(&daemon);
+	daemon.eventLoop = eventLoop;
+	// this flag is usually reset when the daemon starts up
+	daemon.shutdownRequested = false;
+
+	try {
+		Poco::AutoPtr<Poco::Util::MapConfiguration> config = new Poco::Util::MapConfiguration();
+		Window notifying(daemon, config, "Window", false, 0);
+		Window polling(daemon, config, "PolledWindow", true, POLL_INTERVAL);
+		daemon.preparePorts();
+		notifying.port->setPosition(POSITION_AUTO);
+		polling.port->setPosition(POSITION_AUTO);
+		runFor(daemon, 50);
+
+		// idle windows
+		int reads = notifying.autoOpen->reads;
+		int polledReads = polling.autoOpen->reads;
+		int frames = runFor(daemon, 1000);
+		check(notifying.autoOpen->reads == reads, "the state machine is not evaluated in idle frames (evaluations: "
+			+ std::to_string(notifying.autoOpen->reads - reads) + " in " + std::to_string(frames) + " frames)");
+		polledReads = polling.autoOpen->reads - polledReads;
+		check((polledReads >= 1000 / POLL_INTERVAL / 2) && (polledReads <= 1000 / POLL_INTERVAL + 2), "the polling window evaluates its state machine every PollInterval (evaluations: "
+			+ std::to_string(polledReads) + " in " + std::to_string(frames) + " frames)");
+
+		// AutoOpen enables the motor and starts opening after the enable delay
+		reads = notifying.autoOpen->reads;
+		notifying.autoOpen->change(1);
+		int elapsed = runUntil(daemon, [&]() { return notifying.enable->current() == 1; }, 1000);
+		check((elapsed >= 0) && (elapsed <= 20) && !notifying.isOpening(), "a change of the AutoOpen port enables the motor (after: " + std::to_string(elapsed) + " ms)");
+		elapsed = runUntil(daemon, [&]() { return notifying.isOpening(); }, 1000);
+		check((elapsed >= ENABLE_DELAY - 10) && (elapsed <= ENABLE_DELAY + 30), "the motor starts opening after the enable delay (after: " + std::to_string(elapsed) + " ms)");
+		check(notifying.autoOpen->reads - reads <= 4, "the enable delay expires through a timer (evaluations: " + std::to_string(notifying.autoOpen->reads - reads) + ")");
+
+		// the window opens; the sensors report their changes
+		reads = notifying.autoOpen->reads;
+		notifying.sensorClosed->change(0);
+		runFor(daemon, 100);
+		check(notifying.isOpening(), "the motor is still opening after the closed sensor has been released");
+		check(notifying.autoOpen->reads - reads <= 2, "the sensors are not polled while the motor is running (evaluations: " + std::to_string(notifying.autoOpen->reads - reads) + ")");
+		notifying.sensorOpen->change(1);
+		elapsed = runUntil(daemon, [&]() { return notifying.motorA->current() == 0; }, 1000);
+		check((elapsed >= 0) && (elapsed <= 20), "the open sensor stops the motor (after: " + std::to_string(elapsed) + " ms)");
+		elapsed = runUntil(daemon, [&]() { return notifying.isDisabled(); }, 1000);
+		check((elapsed >= 0) && (elapsed <= ENABLE_DELAY + 30), "the motor is disabled after the enable delay (after: " + std::to_string(elapsed) + " ms)");
+
+		// the window is closed by the master but does not reach the closed sensor
+		notifying.autoOpen->change(0);
+		notifying.port->setPosition(POSITION_CLOSED);
+		check(runUntil(daemon, [&]() { return notifying.isClosing(); }, 1000) >= 0, "a position change starts closing the window");
+		// the AutoOpen port is not read unless the position is automatic; the closed sensor is read
+		// in every evaluation while the window is closing
+		reads = notifying.sensorClosed->reads;
+		elapsed = runUntil(daemon, [&]() { return notifying.motorB->current() == 0; }, 1000);
+		check((elapsed >= OPENING_TIME - 10) && (elapsed <= OPENING_TIME + 30), "the motor is stopped when the closing time is up (after: " + std::to_string(elapsed) + " ms)");
+		check(notifying.sensorClosed->reads - reads <= 2, "the closing time expires through a timer (evaluations: " + std::to_string(notifying.sensorClosed->reads - reads) + ")");
+		elapsed = runUntil(daemon, [&]() { return notifying.isDisabled(); }, 1000);
+		check((elapsed >= ENABLE_DELAY - 10) && (elapsed <= ENABLE_DELAY + 30), "the motor is disabled after the enable delay (after: " + std::to_string(elapsed) + " ms)");
+		uint16_t position = 0;
+		bool error = false;
+		try {
+			notifying.port->getState(&position);
+		} catch (opdi::Port::PortError&) {
+			error = true;
+		}
+		check(error, "the window is in the error state because the closed sensor has not been reached");
+
+		// the polling window opens; its sensors do not report their changes
+		polling.autoOpen->change(1);
+		check(runUntil(daemon, [&]() { return polling.isOpening(); }, 1000) >= 0, "the polling window starts opening");
+		polling.sensorClosed->change(0);
+		runFor(daemon, 50);
+		polling.sensorOpen->change(1);
+		elapsed = runUntil(daemon, [&]() { return polling.motorA->current() == 0; }, 1000);
+		check((elapsed >= 0) && (elapsed <= 20), "a hardware sensor stops the motor of the polling window (after: " + std::to_string(elapsed) + " ms)");
+		check(runUntil(daemon, [&]() { return polling.isDisabled(); }, 1000) >= 0, "the motor of the polling window is disabled");
+		reads = polling.autoOpen->reads;
+		runFor(daemon, 200);
+		check(polling.autoOpen->reads - reads <= 200 / POLL_INTERVAL + 2, "the polling window is polled at the PollInterval again after the motor has stopped (evaluations: "
+			+ std::to_string(polling.autoOpen->reads - reads) + ")");
+
+		// the ports are shut down and deleted in the next frame
+		daemon.shutdown();
+		daemon.waiting(0);
+		check(daemon.getPorts().empty(), "the ports have been deleted");
+		check(eventLoop->timerCount() == 0, "the windows have cancelled their timers (remaining: " + std::to_string(eventLoop->timerCount()) + ")");
+	} catch (Poco::Exception& e) {
+		check(false, "unexpected exception: " + e.displayText());
+	}
+
+	return checkResult();
+}
@@ -71,8 +71,8 @@ void LinuxTestOPDIDPlugin::masterDisconnected() {
 extern "C" IOPDIDPlugin* GetOPDIDPluginInstance(int majorVersion, int minorVersion, int patchVersion) {
 
 	// check whether the version is supported
-	if ((majorVersion > 0) || (minorVersion > 1))
-		throw Poco::Exception("This version of the LinuxTestOPDIPlugin supports only OPDID versions up to 0.1");
+	if ((majorVersion > 0) || (minorVersion > 2))
+		throw Poco::Exception("This version of the LinuxTestOPDIPlugin supports only OPDID versions up to 0.2");
 
 	// return a new instance of this plugin
 	return new LinuxTestOPDIDPlugin();
@@ -0,0 +1,292 @@
+// Checks the RFTransmitter of the RemoteSwitch plugin on the SimulatedHardware.
+// The simulation is extended to record every level change of the data line with the
+// time of its clock (the real-time clock, as the transmit thread times the pulses against
+// CLOCK_MONOTONIC). The recorded pulses are compared with the encoded durations: no edge
+// may be early, and the lateness of the edges is reported.
+// The checks also cover the replacement of queued commands for the same switch, the
+// state of the ports after a completed transmission, ports that are deleted while their
+// transmission is in progress, the release of the transmitter with its thread, the
+// start and stop hooks of the plugin, which must start and join the transmit thread, and
+// the teardown of the plugin, which must join the thread before it deletes the hardware.
+//
+// Usage: transmitter_check [pulse length in microseconds [repetitions]]
+// The defaults are 300 microseconds and 3 repetitions.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <set>
+
+// the plugin is compiled into this program to get access to its classes
+#include "../rpi_remoteswitch.cpp"
+
+#include "check.h"
+
+// the main OPDI instance is declared here
+opdid::AbstractOPDID* Opdi = nullptr;
+
+namespace {
+
+const int dataPin = 17;
+
+// the number of simulations that have not been deleted
+std::atomic<int> simulations(0);
+
+/** Records the level changes of the pins with the time of the simulation's clock. */
+class RecordingHardware : public rpi::SimulatedHardware {
+public:
+	struct Change {
+		bool level;
+		uint64_t timeNs;
+	};
+
+	Poco::Mutex changesMutex;
+	std::vector<Change> changes;
+
+	RecordingHardware(opdid::AbstractOPDID* opdid) : rpi::SimulatedHardware(opdid) {
+		simulations++;
+	}
+
+	virtual ~RecordingHardware() {
+		simulations--;
+	}
+
+	virtual void writePin(int pin, bool level) override {
+		if (pin == dataPin) {
+			Change change;
+			change.level = level;
+			change.timeNs = this->clock->nowNs();
+			Poco::Mutex::ScopedLock lock(this->changesMutex);
+			this->changes.push_back(change);
+		}
+		rpi::SimulatedHardware::writePin(pin, level);
+	}
+};
+
+// the number of transmitters that have not been deleted
+std::atomic<int> transmitters(0);
+
+/** Counts its instances and provides access to the encoding. */
+class CheckTransmitter : public RFTransmitter {
+public:
+	CheckTransmitter(opdid::AbstractOPDID* opdid, rpi::Hardware* hardware, int pulseLength, int repeatTransmit)
+		: RFTransmitter(opdid, hardware, dataPin, pulseLength, repeatTransmit) {
+		transmitters++;
+	}
+
+	virtual ~CheckTransmitter() {
+		transmitters--;
+	}
+
+	void encodeCodeWord(const std::string& codeWord, std::vector<uint32_t>& durations) {
+		this->encode(codeWord, durations);
+	}
+};
+
+// IDs of the ports that have been notified about completed transmissions
+std::set<std::string> notifiedPorts;
+
+/** Records the notifications and provides access to the refresh flag. */
+class CheckPort : public RemoteSwitchPort {
+public:
+	CheckPort(opdid::AbstractOPDID* opdid, const char* ID, Poco::SharedPtr<RFTransmitter> transmitter, int unitCode)
+		: RemoteSwitchPort(opdid, ID, transmitter, "10101", unitCode) {}
+
+	virtual void transmissionCompleted(uint16_t position) override {
+		notifiedPorts.insert(this->ID());
+		RemoteSwitchPort::transmissionCompleted(position);
+	}
+
+	bool isRefreshRequired(void) {
+		return this->refreshRequired;
+	}
+
+	std::string codeWord(bool on) {
+		return this->getCodeWord(on);
+	}
+
+	bool stateKnown(void) {
+		try {
+			uint16_t position;
+			this->getState(&position);
+			return true;
+		} catch (opdi::Port::AccessDenied&) {
+			return false;
+		}
+	}
+
+	uint16_t getPosition(void) {
+		uint16_t position;
+		this->getState(&position);
+		return position;
+	}
+};
+
+/** Sets up the plugin state that is needed for the transmitter, as setupPlugin does. */
+class StartStopCheck : public RemoteSwitchPlugin {
+public:
+	StartStopCheck(opdid::AbstractOPDID* daemon, int pulseLength, int repeatTransmit) {
+		this->opdid = daemon;
+		this->nodeID = "RemoteSwitch";
+		this->hardware.reset(new RecordingHardware(daemon));
+		this->gpioPin = dataPin;
+		this->transmitter = new CheckTransmitter(daemon, this->hardware.get(), pulseLength, repeatTransmit);
+	}
+
+	Poco::SharedPtr<RFTransmitter> getTransmitter(void) {
+		return this->transmitter;
+	}
+};
+
+const char* switchItems[] = { "Off", "On", nullptr };
+
+/** Delivers completed transmissions until the ports have been notified or the time is up. */
+bool waitForNotifications(RFTransmitter* transmitter, size_t count, int timeoutMs) {
+	uint64_t start = opdi_get_time_ms();
+	while (notifiedPorts.size() < count) {
+		if (opdi_get_time_ms() - start > (uint64_t)timeoutMs)
+			return false;
+		transmitter->doWork();
+		Poco::Thread::sleep(5);
+	}
+	return true;
+}
+
+}	// end anonymous namespace
+
+int main(int argc, char* argv[]) {
+	int pulseLength = (argc > 1 ? atoi(argv[1]) : 300);
+	int repetitions = (argc > 2 ? atoi(argv[2]) : 3);
+	if ((pulseLength < 1) || (repetitions < 1)) {
+		printf("Invalid pulse length or number of repetitions\n");
+		return 2;
+	}
+
+	opdid::LinuxOPDID daemon;
+	Opdi = &daemon;
+
+	RecordingHardware hardware(&daemon);
+
+	try {
+		CheckTransmitter* checkTransmitter = new CheckTransmitter(&daemon, &hardware, pulseLength, repetitions);
+		// as held by the plugin
+		Poco::SharedPtr<RFTransmitter> transmitter = checkTransmitter;
+
+		CheckPort* first = new CheckPort(&daemon, "First", transmitter, 1);
+		CheckPort* second = new CheckPort(&daemon, "Second", transmitter, 2);
+		first->setItems(switchItems);
+		second->setItems(switchItems);
+
+		check(!first->stateKnown(), "the state is unknown before a transmission");
+
+		// queued before the thread is started, as in test mode; the second command for the first switch replaces the first one
+		first->setPosition(1);
+		first->setPosition(0);
+		second->setPosition(1);
+		Poco::Thread::sleep(200);
+		transmitter->doWork();
+		check(notifiedPorts.empty(), "nothing is sent before the transmitter is started");
+
+		{
+			Poco::Mutex::ScopedLock lock(hardware.changesMutex);
+			hardware.changes.clear();
+		}
+		transmitter->start();
+		check(waitForNotifications(transmitter, 2, 5000), "both transmissions are reported");
+		check(first->stateKnown() && (first->getPosition() == 0) && second->stateKnown() && (second->getPosition() == 1),
+			"the ports report the transmitted positions");
+		check(first->isRefreshRequired() && second->isRefreshRequired(), "the ports request a refresh");
+
+		// compare the pulses with the encoding
+		std::vector<uint32_t> firstDurations;
+		std::vector<uint32_t> secondDurations;
+		for (int i = 0; i < repetitions; i++) {
+			checkTransmitter->encodeCodeWord(first->codeWord(false), firstDurations);
+			checkTransmitter->encodeCodeWord(second->codeWord(true), secondDurations);
+		}
+		std::vector<RecordingHardware::Change> changes;
+		{
+			Poco::Mutex::ScopedLock lock(hardware.changesMutex);
+			changes = hardware.changes;
+		}
+		// each transmission is a sequence of alternating levels that ends with an additional low level
+		size_t expectedChanges = firstDurations.size() + 1 + secondDurations.size() + 1;
+		check(changes.size() == expectedChanges, "one transmission per switch (" + std::to_string(changes.size()) + " level changes, expected "
+			+ std::to_string(expectedChanges) + ")");
+		if (changes.size() == expectedChanges) {
+			bool alternating = true;
+			int64_t minLatenessNs = 0;
+			int64_t maxLatenessNs = 0;
+			int64_t sumLatenessNs = 0;
+			size_t edges = 0;
+			size_t offset = 0;
+			for (auto durations : { &firstDurations, &secondDurations }) {
+				uint64_t startNs = changes[offset].timeNs;
+				uint64_t expectedNs = startNs;
+				for (size_t i = 0; i <= durations->size(); i++) {
+					const RecordingHardware::Change& change = changes[offset + i];
+					alternating = alternating && (change.level == ((i % 2 == 0) && (i < durations->size())));
+					if (i > 0) {
+						expectedNs += (uint64_t)(*durations)[i - 1] * 1000;
+						int64_t lateness = (int64_t)(change.timeNs - expectedNs);
+						minLatenessNs = std::min(minLatenessNs, lateness);
+						maxLatenessNs = std::max(maxLatenessNs, lateness);
+						sumLatenessNs += lateness;
+						edges++;
+					}
+				}
+				offset += durations->size() + 1;
+			}
+			check(alternating, "the levels alternate starting with high and end low");
+			// the first edge is written shortly after the deadlines have been calculated
+			check(minLatenessNs > -20000, "no edge is early (earliest: " + std::to_string(minLatenessNs / 1000) + " us)");
+			printf("Edges: %zu, lateness: mean %.1f us, max %.1f us\n", edges, (double)sumLatenessNs / edges / 1000, (double)maxLatenessNs / 1000);
+		}
+
+		// a port that is deleted during its transmission is not notified
+		notifiedPorts.clear();
+		CheckPort* third = new CheckPort(&daemon, "Third", transmitter, 3);
+		third->setItems(switchItems);
+		third->setPosition(1);
+		second->setPosition(0);
+		Poco::Thread::sleep(20);
+		delete third;
+		check(waitForNotifications(transmitter, 1, 5000) && (notifiedPorts.count("Third") == 0), "a deleted port is not notified");
+
+		// the last reference stops the thread and deletes the transmitter
+		delete first;
+		delete second;
+		check(transmitters == 1, "the transmitter is kept while the plugin holds it");
+		transmitter = nullptr;
+		check(transmitters == 0, "the transmitter is deleted with the last reference");
+
+		// the plugin starts the transmit thread in startPlugin and joins it in stopPlugin
+		int threads = countThreads();
+		StartStopCheck* plugin = new StartStopCheck(&daemon, pulseLength, repetitions);
+		check(countThreads() == threads, "no thread runs before the plugin is started");
+		plugin->startPlugin();
+		check(countThreads() == threads + 1, "startPlugin starts the transmit thread");
+		plugin->stopPlugin();
+		check(countThreads() == threads, "stopPlugin joins the transmit thread");
+		check(transmitters == 0, "stopPlugin releases the transmitter");
+		delete plugin;
+		check(simulations == 1, "the plugin deletes its hardware");
+
+		// a plugin that is deleted without being stopped joins the thread before it deletes the hardware;
+		// a port keeps the transmitter
+		plugin = new StartStopCheck(&daemon, pulseLength, repetitions);
+		plugin->startPlugin();
+		CheckPort* remaining = new CheckPort(&daemon, "Remaining", plugin->getTransmitter(), 1);
+		remaining->setItems(switchItems);
+		remaining->setPosition(1);
+		delete plugin;
+		check((countThreads() == threads) && (simulations == 1) && (transmitters == 1),
+			"deleting a started plugin joins the transmit thread and deletes the hardware");
+		delete remaining;
+		check(transmitters == 0, "the port releases the transmitter of the deleted plugin");
+	} catch (Poco::Exception& e) {
+		check(false, "unexpected exception: " + e.displayText());
+	}
+
+	return checkResult();
+}
@@ -1,36 +1,143 @@
-
 // OPDID plugin that supports 433 MHz radio controlled power sockets on Raspberry Pi
 
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
 #include "Poco/Tuple.h"
 #include "Poco/RegularExpression.h"
+#include "Poco/Thread.h"
+#include "Poco/Runnable.h"
+#include "Poco/Mutex.h"
+#include "Poco/Event.h"
+#include "Poco/SharedPtr.h"
 
 #include "opdi_constants.h"
 #include "opdi_platformfuncs.h"
 
 #include "wiringPi.h"
-#include "RCSwitch.h"
 
 #include "../rpi.h"
+#include "../rpi_hal.h"
 
 #include "LinuxOPDID.h"
-#include "OPDID_PortFunctions.h"
+
+// the transmit thread sleeps until shortly before the end of a pulse and waits actively for the rest
+#define SPIN_MARGIN_US	100
+
+namespace {
+
+class RemoteSwitchPort;
+
+///////////////////////////////////////////////////////////////////////////////
+// WiringPiHardware: Accesses the GPIO pins using wiringPi
+///////////////////////////////////////////////////////////////////////////////
+
+class WiringPiHardware : public rpi::Hardware {
+public:
+	WiringPiHardware(void);
+
+	virtual void setPinMode(int pin, PinMode mode) override;
+	virtual void writePin(int pin, bool level) override;
+	virtual bool readPin(int pin) override;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// RFTransmitter: Sends code words on a dedicated thread
+// Transmissions are queued by the main thread. A transmission that has not yet
+// started is replaced if a new command for the same switch is queued.
+// Completed transmissions are reported to the ports on the main thread.
+// The transmitter is shared by the plugin and its ports; it stops and joins the
+// transmit thread when the last reference is released.
+///////////////////////////////////////////////////////////////////////////////
+
+class RFTransmitter : protected Poco::Runnable {
+public:
+	struct Transmission {
+		RemoteSwitchPort* port;		// identifies the switch
+		std::string codeWord;		// tri-state code word
+		uint16_t position;
+	};
+
+protected:
+	opdid::AbstractOPDID* opdid;
+	rpi::Hardware* hardware;
+	int pin;				// drives the data line of the radio module
+	int pulseLength;		// microseconds
+	int repeatTransmit;
+
+	Poco::Thread thread;
+	Poco::Event event;
+	std::atomic<bool> stopping;
+
+	Poco::Mutex mutex;		// protects the members below
+	std::deque<Transmission> queue;
+	std::vector<Transmission> completed;
+	RemoteSwitchPort* sending;		// port of the transmission in progress; nullptr if it has been removed
+
+	/** Transmit thread method. */
+	virtual void run(void) override;
+
+	/** Appends the pulse durations (alternating high and low, in microseconds) of the code word. */
+	void encode(const std::string& codeWord, std::vector<uint32_t>& durations);
+
+	/** Outputs the pulses on the pin. */
+	void send(const std::vector<uint32_t>& durations);
+
+public:
+	RFTransmitter(opdid::AbstractOPDID* opdid, rpi::Hardware* hardware, int pin, int pulseLength, int repeatTransmit);
+
+	virtual ~RFTransmitter();
+
+	/** Starts the transmit thread. */
+	void start(void);
+
+	/** Stops and joins the transmit thread. Queued transmissions are not sent. */
+	void stop(void);
+
+	/** Queues the transmission. Called on the main thread. */
+	void enqueue(const Transmission& transmission);
+
+	/** Discards the queued and completed transmissions of the port. Called on the main thread
+	* before the port is deleted. */
+	void remove(RemoteSwitchPort* port);
+
+	/** Notifies the ports about completed transmissions. Called on the main thread. */
+	void doWork(void);
+};
 
 ///////////////////////////////////////////////////////////////////////////////
 // RemoteSwitch: Plugin for remote power outlet control
 ///////////////////////////////////////////////////////////////////////////////
 
-class RemoteSwitchPlugin : public IOPDIDPlugin, public IOPDIDConnectionListener {
+class RemoteSwitchPlugin : public IOPDIDPlugin, public opdid::IOPDIDConnectionListener {
 
 protected:
-	AbstractOPDID* opdid;
+	opdid::AbstractOPDID* opdid;
 	std::string nodeID;
 
 	int gpioPin;
 
-	RCSwitch rcSwitch;
+	// native or simulated hardware; must outlive the transmit thread
+	std::unique_ptr<rpi::Hardware> hardware;
+
+	Poco::SharedPtr<RFTransmitter> transmitter;
 
 public:
-	virtual void setupPlugin(AbstractOPDID* abstractOPDID, std::string node, Poco::Util::AbstractConfiguration* nodeConfig);
+	/** Joins the transmit thread if the plugin has not been stopped and deletes the hardware. */
+	virtual ~RemoteSwitchPlugin(void);
+
+	virtual void setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std::string& node, Poco::Util::AbstractConfiguration* config) override;
+
+	/** Starts the transmit thread (not in test mode). */
+	virtual void startPlugin(void) override;
+
+	/** Stops and joins the transmit thread and releases the transmitter. */
+	virtual void stopPlugin(void) override;
 
 	virtual void masterConnected(void) override;
 	virtual void masterDisconnected(void) override;
@@ -38,66 +145,315 @@ public:
 
 ///////////////////////////////////////////////////////////////////////////////
 // RemoteSwitchPort: Represents a remote-controlled power outlet
-// The RemoteSwitchPort is a SelectPort that will never report its state.
-// This is because radio power outlets do not have a way to query their state;
-// thus we don't know what's really going on with the device.
+// Radio power outlets do not have a way to query their state; thus we don't know
+// what's really going on with the device. The RemoteSwitchPort reports the position
+// whose code word has been sent last; until then its state is unknown.
 ///////////////////////////////////////////////////////////////////////////////
 
-class RemoteSwitchPort : public OPDI_SelectPort, protected OPDID_PortFunctions {
+class RemoteSwitchPort : public opdi::SelectPort {
 protected:
-	RCSwitch* rcSwitch;
+	opdid::AbstractOPDID* opdid;
+	Poco::SharedPtr<RFTransmitter> transmitter;
 
 	std::string systemCode;
 	int unitCode;
+	bool transmitted;				// whether a code word has been sent
+	uint16_t transmittedPosition;
+
+	// returns the tri-state code word for switches with 10 pole DIP switches (type A)
+	std::string getCodeWord(bool on);
+
+	virtual uint8_t doWork(uint8_t canSend) override;
 
 public:
-	RemoteSwitchPort(AbstractOPDID* opdid, const char* ID, RCSwitch* rcSwitch, std::string systemCode, int unitCode);
+	RemoteSwitchPort(opdid::AbstractOPDID* opdid, const char* ID, Poco::SharedPtr<RFTransmitter> transmitter, std::string systemCode, int unitCode);
 	virtual ~RemoteSwitchPort(void);
-	virtual void setPosition(uint16_t position) override;
-	virtual void getState(uint16_t* position) override;
+	virtual void setPosition(uint16_t position, ChangeSource changeSource = opdi::Port::ChangeSource::CHANGESOURCE_INT) override;
+	virtual void getState(uint16_t* position) const override;
+
+	/** Called on the main thread when the code word for the position has been sent. */
+	virtual void transmissionCompleted(uint16_t position);
 };
 
-RemoteSwitchPort::RemoteSwitchPort(AbstractOPDID* opdid, const char* ID, RCSwitch* rcSwitch, std::string systemCode, int unitCode) : OPDI_SelectPort(ID) {
+}	// end anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// WiringPiHardware
+///////////////////////////////////////////////////////////////////////////////
+
+WiringPiHardware::WiringPiHardware(void) {
+	if (wiringPiSetup() == -1)
+		throw Poco::ApplicationException("Unable to initialize wiringPi");
+}
+
+void WiringPiHardware::setPinMode(int pin, PinMode mode) {
+	if (mode == PIN_INPUT) {
+		pinMode(pin, INPUT);
+	} else
+	if (mode == PIN_OUTPUT) {
+		pinMode(pin, OUTPUT);
+	} else
+		throw Poco::NotImplementedException("wiringPi does not support the alternate function of pin " + std::to_string(pin));
+}
+
+void WiringPiHardware::writePin(int pin, bool level) {
+	digitalWrite(pin, level ? HIGH : LOW);
+}
+
+bool WiringPiHardware::readPin(int pin) {
+	return digitalRead(pin) == HIGH;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// RFTransmitter
+///////////////////////////////////////////////////////////////////////////////
+
+RFTransmitter::RFTransmitter(opdid::AbstractOPDID* opdid, rpi::Hardware* hardware, int pin, int pulseLength, int repeatTransmit) : stopping(false) {
+	this->opdid = opdid;
+	this->sending = nullptr;
+	this->hardware = hardware;
+	this->pin = pin;
+	this->pulseLength = pulseLength;
+	this->repeatTransmit = repeatTransmit;
+
+	this->hardware->setPinMode(this->pin, rpi::Hardware::PIN_OUTPUT);
+	this->hardware->writePin(this->pin, false);
+}
+
+RFTransmitter::~RFTransmitter() {
+	this->stop();
+}
+
+void RFTransmitter::start(void) {
+	this->thread.setName("RemoteSwitch transmit thread");
+	this->thread.start(*this);
+}
+
+void RFTransmitter::stop(void) {
+	this->stopping = true;
+	this->event.set();
+	if (this->thread.isRunning())
+		this->thread.join();
+}
+
+void RFTransmitter::enqueue(const Transmission& transmission) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+
+	// only the last command for a switch needs to be sent
+	for (auto it = this->queue.begin(), ite = this->queue.end(); it != ite; ++it) {
+		if (it->port == transmission.port) {
+			*it = transmission;
+			return;
+		}
+	}
+	this->queue.push_back(transmission);
+	this->event.set();
+}
+
+void RFTransmitter::remove(RemoteSwitchPort* port) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+
+	for (auto it = this->queue.begin(); it != this->queue.end(); ) {
+		if (it->port == port)
+			it = this->queue.erase(it);
+		else
+			++it;
+	}
+	for (auto it = this->completed.begin(); it != this->completed.end(); ) {
+		if (it->port == port)
+			it = this->completed.erase(it);
+		else
+			++it;
+	}
+	// a transmission in progress is completed but not reported
+	if (this->sending == port)
+		this->sending = nullptr;
+}
+
+void RFTransmitter::doWork(void) {
+	std::vector<Transmission> done;
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		if (this->completed.empty())
+			return;
+		done.swap(this->completed);
+	}
+	for (auto it = done.begin(), ite = done.end(); it != ite; ++it)
+		it->port->transmissionCompleted(it->position);
+}
+
+void RFTransmitter::encode(const std::string& codeWord, std::vector<uint32_t>& durations) {
+	// each tri-state bit consists of two pulse groups of high and low pulses (protocol 1)
+	for (auto it = codeWord.begin(), ite = codeWord.end(); it != ite; ++it) {
+		int first = (*it == '1' ? 3 : 1);
+		int second = (*it == '0' ? 1 : 3);
+		durations.push_back(first * this->pulseLength);
+		durations.push_back((4 - first) * this->pulseLength);
+		durations.push_back(second * this->pulseLength);
+		durations.push_back((4 - second) * this->pulseLength);
+	}
+	// sync bit
+	durations.push_back(this->pulseLength);
+	durations.push_back(31 * this->pulseLength);
+}
+
+void RFTransmitter::send(const std::vector<uint32_t>& durations) {
+	// the deadlines are absolute so that delays do not add up
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	bool high = true;
+	for (auto it = durations.begin(), ite = durations.end(); it != ite; ++it) {
+		this->hardware->writePin(this->pin, high);
+		high = !high;
+
+		deadline.tv_nsec += *it * 1000;
+		while (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_nsec -= 1000000000;
+			deadline.tv_sec++;
+		}
+
+		struct timespec wakeup = deadline;
+		wakeup.tv_nsec -= SPIN_MARGIN_US * 1000;
+		if (wakeup.tv_nsec < 0) {
+			wakeup.tv_nsec += 1000000000;
+			wakeup.tv_sec--;
+		}
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, nullptr) == EINTR);
+
+		struct timespec now;
+		do {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+		} while ((now.tv_sec < deadline.tv_sec) || ((now.tv_sec == deadline.tv_sec) && (now.tv_nsec < deadline.tv_nsec)));
+	}
+	this->hardware->writePin(this->pin, false);
+}
+
+void RFTransmitter::run(void) {
+	// real-time scheduling keeps the pulse timing accurate; requires root permissions
+	struct sched_param param;
+	param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+	if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+		this->opdid->logNormal("RemoteSwitch: Warning: Unable to set real-time priority for the transmit thread; timing may be inaccurate");
+
+	std::vector<uint32_t> durations;
+	while (!this->stopping && !this->opdid->shutdownRequested) {
+		Transmission transmission;
+		bool available = false;
+		{
+			Poco::Mutex::ScopedLock lock(this->mutex);
+			if (!this->queue.empty()) {
+				transmission = this->queue.front();
+				this->queue.pop_front();
+				this->sending = transmission.port;
+				available = true;
+			}
+		}
+		if (!available) {
+			this->event.tryWait(100);
+			continue;
+		}
+
+		durations.clear();
+		for (int i = 0; i < this->repeatTransmit; i++)
+			this->encode(transmission.codeWord, durations);
+		this->send(durations);
+
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		if (this->sending != nullptr)
+			this->completed.push_back(transmission);
+		this->sending = nullptr;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// RemoteSwitchPort
+///////////////////////////////////////////////////////////////////////////////
+
+RemoteSwitchPort::RemoteSwitchPort(opdid::AbstractOPDID* opdid, const char* ID, Poco::SharedPtr<RFTransmitter> transmitter, std::string systemCode, int unitCode) : opdi::SelectPort(ID) {
 	this->opdid = opdid;
-	this->rcSwitch = rcSwitch;
+	this->transmitter = transmitter;
 	this->systemCode = systemCode;
 	this->unitCode = unitCode;
+	this->transmitted = false;
+	this->transmittedPosition = 0;
+	// the state becomes known when the transmission has completed
+	this->setRefreshMode(RefreshMode::REFRESH_AUTO);
 	this->setLabel((this->ID() + "@" + systemCode + "/" + to_string(unitCode)).c_str());
 
 	opdid->logVerbose("Setup complete: RemoteSwitchPort " + to_string(this->getLabel()));
 }
 
 RemoteSwitchPort::~RemoteSwitchPort(void) {
-	// release resources; configure as floating input
+	this->transmitter->remove(this);
+	// releasing the last reference stops and joins the transmit thread and deletes the transmitter
+	this->transmitter = nullptr;
 }
 
-void RemoteSwitchPort::setPosition(uint16_t position)  {
-	OPDI_SelectPort::setPosition(position);
+std::string RemoteSwitchPort::getCodeWord(bool on) {
+	static const char* unitCodes[] = { "0FFFF", "F0FFF", "FF0FF", "FFF0F" };
 
-	if (position == 0) {
-		this->logDebug(this->ID() + ": Switching off");
-		this->rcSwitch->switchOff((char*)this->systemCode.c_str(), this->unitCode);
-	} else {
-		this->logDebug(this->ID() + ": Switching on");
-		this->rcSwitch->switchOn((char*)this->systemCode.c_str(), this->unitCode);
-	}
+	std::string result;
+	// DIP switches that are on are sent as '0', switches that are off as 'F'
+	for (auto it = this->systemCode.begin(), ite = this->systemCode.end(); it != ite; ++it)
+		result += (*it == '1' ? '0' : 'F');
+	result += unitCodes[this->unitCode - 1];
+	result += (on ? "0F" : "F0");
+	return result;
+}
+
+uint8_t RemoteSwitchPort::doWork(uint8_t canSend) {
+	opdi::SelectPort::doWork(canSend);
+
+	// deliver completed transmissions of all ports of the plugin
+	this->transmitter->doWork();
+
+	return OPDI_STATUS_OK;
 }
 
-void RemoteSwitchPort::getState(uint16_t* position) {
-	// the position is always unknown
-	throw AccessDenied("Cannot read a RemoteSwitch");
+void RemoteSwitchPort::setPosition(uint16_t position, ChangeSource changeSource) {
+	opdi::SelectPort::setPosition(position, changeSource);
+
+	RFTransmitter::Transmission transmission;
+	transmission.port = this;
+	transmission.position = position;
+	transmission.codeWord = this->getCodeWord(position != 0);
+
+	this->logDebug(std::string("Queueing transmission: ") + (position != 0 ? "Switching on" : "Switching off"));
+	this->transmitter->enqueue(transmission);
+}
+
+void RemoteSwitchPort::getState(uint16_t* position) const {
+	// the position is unknown until a code word has been sent
+	if (!this->transmitted)
+		throw AccessDenied("Cannot read a RemoteSwitch");
+	*position = this->transmittedPosition;
 }
 
+void RemoteSwitchPort::transmissionCompleted(uint16_t position) {
+	this->logDebug(std::string("Transmission completed: ") + (position != 0 ? "Switched on" : "Switched off"));
+	this->transmitted = true;
+	this->transmittedPosition = position;
+	// notify the master about the new state
+	if (this->refreshMode == RefreshMode::REFRESH_AUTO)
+		this->refreshRequired = true;
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 // RemoteSwitchPlugin
 ///////////////////////////////////////////////////////////////////////////////
 
-void RemoteSwitchPlugin::setupPlugin(AbstractOPDID* abstractOPDID, std::string node, Poco::Util::AbstractConfiguration* config) {
+RemoteSwitchPlugin::~RemoteSwitchPlugin(void) {
+	// ports that outlive the plugin keep the transmitter, but it does not access the
+	// hardware after its thread has been joined
+	if (!this->transmitter.isNull())
+		this->transmitter->stop();
+}
+
+void RemoteSwitchPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std::string& node, Poco::Util::AbstractConfiguration* config) {
 	this->opdid = abstractOPDID;
 	this->nodeID = node;
 
-	Poco::Util::AbstractConfiguration* nodeConfig = config->createView(node);
+	Poco::AutoPtr<Poco::Util::AbstractConfiguration> nodeConfig = config->createView(node);
 
 	int pin = nodeConfig->getInt("Pin", -1);
 	if (pin < 0)
@@ -105,21 +461,38 @@ void RemoteSwitchPlugin::setupPlugin(AbstractOPDID* abstractOPDID, std::string n
 	// TODO validate pin
 	this->gpioPin = pin;
 
-	this->opdid->lockResource(RPI_GPIO_PREFIX + this->opdid->to_string(this->gpioPin), node);
+	int pulseLength = nodeConfig->getInt("PulseLength", 300);
+	if (pulseLength <= 0)
+		throw Poco::DataException("PulseLength must be greater than 0: " + this->opdid->to_string(pulseLength));
+	int repeatTransmit = nodeConfig->getInt("RepeatTransmit", 10);
+	if (repeatTransmit <= 0)
+		throw Poco::DataException("RepeatTransmit must be greater than 0: " + this->opdid->to_string(repeatTransmit));
 
-	// setup wiringPi
-	if (wiringPiSetup() == -1)
-		throw Poco::ApplicationException("Unable to initialize wiringPi");
+	this->opdid->lockResource(RPI_GPIO_PREFIX + this->opdid->to_string(this->gpioPin), node);
 
-	this->rcSwitch.setPulseLength(300);
-	this->rcSwitch.enableTransmit(this->gpioPin);
+	// select the hardware access; the simulation runs without a radio module
+	std::string hardwareType = nodeConfig->getString("Hardware", "Native");
+	if (hardwareType == "Native") {
+		// setup wiringPi
+		this->hardware.reset(new WiringPiHardware());
+	} else
+	if (hardwareType == "Simulated") {
+		this->opdid->logNormal(node + ": Using simulated hardware");
+		rpi::SimulatedHardware* simulation = new rpi::SimulatedHardware(abstractOPDID);
+		Poco::AutoPtr<Poco::Util::AbstractConfiguration> simConfig = config->createView(node + ".Simulation");
+		simulation->configure(simConfig);
+		this->hardware.reset(simulation);
+	} else
+		throw Poco::DataException("Invalid value for Hardware: Expected 'Native' or 'Simulated': " + hardwareType);
+
+	this->transmitter = new RFTransmitter(abstractOPDID, this->hardware.get(), this->gpioPin, pulseLength, repeatTransmit);
 
 	// the remote switch plugin node expects a list of node names that determine the ports that this plugin provides
 
 	// enumerate keys of the plugin's nodes (in specified order)
 	this->opdid->logVerbose("Enumerating RemoteSwitch nodes: " + node + ".Nodes");
 
-	Poco::Util::AbstractConfiguration* nodes = config->createView(node + ".Nodes");
+	Poco::AutoPtr<Poco::Util::AbstractConfiguration> nodes = config->createView(node + ".Nodes");
 
 	// store main node's group (will become the default of ports)
 	std::string group = nodeConfig->getString("Group", "");
@@ -163,14 +536,14 @@ void RemoteSwitchPlugin::setupPlugin(AbstractOPDID* abstractOPDID, std::string n
 		this->opdid->logVerbose("Setting up RemoteSwitchPlugin port for node: " + nodeName);
 
 		// get port section from the configuration
-		Poco::Util::AbstractConfiguration* portConfig = config->createView(nodeName);
+		Poco::AutoPtr<Poco::Util::AbstractConfiguration> portConfig = config->createView(nodeName);
 
 		// get port type (required)
-		std::string portType = abstractOPDID->getConfigString(portConfig, "Type", "", true);
+		std::string portType = abstractOPDID->getConfigString(portConfig, nodeName, "Type", "", true);
 
 		if (portType == "RemoteSwitch") {
 			// read system code (DIP switch)
-			std::string systemCode = abstractOPDID->getConfigString(portConfig, "SystemCode", "", true);
+			std::string systemCode = abstractOPDID->getConfigString(portConfig, nodeName, "SystemCode", "", true);
 			// validate; must be a string of type xxxxx with x = [1, 0]
 			Poco::RegularExpression re("^[01][01][01][01][01]$");
 			if (!re.match(systemCode))
@@ -182,7 +555,7 @@ void RemoteSwitchPlugin::setupPlugin(AbstractOPDID* abstractOPDID, std::string n
 				throw Poco::DataException("A 'UnitCode' between 1 and 4 must be specified for a RemoteSwitch port");
 
 			// setup the port instance and add it
-			RemoteSwitchPort* port = new RemoteSwitchPort(abstractOPDID, nodeName.c_str(), &this->rcSwitch, systemCode, unitCode);
+			RemoteSwitchPort* port = new RemoteSwitchPort(abstractOPDID, nodeName.c_str(), this->transmitter, systemCode, unitCode);
 			// set default group: RemoteSwitchPlugin node's group
 			port->setGroup(group);
 			abstractOPDID->configureSelectPort(portConfig, config, port);
@@ -196,6 +569,17 @@ void RemoteSwitchPlugin::setupPlugin(AbstractOPDID* abstractOPDID, std::string n
 	this->opdid->logVerbose("RemoteSwitchPlugin setup completed successfully as node " + node);
 }
 
+void RemoteSwitchPlugin::startPlugin(void) {
+	// transmissions are sent by a separate thread so that the main loop is not blocked
+	this->transmitter->start();
+}
+
+void RemoteSwitchPlugin::stopPlugin(void) {
+	this->transmitter->stop();
+	// the ports release their references when they are deleted, which deletes the transmitter
+	this->transmitter = nullptr;
+}
+
 void RemoteSwitchPlugin::masterConnected() {
 }
 
@@ -207,8 +591,8 @@ void RemoteSwitchPlugin::masterDisconnected() {
 extern "C" IOPDIDPlugin* GetOPDIDPluginInstance(int majorVersion, int minorVersion, int patchVersion) {
 
 	// check whether the version is supported
-	if ((majorVersion > 0) || (minorVersion > 1))
-		throw Poco::Exception("This version of the RemoteSwitchPlugin supports only OPDID versions up to 0.1");
+	if ((majorVersion > 0) || (minorVersion > 2))
+		throw Poco::Exception("This version of the RemoteSwitchPlugin supports only OPDID versions up to 0.2");
 
 	// return a new instance of this plugin
 	return new RemoteSwitchPlugin();
@@ -0,0 +1,222 @@
+// Checks the timing of the SimulatedHardware with a VirtualClock.
+// A scenario of GPIO, SPI, edge event and serial operations runs twice with a trace file.
+// The first run sends the serial requests in one write, the second byte by byte with pauses,
+// so that the serial thread receives them in different reads. The traces of both runs must
+// be identical, and the virtual time must have advanced exactly by the modelled durations.
+// Then the program exchanges port expander transfer frames with the virtual and with the
+// real-time clock and reports the simulated and the elapsed real time per frame.
+//
+// Usage: simulation_check [number of transfer frames]
+// The default is 100 transfer frames.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "Poco/Util/MapConfiguration.h"
+#include "Poco/AutoPtr.h"
+#include "Poco/Stopwatch.h"
+#include "Poco/Thread.h"
+
+#include "LinuxOPDID.h"
+
+#include "../rpi_hal.h"
+
+#include "check.h"
+
+// the main OPDI instance is declared here
+opdid::AbstractOPDID* Opdi = nullptr;
+
+namespace {
+
+// the activation string of the port expander including the terminating zero, as sent by the GertboardPlugin
+const char expanderMagic[] = "OPDIDGBPEINIT";
+
+const char* serialDevice = "/dev/ttyAMA0";
+const int baudRate = 19200;
+const int serialLatencyUs = 100;
+const int spiLatencyUs = 30;
+
+// one start bit, eight data bits and one stop bit per byte
+const int byteTimeUs = 10 * 1000000 / baudRate;
+
+/** Writes the data in chunks of the specified size; pauses between the chunks. */
+void sendChunked(int fd, const uint8_t* data, size_t length, size_t chunkSize) {
+	for (size_t pos = 0; pos < length; pos += chunkSize) {
+		if (pos > 0)
+			Poco::Thread::sleep(2);
+		size_t size = (length - pos < chunkSize ? length - pos : chunkSize);
+		if (write(fd, data + pos, size) != (ssize_t)size)
+			throw Poco::IOException("Unable to write to the simulated serial device");
+	}
+}
+
+/** Receives the specified number of bytes or throws an exception after one second. */
+void receive(int fd, uint8_t* data, size_t length) {
+	size_t received = 0;
+	while (received < length) {
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, 1000) <= 0)
+			throw Poco::TimeoutException("No response from the simulated serial device");
+		ssize_t bytes = read(fd, data + received, length - received);
+		if (bytes > 0)
+			received += bytes;
+	}
+}
+
+std::string readFile(const std::string& fileName) {
+	std::ifstream in(fileName.c_str());
+	std::stringstream content;
+	content << in.rdbuf();
+	return content.str();
+}
+
+/** Runs the scenario with a trace file; serial requests are written in chunks of the specified size. */
+void runScenario(opdid::AbstractOPDID* daemon, const std::string& traceFile, size_t chunkSize) {
+	rpi::VirtualClock* clock = new rpi::VirtualClock();
+	rpi::SimulatedHardware simulation(daemon, clock);
+	Poco::AutoPtr<Poco::Util::MapConfiguration> config = new Poco::Util::MapConfiguration();
+	config->setString("Trace", traceFile);
+	config->setInt("SPILatency", spiLatencyUs);
+	config->setInt("SerialLatency", serialLatencyUs);
+	simulation.configure(config);
+	std::string run = " (chunk size " + std::to_string(chunkSize) + ")";
+
+	// GPIO outputs do not take time
+	uint64_t start = clock->nowNs();
+	simulation.setPinMode(4, rpi::Hardware::PIN_OUTPUT);
+	simulation.writePin(4, true);
+	clock->advanceUs(1000);
+	simulation.writePin(4, false);
+	check(clock->nowNs() - start == 1000000, "only advanceUs moves the time for GPIO outputs" + run);
+
+	// SPI transfers take the latency
+	simulation.setADC(0, 345);
+	start = clock->nowNs();
+	int value = simulation.readADC(0);
+	simulation.writeDAC(1, 200);
+	check((value == 345) && (simulation.getDAC(1) == 200), "ADC and DAC values" + run);
+	check(clock->nowNs() - start == 2 * spiLatencyUs * 1000, "an ADC read and a DAC write take twice the SPI latency" + run);
+
+	// edges have the timestamp of the virtual clock
+	simulation.setPinMode(17, rpi::Hardware::PIN_INPUT);
+	simulation.setPull(17, rpi::Hardware::PULL_UP);
+	rpi::GPIOEventBackend* backend = simulation.createGPIOEventBackend("simulated");
+	bool level = false;
+	int lineFd = backend->openLine(17, level);
+	clock->advanceUs(250);
+	uint64_t edgeTime = clock->nowNs();
+	simulation.setInput(17, false);
+	std::vector<rpi::GPIOEdge> edges;
+	backend->readEdges(17, lineFd, edges);
+	backend->closeLine(17, lineFd);
+	delete backend;
+	check(level && (edges.size() == 1) && !edges[0].rising && (edges[0].timestampNs == edgeTime), "a falling edge has the virtual timestamp" + run);
+
+	// serial responses take the transmission time of the request and the response plus the latency
+	simulation.attachSerialPeripheral(serialDevice, new rpi::SimulatedPortExpander(0x00ff, 0x0055));
+	int fd = simulation.openSerial(serialDevice, baudRate);
+	uint8_t response[4];
+	start = clock->nowNs();
+	sendChunked(fd, (const uint8_t*)expanderMagic, sizeof(expanderMagic), chunkSize);
+	receive(fd, response, 1);
+	uint64_t expected = ((sizeof(expanderMagic) + 1) * byteTimeUs + serialLatencyUs) * 1000;
+	check((response[0] == 0xff) && (clock->nowNs() - start == expected), "activation takes " + std::to_string((clock->nowNs() - start) / 1000)
+		+ " us of virtual time (expected " + std::to_string(expected / 1000) + " us)" + run);
+
+	// transfer frame: configure pins 8 to 11 as outputs that are high
+	uint8_t request[8] = { 0xe1, 0x00, 0x0f, 0x00, 0x0f, 0x00, 0x0f, 0 };
+	for (size_t i = 0; i < 7; i++)
+		request[7] ^= request[i];
+	start = clock->nowNs();
+	sendChunked(fd, request, sizeof(request), chunkSize);
+	receive(fd, response, sizeof(response));
+	expected = ((sizeof(request) + sizeof(response)) * byteTimeUs + serialLatencyUs) * 1000;
+	check((response[0] == 0xe1) && (response[1] == 0x55) && (response[2] == 0x0f) && (clock->nowNs() - start == expected),
+		"a transfer frame takes " + std::to_string((clock->nowNs() - start) / 1000) + " us of virtual time (expected " + std::to_string(expected / 1000) + " us)" + run);
+
+	simulation.closeSerial(fd);
+}
+
+/** Exchanges the specified number of transfer frames; returns the simulated time in microseconds. */
+uint64_t exchangeFrames(opdid::AbstractOPDID* daemon, rpi::SimulationClock* clock, int frames, int64_t& elapsedUs) {
+	rpi::SimulatedHardware simulation(daemon, clock);
+	simulation.attachSerialPeripheral(serialDevice, new rpi::SimulatedPortExpander(0xffff, 0xa5a5));
+	int fd = simulation.openSerial(serialDevice, baudRate);
+	uint8_t response[4];
+	sendChunked(fd, (const uint8_t*)expanderMagic, sizeof(expanderMagic), sizeof(expanderMagic));
+	receive(fd, response, 1);
+
+	uint8_t request[8] = { 0xe1, 0, 0, 0, 0, 0, 0, 0xe1 };
+	Poco::Stopwatch watch;
+	watch.start();
+	uint64_t start = clock->nowNs();
+	for (int i = 0; i < frames; i++) {
+		sendChunked(fd, request, sizeof(request), sizeof(request));
+		receive(fd, response, sizeof(response));
+	}
+	uint64_t simulated = (clock->nowNs() - start) / 1000;
+	watch.stop();
+	elapsedUs = watch.elapsed();
+	simulation.closeSerial(fd);
+	return simulated;
+}
+
+}	// end anonymous namespace
+
+int main(int argc, char* argv[]) {
+	int frames = (argc > 1 ? atoi(argv[1]) : 100);
+	if (frames < 1) {
+		printf("Invalid number of transfer frames\n");
+		return 2;
+	}
+
+	opdid::LinuxOPDID daemon;
+	Opdi = &daemon;
+
+	try {
+		std::string firstTrace = "simulation_check_1.csv";
+		std::string secondTrace = "simulation_check_2.csv";
+		runScenario(&daemon, firstTrace, 64);
+		runScenario(&daemon, secondTrace, 1);
+		std::string first = readFile(firstTrace);
+		check(!first.empty() && (first == readFile(secondTrace)), "the traces of both runs are identical");
+		unlink(firstTrace.c_str());
+		unlink(secondTrace.c_str());
+
+		// the clock can be selected in the configuration
+		{
+			rpi::SimulatedHardware simulation(&daemon);
+			Poco::AutoPtr<Poco::Util::MapConfiguration> config = new Poco::Util::MapConfiguration();
+			config->setString("Clock", "Virtual");
+			simulation.configure(config);
+			rpi::SimulationClock* clock = simulation.getClock();
+			uint64_t start = clock->nowNs();
+			simulation.readADC(1);
+			check((dynamic_cast<rpi::VirtualClock*>(clock) != nullptr) && (clock->nowNs() - start == 30000), "Clock = Virtual selects the virtual clock");
+		}
+
+		int64_t virtualElapsed;
+		uint64_t virtualSimulated = exchangeFrames(&daemon, new rpi::VirtualClock(), frames, virtualElapsed);
+		int64_t realElapsed;
+		uint64_t realSimulated = exchangeFrames(&daemon, new rpi::RealTimeClock(), frames, realElapsed);
+		uint64_t frameUs = 12 * byteTimeUs + serialLatencyUs;
+		check(virtualSimulated == frames * frameUs, "the virtual time of " + std::to_string(frames) + " transfer frames is exact");
+		check(realSimulated >= frames * frameUs, "the real-time clock waits at least for the modelled time");
+
+		printf("%-10s %14s %14s\n", "clock", "simulated us", "elapsed us");
+		printf("%-10s %14.1f %14.1f\n", "virtual", (double)virtualSimulated / frames, (double)virtualElapsed / frames);
+		printf("%-10s %14.1f %14.1f\n", "real", (double)realSimulated / frames, (double)realElapsed / frames);
+	} catch (Poco::Exception& e) {
+		check(false, "unexpected exception: " + e.displayText());
+	}
+
+	return checkResult();
+}
@@ -35,6 +35,16 @@
 // A value of 255 (all bits set) is the test code that returns the SIGNALCODE code.
 // Any error case returns the SIGNALCODE code.
 
+// Codes with the reserved bit set are commands:
+// The version code 0xE0 returns the protocol version (the first version returns the SIGNALCODE).
+// The transfer code 0xE1 starts a frame that configures any number of ports and reads all ports:
+//   request:  0xE1 maskLo maskHi outputLo outputHi valueLo valueHi checksum
+//   response: 0xE1 lineLo lineHi checksum
+// Ports whose bit is set in the mask are configured; the output bit specifies the direction,
+// the value bit the line state (for outputs) or the pullup flag (for inputs).
+// The response contains the line states of all ports after the configuration.
+// The checksum is the XOR of all preceding bytes of the frame. An invalid request returns the SIGNALCODE.
+
 // The serial port expander must be activated before use by sending it a "magic" string.
 // Otherwise other software could send random instructions causing undefined behaviour.
 // After use the port expander should be deactivated by sending it a value of 128 (reserve bit set).
@@ -46,6 +56,10 @@
 #define PORTMASK 0x0f
 
 #define SIGNALCODE 	0xff
+#define VERSIONCODE	0xe0
+#define TRANSFERCODE	0xe1
+
+#define PROTOCOL_VERSION	2
 
 #define MAGIC	"OPDIDGBPEINIT"
 #define DEACTIVATE	128
@@ -85,6 +99,92 @@ struct bits {
 // B6, B7: Used for crystal
 // D0, D1: UART for Raspberry Pi communication
 
+// sets the direction of the virtual port; value is the line state for outputs or the pullup flag for inputs
+static void configurePort(uint8_t portnumber, uint8_t output, uint8_t value) {
+	switch (portnumber) {
+		case 0:  VP0(DDR)  = output; VP0(PORT)  = value; break;
+		case 1:  VP1(DDR)  = output; VP1(PORT)  = value; break;
+		case 2:  VP2(DDR)  = output; VP2(PORT)  = value; break;
+		case 3:  VP3(DDR)  = output; VP3(PORT)  = value; break;
+		case 4:  VP4(DDR)  = output; VP4(PORT)  = value; break;
+		case 5:  VP5(DDR)  = output; VP5(PORT)  = value; break;
+		case 6:  VP6(DDR)  = output; VP6(PORT)  = value; break;
+		case 7:  VP7(DDR)  = output; VP7(PORT)  = value; break;
+		case 8:  VP8(DDR)  = output; VP8(PORT)  = value; break;
+		case 9:  VP9(DDR)  = output; VP9(PORT)  = value; break;
+		case 10: VP10(DDR) = output; VP10(PORT) = value; break;
+		case 11: VP11(DDR) = output; VP11(PORT) = value; break;
+		case 12: VP12(DDR) = output; VP12(PORT) = value; break;
+		case 13: VP13(DDR) = output; VP13(PORT) = value; break;
+		case 14: VP14(DDR) = output; VP14(PORT) = value; break;
+		case 15: VP15(DDR) = output; VP15(PORT) = value; break;
+	}
+}
+
+static uint8_t readPort(uint8_t portnumber) {
+	switch (portnumber) {
+		case 0:  return VP0(PIN);
+		case 1:  return VP1(PIN);
+		case 2:  return VP2(PIN);
+		case 3:  return VP3(PIN);
+		case 4:  return VP4(PIN);
+		case 5:  return VP5(PIN);
+		case 6:  return VP6(PIN);
+		case 7:  return VP7(PIN);
+		case 8:  return VP8(PIN);
+		case 9:  return VP9(PIN);
+		case 10: return VP10(PIN);
+		case 11: return VP11(PIN);
+		case 12: return VP12(PIN);
+		case 13: return VP13(PIN);
+		case 14: return VP14(PIN);
+		case 15: return VP15(PIN);
+		default: return 0;
+	}
+}
+
+// handles a transfer frame after the transfer code has been received
+static void transfer(void) {
+	uint8_t frame[7];
+	uint8_t checksum = TRANSFERCODE;
+	uint8_t i;
+	
+	for (i = 0; i < sizeof(frame); i++) {
+		frame[i] = getByte();
+		if (i < sizeof(frame) - 1)
+			checksum ^= frame[i];
+	}
+	if (checksum != frame[6]) {
+		putByte(SIGNALCODE);
+		return;
+	}
+	
+	uint16_t mask = frame[0] | (frame[1] << 8);
+	uint16_t output = frame[2] | (frame[3] << 8);
+	uint16_t value = frame[4] | (frame[5] << 8);
+	uint8_t inputConfigured = 0;
+	for (i = 0; i < 16; i++) {
+		if (mask & (1U << i)) {
+			configurePort(i, (output >> i) & 1, (value >> i) & 1);
+			if (!((output >> i) & 1))
+				inputConfigured = 1;
+		}
+	}
+	// wait for the inputs to stabilize
+	if (inputConfigured)
+		_delay_ms(1);
+	
+	uint16_t lines = 0;
+	for (i = 0; i < 16; i++) {
+		if (readPort(i))
+			lines |= (1U << i);
+	}
+	putByte(TRANSFERCODE);
+	putByte(lines & 0xff);
+	putByte(lines >> 8);
+	putByte(TRANSFERCODE ^ (lines & 0xff) ^ (lines >> 8));
+}
+
 /*************************************************************************
 // main program
 *************************************************************************/
@@ -95,7 +195,6 @@ int main(void)
 	uint8_t pullup;
 	uint8_t linestate;
 	uint8_t portnumber;
-	uint8_t in;
 	uint8_t magic_received = 0;
 	uint8_t magic_pos = 0;
 	
@@ -140,6 +239,20 @@ int main(void)
 			continue;
 		}
 				
+		// version query?
+		if (data == VERSIONCODE) {
+			putByte(PROTOCOL_VERSION);
+
+			continue;
+		}
+
+		// transfer frame?
+		if (data == TRANSFERCODE) {
+			transfer();
+
+			continue;
+		}
+
 		// deactivation code received?
 		if (data == DEACTIVATE) {
 			// initialize to require magic first
@@ -164,72 +277,19 @@ int main(void)
 		}
 
 		if (output == 1) {
-			switch (portnumber) {
-				case 0:  VP0(DDR)  = 1; VP0(PORT)  = linestate;  break;
-				case 1:  VP1(DDR)  = 1; VP1(PORT)  = linestate;  break;
-				case 2:  VP2(DDR)  = 1; VP2(PORT)  = linestate;  break;
-				case 3:  VP3(DDR)  = 1; VP3(PORT)  = linestate;  break;
-				case 4:  VP4(DDR)  = 1; VP4(PORT)  = linestate;  break;
-				case 5:  VP5(DDR)  = 1; VP5(PORT)  = linestate;  break;
-				case 6:  VP6(DDR)  = 1; VP6(PORT)  = linestate;  break;
-				case 7:  VP7(DDR)  = 1; VP7(PORT)  = linestate;  break;
-				case 8:  VP8(DDR)  = 1; VP8(PORT)  = linestate;  break;
-				case 9:  VP9(DDR)  = 1; VP9(PORT)  = linestate;  break;
-				case 10: VP10(DDR) = 1; VP10(PORT) = linestate; break;
-				case 11: VP11(DDR) = 1; VP11(PORT) = linestate; break;
-				case 12: VP12(DDR) = 1; VP12(PORT) = linestate; break;
-				case 13: VP13(DDR) = 1; VP13(PORT) = linestate; break;
-				case 14: VP14(DDR) = 1; VP14(PORT) = linestate; break;
-				case 15: VP15(DDR) = 1; VP15(PORT) = linestate; break;
-			}
+			configurePort(portnumber, 1, linestate);
 			
 			// return the same byte
 			putByte(data);
 		} else {
 		
 			// input
-			switch (portnumber) {
-				case 0:  VP0(DDR)  = 0; VP0(PORT)  = pullup;  break;
-				case 1:  VP1(DDR)  = 0; VP1(PORT)  = pullup;  break;
-				case 2:  VP2(DDR)  = 0; VP2(PORT)  = pullup;  break;
-				case 3:  VP3(DDR)  = 0; VP3(PORT)  = pullup;  break;
-				case 4:  VP4(DDR)  = 0; VP4(PORT)  = pullup;  break;
-				case 5:  VP5(DDR)  = 0; VP5(PORT)  = pullup;  break;
-				case 6:  VP6(DDR)  = 0; VP6(PORT)  = pullup;  break;
-				case 7:  VP7(DDR)  = 0; VP7(PORT)  = pullup;  break;
-				case 8:  VP8(DDR)  = 0; VP8(PORT)  = pullup;  break;
-				case 9:  VP9(DDR)  = 0; VP9(PORT)  = pullup;  break;
-				case 10: VP10(DDR) = 0; VP10(PORT) = pullup; break;
-				case 11: VP11(DDR) = 0; VP11(PORT) = pullup; break;
-				case 12: VP12(DDR) = 0; VP12(PORT) = pullup; break;
-				case 13: VP13(DDR) = 0; VP13(PORT) = pullup; break;
-				case 14: VP14(DDR) = 0; VP14(PORT) = pullup; break;
-				case 15: VP15(DDR) = 0; VP15(PORT) = pullup; break;
-			}
+			configurePort(portnumber, 0, pullup);
 			// wait for the input to stabilize
 			_delay_ms(1);
-			switch (portnumber) {
-				case 0:  in = VP0(PIN);  break;
-				case 1:  in = VP1(PIN);  break;
-				case 2:  in = VP2(PIN);  break;
-				case 3:  in = VP3(PIN);  break;
-				case 4:  in = VP4(PIN);  break;
-				case 5:  in = VP5(PIN);  break;
-				case 6:  in = VP6(PIN);  break;
-				case 7:  in = VP7(PIN);  break;
-				case 8:  in = VP8(PIN);  break;
-				case 9:  in = VP9(PIN);  break;
-				case 10: in = VP10(PIN); break;
-				case 11: in = VP11(PIN); break;
-				case 12: in = VP12(PIN); break;
-				case 13: in = VP13(PIN); break;
-				case 14: in = VP14(PIN); break;
-				case 15: in = VP15(PIN); break;
-				default: in = 0;
-			}
 			// set line state in returned byte
 			data &= ~(1 << LINESTATE);
-			if (in == 1)
+			if (readPort(portnumber) == 1)
 				data |= (1 << LINESTATE);
 			putByte(data);
 		}
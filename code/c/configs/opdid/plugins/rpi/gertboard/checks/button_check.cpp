@@ -0,0 +1,133 @@
+// Checks the edge detection of the GertboardButton on the SimulatedHardware.
+// The button watches its pin with a GPIOEventMonitor on the simulated GPIO backend; the
+// simulation drives the pin like a button that pulls the line low while it is pressed.
+// The checks cover a press and release between two frames, which must be reported as
+// pressed to every reader until the refresh has been sent and then as released, a press that is held over several frames, the start
+// and stop hooks of the plugin, which must start and join the GPIO event thread, and the
+// teardown of the plugin, which must join the thread if the plugin has not been stopped.
+//
+// Usage: button_check
+
+#include <stdio.h>
+
+// the plugin is compiled into this program to get access to its classes
+#include "../rpi_gertboard.cpp"
+
+#include "check.h"
+
+// the main OPDI instance is declared here
+opdid::AbstractOPDID* Opdi = nullptr;
+
+namespace {
+
+const int buttonPin = 23;
+
+/** Provides access to the work function and the refresh flag. */
+class CheckButton : public GertboardButton {
+public:
+	CheckButton(opdid::AbstractOPDID* opdid, rpi::Hardware* hardware) : GertboardButton(opdid, hardware, "Button", buttonPin) {}
+
+	void frame(void) {
+		this->doWork(0);
+	}
+
+	bool isRefreshRequired(void) {
+		return this->refreshRequired;
+	}
+
+	uint8_t line(void) {
+		uint8_t mode;
+		uint8_t line;
+		this->getState(&mode, &line);
+		return line;
+	}
+};
+
+/** Sets up the plugin state that is needed for edge events, as setupPlugin does. */
+class TeardownCheck : public GertboardPlugin {
+public:
+	TeardownCheck(opdid::AbstractOPDID* daemon) {
+		this->opdid = daemon;
+		this->nodeID = "Gertboard";
+		this->hardware = new rpi::SimulatedHardware(daemon, new rpi::VirtualClock());
+		this->gpioChip = "simulated";
+	}
+
+	rpi::GPIOEventMonitor* monitor(void) {
+		return this->getGPIOEventMonitor();
+	}
+};
+
+/** Gives the event thread time to process the simulated edges. */
+void waitForEvents(void) {
+	Poco::Thread::sleep(50);
+}
+
+}	// end anonymous namespace
+
+int main(int, char**) {
+	opdid::LinuxOPDID daemon;
+	Opdi = &daemon;
+
+	try {
+		{
+			rpi::VirtualClock* clock = new rpi::VirtualClock();
+			rpi::SimulatedHardware simulation(&daemon, clock);
+			rpi::GPIOEventMonitor* monitor = new rpi::GPIOEventMonitor(&daemon, simulation.createGPIOEventBackend("simulated"));
+			CheckButton* button = new CheckButton(&daemon, &simulation);
+			button->enableEdgeEvents(monitor, 0);
+			monitor->start();
+			check(button->line() == 0, "the button is released initially");
+
+			// a press and release between two frames
+			simulation.setInput(buttonPin, false);
+			clock->advanceUs(2000);
+			simulation.setInput(buttonPin, true);
+			waitForEvents();
+			button->frame();
+			check(button->isRefreshRequired(), "a short press requests a refresh");
+			check(button->line() == 1, "a short press is reported as pressed");
+			check(button->line() == 1, "reading the state does not consume the press");
+			button->frame();
+			check(button->isRefreshRequired() && (button->line() == 0), "the release is reported in the frame after the refresh");
+			button->frame();
+			check(!button->isRefreshRequired() && (button->line() == 0), "no further refresh after the release");
+
+			// a press that is held over several frames
+			simulation.setInput(buttonPin, false);
+			waitForEvents();
+			button->frame();
+			button->frame();
+			check(button->line() == 1 && button->line() == 1, "a held press is reported while it lasts");
+			simulation.setInput(buttonPin, true);
+			waitForEvents();
+			button->frame();
+			check(button->isRefreshRequired() && (button->line() == 0), "the release of a held press is reported");
+			button->frame();
+			check(!button->isRefreshRequired(), "a held press is not latched");
+
+			delete button;
+			delete monitor;
+		}
+
+		// the plugin starts the event thread in startPlugin and joins it in stopPlugin
+		int threads = countThreads();
+		TeardownCheck* plugin = new TeardownCheck(&daemon);
+		plugin->monitor()->watch(buttonPin, 0);
+		check(countThreads() == threads, "no event thread runs before the plugin is started");
+		plugin->startPlugin();
+		check(countThreads() > threads, "startPlugin starts the event thread (" + std::to_string(countThreads() - threads) + " additional thread(s))");
+		plugin->stopPlugin();
+		check(countThreads() == threads, "stopPlugin joins the event thread");
+
+		// the plugin joins the event thread when it is deleted without being stopped
+		plugin->startPlugin();
+		check(countThreads() > threads, "the event thread runs again after startPlugin");
+		delete plugin;
+		check(countThreads() == threads, "the threads have been joined when the plugin is deleted");
+	} catch (Poco::Exception& e) {
+		check(false, "unexpected exception: " + e.displayText());
+	}
+
+	return checkResult();
+}
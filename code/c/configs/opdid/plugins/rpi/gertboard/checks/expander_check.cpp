@@ -0,0 +1,365 @@
+// Checks the expansion port communication of the Gertboard plugin against a fake port expander.
+// The fake runs on the master side of a pseudo terminal and answers like the AtmegaPortExpander
+// firmware (Main.c) of protocol version 2, or of version 1 which serves one pin per exchange.
+// The plugin uses the slave side as its serial device. The fake can corrupt the next transfer
+// frame, like a transmission error would, and can stop responding.
+// The checks cover the version query, batched output changes, reading all pins once per frame,
+// the rejection of a corrupted frame, timeouts, and the per-pin protocol of version 1.
+// The number of bytes exchanged to read 16 input pins is reported for both protocol versions.
+// The activation with the magic string is not covered because it is part of setupPlugin.
+//
+// Usage: expander_check
+
+#include <stdio.h>
+
+#include <atomic>
+
+#include "Poco/Runnable.h"
+#include "Poco/Thread.h"
+#include "Poco/Mutex.h"
+
+// the plugin is compiled into this program to get access to its classes
+#include "../rpi_gertboard.cpp"
+
+#include "check.h"
+
+// the main OPDI instance is declared here
+opdid::AbstractOPDID* Opdi = nullptr;
+
+namespace {
+
+/** Allows the check to advance the frame counter. */
+class CheckOPDID : public opdid::LinuxOPDID {
+public:
+	void nextFrame(void) {
+		this->currentFrame++;
+	}
+};
+
+/** Answers the codes of the plugin like the AtmegaPortExpander firmware (after activation). */
+class FakeExpander : public Poco::Runnable {
+protected:
+	int fd;
+	Poco::Thread thread;
+	std::atomic<bool> stopping;
+
+	Poco::Mutex mutex;		// protects the state below
+	int version;
+	uint16_t pins;			// levels of the pins that are not outputs
+	uint16_t ddr;
+	uint16_t port;
+	bool corruptNext;
+	bool silent;
+	int transfers;
+	int exchanges;
+	size_t bytesReceived;
+	size_t bytesSent;
+
+	uint8_t receiveByte(void) {
+		uint8_t data;
+		while (!this->stopping) {
+			struct pollfd pfd;
+			pfd.fd = this->fd;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			if ((poll(&pfd, 1, 10) > 0) && (read(this->fd, &data, 1) == 1)) {
+				Poco::Mutex::ScopedLock lock(this->mutex);
+				this->bytesReceived++;
+				return data;
+			}
+		}
+		throw Poco::Exception("stopped");
+	}
+
+	void send(const uint8_t* data, size_t length) {
+		{
+			Poco::Mutex::ScopedLock lock(this->mutex);
+			if (this->silent)
+				return;
+			this->bytesSent += length;
+		}
+		if (write(this->fd, data, length) != (ssize_t)length)
+			printf("Fake expander: write failed\n");
+	}
+
+	uint16_t lines(void) {
+		return (this->pins & ~this->ddr) | (this->port & this->ddr);
+	}
+
+	void configurePort(int pin, bool output, bool value) {
+		uint16_t bit = (1 << pin);
+		this->ddr = (output ? this->ddr | bit : this->ddr & ~bit);
+		this->port = (value ? this->port | bit : this->port & ~bit);
+	}
+
+	void transfer(void) {
+		uint8_t frame[7];
+		uint8_t checksum = TRANSFERCODE;
+		for (size_t i = 0; i < sizeof(frame); i++) {
+			frame[i] = this->receiveByte();
+			if (i < sizeof(frame) - 1)
+				checksum ^= frame[i];
+		}
+		uint8_t response[4];
+		{
+			Poco::Mutex::ScopedLock lock(this->mutex);
+			if (this->corruptNext) {
+				// a bit error on the line
+				this->corruptNext = false;
+				checksum ^= 0x10;
+			}
+			if (checksum != frame[6]) {
+				response[0] = SIGNALCODE;
+			} else {
+				uint16_t mask = frame[0] | (frame[1] << 8);
+				uint16_t output = frame[2] | (frame[3] << 8);
+				uint16_t value = frame[4] | (frame[5] << 8);
+				for (int i = 0; i < 16; i++)
+					if (mask & (1 << i))
+						this->configurePort(i, (output >> i) & 1, (value >> i) & 1);
+				uint16_t lines = this->lines();
+				this->transfers++;
+				response[0] = TRANSFERCODE;
+				response[1] = lines & 0xff;
+				response[2] = lines >> 8;
+				response[3] = response[0] ^ response[1] ^ response[2];
+			}
+		}
+		this->send(response, (response[0] == SIGNALCODE ? 1 : sizeof(response)));
+	}
+
+	virtual void run(void) override {
+		try {
+			while (!this->stopping) {
+				uint8_t data = this->receiveByte();
+				uint8_t response = SIGNALCODE;
+				if (data == SIGNALCODE) {
+				} else
+				if (data == VERSIONCODE) {
+					Poco::Mutex::ScopedLock lock(this->mutex);
+					// version 1 answers the version code as an invalid port code
+					response = (this->version >= 2 ? (uint8_t)this->version : SIGNALCODE);
+				} else
+				if ((data == TRANSFERCODE) && (this->version >= 2)) {
+					this->transfer();
+					continue;
+				} else {
+					bool output = (data >> OUTPUT) & 1;
+					bool pullup = (data >> PULLUP) & 1;
+					bool linestate = (data >> LINESTATE) & 1;
+					if (!(output && pullup)) {
+						Poco::Mutex::ScopedLock lock(this->mutex);
+						this->exchanges++;
+						int pin = data & PORTMASK;
+						this->configurePort(pin, output, (output ? linestate : pullup));
+						response = data;
+						if (!output)
+							response = (data & ~(1 << LINESTATE)) | (((this->lines() >> pin) & 1) << LINESTATE);
+					}
+				}
+				this->send(&response, 1);
+			}
+		} catch (Poco::Exception&) {
+			// stopped
+		}
+	}
+
+public:
+	FakeExpander(int fd, int version, uint16_t pins) : fd(fd), stopping(false), version(version), pins(pins), ddr(0), port(0),
+		corruptNext(false), silent(false), transfers(0), exchanges(0), bytesReceived(0), bytesSent(0) {
+		this->thread.start(*this);
+	}
+
+	~FakeExpander() {
+		this->stopping = true;
+		this->thread.join();
+	}
+
+	void corruptNextFrame(void) {
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		this->corruptNext = true;
+	}
+
+	void setSilent(bool silent) {
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		this->silent = silent;
+	}
+
+	int getTransfers(void) {
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		return this->transfers;
+	}
+
+	int getExchanges(void) {
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		return this->exchanges;
+	}
+
+	size_t getBytes(void) {
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		return this->bytesReceived + this->bytesSent;
+	}
+
+	uint16_t getOutputs(void) {
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		return this->port & this->ddr;
+	}
+};
+
+/** Sets up the expansion port state of the plugin as setupPlugin does after the activation. */
+class ExpanderCheck : public GertboardPlugin {
+public:
+	ExpanderCheck(opdid::AbstractOPDID* daemon, int fd, bool batching) {
+		this->opdid = daemon;
+		this->nodeID = "Gertboard";
+		this->logVerbosity = opdi::LogVerbosity::UNKNOWN;
+		this->hardware = nullptr;
+		this->gpioEvents = nullptr;
+		this->uart0_filestream = fd;
+		this->serialTimeoutMs = 300;
+		this->expanderInitialized = true;
+		this->expanderBatching = batching;
+		for (size_t i = 0; i < sizeof(this->expanderCodes); i++)
+			this->expanderCodes[i] = 0xff;
+		this->expanderMask = 0;
+		this->expanderOutputs = 0;
+		this->expanderValues = 0;
+		this->expanderLines = 0;
+		this->expanderLinesFrame = 0;
+		this->expanderLinesValid = false;
+	}
+};
+
+uint8_t inputCode(int pin) {
+	return (uint8_t)pin;
+}
+
+uint8_t outputCode(int pin, bool high) {
+	return (uint8_t)(pin | (1 << OUTPUT) | (high ? (1 << LINESTATE) : 0));
+}
+
+}	// end anonymous namespace
+
+int main(int, char**) {
+	CheckOPDID daemon;
+	Opdi = &daemon;
+
+	// levels of the externally driven pins
+	const uint16_t pins = 0xA5A5;
+
+	try {
+		size_t batchedBytes = 0;
+		size_t perPinBytes = 0;
+
+		// protocol version 2
+		{
+			int master, slave;
+			openTerminal(master, slave);
+			fcntl(slave, F_SETFL, fcntl(slave, F_GETFL) | O_NONBLOCK);
+			FakeExpander expander(master, 2, pins);
+			ExpanderCheck plugin(&daemon, slave, true);
+
+			plugin.sendExpansionPortCode(VERSIONCODE);
+			check(plugin.receiveExpansionPortCode() == 2, "version 2 is reported");
+
+			// output changes are collected
+			for (int i = 0; i < 4; i++)
+				plugin.setExpansionPortPin(outputCode(i, true));
+			check(expander.getTransfers() == 0, "output changes are not sent immediately");
+			plugin.flushExpansionPorts();
+			check((expander.getTransfers() == 1) && (expander.getOutputs() == 0x000f), "four output changes are sent in one transfer");
+			plugin.flushExpansionPorts();
+			check(expander.getTransfers() == 1, "no transfer without changes");
+
+			// inputs are read once per frame
+			daemon.nextFrame();
+			for (int i = 4; i < 16; i++)
+				plugin.setExpansionPortPin(inputCode(i));
+			bool linesOk = true;
+			for (int i = 4; i < 16; i++)
+				linesOk = linesOk && (plugin.getExpansionPortLine(inputCode(i)) == ((pins >> i) & 1));
+			check(linesOk, "input lines are read correctly");
+			check(expander.getTransfers() == 2, "configuring and reading 12 inputs takes one transfer");
+			for (int i = 4; i < 16; i++)
+				plugin.getExpansionPortLine(inputCode(i));
+			check(expander.getTransfers() == 2, "inputs are not read again in the same frame");
+
+			daemon.nextFrame();
+			size_t bytes = expander.getBytes();
+			for (int i = 0; i < 16; i++)
+				plugin.getExpansionPortLine(i < 4 ? outputCode(i, true) : inputCode(i));
+			batchedBytes = expander.getBytes() - bytes;
+			check(expander.getTransfers() == 3, "reading all pins in the next frame takes one transfer");
+
+			// a corrupted frame is rejected with the signal code
+			daemon.nextFrame();
+			plugin.setExpansionPortPin(outputCode(0, false));
+			expander.corruptNextFrame();
+			bool rejected = false;
+			uint64_t start = opdi_get_time_ms();
+			try {
+				plugin.flushExpansionPorts();
+			} catch (opdi::Port::PortError& e) {
+				rejected = (e.message().find("rejected") != std::string::npos);
+				printf("        %s\n", e.message().c_str());
+			}
+			uint64_t elapsed = opdi_get_time_ms() - start;
+			check(rejected, "a corrupted frame is reported as rejected");
+			check(elapsed < 150, "the rejection is reported without waiting for the timeout (" + std::to_string(elapsed) + " ms)");
+			plugin.flushExpansionPorts();
+			check(expander.getOutputs() == 0x000e, "the pending change is sent again with the next transfer");
+
+			// no response
+			daemon.nextFrame();
+			expander.setSilent(true);
+			bool timedOut = false;
+			start = opdi_get_time_ms();
+			try {
+				plugin.getExpansionPortLine(inputCode(4));
+			} catch (opdi::Port::PortError& e) {
+				timedOut = (e.message().find("timeout") != std::string::npos);
+			}
+			elapsed = opdi_get_time_ms() - start;
+			check(timedOut && (elapsed >= 300), "a missing response is reported as a timeout (" + std::to_string(elapsed) + " ms)");
+
+			close(slave);
+			close(master);
+		}
+
+		// protocol version 1
+		{
+			int master, slave;
+			openTerminal(master, slave);
+			fcntl(slave, F_SETFL, fcntl(slave, F_GETFL) | O_NONBLOCK);
+			FakeExpander expander(master, 1, pins);
+			ExpanderCheck plugin(&daemon, slave, false);
+
+			plugin.sendExpansionPortCode(VERSIONCODE);
+			check(plugin.receiveExpansionPortCode() == SIGNALCODE, "version 1 answers the version code with the signal code");
+
+			plugin.setExpansionPortPin(outputCode(3, true));
+			check((expander.getExchanges() == 1) && (expander.getOutputs() == 0x0008), "an output change is sent immediately");
+
+			size_t bytes = expander.getBytes();
+			bool linesOk = true;
+			for (int i = 0; i < 16; i++) {
+				if (i < 4)
+					plugin.setExpansionPortPin(outputCode(i, true));
+				else
+					linesOk = linesOk && (plugin.getExpansionPortLine(inputCode(i)) == ((pins >> i) & 1));
+			}
+			perPinBytes = expander.getBytes() - bytes;
+			check(linesOk, "input lines are read correctly one pin at a time");
+			check(expander.getTransfers() == 0, "no transfer frames are sent");
+
+			close(slave);
+			close(master);
+		}
+
+		printf("Bytes exchanged for 16 pins per frame: %zu with transfer frames, %zu one pin at a time\n", batchedBytes, perPinBytes);
+	} catch (Poco::Exception& e) {
+		check(false, "unexpected exception: " + e.displayText());
+	}
+
+	return checkResult();
+}
@@ -5,6 +5,8 @@
 #include <unistd.h>			//Used for UART
 #include <fcntl.h>			//Used for UART
 #include <termios.h>		//Used for UART
+#include <poll.h>
+#include <errno.h>
 
 #include "Poco/Tuple.h"
 
@@ -16,6 +18,8 @@
 #include "gb_pwm.h"
 
 #include "../rpi.h"
+#include "../rpi_gpioevents.h"
+#include "../rpi_hal.h"
 
 #include "LinuxOPDID.h"
 
@@ -37,6 +41,31 @@ static int pinMapRev2[][2] = {
 
 namespace {
 
+///////////////////////////////////////////////////////////////////////////////
+// GertboardHardware: Accesses the Raspberry Pi peripherals using the
+// Gertboard library (requires root permissions)
+///////////////////////////////////////////////////////////////////////////////
+
+class GertboardHardware : public rpi::Hardware {
+public:
+	GertboardHardware(void);
+
+	virtual void setPinMode(int pin, PinMode mode) override;
+	virtual void setPull(int pin, Pull pull) override;
+	virtual void writePin(int pin, bool level) override;
+	virtual bool readPin(int pin) override;
+
+	virtual void setupSPI(void) override;
+	virtual int readADC(int channel) override;
+	virtual void writeDAC(int channel, int value) override;
+
+	virtual void setupPWM(void) override;
+	virtual void setPWM(int value, bool inverse) override;
+	virtual void stopPWM(void) override;
+
+	virtual int openSerial(const std::string& device, int baudRate) override;
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 // GertboardPlugin: Plugin for providing Gertboard resources to OPDID
 ///////////////////////////////////////////////////////////////////////////////
@@ -48,6 +77,9 @@ protected:
 	std::string nodeID;
 	opdi::LogVerbosity logVerbosity;
 
+	// native or simulated hardware
+	rpi::Hardware* hardware;
+
 	int (*pinMap)[][2];		// the map to use for mapping Gertboard pins to internal pins
 
 	std::string serialDevice;
@@ -56,18 +88,67 @@ protected:
 	int uart0_filestream;
 	bool expanderInitialized;
 
+	// batched expansion port communication (requires protocol version 2 of the port expander)
+	bool expanderBatching;
+	uint8_t expanderCodes[16];		// last configuration code per pin; 0xff if unknown
+	uint16_t expanderMask;			// pins with configuration changes that have not yet been sent
+	uint16_t expanderOutputs;		// direction bits of the pending changes
+	uint16_t expanderValues;		// line state or pullup bits of the pending changes
+	uint16_t expanderLines;			// line states of all pins as read by the last transfer
+	uint64_t expanderLinesFrame;	// frame in which the line states have been read
+	bool expanderLinesValid;
+
+	// edge detection using the GPIO character device
+	std::string gpioChip;
+	rpi::GPIOEventMonitor* gpioEvents;
+
 	// translates external pin IDs to an internal pin; throws an exception if the pin cannot
 	// be mapped or the resource is already used
 	int mapAndLockPin(int pinNumber, std::string forNode);
 
+	// returns the GPIO event monitor; creates it when it's used for the first time
+	rpi::GPIOEventMonitor* getGPIOEventMonitor(void);
+
 public:
+	GertboardPlugin(void);
+
+	// stops the GPIO event thread and releases the hardware
+	virtual ~GertboardPlugin(void);
+
 	virtual void setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std::string& node, Poco::Util::AbstractConfiguration* nodeConfig);
 
+	// starts the GPIO event thread if ports use edge events (not in test mode)
+	virtual void startPlugin(void) override;
+
+	// stops and joins the GPIO event thread; the monitor is deleted with the plugin
+	// because the ports release their lines when they are deleted
+	virtual void stopPlugin(void) override;
+
 	virtual void masterConnected(void) override;
 	virtual void masterDisconnected(void) override;
 
 	virtual void sendExpansionPortCode(uint8_t code);
 	virtual uint8_t receiveExpansionPortCode(void);
+
+	/** Sends the bytes in one write after flushing the input buffer. */
+	virtual void sendExpansionPortFrame(const uint8_t* data, size_t length);
+
+	/** Receives the specified number of bytes or throws an exception on timeout. */
+	virtual void receiveExpansionPortFrame(uint8_t* data, size_t length);
+
+	/** Configures an expansion port pin using the specified port code. In batch mode the change
+	* is sent with the next transfer which happens at the latest in the next frame. */
+	virtual void setExpansionPortPin(uint8_t code);
+
+	/** Returns the line state of the expansion port pin that is configured as an input using the
+	* specified port code. In batch mode all pins are read at most once per frame. */
+	virtual uint8_t getExpansionPortLine(uint8_t code);
+
+	/** Sends the pending configuration changes and reads the line states of all pins in one frame. */
+	virtual void transferExpansionPorts(void);
+
+	/** Sends the pending configuration changes, if any. */
+	virtual void flushExpansionPorts(void);
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -78,10 +159,19 @@ class DigitalGertboardPort : public opdi::DigitalPort {
 friend class GertboardPlugin;
 protected:
 	opdid::AbstractOPDID* opdid;
+	rpi::Hardware* hardware;
 	int pin;
+	// if set, the line is read from the event monitor in input modes
+	rpi::GPIOEventMonitor* gpioEvents;
+	int debounceMs;
+	std::vector<rpi::GPIOEdge> edges;
+
+	virtual uint8_t doWork(uint8_t canSend) override;
 public:
-	DigitalGertboardPort(opdid::AbstractOPDID* opdid, const char* ID, int pin);
+	DigitalGertboardPort(opdid::AbstractOPDID* opdid, rpi::Hardware* hardware, const char* ID, int pin);
 	virtual ~DigitalGertboardPort(void);
+	// uses edge events instead of reading the GPIO registers while the port is an input
+	virtual void enableEdgeEvents(rpi::GPIOEventMonitor* gpioEvents, int debounceMs);
 	virtual void setLine(uint8_t line, ChangeSource changeSource = ChangeSource::CHANGESOURCE_INT) override;
 	virtual void setMode(uint8_t mode, ChangeSource changeSource = ChangeSource::CHANGESOURCE_INT) override;
 	virtual void getState(uint8_t* mode, uint8_t* line) const override;
@@ -95,9 +185,10 @@ class AnalogGertboardOutput : public opdi::AnalogPort {
 friend class GertboardPlugin;
 protected:
 	opdid::AbstractOPDID* opdid;
+	rpi::Hardware* hardware;
 	int output;
 public:
-	AnalogGertboardOutput(opdid::AbstractOPDID* opdid, const char* id, int output);
+	AnalogGertboardOutput(opdid::AbstractOPDID* opdid, rpi::Hardware* hardware, const char* id, int output);
 
 	virtual void setFlags(int32_t flags) override;
 	virtual void setMode(uint8_t mode, ChangeSource changeSource = ChangeSource::CHANGESOURCE_INT) override;
@@ -116,9 +207,10 @@ class AnalogGertboardInput : public opdi::AnalogPort {
 friend class GertboardPlugin;
 protected:
 	opdid::AbstractOPDID* opdid;
+	rpi::Hardware* hardware;
 	int input;
 public:
-	AnalogGertboardInput(opdid::AbstractOPDID* opdid, const char* id, int input);
+	AnalogGertboardInput(opdid::AbstractOPDID* opdid, rpi::Hardware* hardware, const char* id, int input);
 
 	virtual void setFlags(int32_t flags) override;
 	virtual void setMode(uint8_t mode, ChangeSource changeSource = ChangeSource::CHANGESOURCE_INT) override;
@@ -132,24 +224,33 @@ public:
 ///////////////////////////////////////////////////////////////////////////////
 // GertboardButton: Represents a button on the Gertboard.
 // If the button is pressed, a connected master will be notified to update
-// its state. This port permanently queries the state of the button's pin.
+// its state. This port permanently queries the state of the button's pin
+// unless edge events are enabled.
 ///////////////////////////////////////////////////////////////////////////////
 
 class GertboardButton : public opdi::DigitalPort {
 friend class GertboardPlugin;
 protected:
 	opdid::AbstractOPDID* opdid;
+	rpi::Hardware* hardware;
 	int pin;
 	uint8_t lastQueriedState;
 	uint64_t lastQueryTime;
 	uint64_t queryInterval;
 	uint64_t lastRefreshTime;
 	uint64_t refreshInterval;
+	rpi::GPIOEventMonitor* gpioEvents;
+	std::vector<rpi::GPIOEdge> edges;
+	// a press that has been released within one frame is reported as pressed
+	// until the state has been published
+	bool pressLatched;
 
 	virtual uint8_t doWork(uint8_t canSend) override;
 	virtual uint8_t queryState(void);
 public:
-	GertboardButton(opdid::AbstractOPDID* opdid, const char* ID, int pin);
+	GertboardButton(opdid::AbstractOPDID* opdid, rpi::Hardware* hardware, const char* ID, int pin);
+	// detects button changes using edge events instead of querying the pin
+	virtual void enableEdgeEvents(rpi::GPIOEventMonitor* gpioEvents, int debounceMs);
 	virtual void setLine(uint8_t line, ChangeSource changeSource = ChangeSource::CHANGESOURCE_INT) override;
 	virtual void setMode(uint8_t mode, ChangeSource changeSource = ChangeSource::CHANGESOURCE_INT) override;
 	virtual void setDirCaps(const char* dirCaps) override;
@@ -166,10 +267,11 @@ class GertboardPWM: public opdi::DialPort {
 friend class GertboardPlugin;
 protected:
 	opdid::AbstractOPDID* opdid;
+	rpi::Hardware* hardware;
 	int pin;
 	bool inverse;
 public:
-	GertboardPWM(opdid::AbstractOPDID* opdid, const int pin, const char* ID, bool inverse);
+	GertboardPWM(opdid::AbstractOPDID* opdid, rpi::Hardware* hardware, const int pin, const char* ID, bool inverse);
 	virtual ~GertboardPWM(void);
 	virtual void setPosition(int64_t position, ChangeSource changeSource = ChangeSource::CHANGESOURCE_INT) override;
 };
@@ -207,6 +309,11 @@ public:
 #define SIGNALCODE	0xff
 #define MAGIC		"OPDIDGBPEINIT"
 #define DEACTIVATE	128
+#define VERSIONCODE		0xe0
+#define TRANSFERCODE	0xe1
+
+// the first protocol version that supports transfer frames
+#define BATCH_PROTOCOL_VERSION	2
 
 class DigitalExpansionPort : public opdi::DigitalPort {
 friend class GertboardPlugin;
@@ -229,6 +336,8 @@ protected:
 	int pin;
 	DriverType driverType;
 
+	virtual uint8_t doWork(uint8_t canSend) override;
+
 public:
 	DigitalExpansionPort(opdid::AbstractOPDID* opdid, GertboardPlugin* gbPlugin, const char* ID, int pin);
 	virtual ~DigitalExpansionPort(void);
@@ -243,35 +352,53 @@ public:
 // Implementations
 ////////////////////////////////////////////////////////////////////////
 
-DigitalGertboardPort::DigitalGertboardPort(opdid::AbstractOPDID* opdid, const char* ID, int pin) : opdi::DigitalPort(ID,
+DigitalGertboardPort::DigitalGertboardPort(opdid::AbstractOPDID* opdid, rpi::Hardware* hardware, const char* ID, int pin) : opdi::DigitalPort(ID,
 	(std::string("Digital Gertboard Port ") + to_string(pin)).c_str(), // default label - can be changed by configuration
 	OPDI_PORTDIRCAP_BIDI,	// default: input
 	0) {
 	this->opdid = opdid;
+	this->hardware = hardware;
 	this->pin = pin;
+	this->gpioEvents = nullptr;
+	this->debounceMs = 0;
 }
 
 DigitalGertboardPort::~DigitalGertboardPort(void) {
+	if (this->gpioEvents != nullptr)
+		this->gpioEvents->unwatch(this->pin);
+
 	// release resources; configure as floating input
-	// configure as floating input
-	INP_GPIO(this->pin);
+	this->hardware->setPinMode(this->pin, rpi::Hardware::PIN_INPUT);
+	this->hardware->setPull(this->pin, rpi::Hardware::PULL_OFF);
+}
 
-	GPIO_PULL = 0;
-	short_wait();
-	GPIO_PULLCLK0 = (1 < this->pin);
-	short_wait();
-	GPIO_PULL = 0;
-	GPIO_PULLCLK0 = 0;
+void DigitalGertboardPort::enableEdgeEvents(rpi::GPIOEventMonitor* gpioEvents, int debounceMs) {
+	this->gpioEvents = gpioEvents;
+	this->debounceMs = debounceMs;
+	if (this->mode != OPDI_DIGITAL_MODE_OUTPUT)
+		this->gpioEvents->watch(this->pin, this->debounceMs);
+}
+
+uint8_t DigitalGertboardPort::doWork(uint8_t canSend) {
+	opdi::DigitalPort::doWork(canSend);
+
+	if ((this->gpioEvents == nullptr) || !this->gpioEvents->fetchEdges(this->pin, this->edges))
+		return OPDI_STATUS_OK;
+
+	for (auto it = this->edges.begin(), ite = this->edges.end(); it != ite; ++it)
+		this->logExtreme(std::string("Line changed to ") + (it->rising ? "High" : "Low") + " (timestamp: " + to_string(it->timestampNs) + " ns)");
+	this->edges.clear();
+
+	this->refreshRequired = (this->refreshMode == RefreshMode::REFRESH_AUTO);
+	this->handleStateChange(ChangeSource::CHANGESOURCE_INT);
+
+	return OPDI_STATUS_OK;
 }
 
 void DigitalGertboardPort::setLine(uint8_t line, ChangeSource /*changeSource*/) {
 	opdi::DigitalPort::setLine(line);
 
-	if (line == 0) {
-		GPIO_CLR0 = (1 << this->pin);
-	} else {
-		GPIO_SET0 = (1 << this->pin);
-	}
+	this->hardware->writePin(this->pin, line != 0);
 }
 
 void DigitalGertboardPort::setMode(uint8_t mode, ChangeSource /*changeSource*/) {
@@ -284,49 +411,47 @@ void DigitalGertboardPort::setMode(uint8_t mode, ChangeSource /*changeSource*/)
 
 	if (this->mode == OPDI_DIGITAL_MODE_INPUT_FLOATING) {
 		// configure as floating input
-		INP_GPIO(this->pin);
-
-		GPIO_PULL = 0;
-		short_wait();
-		GPIO_PULLCLK0 = (1 < this->pin);
-		short_wait();
-		GPIO_PULL = 0;
-		GPIO_PULLCLK0 = 0;
+		this->hardware->setPinMode(this->pin, rpi::Hardware::PIN_INPUT);
+		this->hardware->setPull(this->pin, rpi::Hardware::PULL_OFF);
 	} else
 	if (this->mode == OPDI_DIGITAL_MODE_INPUT_PULLUP) {
 		// configure as input with pullup
-		INP_GPIO(this->pin);
-
-		GPIO_PULL = 2;
-		short_wait();
-		GPIO_PULLCLK0 = (1 < this->pin);
-		short_wait();
-		GPIO_PULL = 0;
-		GPIO_PULLCLK0 = 0;
+		this->hardware->setPinMode(this->pin, rpi::Hardware::PIN_INPUT);
+		this->hardware->setPull(this->pin, rpi::Hardware::PULL_UP);
 	} else {
-		// configure as output
-		INP_GPIO(this->pin); 
-		OUT_GPIO(this->pin);
+		// configure as output; the line must be released first
+		if (this->gpioEvents != nullptr)
+			this->gpioEvents->unwatch(this->pin);
+		this->hardware->setPinMode(this->pin, rpi::Hardware::PIN_OUTPUT);
 	}
+
+	// detect edges in input modes
+	if ((this->gpioEvents != nullptr) && (this->mode != OPDI_DIGITAL_MODE_OUTPUT))
+		this->gpioEvents->watch(this->pin, this->debounceMs);
 }
 
 void DigitalGertboardPort::getState(uint8_t* mode, uint8_t* line) const {
 	*mode = this->mode;
 
+	// use the debounced level if edges are detected
+	if ((this->gpioEvents != nullptr) && (this->mode != OPDI_DIGITAL_MODE_OUTPUT)) {
+		*line = (this->gpioEvents->getLevel(this->pin) ? 1 : 0);
+		return;
+	}
+
 	// read line
-	unsigned int b = GPIO_IN0;
-	// bit set?
-	*line = (b & (1 << this->pin)) == (unsigned int)(1 << this->pin) ? 1 : 0;
+	*line = (this->hardware->readPin(this->pin) ? 1 : 0);
 }
 
 
-AnalogGertboardOutput::AnalogGertboardOutput(opdid::AbstractOPDID* opdid, const char* id, int output) : opdi::AnalogPort(id, 
+AnalogGertboardOutput::AnalogGertboardOutput(opdid::AbstractOPDID* opdid, rpi::Hardware* hardware, const char* id, int output) : opdi::AnalogPort(id, 
 	(std::string("Analog Gertboard Output ") + to_string(output)).c_str(), // default label - can be changed by configuration
 	OPDI_PORTDIRCAP_OUTPUT, 
 	// possible resolutions - hardware decides which one is actually used; set value in configuration
 	OPDI_ANALOG_PORT_RESOLUTION_8 | OPDI_ANALOG_PORT_RESOLUTION_10 | OPDI_ANALOG_PORT_RESOLUTION_12) {
 
 	this->opdid = opdid;
+	this->hardware = hardware;
 	this->mode = 1;
 	this->resolution = 8;	// most Gertboards apparently use an 8 bit DAC; but this can be changed in the configuration
 	this->reference = 0;
@@ -338,15 +463,15 @@ AnalogGertboardOutput::AnalogGertboardOutput(opdid::AbstractOPDID* opdid, const
 	this->output = output;
 
 	// setup analog output port
-	INP_GPIO(7);  SET_GPIO_ALT(7,0);
-	INP_GPIO(9);  SET_GPIO_ALT(9,0);
-	INP_GPIO(10); SET_GPIO_ALT(10,0);
-	INP_GPIO(11); SET_GPIO_ALT(11,0);
+	this->hardware->setPinMode(7, rpi::Hardware::PIN_ALT0);
+	this->hardware->setPinMode(9, rpi::Hardware::PIN_ALT0);
+	this->hardware->setPinMode(10, rpi::Hardware::PIN_ALT0);
+	this->hardware->setPinMode(11, rpi::Hardware::PIN_ALT0);
 
 	// Setup SPI bus
-	setup_spi();
+	this->hardware->setupSPI();
 
-	write_dac(this->output, this->value);
+	this->hardware->writeDAC(this->output, this->value);
 }
 
 void AnalogGertboardOutput::setFlags(int32_t flags) {
@@ -369,7 +494,7 @@ void AnalogGertboardOutput::setReference(uint8_t reference, ChangeSource /*chang
 void AnalogGertboardOutput::setValue(int32_t value, ChangeSource /*changeSource*/) {
 	opdi::AnalogPort::setValue(value);
 
-	write_dac(this->output, this->value);
+	this->hardware->writeDAC(this->output, this->value);
 }
 
 // function that fills in the current port state
@@ -382,13 +507,14 @@ void AnalogGertboardOutput::getState(uint8_t* mode, uint8_t* resolution, uint8_t
 }
 
 
-AnalogGertboardInput::AnalogGertboardInput(opdid::AbstractOPDID* opdid, const char* id, int input) : opdi::AnalogPort(id, 
+AnalogGertboardInput::AnalogGertboardInput(opdid::AbstractOPDID* opdid, rpi::Hardware* hardware, const char* id, int input) : opdi::AnalogPort(id, 
 	(std::string("Analog Gertboard Input ") + to_string(input)).c_str(), // default label - can be changed by configuration
 	OPDI_PORTDIRCAP_INPUT, 
 	// possible resolutions - hardware decides which one is actually used; set value in configuration
 	OPDI_ANALOG_PORT_RESOLUTION_8 | OPDI_ANALOG_PORT_RESOLUTION_10 | OPDI_ANALOG_PORT_RESOLUTION_12) {
 
 	this->opdid = opdid;
+	this->hardware = hardware;
 	this->mode = 0;
 	this->resolution = 8;	// most Gertboards apparently use an 8 bit DAC; but this can be changed in the configuration
 	this->reference = 0;
@@ -400,13 +526,13 @@ AnalogGertboardInput::AnalogGertboardInput(opdid::AbstractOPDID* opdid, const ch
 	this->input = input;
 
 	// setup analog input port
-	INP_GPIO(8);  SET_GPIO_ALT(8,0);
-	INP_GPIO(9);  SET_GPIO_ALT(9,0);
-	INP_GPIO(10); SET_GPIO_ALT(10,0);
-	INP_GPIO(11); SET_GPIO_ALT(11,0);
+	this->hardware->setPinMode(8, rpi::Hardware::PIN_ALT0);
+	this->hardware->setPinMode(9, rpi::Hardware::PIN_ALT0);
+	this->hardware->setPinMode(10, rpi::Hardware::PIN_ALT0);
+	this->hardware->setPinMode(11, rpi::Hardware::PIN_ALT0);
 
 	// Setup SPI bus
-	setup_spi();
+	this->hardware->setupSPI();
 }
 
 void AnalogGertboardInput::setFlags(int32_t flags) {
@@ -436,26 +562,22 @@ void AnalogGertboardInput::getState(uint8_t* mode, uint8_t* resolution, uint8_t*
 	*resolution = this->resolution;
 	*reference = this->reference;
 	// read value from ADC; correct range
-	*value = opdi::AnalogPort::validateValue(read_adc(this->input));
+	*value = opdi::AnalogPort::validateValue(this->hardware->readADC(this->input));
 }
 
 
-GertboardButton::GertboardButton(opdid::AbstractOPDID* opdid, const char* ID, int pin) : opdi::DigitalPort(ID, 
+GertboardButton::GertboardButton(opdid::AbstractOPDID* opdid, rpi::Hardware* hardware, const char* ID, int pin) : opdi::DigitalPort(ID, 
 	(std::string("Gertboard Button on pin ") + to_string(pin)).c_str(), // default label - can be changed by configuration
 	OPDI_PORTDIRCAP_INPUT,	// default: input with pullup always on
 	OPDI_DIGITAL_PORT_HAS_PULLUP | OPDI_DIGITAL_PORT_PULLUP_ALWAYS) {
 	this->opdid = opdid;
+	this->hardware = hardware;
 	this->pin = pin;
 	this->mode = OPDI_DIGITAL_MODE_INPUT_PULLUP;
 
 	// configure as input with pullup
-	INP_GPIO(this->pin);
-	GPIO_PULL = 2;
-	short_wait();
-	GPIO_PULLCLK0 = (1 << this->pin);
-	short_wait();
-	GPIO_PULL = 0;
-	GPIO_PULLCLK0 = 0;
+	this->hardware->setPinMode(this->pin, rpi::Hardware::PIN_INPUT);
+	this->hardware->setPull(this->pin, rpi::Hardware::PULL_UP);
 
 	this->lastQueryTime = opdi_get_time_ms();
 	this->lastQueriedState = this->queryState();
@@ -464,12 +586,51 @@ GertboardButton::GertboardButton(opdid::AbstractOPDID* opdid, const char* ID, in
 	// to avoid dos'ing the master with refresh requests in case
 	// the button pin toggles too fast
 	this->refreshInterval = 10;
+	this->lastRefreshTime = 0;
+	this->gpioEvents = nullptr;
+	this->pressLatched = false;
+}
+
+void GertboardButton::enableEdgeEvents(rpi::GPIOEventMonitor* gpioEvents, int debounceMs) {
+	this->gpioEvents = gpioEvents;
+	this->gpioEvents->watch(this->pin, debounceMs);
+	// button logic is inverse (low = pressed)
+	this->lastQueriedState = (this->gpioEvents->getLevel(this->pin) ? 0 : 1);
 }
 
 // main work function of the button port - regularly called by the OPDID system
 uint8_t GertboardButton::doWork(uint8_t canSend) {
 	opdi::DigitalPort::doWork(canSend);
 
+	if (this->gpioEvents != nullptr) {
+		// the latched press has been published (the refresh has been sent); now report the release
+		if (this->pressLatched && !this->refreshRequired) {
+			this->pressLatched = false;
+			this->refreshRequired = true;
+			this->handleStateChange(ChangeSource::CHANGESOURCE_INT);
+		}
+
+		if (!this->gpioEvents->fetchEdges(this->pin, this->edges))
+			return OPDI_STATUS_OK;
+
+		bool pressed = false;
+		for (auto it = this->edges.begin(), ite = this->edges.end(); it != ite; ++it) {
+			this->logDebug(std::string("Gertboard Button ") + (it->rising ? "released" : "pressed")
+				+ " (timestamp: " + to_string(it->timestampNs) + " ns)");
+			pressed = pressed || !it->rising;
+		}
+		this->lastQueriedState = (this->edges.back().rising ? 0 : 1);
+		this->edges.clear();
+
+		// a press that is shorter than a frame is latched until the next frame
+		// in which the refresh has been sent
+		if (pressed && (this->lastQueriedState == 0))
+			this->pressLatched = true;
+		this->refreshRequired = true;
+		this->handleStateChange(ChangeSource::CHANGESOURCE_INT);
+		return OPDI_STATUS_OK;
+	}
+
 	// query interval not yet reached?
 	if (opdi_get_time_ms() - this->lastQueryTime < this->queryInterval)
 		return OPDI_STATUS_OK;
@@ -498,10 +659,8 @@ uint8_t GertboardButton::queryState(void) {
 //		opdid->log("Querying Gertboard button pin " + to_string(this->pin) + " (" + this->id + ")");
 
 	// read line
-	unsigned int b = GPIO_IN0;
-	// bit set?
 	// button logic is inverse (low = pressed)
-	uint8_t result = (b & (1 << this->pin)) == (unsigned int)(1 << this->pin) ? 0 : 1;
+	uint8_t result = (this->hardware->readPin(this->pin) ? 0 : 1);
 
 //		opdid->log("Gertboard button pin state is " + to_string((int)result));
 
@@ -527,15 +686,21 @@ void GertboardButton::setFlags(int32_t flags) {
 
 void GertboardButton::getState(uint8_t* mode, uint8_t* line) const {
 	*mode = this->mode;
+	// a latched press is reported to every reader until doWork clears it
+	if (this->pressLatched) {
+		*line = 1;
+		return;
+	}
 	// remember queried line state
 	*line = this->lastQueriedState;
 }
 
 
-GertboardPWM::GertboardPWM(opdid::AbstractOPDID* opdid, const int pin, const char* ID, bool inverse) : opdi::DialPort(ID) {
+GertboardPWM::GertboardPWM(opdid::AbstractOPDID* opdid, rpi::Hardware* hardware, const int pin, const char* ID, bool inverse) : opdi::DialPort(ID) {
 	if (pin != 18)
 		throw Poco::ApplicationException("GertboardPWM only supports pin 18");
 	this->opdid = opdid;
+	this->hardware = hardware;
 	this->pin = pin;
 	this->inverse = inverse;
 	this->minValue = 0;
@@ -544,16 +709,16 @@ GertboardPWM::GertboardPWM(opdid::AbstractOPDID* opdid, const int pin, const cha
 	this->step = 1;
 
 	// initialize PWM
-	INP_GPIO(this->pin);  SET_GPIO_ALT(this->pin, 5);
-	setup_pwm();
-	force_pwm0(0, PWM0_ENABLE);
+	this->hardware->setPinMode(this->pin, rpi::Hardware::PIN_ALT5);
+	this->hardware->setupPWM();
+	this->hardware->setPWM(0, false);
 }
 
 GertboardPWM::~GertboardPWM(void) {
 	// stop PWM when the port is freed
 //	this->opdid->logNormal("Freeing GertboardPWM port; stopping PWM");
 
-	pwm_off();
+	this->hardware->stopPWM();
 }
 
 void GertboardPWM::setPosition(int64_t position, ChangeSource /*changeSource*/) {
@@ -561,7 +726,7 @@ void GertboardPWM::setPosition(int64_t position, ChangeSource /*changeSource*/)
 	opdi::DialPort::setPosition(position);
 
 	// set PWM value; inverse polarity if specified
-	force_pwm0(this->position, PWM0_ENABLE | (this->inverse ? PWM0_REVPOLAR : 0));
+	this->hardware->setPWM(this->position, this->inverse);
 }
 
 
@@ -578,6 +743,19 @@ DigitalExpansionPort::DigitalExpansionPort(opdid::AbstractOPDID* opdid, Gertboar
 DigitalExpansionPort::~DigitalExpansionPort(void) {
 }
 
+uint8_t DigitalExpansionPort::doWork(uint8_t canSend) {
+	opdi::DigitalPort::doWork(canSend);
+
+	// send output changes of this frame
+	try {
+		this->gbPlugin->flushExpansionPorts();
+	} catch (Poco::Exception& e) {
+		this->logWarning("Error sending expansion port changes: " + e.message());
+	}
+
+	return OPDI_STATUS_OK;
+}
+
 void DigitalExpansionPort::setLine(uint8_t line, ChangeSource /*changeSource*/) {
 	opdi::DigitalPort::setLine(line);
 
@@ -612,10 +790,7 @@ void DigitalExpansionPort::setLine(uint8_t line, ChangeSource /*changeSource*/)
 	} else
 		throw PortError("Unknown driver type: " + to_string(driverType));
 
-	this->gbPlugin->sendExpansionPortCode(code);
-	uint8_t returnCode = this->gbPlugin->receiveExpansionPortCode();
-	if ((returnCode & PORTMASK) != (code & PORTMASK))
-		throw PortError("Expansion port communication failure");
+	this->gbPlugin->setExpansionPortPin(code);
 }
 
 void DigitalExpansionPort::setMode(uint8_t mode, ChangeSource /*changeSource*/) {
@@ -663,10 +838,7 @@ void DigitalExpansionPort::setMode(uint8_t mode, ChangeSource /*changeSource*/)
 			throw PortError("Unknown driver type: " + to_string(driverType));
 	}
 
-	this->gbPlugin->sendExpansionPortCode(code);
-	uint8_t returnCode = this->gbPlugin->receiveExpansionPortCode();
-	if ((returnCode & PORTMASK) != (code & PORTMASK))
-		throw PortError("Expansion port communication failure");
+	this->gbPlugin->setExpansionPortPin(code);
 }
 
 void DigitalExpansionPort::getState(uint8_t* mode, uint8_t* line) const {
@@ -683,23 +855,130 @@ void DigitalExpansionPort::getState(uint8_t* mode, uint8_t* line) const {
 			code |= (1 << PULLUP);
 		}
 
-		this->gbPlugin->sendExpansionPortCode(code);
-		uint8_t returnCode = this->gbPlugin->receiveExpansionPortCode();
+		*line = this->gbPlugin->getExpansionPortLine(code);
+	}
+}
 
-		if ((returnCode & ~(1 << LINESTATE)) != code)
-			throw PortError("Expansion port communication failure");
+///////////////////////////////////////////////////////////////////////////////
+// GertboardHardware: Accesses the Raspberry Pi peripherals using the
+// Gertboard library (requires root permissions)
+///////////////////////////////////////////////////////////////////////////////
 
-		if ((returnCode & (1 << LINESTATE)) == (1 << LINESTATE))
-			*line = 1;
-		else
-			*line = 0;
+GertboardHardware::GertboardHardware(void) {
+	// map the peripheral registers
+	setup_io();
+}
+
+void GertboardHardware::setPinMode(int pin, PinMode mode) {
+	// always use INP_GPIO before OUT_GPIO or SET_GPIO_ALT
+	INP_GPIO(pin);
+	if (mode == PIN_OUTPUT) {
+		OUT_GPIO(pin);
+	} else
+	if (mode == PIN_ALT0) {
+		SET_GPIO_ALT(pin, 0);
+	} else
+	if (mode == PIN_ALT5) {
+		SET_GPIO_ALT(pin, 5);
 	}
 }
 
+void GertboardHardware::setPull(int pin, Pull pull) {
+	// 0 = off, 1 = pull down, 2 = pull up; clock the setting into the pin
+	GPIO_PULL = (pull == PULL_UP ? 2 : (pull == PULL_DOWN ? 1 : 0));
+	short_wait();
+	GPIO_PULLCLK0 = (1 << pin);
+	short_wait();
+	GPIO_PULL = 0;
+	GPIO_PULLCLK0 = 0;
+}
+
+void GertboardHardware::writePin(int pin, bool level) {
+	if (level)
+		GPIO_SET0 = (1 << pin);
+	else
+		GPIO_CLR0 = (1 << pin);
+}
+
+bool GertboardHardware::readPin(int pin) {
+	unsigned int b = GPIO_IN0;
+	return (b & (1 << pin)) != 0;
+}
+
+void GertboardHardware::setupSPI(void) {
+	setup_spi();
+}
+
+int GertboardHardware::readADC(int channel) {
+	return read_adc(channel);
+}
+
+void GertboardHardware::writeDAC(int channel, int value) {
+	write_dac(channel, value);
+}
+
+void GertboardHardware::setupPWM(void) {
+	setup_pwm();
+}
+
+void GertboardHardware::setPWM(int value, bool inverse) {
+	force_pwm0(value, PWM0_ENABLE | (inverse ? PWM0_REVPOLAR : 0));
+}
+
+void GertboardHardware::stopPWM(void) {
+	pwm_off();
+}
+
+int GertboardHardware::openSerial(const std::string& device, int baudRate) {
+	speed_t speed;
+	switch (baudRate) {
+	case 9600: speed = B9600; break;
+	case 19200: speed = B19200; break;
+	case 38400: speed = B38400; break;
+	case 57600: speed = B57600; break;
+	case 115200: speed = B115200; break;
+	default:
+		throw Poco::InvalidArgumentException("Baud rate not supported: " + std::to_string(baudRate));
+	}
+
+	int fd = open(device.c_str(), O_RDWR | O_NOCTTY | O_NDELAY);		// open in non blocking read/write mode
+	if (fd == -1)
+		throw Poco::Exception("Unable to open serial device " + device);
+
+	struct termios options;
+	tcgetattr(fd, &options);
+	options.c_cflag = speed | CS8 | CLOCAL | CREAD;		// set baud rate
+	options.c_iflag = IGNPAR;
+	options.c_oflag = 0;
+	options.c_lflag = 0;
+	tcflush(fd, TCIFLUSH);
+	tcsetattr(fd, TCSANOW, &options);
+
+	return fd;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // GertboardPlugin: Plugin for providing Gertboard resources to OPDID
 ///////////////////////////////////////////////////////////////////////////////
 
+GertboardPlugin::GertboardPlugin(void) {
+	this->hardware = nullptr;
+	this->uart0_filestream = -1;
+	this->gpioEvents = nullptr;
+}
+
+GertboardPlugin::~GertboardPlugin(void) {
+	// the ports that use the monitor have been deleted; this joins the event thread if the plugin has not been stopped
+	if (this->gpioEvents != nullptr)
+		delete this->gpioEvents;
+	// the simulation must outlive the monitor
+	if (this->hardware != nullptr) {
+		if (this->uart0_filestream != -1)
+			this->hardware->closeSerial(this->uart0_filestream);
+		delete this->hardware;
+	}
+}
+
 int GertboardPlugin::mapAndLockPin(int pinNumber, std::string forNode) {
 	int i = 0;
 	int internalPin = -1;
@@ -720,10 +999,28 @@ int GertboardPlugin::mapAndLockPin(int pinNumber, std::string forNode) {
 	return internalPin;
 }
 
+rpi::GPIOEventMonitor* GertboardPlugin::getGPIOEventMonitor(void) {
+	if (this->gpioEvents == nullptr) {
+		this->opdid->logVerbose(this->nodeID + ": Using GPIO edge events of " + this->gpioChip);
+		this->gpioEvents = new rpi::GPIOEventMonitor(this->opdid, this->hardware->createGPIOEventBackend(this->gpioChip));
+	}
+	return this->gpioEvents;
+}
+
 void GertboardPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std::string& node, Poco::Util::AbstractConfiguration* config) {
 	this->opdid = abstractOPDID;
 	this->nodeID = node;
 	this->expanderInitialized = false;
+	this->expanderBatching = false;
+	for (size_t i = 0; i < sizeof(this->expanderCodes); i++)
+		this->expanderCodes[i] = 0xff;
+	this->expanderMask = 0;
+	this->expanderOutputs = 0;
+	this->expanderValues = 0;
+	this->expanderLines = 0;
+	this->expanderLinesFrame = 0;
+	this->expanderLinesValid = false;
+	this->gpioEvents = nullptr;
 
 	Poco::Util::AbstractConfiguration* nodeConfig = config->createView(node);
 
@@ -733,8 +1030,21 @@ void GertboardPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std
 	// to avoid trouble repeatedly initializing IO
 	this->opdid->lockResource(std::string("Gertboard"), node);
 
-	// prepare Gertboard IO (requires root permissions)
-	setup_io();
+	// select the hardware access; the simulation runs without a Gertboard
+	Poco::Util::AbstractConfiguration* simConfig = nullptr;
+	std::string hardwareType = nodeConfig->getString("Hardware", "Native");
+	if (hardwareType == "Native") {
+		// prepare Gertboard IO (requires root permissions)
+		this->hardware = new GertboardHardware();
+	} else
+	if (hardwareType == "Simulated") {
+		this->opdid->logNormal(node + ": Using simulated hardware");
+		rpi::SimulatedHardware* simulation = new rpi::SimulatedHardware(this->opdid);
+		this->hardware = simulation;
+		simConfig = config->createView(node + ".Simulation");
+		simulation->configure(simConfig);
+	} else
+		throw Poco::DataException("Invalid value for Hardware: Expected 'Native' or 'Simulated': " + hardwareType);
 
 	// determine pin map to use
 	this->pinMap = (int (*)[][2])&pinMapRev1;
@@ -750,6 +1060,9 @@ void GertboardPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std
 	// store main node's group (will become the default of ports)
 	std::string group = nodeConfig->getString("Group", "");
 
+	// GPIO character device for ports that use edge events
+	this->gpioChip = nodeConfig->getString("GPIOChip", "/dev/gpiochip0");
+
 	// to use the expansion ports we need to have a serial device name
 	// if this is not configured we can't use the serial port expansion
 	this->serialDevice = nodeConfig->getString("SerialDevice", "");
@@ -768,18 +1081,13 @@ void GertboardPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std
 
 		this->serialTimeoutMs = timeout;
 
-		this->uart0_filestream = open(this->serialDevice.c_str(), O_RDWR | O_NOCTTY | O_NDELAY);		// open in non blocking read/write mode
-		if (this->uart0_filestream == -1)
-			throw Poco::Exception("Unable to open serial device " + this->serialDevice);
+		// the simulation connects the serial device to a simulated port expander
+		if (simConfig != nullptr) {
+			((rpi::SimulatedHardware*)this->hardware)->attachSerialPeripheral(this->serialDevice,
+				new rpi::SimulatedPortExpander(simConfig->getInt("PortExpanderDriven", 0), simConfig->getInt("PortExpanderInputs", 0)));
+		}
 
-		struct termios options;
-		tcgetattr(uart0_filestream, &options);
-		options.c_cflag = B19200 | CS8 | CLOCAL | CREAD;		// set baud rate
-		options.c_iflag = IGNPAR;
-		options.c_oflag = 0;
-		options.c_lflag = 0;
-		tcflush(uart0_filestream, TCIFLUSH);
-		tcsetattr(uart0_filestream, TCSANOW, &options);
+		this->uart0_filestream = this->hardware->openSerial(this->serialDevice, 19200);
 
 		// the serial device, if present, uses pins 14 and 15, so these need to be locked
 		// if other ports try to use these ports it will fail
@@ -850,10 +1158,17 @@ void GertboardPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std
 			int internalPin = this->mapAndLockPin(pinNumber, nodeName);
 
 			// setup the port instance and add it; use internal pin number
-			DigitalGertboardPort* port = new DigitalGertboardPort(abstractOPDID, nodeName.c_str(), internalPin);
+			DigitalGertboardPort* port = new DigitalGertboardPort(abstractOPDID, this->hardware, nodeName.c_str(), internalPin);
 			// set default group: Gertboard's node's group
 			port->setGroup(group);
 			port->logVerbosity = opdid->getConfigLogVerbosity(portConfig, this->logVerbosity);
+			if (portConfig->getBool("EdgeEvents", false)) {
+				int debounce = portConfig->getInt("Debounce", 0);
+				if (debounce < 0)
+					throw Poco::DataException("Debounce must not be negative: " + abstractOPDID->to_string(debounce));
+				// must be enabled before the mode is configured
+				port->enableEdgeEvents(this->getGPIOEventMonitor(), debounce);
+			}
 			abstractOPDID->configureDigitalPort(portConfig, port);
 			abstractOPDID->addPort(port);
 		} else
@@ -867,10 +1182,16 @@ void GertboardPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std
 			int internalPin = this->mapAndLockPin(pinNumber, nodeName);
 
 			// setup the port instance and add it; use internal pin number
-			GertboardButton* port = new GertboardButton(abstractOPDID, nodeName.c_str(), internalPin);
+			GertboardButton* port = new GertboardButton(abstractOPDID, this->hardware, nodeName.c_str(), internalPin);
 			// set default group: Gertboard's node's group
 			port->setGroup(group);
 			port->logVerbosity = opdid->getConfigLogVerbosity(portConfig, this->logVerbosity);
+			if (portConfig->getBool("EdgeEvents", false)) {
+				int debounce = portConfig->getInt("Debounce", 20);
+				if (debounce < 0)
+					throw Poco::DataException("Debounce must not be negative: " + abstractOPDID->to_string(debounce));
+				port->enableEdgeEvents(this->getGPIOEventMonitor(), debounce);
+			}
 			abstractOPDID->configureDigitalPort(portConfig, port);
 			abstractOPDID->addPort(port);
 		} else
@@ -894,7 +1215,7 @@ void GertboardPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std
 			abstractOPDID->lockResource(std::string("AnalogOut") + abstractOPDID->to_string(outputNumber), nodeName);
 
 			// setup the port instance and add it; use internal pin number
-			AnalogGertboardOutput* port = new AnalogGertboardOutput(abstractOPDID, nodeName.c_str(), outputNumber);
+			AnalogGertboardOutput* port = new AnalogGertboardOutput(abstractOPDID, this->hardware, nodeName.c_str(), outputNumber);
 			// set default group: Gertboard's node's group
 			port->setGroup(group);
 			port->logVerbosity = opdid->getConfigLogVerbosity(portConfig, this->logVerbosity);
@@ -921,7 +1242,7 @@ void GertboardPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std
 			abstractOPDID->lockResource(std::string("AnalogIn") + abstractOPDID->to_string(inputNumber), nodeName);
 
 			// setup the port instance and add it; use internal pin number
-			AnalogGertboardInput* port = new AnalogGertboardInput(abstractOPDID, nodeName.c_str(), inputNumber);
+			AnalogGertboardInput* port = new AnalogGertboardInput(abstractOPDID, this->hardware, nodeName.c_str(), inputNumber);
 			// set default group: Gertboard's node's group
 			port->setGroup(group);
 			port->logVerbosity = opdid->getConfigLogVerbosity(portConfig, this->logVerbosity);
@@ -936,7 +1257,7 @@ void GertboardPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std
 			int internalPin = this->mapAndLockPin(18, nodeName);
 
 			// setup the port instance and add it; use internal pin number
-			GertboardPWM* port = new GertboardPWM(abstractOPDID, internalPin, nodeName.c_str(), inverse);
+			GertboardPWM* port = new GertboardPWM(abstractOPDID, this->hardware, internalPin, nodeName.c_str(), inverse);
 			// set default group: Gertboard's node's group
 			port->setGroup(group);
 			port->logVerbosity = opdid->getConfigLogVerbosity(portConfig, this->logVerbosity);
@@ -978,6 +1299,20 @@ void GertboardPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std
 					this->opdid->logVerbose(node + ": Port Expander initialization sequence successfully completed");
 					this->expanderInitialized = true;
 				}
+
+				// older firmware versions respond to the version code with the signal code
+				if (nodeConfig->getBool("ExpansionPortBatching", true)) {
+					this->sendExpansionPortCode(VERSIONCODE);
+					uint8_t version = SIGNALCODE;
+					try {
+						version = this->receiveExpansionPortCode();
+					} catch (...) {}
+					this->expanderBatching = (version != SIGNALCODE) && (version >= BATCH_PROTOCOL_VERSION);
+					if (this->expanderBatching)
+						this->opdid->logVerbose(node + ": Port Expander supports batched transfers; protocol version " + this->opdid->to_string((int)version));
+					else
+						this->opdid->logVerbose(node + ": Port Expander does not support batched transfers; please consider updating its firmware");
+				}
 			}
 
 			// read pin number
@@ -1021,6 +1356,16 @@ void GertboardPlugin::setupPlugin(opdid::AbstractOPDID* abstractOPDID, const std
 	this->opdid->logVerbose(node + ": GertboardPlugin setup completed successfully as node " + node);
 }
 
+void GertboardPlugin::startPlugin(void) {
+	if (this->gpioEvents != nullptr)
+		this->gpioEvents->start();
+}
+
+void GertboardPlugin::stopPlugin(void) {
+	if (this->gpioEvents != nullptr)
+		this->gpioEvents->stop();
+}
+
 void GertboardPlugin::masterConnected() {
 }
 
@@ -1028,46 +1373,160 @@ void GertboardPlugin::masterDisconnected() {
 }
 
 void GertboardPlugin::sendExpansionPortCode(uint8_t code){
-	if (uart0_filestream != -1) {
-		this->opdid->logDebug(this->nodeID + ": Sending expansion port control code: " + this->opdid->to_string((int)code));
+	this->opdid->logDebug(this->nodeID + ": Sending expansion port control code: " + this->opdid->to_string((int)code));
+
+	this->sendExpansionPortFrame(&code, 1);
+}
 
+uint8_t GertboardPlugin::receiveExpansionPortCode(void) {
+	uint8_t code;
+	this->receiveExpansionPortFrame(&code, 1);
+
+	this->opdid->logDebug(this->nodeID + ": Received expansion port return code: " + this->opdid->to_string((int)code));
+	return code;
+}
+
+void GertboardPlugin::sendExpansionPortFrame(const uint8_t* data, size_t length) {
+	if (uart0_filestream != -1) {
 		// flush the input buffer
-		uint8_t rx_buffer[1];
-		while (read(uart0_filestream, (void*)rx_buffer, 1) > 0);
-		int count = write(uart0_filestream, &code, 1);
+		uint8_t rx_buffer[16];
+		while (read(uart0_filestream, (void*)rx_buffer, sizeof(rx_buffer)) > 0);
+		int count = write(uart0_filestream, data, length);
 		if (count < 0)
 			throw opdi::Port::PortError(this->nodeID + ": Serial communication error while sending: " + this->opdid->to_string(errno));
+		if ((size_t)count < length)
+			throw opdi::Port::PortError(this->nodeID + ": Serial communication error while sending: Incomplete write");
 	} else
 		throw opdi::Port::PortError(this->nodeID + ": Serial communication not initialized");
 }
 
-uint8_t GertboardPlugin::receiveExpansionPortCode(void) {
+void GertboardPlugin::receiveExpansionPortFrame(uint8_t* data, size_t length) {
 	if (uart0_filestream != -1) {
-		uint8_t rx_buffer[1];
 		uint64_t ticks = opdi_get_time_ms();
-
-		int rx_length = 0;
-
-		while ((rx_length <= 0) && (opdi_get_time_ms() - ticks < this->serialTimeoutMs)) {
-			rx_length = read(uart0_filestream, (void*)rx_buffer, 1);
+		size_t received = 0;
+
+		while (received < length) {
+			uint64_t elapsed = opdi_get_time_ms() - ticks;
+			if (elapsed >= this->serialTimeoutMs)
+				throw opdi::Port::PortError(this->nodeID + ": Serial communication timeout");
+
+			// wait for the data instead of polling the device
+			struct pollfd pfd;
+			pfd.fd = uart0_filestream;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			int result = poll(&pfd, 1, (int)(this->serialTimeoutMs - elapsed));
+			if ((result < 0) && (errno != EINTR))
+				throw opdi::Port::PortError(this->nodeID + ": Serial communication error while receiving: " + this->opdid->to_string(errno));
+			if (result <= 0)
+				continue;
+
+			int rx_length = read(uart0_filestream, (void*)(data + received), length - received);
+			if ((rx_length < 0) && (errno != EAGAIN) && (errno != EINTR))
+				throw opdi::Port::PortError(this->nodeID + ": Serial communication error while receiving: " + this->opdid->to_string(errno));
+			if (rx_length > 0)
+				received += rx_length;
 		}
-		if (rx_length < 0)
-			throw opdi::Port::PortError(this->nodeID + ": Serial communication error while receiving: " + this->opdid->to_string(errno));
-		else if (rx_length == 0)
-			throw opdi::Port::PortError(this->nodeID + ": Serial communication timeout");
-
-		this->opdid->logDebug(this->nodeID + ": Received expansion port return code: " + this->opdid->to_string((int)rx_buffer[0]));
-		return rx_buffer[0];
 	} else
 		throw opdi::Port::PortError(this->nodeID + ": Serial communication not initialized");
 }
 
+void GertboardPlugin::setExpansionPortPin(uint8_t code) {
+	if (!this->expanderBatching) {
+		// exchange the code immediately
+		this->sendExpansionPortCode(code);
+		uint8_t returnCode = this->receiveExpansionPortCode();
+		if ((returnCode & PORTMASK) != (code & PORTMASK))
+			throw opdi::Port::PortError("Expansion port communication failure");
+		return;
+	}
+
+	int pin = code & PORTMASK;
+	uint16_t bit = (1 << pin);
+	this->expanderCodes[pin] = code;
+	this->expanderMask |= bit;
+	if ((code & (1 << OUTPUT)) == (1 << OUTPUT))
+		this->expanderOutputs |= bit;
+	else
+		this->expanderOutputs &= ~bit;
+	// the line state for outputs or the pullup flag for inputs
+	if ((code & ((1 << LINESTATE) | (1 << PULLUP))) != 0)
+		this->expanderValues |= bit;
+	else
+		this->expanderValues &= ~bit;
+}
+
+uint8_t GertboardPlugin::getExpansionPortLine(uint8_t code) {
+	if (!this->expanderBatching) {
+		// the expander configures the pin and returns its line state
+		this->sendExpansionPortCode(code);
+		uint8_t returnCode = this->receiveExpansionPortCode();
+
+		if ((returnCode & ~(1 << LINESTATE)) != code)
+			throw opdi::Port::PortError("Expansion port communication failure");
+
+		return ((returnCode & (1 << LINESTATE)) == (1 << LINESTATE) ? 1 : 0);
+	}
+
+	// configure the pin if necessary
+	int pin = code & PORTMASK;
+	if (this->expanderCodes[pin] != code)
+		this->setExpansionPortPin(code);
+
+	// read all pins once per frame, or again if the pin's configuration has been changed
+	if (!this->expanderLinesValid || (this->expanderLinesFrame != this->opdid->getCurrentFrame())
+		|| ((this->expanderMask & (1 << pin)) != 0))
+		this->transferExpansionPorts();
+
+	return (this->expanderLines >> pin) & 1;
+}
+
+void GertboardPlugin::transferExpansionPorts(void) {
+	uint8_t request[8];
+	request[0] = TRANSFERCODE;
+	request[1] = this->expanderMask & 0xff;
+	request[2] = this->expanderMask >> 8;
+	request[3] = this->expanderOutputs & 0xff;
+	request[4] = this->expanderOutputs >> 8;
+	request[5] = this->expanderValues & 0xff;
+	request[6] = this->expanderValues >> 8;
+	request[7] = 0;
+	for (size_t i = 0; i < sizeof(request) - 1; i++)
+		request[7] ^= request[i];
+
+	this->opdid->logDebug(this->nodeID + ": Transferring expansion port changes for pin mask: " + this->opdid->to_string((int)this->expanderMask));
+
+	this->sendExpansionPortFrame(request, sizeof(request));
+	uint8_t response[4];
+	// the expander answers a frame with an invalid checksum or request with the signal code only
+	this->receiveExpansionPortFrame(response, 1);
+	if (response[0] == SIGNALCODE)
+		throw opdi::Port::PortError(this->nodeID + ": Expansion port rejected the transfer frame (invalid checksum or request)");
+	if (response[0] != TRANSFERCODE)
+		throw opdi::Port::PortError(this->nodeID + ": Expansion port communication failure: Unexpected response code: " + this->opdid->to_string((int)response[0]));
+	this->receiveExpansionPortFrame(response + 1, sizeof(response) - 1);
+
+	if (response[3] != (response[0] ^ response[1] ^ response[2]))
+		throw opdi::Port::PortError(this->nodeID + ": Expansion port communication failure: Invalid response checksum");
+
+	// the changes have been applied
+	this->expanderMask = 0;
+	this->expanderLines = response[1] | (response[2] << 8);
+	this->expanderLinesFrame = this->opdid->getCurrentFrame();
+	this->expanderLinesValid = true;
+}
+
+void GertboardPlugin::flushExpansionPorts(void) {
+	if (this->expanderBatching && (this->expanderMask != 0))
+		this->transferExpansionPorts();
+}
+
 // plugin factory function
 extern "C" IOPDIDPlugin* GetOPDIDPluginInstance(int majorVersion, int minorVersion, int patchVersion) {
 
 	// check whether the version is supported
-	if ((majorVersion > 0) || (minorVersion > 1))
-		throw Poco::Exception("This version of the GertboardPlugin supports only OPDID versions up to 0.1");
+	if ((majorVersion > 0) || (minorVersion > 2))
+		throw Poco::Exception("This version of the GertboardPlugin supports only OPDID versions up to 0.2");
 
 	// return a new instance of this plugin
 	return new GertboardPlugin();
@@ -0,0 +1,369 @@
+#include "rpi_gpioevents.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <linux/gpio.h>
+
+#include "Poco/Exception.h"
+
+#include "AbstractOPDID.h"
+
+// the event thread checks for shutdown at least this often
+#define MAX_EVENT_WAIT_MS		100
+
+// accepted edges that have not been fetched by the port are dropped beyond this number
+#define MAX_PENDING_EDGES		256
+
+#define GPIO_CONSUMER_LABEL		"opdid"
+
+namespace rpi {
+
+static uint64_t monotonicNs(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Character Device GPIO Backend
+///////////////////////////////////////////////////////////////////////////////
+
+CharDeviceGPIOBackend::CharDeviceGPIOBackend(const std::string& chipPath) {
+	this->chipPath = chipPath;
+	this->chipFd = open(chipPath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (this->chipFd < 0)
+		throw Poco::OpenFileException("Unable to open GPIO chip: " + std::string(strerror(errno)), chipPath);
+}
+
+CharDeviceGPIOBackend::~CharDeviceGPIOBackend() {
+	close(this->chipFd);
+}
+
+int CharDeviceGPIOBackend::openLine(int pin, bool& level) {
+	struct gpioevent_request request;
+	memset(&request, 0, sizeof(request));
+	request.lineoffset = pin;
+	request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+	request.eventflags = GPIOEVENT_REQUEST_BOTH_EDGES;
+	strncpy(request.consumer_label, GPIO_CONSUMER_LABEL, sizeof(request.consumer_label) - 1);
+	if (ioctl(this->chipFd, GPIO_GET_LINEEVENT_IOCTL, &request) < 0)
+		throw Poco::IOException("Unable to request events for GPIO line " + std::to_string(pin) + " of " + this->chipPath + ": " + strerror(errno));
+
+	fcntl(request.fd, F_SETFL, fcntl(request.fd, F_GETFL) | O_NONBLOCK);
+
+	struct gpiohandle_data data;
+	memset(&data, 0, sizeof(data));
+	if (ioctl(request.fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) < 0) {
+		int error = errno;
+		close(request.fd);
+		throw Poco::IOException("Unable to read GPIO line " + std::to_string(pin) + " of " + this->chipPath + ": " + strerror(error));
+	}
+	level = (data.values[0] != 0);
+
+	return request.fd;
+}
+
+void CharDeviceGPIOBackend::readEdges(int /*pin*/, int fd, std::vector<GPIOEdge>& edges) {
+	struct gpioevent_data events[16];
+	while (true) {
+		ssize_t bytes = read(fd, events, sizeof(events));
+		if (bytes <= 0)
+			return;
+		for (size_t i = 0; i < bytes / sizeof(struct gpioevent_data); i++) {
+			GPIOEdge edge;
+			edge.rising = (events[i].id == GPIOEVENT_EVENT_RISING_EDGE);
+			edge.timestampNs = events[i].timestamp;
+			edges.push_back(edge);
+		}
+	}
+}
+
+void CharDeviceGPIOBackend::closeLine(int /*pin*/, int fd) {
+	close(fd);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Simulated GPIO Backend
+///////////////////////////////////////////////////////////////////////////////
+
+SimulatedGPIOBackend::~SimulatedGPIOBackend() {
+	for (auto it = this->lines.begin(), ite = this->lines.end(); it != ite; ++it) {
+		close(it->second.readFd);
+		close(it->second.writeFd);
+	}
+}
+
+void SimulatedGPIOBackend::setLevel(int pin, bool level, uint64_t timestampNs) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+
+	bool& current = this->levels[pin];
+	if (current == level)
+		return;
+	current = level;
+
+	auto it = this->lines.find(pin);
+	if (it == this->lines.end())
+		return;
+
+	GPIOEdge edge;
+	edge.rising = level;
+	edge.timestampNs = (timestampNs > 0 ? timestampNs : monotonicNs());
+	// like the kernel's event buffer, the socket drops edges when it is full
+	send(it->second.writeFd, &edge, sizeof(edge), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+int SimulatedGPIOBackend::openLine(int pin, bool& level) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+
+	if (this->lines.find(pin) != this->lines.end())
+		throw Poco::IOException("Simulated GPIO line is already in use: " + std::to_string(pin));
+
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) < 0)
+		throw Poco::IOException("Unable to create socket pair for simulated GPIO line " + std::to_string(pin) + ": " + strerror(errno));
+
+	Line line;
+	line.readFd = fds[0];
+	line.writeFd = fds[1];
+	this->lines[pin] = line;
+
+	level = this->levels[pin];
+	return line.readFd;
+}
+
+void SimulatedGPIOBackend::readEdges(int /*pin*/, int fd, std::vector<GPIOEdge>& edges) {
+	GPIOEdge edge;
+	while (recv(fd, &edge, sizeof(edge), MSG_DONTWAIT) == sizeof(edge))
+		edges.push_back(edge);
+}
+
+void SimulatedGPIOBackend::closeLine(int pin, int /*fd*/) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+
+	auto it = this->lines.find(pin);
+	if (it == this->lines.end())
+		return;
+	close(it->second.readFd);
+	close(it->second.writeFd);
+	this->lines.erase(it);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// GPIO Event Monitor
+///////////////////////////////////////////////////////////////////////////////
+
+GPIOEventMonitor::GPIOEventMonitor(opdid::AbstractOPDID* opdid, GPIOEventBackend* backend) : stopping(false) {
+	this->opdid = opdid;
+	this->backend = backend;
+	this->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (this->wakeFd < 0)
+		throw Poco::SystemException(std::string("Unable to create eventfd for the GPIO event thread: ") + strerror(errno));
+}
+
+GPIOEventMonitor::~GPIOEventMonitor() {
+	this->stop();
+	for (auto it = this->lines.begin(), ite = this->lines.end(); it != ite; ++it)
+		this->backend->closeLine(it->first, it->second.fd);
+	delete this->backend;
+	close(this->wakeFd);
+}
+
+void GPIOEventMonitor::wakeUp(void) {
+	uint64_t value = 1;
+	if (write(this->wakeFd, &value, sizeof(value)) < 0) {
+		// the counter is already set; the thread will wake up anyway
+	}
+}
+
+void GPIOEventMonitor::start(void) {
+	if (this->thread.isRunning())
+		return;
+	this->stopping = false;
+	this->thread.setName("GPIO event thread");
+	this->thread.start(*this);
+}
+
+void GPIOEventMonitor::stop(void) {
+	this->stopping = true;
+	this->wakeUp();
+	if (this->thread.isRunning())
+		this->thread.join();
+}
+
+void GPIOEventMonitor::watch(int pin, int debounceMs) {
+	if (debounceMs < 0)
+		throw Poco::InvalidArgumentException("The debounce time must not be negative: " + std::to_string(debounceMs));
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+
+		auto it = this->lines.find(pin);
+		if (it != this->lines.end()) {
+			it->second.debounceNs = (uint64_t)debounceMs * 1000000;
+			return;
+		}
+
+		Line line;
+		line.fd = this->backend->openLine(pin, line.level);
+		line.debounceNs = (uint64_t)debounceMs * 1000000;
+		line.rawLevel = line.level;
+		line.rawTimestampNs = 0;
+		line.stableTimeNs = 0;
+		this->lines[pin] = line;
+	}
+
+	this->wakeUp();
+}
+
+void GPIOEventMonitor::unwatch(int pin) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+
+	auto it = this->lines.find(pin);
+	if (it == this->lines.end())
+		return;
+	this->backend->closeLine(pin, it->second.fd);
+	this->lines.erase(it);
+	this->wakeUp();
+}
+
+bool GPIOEventMonitor::isWatched(int pin) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+
+	return this->lines.find(pin) != this->lines.end();
+}
+
+bool GPIOEventMonitor::getLevel(int pin) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+
+	auto it = this->lines.find(pin);
+	if (it == this->lines.end())
+		throw Poco::InvalidAccessException("GPIO line is not watched: " + std::to_string(pin));
+	return it->second.level;
+}
+
+bool GPIOEventMonitor::fetchEdges(int pin, std::vector<GPIOEdge>& edges) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+
+	auto it = this->lines.find(pin);
+	if ((it == this->lines.end()) || it->second.edges.empty())
+		return false;
+	edges.insert(edges.end(), it->second.edges.begin(), it->second.edges.end());
+	it->second.edges.clear();
+	return true;
+}
+
+void GPIOEventMonitor::processEdges(Line& line, const std::vector<GPIOEdge>& edges, uint64_t now) {
+	for (auto it = edges.begin(), ite = edges.end(); it != ite; ++it) {
+		line.rawLevel = it->rising;
+		line.rawTimestampNs = it->timestampNs;
+		if (line.debounceNs > 0) {
+			// wait until the line has been stable for the debounce time
+			line.stableTimeNs = now + line.debounceNs;
+			continue;
+		}
+		if (line.rawLevel != line.level) {
+			line.level = line.rawLevel;
+			if (line.edges.size() < MAX_PENDING_EDGES)
+				line.edges.push_back(*it);
+		}
+	}
+}
+
+uint64_t GPIOEventMonitor::processDeadlines(uint64_t now) {
+	uint64_t next = 0;
+	for (auto it = this->lines.begin(), ite = this->lines.end(); it != ite; ++it) {
+		Line& line = it->second;
+		if (line.stableTimeNs == 0)
+			continue;
+		if (now < line.stableTimeNs) {
+			if ((next == 0) || (line.stableTimeNs < next))
+				next = line.stableTimeNs;
+			continue;
+		}
+		line.stableTimeNs = 0;
+		// a pulse that is shorter than the debounce time is ignored
+		if (line.rawLevel != line.level) {
+			line.level = line.rawLevel;
+			GPIOEdge edge;
+			edge.rising = line.rawLevel;
+			edge.timestampNs = line.rawTimestampNs;
+			if (line.edges.size() < MAX_PENDING_EDGES)
+				line.edges.push_back(edge);
+		}
+	}
+	return next;
+}
+
+void GPIOEventMonitor::run(void) {
+	std::vector<struct pollfd> pollFds;
+	std::vector<int> pollPins;
+	std::vector<GPIOEdge> edges;
+
+	while (!this->stopping && !this->opdid->shutdownRequested) {
+		pollFds.clear();
+		pollPins.clear();
+		struct pollfd wakePfd;
+		wakePfd.fd = this->wakeFd;
+		wakePfd.events = POLLIN;
+		wakePfd.revents = 0;
+		pollFds.push_back(wakePfd);
+		pollPins.push_back(-1);
+
+		int timeout = MAX_EVENT_WAIT_MS;
+		{
+			Poco::Mutex::ScopedLock lock(this->mutex);
+			for (auto it = this->lines.begin(), ite = this->lines.end(); it != ite; ++it) {
+				struct pollfd pfd;
+				pfd.fd = it->second.fd;
+				pfd.events = POLLIN;
+				pfd.revents = 0;
+				pollFds.push_back(pfd);
+				pollPins.push_back(it->first);
+			}
+			uint64_t now = monotonicNs();
+			uint64_t next = this->processDeadlines(now);
+			if ((next > 0) && ((next - now) / 1000000 < MAX_EVENT_WAIT_MS))
+				// round up so that the deadline has passed when the thread wakes up
+				timeout = (int)((next - now + 999999) / 1000000);
+		}
+
+		int result = poll(pollFds.data(), pollFds.size(), timeout);
+		if (result < 0) {
+			if (errno == EINTR)
+				continue;
+			this->opdid->logNormal(std::string("GPIO event thread: poll failed: ") + strerror(errno));
+			usleep(MAX_EVENT_WAIT_MS * 1000);
+			continue;
+		}
+
+		if (pollFds[0].revents & POLLIN) {
+			uint64_t value;
+			if (read(this->wakeFd, &value, sizeof(value)) < 0) {
+				// already reset
+			}
+		}
+
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		uint64_t now = monotonicNs();
+		for (size_t i = 1; i < pollFds.size(); i++) {
+			if (pollFds[i].revents == 0)
+				continue;
+			// the line may have been released or requested again in the meantime
+			auto it = this->lines.find(pollPins[i]);
+			if ((it == this->lines.end()) || (it->second.fd != pollFds[i].fd))
+				continue;
+			edges.clear();
+			this->backend->readEdges(it->first, it->second.fd, edges);
+			this->processEdges(it->second, edges, now);
+		}
+		this->processDeadlines(now);
+	}
+}
+
+}		// namespace rpi
@@ -0,0 +1,176 @@
+#ifndef __RPI_GPIOEVENTS_H
+#define __RPI_GPIOEVENTS_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <stdint.h>
+
+#include "Poco/Mutex.h"
+#include "Poco/Thread.h"
+#include "Poco/Runnable.h"
+
+namespace opdid {
+	class AbstractOPDID;
+}
+
+namespace rpi {
+
+/** A level change of a GPIO input line. */
+struct GPIOEdge {
+	bool rising;
+	uint64_t timestampNs;		// as reported by the backend
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// GPIO Event Backend
+///////////////////////////////////////////////////////////////////////////////
+
+/** A source of edge events of GPIO input lines.
+*   openLine and closeLine are called on the main thread; readEdges is called
+*   on the event thread. Calls are serialized by the GPIOEventMonitor.
+*/
+class GPIOEventBackend {
+public:
+	virtual ~GPIOEventBackend() {};
+
+	/** Requests the line as an input and starts edge detection. Returns a file descriptor
+	* that becomes readable when edges are available, and the current level of the line.
+	* Throws an exception if the line cannot be requested. */
+	virtual int openLine(int pin, bool& level) = 0;
+
+	/** Appends the available edges of the line. Does not block. */
+	virtual void readEdges(int pin, int fd, std::vector<GPIOEdge>& edges) = 0;
+
+	/** Stops edge detection and releases the line. */
+	virtual void closeLine(int pin, int fd) = 0;
+};
+
+/** Uses the line event interface of the GPIO character device (/dev/gpiochipN).
+*   The pin numbers are the line offsets of the chip which are the BCM GPIO numbers
+*   for gpiochip0 on the Raspberry Pi.
+*/
+class CharDeviceGPIOBackend : public GPIOEventBackend {
+protected:
+	std::string chipPath;
+	int chipFd;
+
+public:
+	CharDeviceGPIOBackend(const std::string& chipPath);
+
+	virtual ~CharDeviceGPIOBackend();
+
+	virtual int openLine(int pin, bool& level) override;
+	virtual void readEdges(int pin, int fd, std::vector<GPIOEdge>& edges) override;
+	virtual void closeLine(int pin, int fd) override;
+};
+
+/** Simulates GPIO lines without hardware. Edges are delivered through a socket pair per line,
+*   so they pass through the same event thread code as real line events.
+*/
+class SimulatedGPIOBackend : public GPIOEventBackend {
+protected:
+	struct Line {
+		int readFd;
+		int writeFd;
+	};
+
+	Poco::Mutex mutex;		// protects the members below
+	std::map<int, bool> levels;
+	std::map<int, Line> lines;
+
+public:
+	virtual ~SimulatedGPIOBackend();
+
+	/** Changes the level of the line. If the level changes and the line is open, an edge
+	* with the specified timestamp is delivered. A timestamp of 0 means the current time.
+	* May be called from any thread. */
+	virtual void setLevel(int pin, bool level, uint64_t timestampNs = 0);
+
+	virtual int openLine(int pin, bool& level) override;
+	virtual void readEdges(int pin, int fd, std::vector<GPIOEdge>& edges) override;
+	virtual void closeLine(int pin, int fd) override;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// GPIO Event Monitor
+///////////////////////////////////////////////////////////////////////////////
+
+/** The GPIOEventMonitor detects level changes of GPIO input lines on an event thread,
+*   so that short pulses are not missed between two frames and idle lines do not need
+*   to be polled. Edges are debounced per line: a new level is accepted when the line
+*   has been stable for the debounce time. The accepted edges, with the timestamp of
+*   the edge that started the stable period, are queued until the port fetches them.
+*   The event thread runs between start() and stop(); while it is stopped, the lines
+*   keep the level that they had when they were opened.
+*   All public methods must be called on the main thread.
+*/
+class GPIOEventMonitor : protected Poco::Runnable {
+protected:
+	struct Line {
+		int fd;
+		uint64_t debounceNs;
+		bool level;					// debounced level
+		bool rawLevel;				// level after the last edge
+		uint64_t rawTimestampNs;	// timestamp of the last edge
+		uint64_t stableTimeNs;		// monotonic time when rawLevel is accepted; 0 if nothing is pending
+		std::vector<GPIOEdge> edges;	// accepted edges that have not yet been fetched
+	};
+
+	opdid::AbstractOPDID* opdid;
+	GPIOEventBackend* backend;
+
+	Poco::Thread thread;
+	std::atomic<bool> stopping;
+	int wakeFd;
+
+	Poco::Mutex mutex;		// protects the lines and the backend
+	std::map<int, Line> lines;		// by pin
+
+	/** Event thread method. */
+	virtual void run(void) override;
+
+	/** Wakes up the event thread so that it updates its set of file descriptors. */
+	void wakeUp(void);
+
+	/** Processes the raw edges of the line. Requires the lock. */
+	void processEdges(Line& line, const std::vector<GPIOEdge>& edges, uint64_t now);
+
+	/** Accepts pending levels that have become stable. Requires the lock.
+	* Returns the monotonic time of the next pending decision, or 0. */
+	uint64_t processDeadlines(uint64_t now);
+
+public:
+	/** The monitor takes ownership of the backend. */
+	GPIOEventMonitor(opdid::AbstractOPDID* opdid, GPIOEventBackend* backend);
+
+	/** Stops the event thread, releases the lines and deletes the backend. */
+	virtual ~GPIOEventMonitor();
+
+	/** Starts the event thread. Has no effect if it is already running. */
+	virtual void start(void);
+
+	/** Stops and joins the event thread. The lines remain watched. */
+	virtual void stop(void);
+
+	/** Starts detecting edges of the line, or changes the debounce time if the line is
+	* already watched. */
+	virtual void watch(int pin, int debounceMs);
+
+	/** Stops detecting edges of the line and releases it. Pending edges are discarded. */
+	virtual void unwatch(int pin);
+
+	virtual bool isWatched(int pin);
+
+	/** Returns the debounced level of a watched line. */
+	virtual bool getLevel(int pin);
+
+	/** Appends the accepted edges of the line that have occurred since the last call.
+	* Returns true if there were any. */
+	virtual bool fetchEdges(int pin, std::vector<GPIOEdge>& edges);
+};
+
+}		// namespace rpi
+
+#endif
@@ -0,0 +1,618 @@
+#include "rpi_hal.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#include "Poco/Exception.h"
+#include "Poco/NumberParser.h"
+
+#include "AbstractOPDID.h"
+
+// the serial thread checks for shutdown at least this often
+#define MAX_SERIAL_WAIT_MS		100
+
+// the simulation sleeps until shortly before the end of a delay and waits actively for the rest
+#define SPIN_MARGIN_US			100
+
+// port expander protocol (see gertboard/AtmegaPortExpander/Main.c)
+#define PE_OUTPUT			6
+#define PE_PULLUP			5
+#define PE_LINESTATE		4
+#define PE_PORTMASK			0x0f
+#define PE_SIGNALCODE		0xff
+#define PE_VERSIONCODE		0xe0
+#define PE_TRANSFERCODE		0xe1
+#define PE_DEACTIVATE		128
+#define PE_MAGIC			"OPDIDGBPEINIT"
+#define PE_PROTOCOL_VERSION	2
+
+namespace rpi {
+
+///////////////////////////////////////////////////////////////////////////////
+// Simulation Clocks
+///////////////////////////////////////////////////////////////////////////////
+
+uint64_t RealTimeClock::nowNs(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void RealTimeClock::delayUs(int us) {
+	if (us <= 0)
+		return;
+	uint64_t deadline = this->nowNs() + (uint64_t)us * 1000;
+	if (us > SPIN_MARGIN_US)
+		usleep(us - SPIN_MARGIN_US);
+	while (this->nowNs() < deadline);
+}
+
+VirtualClock::VirtualClock(uint64_t startNs) : timeNs(startNs > 0 ? startNs : 1) {
+}
+
+uint64_t VirtualClock::nowNs(void) {
+	return this->timeNs;
+}
+
+void VirtualClock::delayUs(int us) {
+	if (us > 0)
+		this->timeNs += (uint64_t)us * 1000;
+}
+
+void VirtualClock::advanceUs(uint64_t us) {
+	this->timeNs += us * 1000;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Hardware
+///////////////////////////////////////////////////////////////////////////////
+
+void Hardware::setPinMode(int /*pin*/, PinMode /*mode*/) {
+	throw Poco::NotImplementedException("This hardware does not support setting the pin mode");
+}
+
+void Hardware::setPull(int /*pin*/, Pull /*pull*/) {
+	throw Poco::NotImplementedException("This hardware does not support pull resistors");
+}
+
+void Hardware::writePin(int /*pin*/, bool /*level*/) {
+	throw Poco::NotImplementedException("This hardware does not support writing pins");
+}
+
+bool Hardware::readPin(int /*pin*/) {
+	throw Poco::NotImplementedException("This hardware does not support reading pins");
+}
+
+GPIOEventBackend* Hardware::createGPIOEventBackend(const std::string& chipPath) {
+	return new CharDeviceGPIOBackend(chipPath);
+}
+
+void Hardware::setupSPI(void) {
+	throw Poco::NotImplementedException("This hardware does not support SPI");
+}
+
+int Hardware::readADC(int /*channel*/) {
+	throw Poco::NotImplementedException("This hardware does not support A/D conversion");
+}
+
+void Hardware::writeDAC(int /*channel*/, int /*value*/) {
+	throw Poco::NotImplementedException("This hardware does not support D/A conversion");
+}
+
+void Hardware::setupPWM(void) {
+	throw Poco::NotImplementedException("This hardware does not support PWM");
+}
+
+void Hardware::setPWM(int /*value*/, bool /*inverse*/) {
+	throw Poco::NotImplementedException("This hardware does not support PWM");
+}
+
+void Hardware::stopPWM(void) {
+	throw Poco::NotImplementedException("This hardware does not support PWM");
+}
+
+int Hardware::openSerial(const std::string& device, int /*baudRate*/) {
+	throw Poco::NotImplementedException("This hardware does not support serial devices", device);
+}
+
+void Hardware::closeSerial(int fd) {
+	close(fd);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Simulated Hardware
+///////////////////////////////////////////////////////////////////////////////
+
+/** Passes the calls of a GPIO event monitor to the simulated lines. */
+class SimulatedEventBackend : public GPIOEventBackend {
+protected:
+	SimulatedGPIOBackend* lines;
+
+public:
+	SimulatedEventBackend(SimulatedGPIOBackend* lines) {
+		this->lines = lines;
+	}
+
+	virtual int openLine(int pin, bool& level) override {
+		return this->lines->openLine(pin, level);
+	}
+
+	virtual void readEdges(int pin, int fd, std::vector<GPIOEdge>& edges) override {
+		this->lines->readEdges(pin, fd, edges);
+	}
+
+	virtual void closeLine(int pin, int fd) override {
+		this->lines->closeLine(pin, fd);
+	}
+};
+
+SimulatedHardware::SimulatedHardware(opdid::AbstractOPDID* opdid, SimulationClock* clock) : stopping(false) {
+	this->opdid = opdid;
+	this->clock = (clock != nullptr ? clock : new RealTimeClock());
+	this->startTimeNs = this->clock->nowNs();
+	this->adcValues[0] = this->adcValues[1] = 0;
+	this->dacValues[0] = this->dacValues[1] = 0;
+	this->spiLatencyUs = 30;
+	this->pwmValue = 0;
+	this->pwmEnabled = false;
+	this->serialLatencyUs = 100;
+	this->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (this->wakeFd < 0)
+		throw Poco::SystemException(std::string("Unable to create eventfd for the simulation: ") + strerror(errno));
+}
+
+SimulatedHardware::~SimulatedHardware() {
+	this->stopping = true;
+	uint64_t value = 1;
+	if (write(this->wakeFd, &value, sizeof(value)) < 0) {
+		// the thread will wake up anyway
+	}
+	if (this->serialThread.isRunning())
+		this->serialThread.join();
+	for (auto it = this->serialLines.begin(), ite = this->serialLines.end(); it != ite; ++it) {
+		close(it->second.simFd);
+		close(it->first);
+	}
+	for (auto it = this->peripherals.begin(), ite = this->peripherals.end(); it != ite; ++it)
+		delete it->second;
+	close(this->wakeFd);
+	delete this->clock;
+}
+
+void SimulatedHardware::configure(Poco::Util::AbstractConfiguration* config) {
+	std::string clockType = config->getString("Clock", "Real");
+	if (clockType == "Virtual") {
+		// the simulation has not been used yet
+		delete this->clock;
+		this->clock = new VirtualClock();
+		this->startTimeNs = this->clock->nowNs();
+	} else
+	if (clockType != "Real")
+		throw Poco::DataException("Invalid value for Clock: Expected 'Real' or 'Virtual': " + clockType);
+
+	std::string traceFile = config->getString("Trace", "");
+	if (!traceFile.empty()) {
+		this->trace.open(traceFile.c_str(), std::ios::out | std::ios::trunc);
+		if (!this->trace.is_open())
+			throw Poco::OpenFileException("Unable to open the simulation trace file", traceFile);
+		this->trace << "time_us,event,channel,value" << std::endl;
+	}
+
+	this->spiLatencyUs = config->getInt("SPILatency", this->spiLatencyUs);
+	if (this->spiLatencyUs < 0)
+		throw Poco::DataException("SPILatency must not be negative: " + std::to_string(this->spiLatencyUs));
+	this->serialLatencyUs = config->getInt("SerialLatency", this->serialLatencyUs);
+	if (this->serialLatencyUs < 0)
+		throw Poco::DataException("SerialLatency must not be negative: " + std::to_string(this->serialLatencyUs));
+	this->adcValues[0] = config->getInt("ADC0", this->adcValues[0]);
+	this->adcValues[1] = config->getInt("ADC1", this->adcValues[1]);
+
+	Poco::Util::AbstractConfiguration::Keys keys;
+	config->keys("", keys);
+	for (auto it = keys.begin(), ite = keys.end(); it != ite; ++it) {
+		int pin;
+		if ((it->compare(0, 4, "GPIO") == 0) && Poco::NumberParser::tryParse(it->substr(4), pin))
+			this->setInput(pin, config->getInt(*it, 0) != 0);
+	}
+}
+
+SimulationClock* SimulatedHardware::getClock(void) {
+	return this->clock;
+}
+
+void SimulatedHardware::attachSerialPeripheral(const std::string& device, SerialPeripheral* peripheral) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+
+	auto it = this->peripherals.find(device);
+	if (it != this->peripherals.end())
+		delete it->second;
+	this->peripherals[device] = peripheral;
+}
+
+void SimulatedHardware::traceEvent(const char* event, const std::string& channel, int64_t value, uint64_t timeNs) {
+	// the file is opened before the simulation is used
+	if (!this->trace.is_open())
+		return;
+	uint64_t time = ((timeNs > 0 ? timeNs : this->clock->nowNs()) - this->startTimeNs) / 1000;
+
+	Poco::Mutex::ScopedLock lock(this->traceMutex);
+	this->trace << time << ',' << event << ',' << channel << ',' << value << '\n';
+}
+
+bool SimulatedHardware::getInputLevel(int pin) {
+	auto mode = this->pinModes.find(pin);
+	if ((mode != this->pinModes.end()) && (mode->second == PIN_OUTPUT))
+		return this->outputs[pin];
+	auto input = this->inputs.find(pin);
+	if (input != this->inputs.end())
+		return input->second;
+	auto pull = this->pulls.find(pin);
+	return (pull != this->pulls.end()) && (pull->second == PULL_UP);
+}
+
+void SimulatedHardware::updateEventBackend(int pin) {
+	this->eventLines.setLevel(pin, this->getInputLevel(pin), this->clock->nowNs());
+}
+
+void SimulatedHardware::setInput(int pin, bool level) {
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		this->inputs[pin] = level;
+		this->updateEventBackend(pin);
+	}
+	this->traceEvent("gpio_in", std::to_string(pin), level ? 1 : 0);
+}
+
+void SimulatedHardware::releaseInput(int pin) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+	this->inputs.erase(pin);
+	this->updateEventBackend(pin);
+}
+
+void SimulatedHardware::setADC(int channel, int value) {
+	if ((channel < 0) || (channel > 1))
+		throw Poco::InvalidArgumentException("Invalid ADC channel: " + std::to_string(channel));
+	Poco::Mutex::ScopedLock lock(this->mutex);
+	this->adcValues[channel] = value;
+}
+
+int SimulatedHardware::getDAC(int channel) {
+	if ((channel < 0) || (channel > 1))
+		throw Poco::InvalidArgumentException("Invalid DAC channel: " + std::to_string(channel));
+	Poco::Mutex::ScopedLock lock(this->mutex);
+	return this->dacValues[channel];
+}
+
+int SimulatedHardware::getPWM(void) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+	return (this->pwmEnabled ? this->pwmValue : 0);
+}
+
+void SimulatedHardware::setPinMode(int pin, PinMode mode) {
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		this->pinModes[pin] = mode;
+		this->updateEventBackend(pin);
+	}
+	this->traceEvent("gpio_mode", std::to_string(pin), mode);
+}
+
+void SimulatedHardware::setPull(int pin, Pull pull) {
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		this->pulls[pin] = pull;
+		this->updateEventBackend(pin);
+	}
+	this->traceEvent("gpio_pull", std::to_string(pin), pull);
+}
+
+void SimulatedHardware::writePin(int pin, bool level) {
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		this->outputs[pin] = level;
+	}
+	this->traceEvent("gpio_out", std::to_string(pin), level ? 1 : 0);
+}
+
+bool SimulatedHardware::readPin(int pin) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+	return this->getInputLevel(pin);
+}
+
+GPIOEventBackend* SimulatedHardware::createGPIOEventBackend(const std::string& /*chipPath*/) {
+	// the monitor owns the returned backend; the lines remain with the simulation
+	return new SimulatedEventBackend(&this->eventLines);
+}
+
+void SimulatedHardware::setupSPI(void) {
+	this->traceEvent("spi_setup", "0", 0);
+}
+
+int SimulatedHardware::readADC(int channel) {
+	if ((channel < 0) || (channel > 1))
+		throw Poco::InvalidArgumentException("Invalid ADC channel: " + std::to_string(channel));
+	this->clock->delayUs(this->spiLatencyUs);
+	int value;
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		value = this->adcValues[channel];
+	}
+	this->traceEvent("adc", std::to_string(channel), value);
+	return value;
+}
+
+void SimulatedHardware::writeDAC(int channel, int value) {
+	if ((channel < 0) || (channel > 1))
+		throw Poco::InvalidArgumentException("Invalid DAC channel: " + std::to_string(channel));
+	this->clock->delayUs(this->spiLatencyUs);
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		this->dacValues[channel] = value;
+	}
+	this->traceEvent("dac", std::to_string(channel), value);
+}
+
+void SimulatedHardware::setupPWM(void) {
+	this->traceEvent("pwm_setup", "0", 0);
+}
+
+void SimulatedHardware::setPWM(int value, bool inverse) {
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		this->pwmValue = value;
+		this->pwmEnabled = true;
+	}
+	this->traceEvent("pwm", inverse ? "0i" : "0", value);
+}
+
+void SimulatedHardware::stopPWM(void) {
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+		this->pwmEnabled = false;
+	}
+	this->traceEvent("pwm_off", "0", 0);
+}
+
+int SimulatedHardware::openSerial(const std::string& device, int baudRate) {
+	if (baudRate <= 0)
+		throw Poco::InvalidArgumentException("Invalid baud rate: " + std::to_string(baudRate));
+	int fd;
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+
+		auto it = this->peripherals.find(device);
+		if (it == this->peripherals.end())
+			throw Poco::OpenFileException("No simulated peripheral is attached to the serial device", device);
+
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) < 0)
+			throw Poco::IOException("Unable to create socket pair for the simulated serial device " + device + ": " + strerror(errno));
+
+		SerialLine line;
+		line.device = device;
+		line.simFd = fds[1];
+		line.baudRate = baudRate;
+		line.peripheral = it->second;
+		this->serialLines[fds[0]] = line;
+		fd = fds[0];
+	}
+	this->traceEvent("serial_open", device, baudRate);
+
+	if (!this->serialThread.isRunning()) {
+		this->serialThread.setName("Simulated serial thread");
+		this->serialThread.start(*this);
+	} else {
+		uint64_t value = 1;
+		if (write(this->wakeFd, &value, sizeof(value)) < 0) {
+			// the thread will wake up anyway
+		}
+	}
+	return fd;
+}
+
+void SimulatedHardware::closeSerial(int fd) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+
+	auto it = this->serialLines.find(fd);
+	if (it == this->serialLines.end())
+		return;
+	close(it->second.simFd);
+	this->serialLines.erase(it);
+	close(fd);
+}
+
+void SimulatedHardware::run(void) {
+	std::vector<struct pollfd> pollFds;
+	std::vector<uint8_t> request;
+	std::vector<uint8_t> response;
+
+	while (!this->stopping && !this->opdid->shutdownRequested) {
+		pollFds.clear();
+		struct pollfd pfd;
+		pfd.fd = this->wakeFd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		pollFds.push_back(pfd);
+		{
+			Poco::Mutex::ScopedLock lock(this->mutex);
+			for (auto it = this->serialLines.begin(), ite = this->serialLines.end(); it != ite; ++it) {
+				pfd.fd = it->second.simFd;
+				pollFds.push_back(pfd);
+			}
+		}
+
+		int result = poll(pollFds.data(), pollFds.size(), MAX_SERIAL_WAIT_MS);
+		if (result <= 0)
+			continue;
+
+		if (pollFds[0].revents & POLLIN) {
+			uint64_t value;
+			if (read(this->wakeFd, &value, sizeof(value)) < 0) {
+				// already reset
+			}
+		}
+
+		for (size_t i = 1; i < pollFds.size(); i++) {
+			if (pollFds[i].revents == 0)
+				continue;
+
+			// the line may have been closed in the meantime
+			SerialLine line;
+			bool found = false;
+			{
+				Poco::Mutex::ScopedLock lock(this->mutex);
+				for (auto it = this->serialLines.begin(), ite = this->serialLines.end(); it != ite; ++it) {
+					if (it->second.simFd == pollFds[i].fd) {
+						line = it->second;
+						found = true;
+						break;
+					}
+				}
+			}
+			if (!found)
+				continue;
+
+			request.clear();
+			uint8_t buffer[64];
+			ssize_t bytes;
+			while ((bytes = read(line.simFd, buffer, sizeof(buffer))) > 0)
+				request.insert(request.end(), buffer, buffer + bytes);
+			if (request.empty())
+				continue;
+
+			// one start bit, eight data bits and one stop bit per byte
+			int byteTimeUs = 10 * 1000000 / line.baudRate;
+
+			// each byte takes its transmission time, independent of how the bytes are
+			// split into reads, so that the timing does not depend on the scheduling
+			uint64_t receivedNs = this->clock->nowNs();
+			response.clear();
+			for (auto it = request.begin(), ite = request.end(); it != ite; ++it) {
+				receivedNs += (uint64_t)byteTimeUs * 1000;
+				this->traceEvent("serial_rx", line.device, *it, receivedNs);
+				line.peripheral->receive(*it, response);
+			}
+			int delayUs = (int)request.size() * byteTimeUs;
+			if (!response.empty())
+				delayUs += (int)response.size() * byteTimeUs + this->serialLatencyUs;
+			this->clock->delayUs(delayUs);
+			if (response.empty())
+				continue;
+
+			for (auto it = response.begin(), ite = response.end(); it != ite; ++it)
+				this->traceEvent("serial_tx", line.device, *it);
+			if (send(line.simFd, response.data(), response.size(), MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+				this->opdid->logNormal("Simulation: Unable to send the response of the serial peripheral on " + line.device + ": " + strerror(errno));
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Simulated Port Expander
+///////////////////////////////////////////////////////////////////////////////
+
+SimulatedPortExpander::SimulatedPortExpander(uint16_t driven, uint16_t lines) {
+	this->externalDriven = driven;
+	this->externalLines = lines;
+	this->ddr = 0;
+	this->port = 0;
+	this->activated = false;
+	this->magicPos = 0;
+	this->inFrame = false;
+}
+
+uint16_t SimulatedPortExpander::readLines(void) {
+	// inputs read the external level if driven, otherwise the pullup state
+	uint16_t inputs = (this->externalDriven & this->externalLines) | (~this->externalDriven & this->port);
+	return (this->ddr & this->port) | (~this->ddr & inputs);
+}
+
+void SimulatedPortExpander::configurePort(int pin, bool output, bool value) {
+	uint16_t bit = (1 << pin);
+	this->ddr = (output ? this->ddr | bit : this->ddr & ~bit);
+	this->port = (value ? this->port | bit : this->port & ~bit);
+}
+
+void SimulatedPortExpander::receive(uint8_t data, std::vector<uint8_t>& response) {
+	if (this->inFrame) {
+		this->frame.push_back(data);
+		if (this->frame.size() < 7)
+			return;
+		this->inFrame = false;
+
+		uint8_t checksum = PE_TRANSFERCODE;
+		for (size_t i = 0; i < 6; i++)
+			checksum ^= this->frame[i];
+		if (checksum != this->frame[6]) {
+			response.push_back(PE_SIGNALCODE);
+			return;
+		}
+		uint16_t mask = this->frame[0] | (this->frame[1] << 8);
+		uint16_t output = this->frame[2] | (this->frame[3] << 8);
+		uint16_t value = this->frame[4] | (this->frame[5] << 8);
+		for (int i = 0; i < 16; i++)
+			if (mask & (1 << i))
+				this->configurePort(i, (output >> i) & 1, (value >> i) & 1);
+		uint16_t lines = this->readLines();
+		response.push_back(PE_TRANSFERCODE);
+		response.push_back(lines & 0xff);
+		response.push_back(lines >> 8);
+		response.push_back(PE_TRANSFERCODE ^ (lines & 0xff) ^ (lines >> 8));
+		return;
+	}
+
+	if (!this->activated) {
+		// the magic string includes the terminating zero
+		if (data == (uint8_t)PE_MAGIC[this->magicPos]) {
+			this->magicPos++;
+			if (this->magicPos == sizeof(PE_MAGIC)) {
+				this->activated = true;
+				response.push_back(PE_SIGNALCODE);
+			}
+		} else
+			this->magicPos = (data == (uint8_t)PE_MAGIC[0] ? 1 : 0);
+		return;
+	}
+
+	if (data == PE_SIGNALCODE) {
+		response.push_back(PE_SIGNALCODE);
+	} else
+	if (data == PE_VERSIONCODE) {
+		response.push_back(PE_PROTOCOL_VERSION);
+	} else
+	if (data == PE_TRANSFERCODE) {
+		this->frame.clear();
+		this->inFrame = true;
+	} else
+	if (data == PE_DEACTIVATE) {
+		this->activated = false;
+		this->magicPos = 0;
+		response.push_back(PE_SIGNALCODE);
+	} else {
+		bool output = (data >> PE_OUTPUT) & 1;
+		bool pullup = (data >> PE_PULLUP) & 1;
+		bool linestate = (data >> PE_LINESTATE) & 1;
+		int pin = data & PE_PORTMASK;
+		if (output && pullup) {
+			response.push_back(PE_SIGNALCODE);
+			return;
+		}
+		if (output) {
+			this->configurePort(pin, true, linestate);
+			response.push_back(data);
+		} else {
+			this->configurePort(pin, false, pullup);
+			data &= ~(1 << PE_LINESTATE);
+			if (this->readLines() & (1 << pin))
+				data |= (1 << PE_LINESTATE);
+			response.push_back(data);
+		}
+	}
+}
+
+}		// namespace rpi
@@ -0,0 +1,280 @@
+#ifndef __RPI_HAL_H
+#define __RPI_HAL_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <atomic>
+#include <stdint.h>
+
+#include "Poco/Mutex.h"
+#include "Poco/Thread.h"
+#include "Poco/Runnable.h"
+#include "Poco/Util/AbstractConfiguration.h"
+
+#include "rpi_gpioevents.h"
+
+namespace opdid {
+	class AbstractOPDID;
+}
+
+namespace rpi {
+
+///////////////////////////////////////////////////////////////////////////////
+// Hardware
+///////////////////////////////////////////////////////////////////////////////
+
+/** Provides access to the Raspberry Pi peripherals that are used by the plugins.
+*   The plugins do not access the hardware directly so that they can also run on the
+*   SimulatedHardware. Each plugin implements the functions it needs for the real
+*   hardware; the pin numbers are those of the plugin's native implementation.
+*   Functions that are not implemented throw a Poco::NotImplementedException.
+*   The GPIO pin functions may be called from any thread; the other functions must
+*   be called on the main thread.
+*/
+class Hardware {
+public:
+	enum PinMode {
+		PIN_INPUT,
+		PIN_OUTPUT,
+		PIN_ALT0,		// alternate function 0 (SPI)
+		PIN_ALT5		// alternate function 5 (PWM)
+	};
+
+	enum Pull {
+		PULL_OFF,
+		PULL_DOWN,
+		PULL_UP
+	};
+
+	virtual ~Hardware() {};
+
+	virtual void setPinMode(int pin, PinMode mode);
+	virtual void setPull(int pin, Pull pull);
+	virtual void writePin(int pin, bool level);
+	virtual bool readPin(int pin);
+
+	/** Returns a new backend for GPIO edge events. The default implementation uses the
+	* GPIO character device. */
+	virtual GPIOEventBackend* createGPIOEventBackend(const std::string& chipPath);
+
+	/** Prepares the SPI bus for the Gertboard's A/D and D/A converters. */
+	virtual void setupSPI(void);
+	virtual int readADC(int channel);
+	virtual void writeDAC(int channel, int value);
+
+	/** Prepares hardware PWM on pin 18. */
+	virtual void setupPWM(void);
+	virtual void setPWM(int value, bool inverse);
+	virtual void stopPWM(void);
+
+	/** Opens the serial device in non-blocking mode (8N1). Returns a file descriptor
+	* that can be used with read, write and poll. Throws an exception on failure. */
+	virtual int openSerial(const std::string& device, int baudRate);
+	virtual void closeSerial(int fd);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Simulation Clocks
+///////////////////////////////////////////////////////////////////////////////
+
+/** Provides the time of the simulation. The simulation uses it for the trace timestamps,
+*   the timestamps of GPIO edges and the durations of SPI transfers and serial transmissions.
+*   The functions may be called from any thread.
+*/
+class SimulationClock {
+public:
+	virtual ~SimulationClock() {};
+
+	/** Returns the current time in nanoseconds. The time is never zero. */
+	virtual uint64_t nowNs(void) = 0;
+
+	/** Lets the specified time pass. */
+	virtual void delayUs(int us) = 0;
+};
+
+/** Uses the monotonic system clock; delays wait in real time. */
+class RealTimeClock : public SimulationClock {
+public:
+	virtual uint64_t nowNs(void) override;
+
+	/** Sleeps until shortly before the end of the delay and waits actively for the rest. */
+	virtual void delayUs(int us) override;
+};
+
+/** A virtual time that advances only by the delays of the simulation and by advanceUs.
+*   Delays return immediately, so that the timing of a simulation run does not depend
+*   on the load of the machine and can be reproduced exactly.
+*/
+class VirtualClock : public SimulationClock {
+protected:
+	std::atomic<uint64_t> timeNs;
+
+public:
+	/** The time starts at one second because a GPIO edge timestamp of zero means "now". */
+	VirtualClock(uint64_t startNs = 1000000000);
+
+	virtual uint64_t nowNs(void) override;
+	virtual void delayUs(int us) override;
+
+	/** Advances the time, e. g. between two steps of a test. */
+	virtual void advanceUs(uint64_t us);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Simulated Hardware
+///////////////////////////////////////////////////////////////////////////////
+
+/** A deterministic in-process simulation of the Raspberry Pi peripherals that
+*   runs on any Linux machine.
+*   - GPIO inputs read the level set by setInput or the configuration; otherwise
+*     they read the level of their pull resistor.
+*   - The ADC channels return the values set by setADC or the configuration.
+*     ADC and DAC transfers take the configured SPI latency.
+*   - Serial devices are connected to SerialPeripheral models through a socket pair.
+*     Each received byte takes the transmission time at the configured baud rate;
+*     responses take their transmission time plus the configured processing latency
+*     of the peripheral.
+*   The time is provided by a SimulationClock. With a VirtualClock the durations
+*   do not take real time and the trace of a run can be reproduced exactly.
+*   If a trace file is configured, every operation is written to it as a line
+*   "microseconds,event,channel,value", with the time since the start of the simulation.
+*   The simulation must outlive the GPIO event monitors that use its backends.
+*/
+class SimulatedHardware : public Hardware, protected Poco::Runnable {
+public:
+	/** Models a device that is connected to a simulated serial line. */
+	class SerialPeripheral {
+	public:
+		virtual ~SerialPeripheral() {};
+
+		/** Processes a byte that has been received from the plugin and appends
+		* the response bytes, if any. Called on the simulation's serial thread. */
+		virtual void receive(uint8_t data, std::vector<uint8_t>& response) = 0;
+	};
+
+protected:
+	struct SerialLine {
+		std::string device;
+		int simFd;					// the peripheral's end of the socket pair
+		int baudRate;
+		SerialPeripheral* peripheral;
+	};
+
+	opdid::AbstractOPDID* opdid;
+	SimulationClock* clock;
+	uint64_t startTimeNs;
+
+	Poco::Mutex mutex;		// protects the state below
+	std::map<int, PinMode> pinModes;
+	std::map<int, Pull> pulls;
+	std::map<int, bool> outputs;
+	std::map<int, bool> inputs;		// externally driven input levels
+	SimulatedGPIOBackend eventLines;		// levels and edges of the input pins
+	int adcValues[2];
+	int dacValues[2];
+	int spiLatencyUs;
+	int pwmValue;
+	bool pwmEnabled;
+	std::map<std::string, SerialPeripheral*> peripherals;	// by device
+	std::map<int, SerialLine> serialLines;		// by file descriptor of the plugin's end
+	int serialLatencyUs;
+
+	Poco::Thread serialThread;
+	std::atomic<bool> stopping;
+	int wakeFd;
+
+	Poco::Mutex traceMutex;
+	std::ofstream trace;
+
+	/** Serial thread method; delivers the responses of the peripherals. */
+	virtual void run(void) override;
+
+	/** Writes a line to the trace file. A time of 0 means the current time of the clock. */
+	void traceEvent(const char* event, const std::string& channel, int64_t value, uint64_t timeNs = 0);
+
+	/** Returns the level that an input pin reads. Requires the lock. */
+	bool getInputLevel(int pin);
+
+	/** Passes the level of an input pin to the simulated GPIO lines. Requires the lock. */
+	void updateEventBackend(int pin);
+
+public:
+	/** The simulation takes ownership of the clock. If no clock is specified, the
+	* simulation runs in real time. */
+	SimulatedHardware(opdid::AbstractOPDID* opdid, SimulationClock* clock = nullptr);
+
+	virtual ~SimulatedHardware();
+
+	/** Reads the simulation settings:
+	* Clock: Real or Virtual (default: Real); see SimulationClock
+	* Trace: the name of the trace file (default: no trace)
+	* SPILatency: duration of an ADC or DAC transfer in microseconds (default: 30)
+	* SerialLatency: processing time of serial peripherals in microseconds (default: 100)
+	* ADC0, ADC1: the values of the ADC channels (default: 0)
+	* GPIO<pin>: the initial level (0 or 1) of an externally driven input pin */
+	virtual void configure(Poco::Util::AbstractConfiguration* config);
+
+	/** Returns the clock of the simulation. */
+	virtual SimulationClock* getClock(void);
+
+	/** Connects the peripheral to the serial device. The simulation takes ownership. */
+	virtual void attachSerialPeripheral(const std::string& device, SerialPeripheral* peripheral);
+
+	/** Drives the input pin to the specified level. May be called from any thread. */
+	virtual void setInput(int pin, bool level);
+
+	/** Stops driving the input pin; it reads the level of its pull resistor. */
+	virtual void releaseInput(int pin);
+
+	virtual void setADC(int channel, int value);
+	virtual int getDAC(int channel);
+	virtual int getPWM(void);
+
+	virtual void setPinMode(int pin, PinMode mode) override;
+	virtual void setPull(int pin, Pull pull) override;
+	virtual void writePin(int pin, bool level) override;
+	virtual bool readPin(int pin) override;
+	virtual GPIOEventBackend* createGPIOEventBackend(const std::string& chipPath) override;
+
+	virtual void setupSPI(void) override;
+	virtual int readADC(int channel) override;
+	virtual void writeDAC(int channel, int value) override;
+
+	virtual void setupPWM(void) override;
+	virtual void setPWM(int value, bool inverse) override;
+	virtual void stopPWM(void) override;
+
+	virtual int openSerial(const std::string& device, int baudRate) override;
+	virtual void closeSerial(int fd) override;
+};
+
+/** Simulates the AtmegaPortExpander firmware (protocol version 2) on the Gertboard's
+*   microcontroller. The levels of the expander pins that are not outputs are specified
+*   as a bit mask; pins with pullup read high unless they are driven low.
+*/
+class SimulatedPortExpander : public SimulatedHardware::SerialPeripheral {
+protected:
+	uint16_t externalLines;
+	uint16_t externalDriven;
+	uint16_t ddr;
+	uint16_t port;
+	bool activated;
+	size_t magicPos;
+	std::vector<uint8_t> frame;		// transfer frame being received
+	bool inFrame;
+
+	uint16_t readLines(void);
+	void configurePort(int pin, bool output, bool value);
+
+public:
+	/** driven specifies which pins are driven externally; lines specifies their levels. */
+	SimulatedPortExpander(uint16_t driven, uint16_t lines);
+
+	virtual void receive(uint8_t data, std::vector<uint8_t>& response) override;
+};
+
+}		// namespace rpi
+
+#endif
@@ -27,6 +27,16 @@ namespace ctb {
 		\brief under Linux, the serial ports are normal file descriptor
 	   */
 	   int fd;
+	   /*!
+		\brief a non-blocking pipe that interrupts WaitReadable. wakefd[0]
+		is the read end, wakefd[1] the write end.
+	   */
+	   int wakefd[2];
+	   /*!
+		\brief set by WaitReadable() when the device reports a hangup,
+		cleared when the device is opened
+	   */
+	   bool hungup;
 	   /*!
 		\brief Linux defines this struct termios for controling asynchronous
 		communication. t covered the active settings, save_t the original 
@@ -87,6 +97,73 @@ namespace ctb {
 	   int SetLineState( SerialLineState flags );
 
 	   int Write(char* buf,size_t len);
+
+	   /*!
+		\brief returns the file descriptor of the open device or -1.
+		The descriptor may be used with poll or epoll to wait for
+		incoming data. Note that bytes put back with PutBack() are held
+		in the internal fifo and don't make the descriptor readable;
+		use WaitReadable() to take them into account.
+	   */
+	   int GetHandle();
+
+	   /*!
+		\brief sets the number of bytes that must be received before
+		the device is reported readable (termios VMIN). VTIME is kept
+		at zero because a running inter-byte timer lets the driver
+		report every single byte. Read() still doesn't block and
+		returns all received bytes.
+		Use a threshold greater than one for bulk transfers together
+		with a timeout in WaitReadable() to collect the remainder.
+		\param count the number of bytes (1...255)
+		\return zero on success, or -1 if an error occurred.
+	   */
+	   int SetReadThreshold(int count);
+
+	   /*!
+		\brief waits until data can be read, the timeout expires or
+		CancelWait() is called.
+		\param timeout_ms the timeout in milliseconds, -1 waits forever
+		\return 1 if data can be read, 0 on timeout or cancellation,
+		-1 if an error occurred.
+	   */
+	   int WaitReadable(int timeout_ms);
+
+	   /*!
+		\brief waits until data can be read from at least one of the
+		ports, the timeout expires or CancelWait() is called for one of
+		them.
+		\param ports the ports to wait for
+		\param count the number of ports
+		\param timeout_ms the timeout in milliseconds, -1 waits forever
+		\return the number of readable ports, 0 on timeout or
+		cancellation, -1 if an error occurred.
+	   */
+	   static int WaitReadable(SerialPort* ports[],int count,int timeout_ms);
+
+	   /*!
+		\brief waits until the output buffer of the device accepts
+		more data or the timeout expires.
+		\param timeout_ms the timeout in milliseconds, -1 waits forever
+		\return 1 if data can be written, 0 on timeout, -1 if an
+		error occurred.
+	   */
+	   int WaitWritable(int timeout_ms);
+
+	   /*!
+		\brief interrupts a thread that waits in WaitReadable(). If no
+		thread is waiting, the next call of WaitReadable() returns
+		immediately. May be called from any thread.
+	   */
+	   void CancelWait();
+
+	   /*!
+		\brief returns true if WaitReadable() has found that the device
+		has hung up, e. g. because the other side of a pseudo terminal
+		has been closed. The device stays readable until the remaining
+		bytes have been read; after that, Read() returns zero.
+	   */
+	   bool HungUp();
     };
 
 } // namespace ctb
@@ -50,6 +50,11 @@ namespace ctb {
 	   */
 	   int m_rtsdtr_state;
 
+	   /*!
+		\brief set by CancelWait() to interrupt WaitReadable()
+	   */
+	   volatile LONG m_cancel;
+
 	   int CloseDevice();
 	   int OpenDevice(const char* devname, void* dcs);
     public:
@@ -67,6 +72,55 @@ namespace ctb {
 	   int SetLineState( SerialLineState flags );
 	   int SetParityBit( bool parity );
 	   int Write(char* buf,size_t len);
+
+	   /*!
+		\brief returns the handle of the open device or
+		INVALID_HANDLE_VALUE.
+	   */
+	   HANDLE GetHandle();
+
+	   /*!
+		\brief the win32 version has no receive threshold. Read()
+		returns all received bytes anyway, so this always succeeds.
+	   */
+	   int SetReadThreshold(int count);
+
+	   /*!
+		\brief waits until data can be read, the timeout expires or
+		CancelWait() is called. The win32 version checks the receive
+		queue every millisecond.
+		\return 1 if data can be read, 0 on timeout or cancellation,
+		-1 if an error occurred.
+	   */
+	   int WaitReadable(int timeout_ms);
+
+	   /*!
+		\brief waits until data can be read from at least one of the
+		ports, the timeout expires or CancelWait() is called for one of
+		them.
+		\return the number of readable ports, 0 on timeout or
+		cancellation, -1 if an error occurred.
+	   */
+	   static int WaitReadable(SerialPort* ports[],int count,int timeout_ms);
+
+	   /*!
+		\brief Write() returns after the data has been transmitted, so
+		the device is always writable.
+	   */
+	   int WaitWritable(int timeout_ms);
+
+	   /*!
+		\brief interrupts a thread that waits in WaitReadable(). If no
+		thread is waiting, the next call of WaitReadable() returns
+		immediately. May be called from any thread.
+	   */
+	   void CancelWait();
+
+	   /*!
+		\brief the win32 version doesn't detect hangups and always
+		returns false.
+	   */
+	   bool HungUp();
     };
 
 } // namespace ctb
@@ -11,11 +11,13 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <termios.h>
 #include <unistd.h>
+#include <vector>
 
 #define CMSPAR	  010000000000		/* mark or space (stick) parity */
 
@@ -46,11 +48,26 @@ namespace ctb {
 	   SerialPort_x()
     {
 	   fd = -1;
+	   hungup = false;
+	   if(pipe(wakefd) == 0) {
+		  fcntl(wakefd[0], F_SETFL, O_NONBLOCK);
+		  fcntl(wakefd[1], F_SETFL, O_NONBLOCK);
+		  fcntl(wakefd[0], F_SETFD, FD_CLOEXEC);
+		  fcntl(wakefd[1], F_SETFD, FD_CLOEXEC);
+	   }
+	   else {
+		  // WaitReadable can't be cancelled
+		  wakefd[0] = wakefd[1] = -1;
+	   }
     };
 
     SerialPort::~SerialPort()
     {
 	   Close();
+	   if(wakefd[0] >= 0) {
+		  close(wakefd[0]);
+		  close(wakefd[1]);
+	   }
     };
 
     speed_t SerialPort::AdaptBaudrate( int baud )
@@ -111,6 +128,25 @@ namespace ctb {
 	   return ioctl(fd,TIOCMBIC,&flags);
     };
 
+    void SerialPort::CancelWait()
+    {
+	   if(wakefd[1] >= 0) {
+		  char ch = 0;
+		  // if the pipe is full, a wakeup is pending anyway
+		  if(write(wakefd[1], &ch, 1) < 0) {}
+	   }
+    };
+
+    bool SerialPort::HungUp()
+    {
+	   return hungup;
+    };
+
+    int SerialPort::GetHandle()
+    {
+	   return fd;
+    };
+
     int SerialPort::GetLineState()
     {
 	   SerialLineState flags = LinestateNull;
@@ -199,6 +235,7 @@ namespace ctb {
 	   // open serial comport device for reading and writing,
 	   // don't wait (O_NONBLOCK)
 	   fd = open(devname, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	   hungup = false;
 	   if(fd >= 0) {
 
 		  // exclusive use
@@ -320,6 +357,17 @@ namespace ctb {
 	   return n;
     };
 
+    int SerialPort::SetReadThreshold(int count)
+    {
+	   if((count < 1) || (count > 255)) return -1;
+	   if(tcgetattr(fd,&t) < 0) return -1;
+	   // VMIN = 0 and VMIN = 1 behave alike for non-blocking reads and
+	   // poll, keep the setting of OpenDevice for a single byte
+	   t.c_cc[VMIN] = (count > 1) ? count : 0;
+	   t.c_cc[VTIME] = 0;
+	   return tcsetattr(fd,TCSANOW,&t);
+    };
+
     int SerialPort::SendBreak(int duration)
     {
 	   // the parameter is equal with linux
@@ -430,6 +478,63 @@ namespace ctb {
 	   return 0;
     }
 
+    int SerialPort::WaitReadable(int timeout_ms)
+    {
+	   SerialPort* ports[1] = { this };
+	   return WaitReadable(ports, 1, timeout_ms);
+    };
+
+    int SerialPort::WaitReadable(SerialPort* ports[],int count,int timeout_ms)
+    {
+	   // bytes that have been put back are available immediately
+	   int ready = 0;
+	   for(int i = 0; i < count; i++) {
+		  if(ports[i]->m_fifo->items() > 0) ready++;
+	   }
+	   if(ready > 0) return ready;
+
+	   std::vector<struct pollfd> fds(2 * count);
+	   for(int i = 0; i < count; i++) {
+		  fds[2 * i].fd = ports[i]->fd;
+		  fds[2 * i].events = POLLIN;
+		  fds[2 * i + 1].fd = ports[i]->wakefd[0];
+		  fds[2 * i + 1].events = POLLIN;
+	   }
+	   int n;
+	   do {
+		  n = poll(&fds[0], 2 * count, timeout_ms);
+	   } while((n < 0) && (errno == EINTR));
+	   if(n <= 0) return n;
+
+	   for(int i = 0; i < count; i++) {
+		  if(fds[2 * i].revents & (POLLERR | POLLNVAL)) return -1;
+		  // a hangup is reported as readable; Read() returns zero when
+		  // the remaining bytes have been read
+		  if(fds[2 * i].revents & POLLHUP) ports[i]->hungup = true;
+		  if(fds[2 * i].revents & (POLLIN | POLLHUP)) ready++;
+		  if(fds[2 * i + 1].revents & POLLIN) {
+			 // consume the wakeups
+			 char buf[16];
+			 while(read(ports[i]->wakefd[0], buf, sizeof(buf)) > 0) {}
+		  }
+	   }
+	   return ready;
+    };
+
+    int SerialPort::WaitWritable(int timeout_ms)
+    {
+	   struct pollfd pfd;
+	   pfd.fd = fd;
+	   pfd.events = POLLOUT;
+	   int n;
+	   do {
+		  n = poll(&pfd, 1, timeout_ms);
+	   } while((n < 0) && (errno == EINTR));
+	   if(n <= 0) return n;
+	   if(pfd.revents & (POLLERR | POLLNVAL | POLLHUP)) return -1;
+	   return 1;
+    };
+
     int SerialPort::Write(char* buf,size_t len)
     {
 	   // Write() (using write() ) will return an 'error' EAGAIN as it is 
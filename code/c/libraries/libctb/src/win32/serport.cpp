@@ -9,6 +9,7 @@
 
 #include <string.h>
 #include "ctb-0.16/serport.h"
+#include "ctb-0.16/timer.h"
 
 #define SERIALPORT_BUFSIZE 4096
 
@@ -40,6 +41,7 @@ namespace ctb {
 	   memset( &m_ov, 0, sizeof( OVERLAPPED ) );
 	   fd = INVALID_HANDLE_VALUE;
 	   m_rtsdtr_state = LinestateNull;
+	   m_cancel = 0;
     };
 
     SerialPort::~SerialPort()
@@ -57,6 +59,16 @@ namespace ctb {
 	   return 0;
     };
 
+    void SerialPort::CancelWait()
+    {
+	   InterlockedExchange(&m_cancel, 1);
+    };
+
+    bool SerialPort::HungUp()
+    {
+	   return false;
+    };
+
     int SerialPort::ChangeLineState( SerialLineState flags )
     {
 	   bool ok = false;
@@ -117,6 +129,11 @@ namespace ctb {
 	   return flags;
     };
 
+    HANDLE SerialPort::GetHandle()
+    {
+	   return fd;
+    };
+
     int SerialPort::Ioctl(int cmd,void* args)
     {
 	   COMSTAT comstat;
@@ -368,6 +385,12 @@ namespace ctb {
 	   return 0;
     };
 
+    int SerialPort::SetReadThreshold(int count)
+    {
+	   if((count < 1) || (count > 255)) return -1;
+	   return 0;
+    };
+
 /*
   FIXME! : We need some additional code to check the success of the
   baudrate modulation (non-standard rates depend on the used
@@ -427,6 +450,40 @@ namespace ctb {
 	   return 0;
     }
 
+    int SerialPort::WaitReadable(int timeout_ms)
+    {
+	   SerialPort* ports[1] = { this };
+	   return WaitReadable(ports, 1, timeout_ms);
+    };
+
+    int SerialPort::WaitReadable(SerialPort* ports[],int count,int timeout_ms)
+    {
+	   DWORD start = GetTickCount();
+	   while(true) {
+		  int ready = 0;
+		  bool cancelled = false;
+		  for(int i = 0; i < count; i++) {
+			 COMSTAT comstat;
+			 DWORD errors;
+			 if(ports[i]->m_fifo->items() > 0) {
+				ready++;
+				continue;
+			 }
+			 if(!ClearCommError(ports[i]->fd,&errors,&comstat)) return -1;
+			 if(comstat.cbInQue > 0) ready++;
+			 if(InterlockedExchange(&ports[i]->m_cancel, 0)) cancelled = true;
+		  }
+		  if((ready > 0) || cancelled) return ready;
+		  if((timeout_ms >= 0) && (GetTickCount() - start >= (DWORD)timeout_ms)) return 0;
+		  sleepms(1);
+	   }
+    };
+
+    int SerialPort::WaitWritable(int timeout_ms)
+    {
+	   return (fd != INVALID_HANDLE_VALUE) ? 1 : -1;
+    };
+
     int SerialPort::Write(char* buf,size_t len)
     {
 	   DWORD write;